@@ -427,6 +427,9 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include <math.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
 
 #ifdef __WXMSW__
 #include <malloc.h>
@@ -458,6 +461,7 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include "Mix.h"
 #include "Resample.h"
 #include "RingBuffer.h"
+#include "ThreadPool.h"
 #include "prefs/GUISettings.h"
 #include "Prefs.h"
 #include "Project.h"
@@ -1060,6 +1064,16 @@ AudioIO::AudioIO()
 
 #endif
 
+   // Helpers of the audio thread; more than a few would only contend
+   // for the disk, and leave fewer processors to the rest of the program
+   {
+      auto nFillThreads = AudioIOFillThreads.Read();
+      if (nFillThreads < 0)
+         nFillThreads = std::min(3u,
+            std::max(2u, std::thread::hardware_concurrency()) - 2);
+      mFillPool = std::make_unique<ThreadPool>(size_t(nFillThreads));
+   }
+
    // Start thread
    mThread = std::make_unique<AudioThread>();
    mThread->Create();
@@ -1457,6 +1471,10 @@ int AudioIO::StartStream(const TransportTracks &tracks,
 {
    mLostSamples = 0;
    mLostCaptureIntervals.clear();
+   {
+      std::lock_guard<std::mutex> guard(mFillStatsMutex);
+      mFillStats = {};
+   }
    mDetectDropouts =
       gPrefs->Read( WarningDialogKey(wxT("DropoutDetected")), true ) != 0;
    auto cleanup = finally ( [this] { ClearRecordingException(); } );
@@ -1537,7 +1555,7 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    });
    mPlaybackBuffers.reset();
    mPlaybackMixers.reset();
-   mCaptureBuffers.reset();
+   mCaptureBuffer.reset();
    mResample.reset();
    mTimeQueue.mData.reset();
 
@@ -1889,14 +1907,16 @@ bool AudioIO::AllocateBuffers(
                return false;
             }
 
-            mCaptureBuffers.reinit(mCaptureTracks.size());
+            // One buffer of frames as PortAudio delivers them, so the
+            // callback needn't deinterleave
+            wxASSERT(mNumCaptureChannels == mCaptureTracks.size());
+            mCaptureBuffer = std::make_unique<RingBuffer>(
+               mCaptureFormat, captureBufferSize, mCaptureTracks.size() );
             mResample.reinit(mCaptureTracks.size());
             mFactor = sampleRate / mRate;
 
             for( unsigned int i = 0; i < mCaptureTracks.size(); i++ )
             {
-               mCaptureBuffers[i] = std::make_unique<RingBuffer>(
-                  mCaptureTracks[i]->GetSampleFormat(), captureBufferSize );
                mResample[i] =
                   std::make_unique<Resample>(true, mFactor, mFactor);
                   // constant rate resampling
@@ -1939,7 +1959,7 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
 
    mPlaybackBuffers.reset();
    mPlaybackMixers.reset();
-   mCaptureBuffers.reset();
+   mCaptureBuffer.reset();
    mResample.reset();
    mTimeQueue.mData.reset();
 
@@ -2253,6 +2273,13 @@ void AudioIO::StopStream()
          mPlaybackBuffers.reset();
          mPlaybackMixers.reset();
          mTimeQueue.mData.reset();
+
+         const auto stats = GetFillStats();
+         if (stats.cycles > 0)
+            wxLogDebug(wxT("Playback of %d tracks filled %.1f s of audio in %.1f s, %d fills, longest %.1f ms, least headroom %.1f"),
+               (int)mPlaybackTracks.size(),
+               stats.audioSeconds, stats.fillSeconds, (int)stats.cycles,
+               stats.maxFillSeconds * 1000.0, stats.minHeadroom);
       }
 
       //
@@ -2260,7 +2287,7 @@ void AudioIO::StopStream()
       //
       if (mCaptureTracks.size() > 0)
       {
-         mCaptureBuffers.reset();
+         mCaptureBuffer.reset();
          mResample.reset();
 
          //
@@ -2573,6 +2600,28 @@ MidiThread::ExitCode MidiThread::Entry()
 }
 #endif
 
+void AudioIO::RecordFill(double fillSeconds, double audioSeconds)
+{
+   const auto headroom = fillSeconds > 0
+      ? audioSeconds / fillSeconds
+      : std::numeric_limits<double>::infinity();
+   std::lock_guard<std::mutex> guard(mFillStatsMutex);
+   auto &stats = mFillStats;
+   stats.minHeadroom = (stats.cycles == 0)
+      ? headroom
+      : std::min(stats.minHeadroom, headroom);
+   ++stats.cycles;
+   stats.fillSeconds += fillSeconds;
+   stats.audioSeconds += audioSeconds;
+   stats.maxFillSeconds = std::max(stats.maxFillSeconds, fillSeconds);
+}
+
+auto AudioIO::GetFillStats() const -> FillStats
+{
+   std::lock_guard<std::mutex> guard(mFillStatsMutex);
+   return mFillStats;
+}
+
 size_t AudioIO::GetCommonlyFreePlayback()
 {
    auto commonlyAvail = mPlaybackBuffers[0]->AvailForPut();
@@ -2598,11 +2647,7 @@ size_t AudioIoCallback::GetCommonlyReadyPlayback()
 
 size_t AudioIO::GetCommonlyAvailCapture()
 {
-   auto commonlyAvail = mCaptureBuffers[0]->AvailForGet();
-   for (unsigned i = 1; i < mCaptureTracks.size(); ++i)
-      commonlyAvail = std::min(commonlyAvail,
-         mCaptureBuffers[i]->AvailForGet());
-   return commonlyAvail;
+   return mCaptureBuffer->AvailForGet();
 }
 
 // This method is the data gateway between the audio thread (which
@@ -2721,26 +2766,33 @@ void AudioIO::FillBuffers()
                (mPlaybackSchedule.Interactive() ? mScrubSpeed : 1.0),
                frames);
 
-            for (i = 0; i < mPlaybackTracks.size(); i++)
+            // Each track has its own mixer and ring buffer, so the tracks
+            // can be done concurrently; ParallelFor returns only when all
+            // are done, so the time queue and the samples still agree
+            if (frames > 0)
             {
-               // The mixer here isn't actually mixing: it's just doing
-               // resampling, format conversion, and possibly time track
-               // warping
-               samplePtr warpedSamples;
-
-               if (frames > 0)
+               const auto fillStart = std::chrono::steady_clock::now();
+               mFillPool->ParallelFor(mPlaybackTracks.size(), [&](size_t ii)
                {
+                  // The mixer here isn't actually mixing: it's just doing
+                  // resampling, format conversion, and possibly time track
+                  // warping
+                  samplePtr warpedSamples;
+
                   size_t processed = 0;
                   if ( toProcess )
-                     processed = mPlaybackMixers[i]->Process( toProcess );
+                     processed = mPlaybackMixers[ii]->Process( toProcess );
                   //wxASSERT(processed <= toProcess);
-                  warpedSamples = mPlaybackMixers[i]->GetBuffer();
-                  const auto put = mPlaybackBuffers[i]->Put(
+                  warpedSamples = mPlaybackMixers[ii]->GetBuffer();
+                  const auto put = mPlaybackBuffers[ii]->Put(
                      warpedSamples, floatSample, processed, frames - processed);
                   // wxASSERT(put == frames);
                   // but we can't assert in this thread
                   wxUnusedVar(put);
-               }               
+               });
+               const std::chrono::duration<double> fillTime =
+                  std::chrono::steady_clock::now() - fillStart;
+               RecordFill(fillTime.count(), frames / mRate);
             }
 
             available -= frames;
@@ -2850,13 +2902,13 @@ void AudioIO::FillBuffers()
             // Append captured samples to the end of the WaveTracks.
             // The WaveTracks have their own buffering for efficiency.
             auto numChannels = mCaptureTracks.size();
+            // Discarding from the interleaved buffer is for all channels
+            size_t discarded = 0;
 
             for( i = 0; i < numChannels; i++ )
             {
                sampleFormat trackFormat = mCaptureTracks[i]->GetSampleFormat();
 
-               size_t discarded = 0;
-
                if (!mRecordingSchedule.mLatencyCorrected) {
                   const auto correction = mRecordingSchedule.TotalCorrection();
                   if (correction >= 0) {
@@ -2868,7 +2920,7 @@ void AudioIO::FillBuffers()
                      ClearSamples(temp.ptr(), trackFormat, 0, size);
                      mCaptureTracks[i]->Append(temp.ptr(), trackFormat, size, 1);
                   }
-                  else {
+                  else if (i == 0) {
                      // Leftward shift
                      // discard some samples from the ring buffers.
                      size_t size = floor(
@@ -2876,7 +2928,7 @@ void AudioIO::FillBuffers()
 
                      // The ring buffer might have grown concurrently -- don't discard more
                      // than the "avail" value noted above.
-                     discarded = mCaptureBuffers[i]->Discard(std::min(avail, size));
+                     discarded = mCaptureBuffer->Discard(std::min(avail, size));
 
                      if (discarded < size)
                         // We need to visit this again to complete the
@@ -2917,7 +2969,7 @@ void AudioIO::FillBuffers()
                      format = trackFormat;
                   temp.Allocate(size, format);
                   const auto got =
-                     mCaptureBuffers[i]->Get(temp.ptr(), format, toGet);
+                     mCaptureBuffer->GetChannel(i, temp.ptr(), format, toGet);
                   // wxASSERT(got == toGet);
                   // but we can't assert in this thread
                   wxUnusedVar(got);
@@ -2931,7 +2983,7 @@ void AudioIO::FillBuffers()
                   SampleBuffer temp1(toGet, floatSample);
                   temp.Allocate(size, format);
                   const auto got =
-                     mCaptureBuffers[i]->Get(temp1.ptr(), floatSample, toGet);
+                     mCaptureBuffer->GetChannel(i, temp1.ptr(), floatSample, toGet);
                   // wxASSERT(got == toGet);
                   // but we can't assert in this thread
                   wxUnusedVar(got);
@@ -2972,6 +3024,9 @@ void AudioIO::FillBuffers()
                   || newBlocks;
             } // end loop over capture channels
 
+            // All channels are copied out now
+            mCaptureBuffer->ReleaseRead(avail - discarded);
+
             // Now update the recording schedule position
             mRecordingSchedule.mPosition += avail / mRate;
             mRecordingSchedule.mLatencyCorrected = latencyCorrected;
@@ -3756,6 +3811,11 @@ bool AudioIoCallback::FillOutputBuffers(
    // These are small structures.
    WaveTrack **chans = (WaveTrack **) alloca(numPlaybackChannels * sizeof(WaveTrack *));
    float **tempBufs = (float **) alloca(numPlaybackChannels * sizeof(float *));
+   // Where each channel's samples are, either in tempBufs or in its ring
+   // buffer, which track they came from, and how many to give back
+   float **chanBufs = (float **) alloca(numPlaybackChannels * sizeof(float *));
+   unsigned *chanTracks = (unsigned *) alloca(numPlaybackChannels * sizeof(unsigned));
+   size_t *chanLens = (size_t *) alloca(numPlaybackChannels * sizeof(size_t));
    // And these are larger structures....
    for (unsigned int c = 0; c < numPlaybackChannels; c++)
       tempBufs[c] = (float *) alloca(framesPerBuffer * sizeof(float));
@@ -3817,19 +3877,34 @@ bool AudioIoCallback::FillOutputBuffers(
       }
       else
       {
-         len = mPlaybackBuffers[t]->Get((samplePtr)tempBufs[chanCnt],
-                                                   floatSample,
-                                                   toGet);
+         // Use the samples where they lie in the ring buffer, unless they
+         // wrap around its end or fall short; then copy them out.  The ring
+         // buffer won't reuse the space until ReleaseRead(), so realtime
+         // effects may even process them in place.
+         const auto regions = mPlaybackBuffers[t]->GetReadRegions(toGet);
+         len = regions[0].frames + regions[1].frames;
          // wxASSERT( len == toGet );
-         if (len < framesPerBuffer)
-            // This used to happen normally at the end of non-looping
-            // plays, but it can also be an anomalous case where the
-            // supply from FillBuffers fails to keep up with the
-            // real-time demand in this thread (see bug 1932).  We
-            // must supply something to the sound card, so pad it with
-            // zeroes and not random garbage.
-            memset((void*)&tempBufs[chanCnt][len], 0,
-               (framesPerBuffer - len) * sizeof(float));
+         if (len == toGet && regions[1].frames == 0)
+            chanBufs[chanCnt] = (float *)regions[0].data;
+         else {
+            chanBufs[chanCnt] = tempBufs[chanCnt];
+            auto dest = tempBufs[chanCnt];
+            for (const auto &region : regions) {
+               memcpy(dest, region.data, region.frames * sizeof(float));
+               dest += region.frames;
+            }
+            if (len < framesPerBuffer)
+               // This used to happen normally at the end of non-looping
+               // plays, but it can also be an anomalous case where the
+               // supply from FillBuffers fails to keep up with the
+               // real-time demand in this thread (see bug 1932).  We
+               // must supply something to the sound card, so pad it with
+               // zeroes and not random garbage.
+               memset((void*)&tempBufs[chanCnt][len], 0,
+                  (framesPerBuffer - len) * sizeof(float));
+         }
+         chanTracks[chanCnt] = t;
+         chanLens[chanCnt] = len;
          chanCnt++;
       }
       // PRL:  Bug1104:
@@ -3844,9 +3919,15 @@ bool AudioIoCallback::FillOutputBuffers(
       // Last channel of a track seen now
       len = mMaxFramesOutput;
       if( !dropQuickly && selected )
-         len = em.RealtimeProcess(group, chanCnt, tempBufs, len);
+         len = em.RealtimeProcess(group, chanCnt, chanBufs, len);
       group++;
       CallbackCheckCompletion(mCallbackReturn, len);
+      // Give back the ring buffer space of the samples used, after mixing
+      auto releaseChannels = finally( [&] {
+         for (int c = 0; c < chanCnt; c++)
+            mPlaybackBuffers[chanTracks[c]]->ReleaseRead(chanLens[c]);
+         chanCnt = 0;
+      } );
       if (dropQuickly) // no samples to process, they've been discarded
          continue;
       // Our channels aren't silent.  We need to pass their data on.
@@ -3865,13 +3946,12 @@ bool AudioIoCallback::FillOutputBuffers(
          if (vt->GetChannelIgnoringPan() == Track::LeftChannel ||
                vt->GetChannelIgnoringPan() == Track::MonoChannel )
             AddToOutputChannel( 0, outputMeterFloats, outputFloats,
-               tempBufs[c], drop, len, vt);
+               chanBufs[c], drop, len, vt);
          if (vt->GetChannelIgnoringPan() == Track::RightChannel ||
                vt->GetChannelIgnoringPan() == Track::MonoChannel  )
             AddToOutputChannel( 1, outputMeterFloats, outputFloats,
-               tempBufs[c], drop, len, vt);
+               chanBufs[c], drop, len, vt);
       }
-      chanCnt = 0;
    }
    // Poke: If there are no playback tracks, then the earlier check
    // about the time indicator being past the end won't happen;
@@ -3931,16 +4011,14 @@ void AudioIoCallback::FillInputBuffers(
    // But it seems it's easy to get false positives, at least on Mac
    // So we have not decided to enable this extra detection yet in
    // production
-   size_t len = framesPerBuffer;
-   for(unsigned t = 0; t < numCaptureChannels; t++)
-      len = std::min( len, mCaptureBuffers[t]->AvailForPut() );
+   size_t len = std::min<size_t>( framesPerBuffer, mCaptureBuffer->AvailForPut() );
    if (mSimulateRecordingErrors && 100LL * rand() < RAND_MAX)
       // Make spurious errors for purposes of testing the error
       // reporting
       len = 0;
    // A different symptom is that len < framesPerBuffer because
    // the other thread, executing FillBuffers, isn't consuming fast
-   // enough from mCaptureBuffers; maybe it's CPU-bound, or maybe the
+   // enough from mCaptureBuffer; maybe it's CPU-bound, or maybe the
    // storage device it writes is too slow
    if (mDetectDropouts &&
          ((mDetectUpstreamDropouts && inputError) ||
@@ -3965,49 +4043,14 @@ void AudioIoCallback::FillInputBuffers(
       wxPrintf(wxT("lost %d samples\n"), (int)(framesPerBuffer - len));
    }
    if (len <= 0) return;
-   // We have an ASSERT in the AudioIO constructor to alert us to 
-   // possible issues with the (short*) cast.  We'd have a problem if
-   // sizeof(short) > sizeof(float) since our buffers are sized for floats.
-   for(unsigned t = 0; t < numCaptureChannels; t++) {
-      // dmazzoni:
-      // Un-interleave.  Ugly special-case code required because the
-      // capture channels could be in three different sample formats;
-      // it'd be nice to be able to call CopySamples, but it can't
-      // handle multiplying by the gain and then clipping.  Bummer.
-      switch(mCaptureFormat) {
-         case floatSample: {
-            float *inputFloats = (float *)inputBuffer;
-            for(unsigned i = 0; i < len; i++)
-               tempFloats[i] =
-                  inputFloats[numCaptureChannels*i+t];
-         } break;
-         case int24Sample:
-            // We should never get here. Sneedacity's int24Sample format
-            // is different from PortAudio's sample format and so we
-            // make PortAudio return float samples when recording in
-            // 24-bit samples.
-            wxASSERT(false);
-            break;
-         case int16Sample: {
-            short *inputShorts = (short *)inputBuffer;
-            short *tempShorts = (short *)tempFloats;
-            for( unsigned i = 0; i < len; i++) {
-               float tmp = inputShorts[numCaptureChannels*i+t];
-               tmp = wxClip( -32768, tmp, 32767 );
-               tempShorts[i] = (short)(tmp);
-            }
-         } break;
-      } // switch
-      // JKC: mCaptureFormat must be for samples with sizeof(float) or
-      // fewer bytes (because tempFloats is sized for floats).  All 
-      // formats are 2 or 4 bytes, so we are OK.
-      const auto put =
-         mCaptureBuffers[t]->Put(
-            (samplePtr)tempFloats, mCaptureFormat, len);
-      // wxASSERT(put == len);
-      // but we can't assert in this thread
-      wxUnusedVar(put);
-   }
+   // The ring buffer holds frames just as PortAudio delivers them, in
+   // mCaptureFormat, so store them with one copy and leave the
+   // deinterleaving to the audio thread
+   const auto put =
+      mCaptureBuffer->Put((samplePtr)inputBuffer, mCaptureFormat, len);
+   // wxASSERT(put == len);
+   // but we can't assert in this thread
+   wxUnusedVar(put);
 }
 
 #if 0
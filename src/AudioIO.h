@@ -21,6 +21,7 @@
 
 
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <wx/atomic.h> // member variable
 
@@ -49,6 +50,7 @@ class RingBuffer;
 class Mixer;
 class Resample;
 class AudioThread;
+class ThreadPool;
 class SelectedRegion;
 
 class SneedacityProject;
@@ -452,12 +454,16 @@ public:
 #endif
 #endif
    ArrayOf<std::unique_ptr<Resample>> mResample;
-   ArrayOf<std::unique_ptr<RingBuffer>> mCaptureBuffers;
+   //! Interleaved, one channel for each capture track
+   std::unique_ptr<RingBuffer> mCaptureBuffer;
    WaveTrackArray      mCaptureTracks;
    ArrayOf<std::unique_ptr<RingBuffer>> mPlaybackBuffers;
    WaveTrackArray      mPlaybackTracks;
 
    ArrayOf<std::unique_ptr<Mixer>> mPlaybackMixers;
+   //! Workers for the audio thread, which run the mixers of different
+   //! playback tracks at once
+   std::unique_ptr<ThreadPool> mFillPool;
    static int          mNextStreamToken;
    double              mFactor;
    unsigned long       mMaxFramesOutput; // The actual number of frames output.
@@ -545,6 +551,25 @@ public:
    const std::vector< std::pair<double, double> > &LostCaptureIntervals()
    { return mLostCaptureIntervals; }
 
+   //! Timing of the filling of playback buffers by the audio thread
+   /*! Headroom is the duration of the audio produced divided by the time
+    taken to produce it; below one, playback must eventually underrun */
+   struct FillStats {
+      size_t cycles{};          //!< Fills that produced audio
+      double fillSeconds{};     //!< Total time spent filling
+      double audioSeconds{};    //!< Total duration of audio produced
+      double maxFillSeconds{};  //!< Longest single fill
+      double minHeadroom{};     //!< Least headroom of a single fill
+   };
+   //! Since the start of the last stream; may be called during playback
+   FillStats GetFillStats() const;
+
+protected:
+   void RecordFill(double fillSeconds, double audioSeconds);
+   mutable std::mutex mFillStatsMutex;
+   FillStats mFillStats;
+
+public:
    // Used only for testing purposes in alpha builds
    bool mSimulateRecordingErrors{ false };
 
@@ -1057,6 +1057,9 @@ wxString AudioIOBase::GetMidiDeviceInfo()
 }
 #endif
 
+// Workers helping the audio thread; negative chooses from the processor count
+IntSetting AudioIOFillThreads{
+   L"/AudioIO/FillThreads", -1 };
 StringSetting AudioIOHost{
    L"/AudioIO/Host", L"" };
 DoubleSetting AudioIOLatencyCorrection{
@@ -342,6 +342,7 @@ protected:
 
 #include "Prefs.h"
 
+extern SNEEDACITY_DLL_API IntSetting    AudioIOFillThreads;
 extern SNEEDACITY_DLL_API StringSetting AudioIOHost;
 extern SNEEDACITY_DLL_API DoubleSetting AudioIOLatencyCorrection;
 extern SNEEDACITY_DLL_API DoubleSetting AudioIOLatencyDuration;
@@ -18,6 +18,13 @@ of sample block storage.
 
 #include "Benchmark.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+
 #include <wx/app.h>
 #include <wx/log.h>
 #include <wx/textctrl.h>
@@ -33,17 +40,27 @@ of sample block storage.
 #include <wx/valtext.h>
 #include <wx/intl.h>
 
+#include "AudioIOBase.h"
 #include "SampleBlock.h"
 #include "ShuttleGui.h"
 #include "Project.h"
 #include "WaveClip.h"
 #include "WaveTrack.h"
 #include "Sequence.h"
+#include "SummaryKernels.h"
+#include "FFTKernels.h"
+#include "RealFFTf.h"
+#include "effects/EBUR128.h"
+#include "effects/Effect.h"
+#include "effects/PartitionedConvolution.h"
+#include "effects/RealtimeEffectManager.h"
 #include "Prefs.h"
+#include "ProjectSerializer.h"
 #include "ProjectSettings.h"
 #include "ViewInfo.h"
 
 #include "FileNames.h"
+#include "xml/XMLFileReader.h"
 #include "widgets/SneedacityMessageBox.h"
 #include "widgets/wxPanelWrapper.h"
 
@@ -52,6 +69,62 @@ of sample block storage.
 #define SampleType short
 #define SampleFormat int16Sample
 
+// Receives a project document, and sums what it can read as numbers
+struct BenchmarkTagHandler final : XMLTagHandler
+{
+   bool HandleXMLTag(const wxChar *WXUNUSED(tag), const wxChar **attrs) override
+   {
+      ++nTags;
+      while (*attrs) {
+         ++attrs;
+         long long value;
+         if (wxString(*attrs++).ToLongLong(&value))
+            sum += value;
+      }
+      return true;
+   }
+
+   XMLTagHandler *HandleXMLChild(const wxChar *WXUNUSED(tag)) override
+   {
+      return this;
+   }
+
+   long long nTags{ 0 };
+   long long sum{ 0 };
+};
+
+// Adds one to each sample, so that the output counts the effects applied,
+// and counts the buffers it starts and ends
+struct BenchmarkCountingEffect final : Effect
+{
+   unsigned GetAudioInCount() override { return 1; }
+   unsigned GetAudioOutCount() override { return 1; }
+
+   bool RealtimeProcessStart() override
+   {
+      ++nStarted;
+      return true;
+   }
+
+   size_t RealtimeProcess(int WXUNUSED(group),
+      float **inbuf, float **outbuf, size_t numSamples) override
+   {
+      for (size_t i = 0; i < numSamples; i++)
+         outbuf[0][i] = inbuf[0][i] + 1.0f;
+      return numSamples;
+   }
+
+   bool RealtimeProcessEnd() override
+   {
+      ++nEnded;
+      return true;
+   }
+
+   // Only the playing thread changes these
+   long long nStarted{ 0 };
+   long long nEnded{ 0 };
+};
+
 class BenchmarkDialog final : public wxDialogWrapper
 {
 public:
@@ -571,6 +644,471 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("At 44100 Hz, %d bytes per sample, the estimated number of\n simultaneous tracks that could be played at once: %.1f\n" )
       .Format( SAMPLE_SIZE(SampleFormat), (nChunks*chunkSize/44100.0)/(elapsed/1000.0) ) );
 
+   {
+      // Each summary kernel the CPU supports must agree exactly with the
+      // scalar one, or summaries would depend on the machine
+      Printf( XO("Checking summary kernels...\n") );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const size_t nSamples = 1 << 20, nTriples = 1 << 16, nRepeats = 20;
+      Floats summarySamples{ nSamples };
+      for (size_t i = 0; i < nSamples; i++)
+         summarySamples[i] = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+      // Then again with NaN, which all must skip alike, and zeros of both
+      // signs, of which all must keep the same one
+      Floats specialSamples{ nSamples };
+      for (size_t i = 0; i < nSamples; i++) {
+         const auto choice = rand() % 16;
+         specialSamples[i] =
+              (choice == 0) ? std::numeric_limits<float>::quiet_NaN()
+            : (choice == 1) ? 0.0f
+            : (choice == 2) ? -0.0f
+            : summarySamples[i];
+      }
+
+      using namespace SummaryKernels;
+      const auto &scalar = *GetKernels(Kind::Scalar);
+      for (auto kind : { Kind::Scalar, Kind::SSE2, Kind::AVX2 }) {
+         const auto pKernels = GetKernels(kind);
+         if (!pKernels)
+            continue;
+
+         timer.Start();
+         for (size_t r = 0; r < nRepeats; r++)
+            for (size_t i = 0; i < nSamples; i += 256)
+               pKernels->scanSamples(summarySamples.get() + i, 256);
+         elapsed = timer.Time();
+
+         for (const float *data :
+              { summarySamples.get(), specialSamples.get() }) {
+            // Odd lengths exercise the tails
+            for (size_t len :
+                 { nSamples, nSamples - 13, size_t(255), size_t(7) }) {
+               const auto expected = scalar.scanSamples(data, len);
+               const auto actual = pKernels->scanSamples(data, len);
+               if (memcmp(&expected, &actual, sizeof(actual))) {
+                  Printf( XO("Summary kernel %s differs from scalar for %lld samples.\n")
+                     .Format( pKernels->name, (long long)len ) );
+                  goto fail;
+               }
+            }
+            for (size_t len : { nTriples, nTriples - 5 }) {
+               const auto expected = scalar.scanTriples(data, len);
+               const auto actual = pKernels->scanTriples(data, len);
+               if (memcmp(&expected, &actual, sizeof(actual))) {
+                  Printf( XO("Summary kernel %s differs from scalar for %lld triples.\n")
+                     .Format( pKernels->name, (long long)len ) );
+                  goto fail;
+               }
+            }
+         }
+
+         Printf( XO("Time to summarize %.1f MB with %s kernel: %ld ms\n")
+            .Format( nRepeats * nSamples * sizeof(float) / 1048576.0,
+               pKernels->name, elapsed ) );
+      }
+   }
+
+   {
+      // Opening a project decodes its binary document; compare the old way,
+      // through XML text and expat, with direct calls to the handlers
+      const int nBlocks = 100000, nRepeats = 5;
+      Printf( XO("Decoding a project document of %d blocks...\n")
+         .Format( nBlocks ) );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      ProjectSerializer doc;
+      doc.StartTag(wxT("project"));
+      doc.WriteAttr(wxT("version"), wxT("1.3.0"));
+      doc.StartTag(wxT("wavetrack"));
+      doc.WriteAttr(wxT("name"), wxT("Benchmark"));
+      doc.WriteAttr(wxT("rate"), 44100.0, 12);
+      doc.StartTag(wxT("waveclip"));
+      doc.WriteAttr(wxT("offset"), 0.0, 8);
+      doc.StartTag(wxT("sequence"));
+      doc.WriteAttr(wxT("maxsamples"), (size_t)chunkSize);
+      doc.WriteAttr(wxT("sampleformat"), (size_t)SampleFormat);
+      doc.WriteAttr(wxT("numsamples"), (long long)(nBlocks * chunkSize));
+      for (int i = 0; i < nBlocks; i++) {
+         doc.StartTag(wxT("waveblock"));
+         doc.WriteAttr(wxT("start"), (long long)(i * chunkSize));
+         doc.WriteAttr(wxT("blockid"), (long long)i + 1);
+         doc.EndTag(wxT("waveblock"));
+      }
+      doc.EndTag(wxT("sequence"));
+      doc.EndTag(wxT("waveclip"));
+      doc.EndTag(wxT("wavetrack"));
+      doc.EndTag(wxT("project"));
+
+      // As ProjectFileIO stores it
+      wxMemoryBuffer buffer;
+      buffer.AppendData(doc.GetDict().GetData(), doc.GetDict().GetDataLen());
+      buffer.AppendData(doc.GetData().GetData(), doc.GetData().GetDataLen());
+
+      BenchmarkTagHandler viaText, direct;
+
+      timer.Start();
+      for (int r = 0; r < nRepeats; r++) {
+         viaText = {};
+         XMLFileReader reader;
+         if (!reader.ParseString(&viaText, ProjectSerializer::Decode(buffer))) {
+            Printf( XO("Failed to parse the decoded document.\n") );
+            goto fail;
+         }
+      }
+      const auto textElapsed = timer.Time();
+
+      timer.Start();
+      for (int r = 0; r < nRepeats; r++) {
+         direct = {};
+         if (ProjectSerializer::Decode(buffer, direct) !=
+             ProjectSerializer::DecodeResult::Success) {
+            Printf( XO("Failed to decode the document to handlers.\n") );
+            goto fail;
+         }
+      }
+      const auto directElapsed = timer.Time();
+
+      if (viaText.nTags != direct.nTags || viaText.sum != direct.sum) {
+         Printf( XO("Decoding to handlers differs: %lld tags, not %lld.\n")
+            .Format( direct.nTags, viaText.nTags ) );
+         goto fail;
+      }
+
+      Printf( XO("Time to open the document through XML text: %ld ms\n")
+         .Format( textElapsed / nRepeats ) );
+      Printf( XO("Time to open the document directly: %ld ms\n")
+         .Format( directElapsed / nRepeats ) );
+   }
+
+   {
+      // Each FFT kernel the CPU supports must agree exactly with the scalar
+      // one, which is the code RealFFTf() had before there were kernels
+      Printf( XO("Checking FFT kernels...\n") );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      // Transform the same number of samples at each size
+      const size_t totalPoints = 1 << 24, maxPoints = 65536;
+      Floats fftInput{ maxPoints }, expected{ maxPoints }, actual{ maxPoints };
+      for (size_t i = 0; i < maxPoints; i++)
+         fftInput[i] = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+
+      using namespace FFTKernels;
+      const auto &scalar = *GetKernels(Kind::Scalar);
+      for (size_t size = 256; size <= maxPoints; size <<= 1) {
+         const auto hFFT = GetFFT(size);
+         const auto bytes = size * sizeof(float);
+         for (auto kind : { Kind::Scalar, Kind::SSE2, Kind::AVX }) {
+            const auto pKernels = GetKernels(kind);
+            if (!pKernels)
+               continue;
+
+            memcpy(expected.get(), fftInput.get(), bytes);
+            memcpy(actual.get(), fftInput.get(), bytes);
+            RealFFTf(expected.get(), hFFT.get(), scalar);
+            RealFFTf(actual.get(), hFFT.get(), *pKernels);
+            bool same = !memcmp(expected.get(), actual.get(), bytes);
+            InverseRealFFTf(expected.get(), hFFT.get(), scalar);
+            InverseRealFFTf(actual.get(), hFFT.get(), *pKernels);
+            same = same && !memcmp(expected.get(), actual.get(), bytes);
+            if (!same) {
+               Printf( XO("FFT kernel %s differs from scalar for %lld points.\n")
+                  .Format( pKernels->name, (long long)size ) );
+               goto fail;
+            }
+
+            // Inverse after forward keeps the values in range
+            timer.Start();
+            for (size_t r = 0; r < totalPoints / size; r++) {
+               RealFFTf(actual.get(), hFFT.get(), *pKernels);
+               InverseRealFFTf(actual.get(), hFFT.get(), *pKernels);
+            }
+            elapsed = timer.Time();
+
+            Printf( XO("Time for %lld pairs of %lld point FFTs with %s kernel: %ld ms\n")
+               .Format( (long long)(totalPoints / size), (long long)size,
+                  pKernels->name, elapsed ) );
+         }
+      }
+
+      // Other even sizes must agree with the definition of the transform,
+      // and the inverse must give back the samples
+      for (size_t size : { 1000, 1764, 4410, 44100 }) {
+         const auto hFFT = GetFFT(size);
+         memcpy(actual.get(), fftInput.get(), size * sizeof(float));
+         RealFFTf(actual.get(), hFFT.get());
+
+         // Check a few hundred bins, including DC and Fs/2
+         double maxError = 0, maxMagnitude = 0;
+         for (size_t i = 0; i <= 250; i++) {
+            const auto k = i * (size / 2) / 250;
+            double re = 0, im = 0;
+            for (size_t n = 0; n < size; n++) {
+               const double angle = -2 * M_PI * ((k * n) % size) / size;
+               re += fftInput[n] * cos(angle);
+               im += fftInput[n] * sin(angle);
+            }
+            // DC and Fs/2 are real, and share the first pair
+            const double actualRe = k == 0 ? actual[0]
+               : k == size / 2 ? actual[1]
+               : actual[hFFT->BitReversed[k]];
+            const double actualIm = (k == 0 || k == size / 2) ? 0
+               : actual[hFFT->BitReversed[k] + 1];
+            maxError = std::max(maxError,
+               std::max(fabs(actualRe - re), fabs(actualIm - im)));
+            maxMagnitude = std::max(maxMagnitude, sqrt(re * re + im * im));
+         }
+         bool same = maxError <= 1e-5 * maxMagnitude;
+
+         InverseRealFFTf(actual.get(), hFFT.get());
+         for (size_t n = 0; n < size; n++)
+            same = same && fabs(actual[n] - fftInput[n]) <= 1e-5;
+
+         if (!same) {
+            Printf( XO("FFT of %lld points differs from the definition.\n")
+               .Format( (long long)size ) );
+            goto fail;
+         }
+
+         timer.Start();
+         for (size_t r = 0; r < totalPoints / size; r++) {
+            RealFFTf(actual.get(), hFFT.get());
+            InverseRealFFTf(actual.get(), hFFT.get());
+         }
+         elapsed = timer.Time();
+
+         Printf( XO("Time for %lld pairs of %lld point FFTs: %ld ms\n")
+            .Format( (long long)(totalPoints / size), (long long)size,
+               elapsed ) );
+      }
+
+      // An odd count, so that the vector kernels have a tail
+      const size_t count = 4095;
+      Floats sums{ 4 * count };
+      for (auto kind : { Kind::SSE2, Kind::AVX }) {
+         const auto pKernels = GetKernels(kind);
+         if (!pKernels)
+            continue;
+
+         std::fill(sums.get(), sums.get() + 4 * count, 0.0f);
+         for (size_t r = 0; r < 3; r++) {
+            const auto x = fftInput.get() + r * count;
+            const auto h = fftInput.get() + 8 * count + r * count;
+            scalar.multiplyAdd(sums.get(), sums.get() + count,
+               x, x + 4 * count, h, h + 4 * count, count);
+            pKernels->multiplyAdd(sums.get() + 2 * count, sums.get() + 3 * count,
+               x, x + 4 * count, h, h + 4 * count, count);
+         }
+         if (memcmp(sums.get(), sums.get() + 2 * count,
+                    2 * count * sizeof(float))) {
+            Printf( XO("FFT kernel %s multiplies spectra differently from scalar.\n")
+               .Format( pKernels->name ) );
+            goto fail;
+         }
+      }
+   }
+
+   {
+      // Partitioned convolution must agree with direct convolution, for any
+      // division of the input among calls
+      Printf( XO("Checking partitioned convolution...\n") );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const size_t nTaps = 8191, len = 1 << 16, chunk = 1000;
+      Floats taps{ nTaps }, input{ len }, expected{ len }, actual{ len };
+      for (size_t i = 0; i < nTaps; i++)
+         taps[i] = ((rand() / (float)RAND_MAX) * 2.0f - 1.0f) / 64;
+      for (size_t i = 0; i < len; i++)
+         input[i] = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+      for (size_t i = 0; i < len; i++) {
+         double sum = 0;
+         for (size_t j = 0; j < nTaps && j <= i; j++)
+            sum += (double)taps[j] * input[i - j];
+         expected[i] = sum;
+      }
+
+      for (size_t blockSize = 64; blockSize <= 8192; blockSize <<= 1) {
+         PartitionedConvolver convolver{
+            std::make_shared<PartitionedFilter>(taps.get(), nTaps, blockSize) };
+         const auto latency = convolver.GetLatency();
+         for (size_t i = 0; i < len; i += chunk) {
+            const auto n = std::min(chunk, len - i);
+            convolver.Process(&input[i], &actual[i], n);
+         }
+         for (size_t i = latency; i < len; i++)
+            if (fabs(actual[i] - expected[i - latency]) > 1e-4) {
+               Printf( XO("Partitioned convolution in blocks of %lld differs at sample %lld.\n")
+                  .Format( (long long)blockSize, (long long)(i - latency) ) );
+               goto fail;
+            }
+
+         // Convolve 128 times as many samples
+         timer.Start();
+         for (size_t r = 0; r < 128; r++)
+            convolver.Process(input.get(), actual.get(), len);
+         elapsed = timer.Time();
+
+         Printf( XO("Time to convolve %lld samples with %lld taps in blocks of %lld: %ld ms\n")
+            .Format( (long long)(128 * len), (long long)nTaps,
+               (long long)blockSize, elapsed ) );
+      }
+   }
+
+   {
+      // A sine at a quarter of the rate, sampled between its peaks, has a
+      // true peak well above its largest sample; measuring it in blocks and
+      // sample by sample must agree exactly
+      Printf( XO("Checking true peak measurement...\n") );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const double rate = 48000;
+      const size_t len = 10 * 48000, chunk = 1000;
+      const float amplitude = 0.5f;
+      Floats left{ len }, right{ len };
+      for (size_t i = 0; i < len; i++) {
+         left[i] = amplitude * sin(M_PI / 2 * i + M_PI / 4);
+         right[i] = amplitude * sin(2 * M_PI * 997 * i / rate);
+      }
+
+      EBUR128 inBlocks{ rate, 2, true }, bySample{ rate, 2, true };
+      inBlocks.Initialize();
+      bySample.Initialize();
+      timer.Start();
+      for (size_t i = 0; i < len; i += chunk) {
+         const float *channels[] = { &left[i], &right[i] };
+         inBlocks.ProcessBlock(channels, std::min(chunk, len - i));
+      }
+      const auto truePeak = inBlocks.TruePeak();
+      elapsed = timer.Time();
+      for (size_t i = 0; i < len; i++) {
+         bySample.ProcessSampleFromChannel(left[i], 0);
+         bySample.ProcessSampleFromChannel(right[i], 1);
+         bySample.NextSample();
+      }
+
+      Printf( XO("Time to measure loudness and true peak of %lld stereo samples: %ld ms\n")
+         .Format( (long long)len, elapsed ) );
+      if (truePeak < 0.98 * amplitude || truePeak > 1.02 * amplitude) {
+         Printf( XO("True peak of a sine of amplitude %f measured as %f.\n")
+            .Format( amplitude, truePeak ) );
+         goto fail;
+      }
+      if (bySample.TruePeak() != truePeak ||
+          bySample.IntegrativeLoudness() != inBlocks.IntegrativeLoudness()) {
+         Printf( XO("Loudness measured sample by sample differs from loudness measured in blocks.\n") );
+         goto fail;
+      }
+   }
+
+   {
+      // Effects are added, removed, suspended and resumed while another
+      // thread plays two tracks; that thread must never wait, and must apply
+      // one chain of effects to all of each buffer, in both tracks
+      Printf( XO("Checking realtime effect chain updates...\n") );
+
+      wxTheApp->Yield();
+      FlushPrint();
+
+      auto &manager = RealtimeEffectManager::Get();
+      if (AudioIOBase::Get()->IsBusy() || manager.RealtimeIsActive())
+         Printf( XO("Skipped, because audio or realtime effects are in use.\n") );
+      else {
+         const unsigned nEffects = 4, nChannels = 2, nGroups = 2;
+         const size_t nSamples = 512, nChanges = 5000;
+         BenchmarkCountingEffect effects[nEffects];
+         bool added[nEffects] = {}, suspended[nEffects] = {};
+
+         manager.RealtimeInitialize(44100);
+         for (unsigned group = 0; group < nGroups; group++)
+            manager.RealtimeAddProcessor(group, nChannels, 44100);
+
+         std::atomic<bool> stop{ false };
+         long long nBuffers = 0, nTorn = 0;
+         double maxTime = 0;
+         std::thread player{ [&]{
+            Floats samples{ nGroups * nChannels * nSamples };
+            float *buffers[nGroups][nChannels];
+            for (unsigned group = 0; group < nGroups; group++)
+               for (unsigned channel = 0; channel < nChannels; channel++)
+                  buffers[group][channel] = samples.get() +
+                     (group * nChannels + channel) * nSamples;
+            const auto end = samples.get() + nGroups * nChannels * nSamples;
+            while (!stop) {
+               std::fill(samples.get(), end, 0.0f);
+
+               const auto start = std::chrono::steady_clock::now();
+               manager.RealtimeProcessStart();
+               for (unsigned group = 0; group < nGroups; group++)
+                  manager.RealtimeProcess(
+                     group, nChannels, buffers[group], nSamples);
+               manager.RealtimeProcessEnd();
+               const std::chrono::duration<double, std::milli> time =
+                  std::chrono::steady_clock::now() - start;
+               maxTime = std::max(maxTime, time.count());
+
+               // All channels of all groups count the same effects
+               const auto count = samples[0];
+               if (count < 0 || count > nEffects ||
+                   std::any_of(samples.get(), end,
+                      [=](float x){ return x != count; }))
+                  ++nTorn;
+               ++nBuffers;
+            }
+         } };
+
+         for (size_t i = 0; i < nChanges; i++) {
+            const auto which = rand() % nEffects;
+            auto &effect = effects[which];
+            if (!added[which] || rand() % 2) {
+               if (added[which])
+                  manager.RealtimeRemoveEffect(&effect);
+               else
+                  manager.RealtimeAddEffect(&effect);
+               added[which] = !added[which];
+               suspended[which] = false;
+            }
+            else {
+               if (suspended[which])
+                  manager.RealtimeResumeOne(effect);
+               else
+                  manager.RealtimeSuspendOne(effect);
+               suspended[which] = !suspended[which];
+            }
+         }
+
+         stop = true;
+         player.join();
+         for (unsigned which = 0; which < nEffects; which++)
+            if (added[which])
+               manager.RealtimeRemoveEffect(&effects[which]);
+         manager.RealtimeFinalize();
+
+         Printf( XO("Longest of %lld buffers during %lld changes of effects: %.3f ms\n")
+            .Format( nBuffers, (long long)nChanges, maxTime ) );
+         if (nTorn > 0) {
+            Printf( XO("%lld buffers were processed by inconsistent effects.\n")
+               .Format( nTorn ) );
+            goto fail;
+         }
+         for (const auto &effect : effects)
+            if (effect.nStarted != effect.nEnded) {
+               Printf( XO("An effect started %lld buffers but ended %lld.\n")
+                  .Format( effect.nStarted, effect.nEnded ) );
+               goto fail;
+            }
+      }
+   }
+
    goto success;
 
  fail:
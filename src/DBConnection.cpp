@@ -15,12 +15,14 @@ Paul Licameli -- split from ProjectFileIO.cpp
 
 #include <wx/progdlg.h>
 #include <wx/string.h>
+#include <wx/timer.h>
 
 #include "SneedacityLogger.h"
 #include "FileNames.h"
 #include "Internat.h"
 #include "Project.h"
 #include "FileException.h"
+#include "SampleBlockPrefetcher.h"
 #include "wxFileNameWrapper.h"
 
 // Configuration to provide "safe" connections
@@ -31,6 +33,30 @@ static const char *SafeConfig =
    "PRAGMA <schema>.journal_mode = WAL;"
    "PRAGMA <schema>.wal_autocheckpoint = 0;";
 
+// Limits on a batch of writes sharing one transaction; whichever is reached
+// first commits the batch.  The age limit bounds the work lost at a crash, and
+// the size limits bound the work lost if an error rolls the batch back.
+static const size_t MaxBatchWrites = 256;
+static const size_t MaxBatchBytes = 64 * 1024 * 1024;
+static const std::chrono::milliseconds MaxBatchAge{ 2000 };
+
+//! Commits a batch that no later write has committed, once it is old enough
+class DBConnection::BatchTimer final : public wxTimer
+{
+public:
+   explicit BatchTimer(DBConnection &connection)
+      : mConnection{ connection }
+   {}
+
+   void Notify() override
+   {
+      mConnection.CommitOldBatch();
+   }
+
+private:
+   DBConnection &mConnection;
+};
+
 // Configuration to provide "Fast" connections
 static const char *FastConfig =
    "PRAGMA <schema>.busy_timeout = 5000;"
@@ -202,6 +228,14 @@ int DBConnection::OpenStepByStep(const FilePath fileName)
 
    // Install our checkpoint hook
    sqlite3_wal_hook(mDB, CheckpointHook, this);
+
+   // The prefetch thread starts only when the first hint arrives
+   mpPrefetcher = std::make_unique<SampleBlockPrefetcher>(*this);
+
+   // Writes stop coming when an import or recording ends, so the age limit
+   // of the last batch must be checked without them
+   mpBatchTimer = std::make_unique<BatchTimer>(*this);
+   mpBatchTimer->Start(MaxBatchAge.count() / 2);
    return rc;
 }
 
@@ -216,6 +250,10 @@ bool DBConnection::Close()
       return true;
    }
 
+   // Make pending sample blocks durable before the final checkpoint
+   mpBatchTimer.reset();
+   FlushBatch();
+
    // Uninstall our checkpoint hook so that no additional checkpoints
    // are sent our way.  (Though this shouldn't really happen.)
    sqlite3_wal_hook(mDB, nullptr, nullptr);
@@ -260,6 +298,9 @@ bool DBConnection::Close()
       mCheckpointThread.join();
    }
 
+   // Stop the prefetch thread too, before its statement is finalized
+   mpPrefetcher.reset();
+
    // We're done with the prepared statements
    {
       std::lock_guard<std::mutex> guard(mStatementMutex);
@@ -423,6 +464,108 @@ sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
    return stmt;
 }
 
+SampleBlockPrefetcher *DBConnection::GetPrefetcher()
+{
+   return mpPrefetcher.get();
+}
+
+void DBConnection::BeginBatchedWrite()
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   // Don't open a transaction inside a savepoint or other explicit
+   // transaction; the write belongs to that one
+   if (mBatchOpen || !sqlite3_get_autocommit(mDB))
+   {
+      return;
+   }
+
+   if (sqlite3_exec(mDB, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK)
+   {
+      // Not fatal; the write just commits by itself as it always used to
+      return;
+   }
+
+   mBatchOpen = true;
+   mBatchWrites = 0;
+   mBatchBytes = 0;
+   mBatchStart = std::chrono::steady_clock::now();
+}
+
+void DBConnection::EndBatchedWrite(size_t bytes)
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   if (!mBatchOpen)
+   {
+      return;
+   }
+
+   if (sqlite3_get_autocommit(mDB))
+   {
+      // Some errors (such as a full disk) roll back the whole transaction
+      // and not only the failed statement
+      wxLogMessage("Batch of %lld writes ended without commit",
+         (long long) mBatchWrites);
+      mBatchOpen = false;
+      return;
+   }
+
+   ++mBatchWrites;
+   mBatchBytes += bytes;
+   if (mBatchWrites >= MaxBatchWrites ||
+       mBatchBytes >= MaxBatchBytes ||
+       std::chrono::steady_clock::now() - mBatchStart >= MaxBatchAge)
+   {
+      CommitBatch();
+   }
+}
+
+bool DBConnection::FlushBatch()
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+   return CommitBatch();
+}
+
+void DBConnection::CommitOldBatch()
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+   if (mBatchOpen &&
+       std::chrono::steady_clock::now() - mBatchStart >= MaxBatchAge)
+   {
+      CommitBatch();
+   }
+}
+
+bool DBConnection::CommitBatch()
+{
+   if (!mBatchOpen)
+   {
+      return true;
+   }
+
+   if (sqlite3_get_autocommit(mDB))
+   {
+      // Already ended, see EndBatchedWrite()
+      mBatchOpen = false;
+      return true;
+   }
+
+   int rc = sqlite3_exec(mDB, "COMMIT;", nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Failed to commit new sample blocks to the project file")
+      );
+      // Still open if the commit was only busy; try again at the next flush
+      mBatchOpen = !sqlite3_get_autocommit(mDB);
+      return false;
+   }
+
+   mBatchOpen = false;
+   return true;
+}
+
 void DBConnection::CheckpointThread(sqlite3 *db, const FilePath &fileName)
 {
    int rc = SQLITE_OK;
@@ -596,7 +739,16 @@ TransactionScope::TransactionScope(
 :  mConnection(connection),
    mName(name)
 {
-   mInTrans = TransactionStart(mName);
+   // Commit batched writes first, so that committing this transaction makes
+   // its changes durable, rather than only releasing a savepoint nested in
+   // the batch.  If that fails, the changes still commit with the batch.
+   // Hold the lock until the savepoint exists, so that no other thread opens
+   // a new batch in between.
+   {
+      std::lock_guard<std::mutex> guard(mConnection.mBatchMutex);
+      mConnection.CommitBatch();
+      mInTrans = TransactionStart(mName);
+   }
    if ( !mInTrans )
       // To do, improve the message
       throw SimpleMessageBoxException( ExceptionType::Internal,
@@ -13,6 +13,7 @@ Paul Licameli -- split from ProjectFileIO.h
 #define __SNEEDACITY_DB_CONNECTION__
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <map>
@@ -27,6 +28,8 @@ struct sqlite3;
 struct sqlite3_stmt;
 class wxString;
 class SneedacityProject;
+class SampleBlockPrefetcher;
+class TransactionScope;
 
 struct DBConnectionErrors
 {
@@ -77,10 +80,34 @@ public:
       InsertSampleBlock,
       DeleteSampleBlock,
       GetRootPage,
-      GetDBPage
+      GetDBPage,
+      PrefetchSamples
    };
    sqlite3_stmt *Prepare(enum StatementID id, const char *sql);
 
+   //! Background reader of sample blocks; null when the connection is not open
+   SampleBlockPrefetcher *GetPrefetcher();
+
+   //! Call before executing an insert that may share a transaction with
+   //! neighboring inserts
+   /*! Opens a batch transaction unless one is open already.  Does nothing if
+    some other transaction is active, which then includes the write instead.
+    */
+   void BeginBatchedWrite();
+
+   //! Call after the statement, whether it succeeded or not
+   /*! Commits the batch when it holds enough writes or bytes or is old
+    enough.
+    @param bytes size of the data written, or zero after a failure */
+   void EndBatchedWrite(size_t bytes);
+
+   //! Commit any open batch of writes
+   /*! Call this before writes that must not become durable without the
+    batched writes, such as a document referring to sample blocks, and before
+    statements that can't run inside a transaction.
+    @return false if the commit failed, leaving the batch open */
+   bool FlushBatch();
+
    void SetBypass( bool bypass );
    bool ShouldBypass();
 
@@ -100,6 +127,11 @@ private:
    int OpenStepByStep(const FilePath fileName);
    int ModeConfig(sqlite3 *db, const char *schema, const char *config);
 
+   //! Precondition: mBatchMutex is held
+   bool CommitBatch();
+   //! Commit the batch if it is older than the limit; called in the main thread
+   void CommitOldBatch();
+
    void CheckpointThread(sqlite3 *db, const FilePath &fileName);
    static int CheckpointHook(void *data, sqlite3 *db, const char *schema, int pages);
 
@@ -119,11 +151,23 @@ private:
    using StatementIndex = std::pair<enum StatementID, std::thread::id>;
    std::map<StatementIndex, sqlite3_stmt *> mStatements;
 
+   std::unique_ptr<SampleBlockPrefetcher> mpPrefetcher;
+
+   std::mutex mBatchMutex;
+   bool mBatchOpen{ false };
+   size_t mBatchWrites{ 0 };
+   size_t mBatchBytes{ 0 };
+   std::chrono::steady_clock::time_point mBatchStart;
+   class BatchTimer;
+   std::unique_ptr<BatchTimer> mpBatchTimer;
+
    std::shared_ptr<DBConnectionErrors> mpErrors;
    CheckpointFailureCallback mCallback;
 
    // Bypass transactions if database will be deleted after close
    bool mBypass;
+
+   friend TransactionScope;
 };
 
 //! RAII for a database transaction, possibly nested
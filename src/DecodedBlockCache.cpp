@@ -0,0 +1,153 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file DecodedBlockCache.cpp
+@brief Implements DecodedBlockCache
+
+**********************************************************************/
+
+#include "DecodedBlockCache.h"
+
+#include <cstring>
+#include <functional>
+
+#include "Prefs.h"
+
+IntSetting DecodedBlockCache::MemoryLimit{
+   L"/Performance/DecodedBlockCacheMB", 256 };
+
+DecodedBlockCache &DecodedBlockCache::Get()
+{
+   static DecodedBlockCache instance;
+   return instance;
+}
+
+DecodedBlockCache::DecodedBlockCache()
+   : mByteBudget{ size_t(std::max(0, MemoryLimit.Read())) * 1024 * 1024 }
+{
+}
+
+size_t DecodedBlockCache::KeyHash::operator () (const Key &key) const
+{
+   auto result = std::hash<const void*>{}(key.owner);
+   result = result * 31 + std::hash<SampleBlockID>{}(key.id);
+   result = result * 31 + std::hash<unsigned>{}(key.format);
+   return result;
+}
+
+bool DecodedBlockCache::Read(const void *owner, SampleBlockID id,
+   sampleFormat format, samplePtr dest, size_t offset, size_t len)
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      auto iter = mEntries.find({ owner, id, format });
+      if (iter != mEntries.end()) {
+         auto &entry = iter->second;
+         if (offset <= entry.count && len <= entry.count - offset) {
+            const auto size = SAMPLE_SIZE(format);
+            memcpy(dest, entry.data.get() + offset * size, len * size);
+            // Move to the front of the recency list
+            mRecency.splice(mRecency.begin(), mRecency, entry.position);
+            ++mHits;
+            return true;
+         }
+      }
+   }
+   ++mMisses;
+   return false;
+}
+
+bool DecodedBlockCache::Contains(
+   const void *owner, SampleBlockID id, sampleFormat format)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mEntries.count({ owner, id, format }) > 0;
+}
+
+void DecodedBlockCache::Store(const void *owner, SampleBlockID id,
+   sampleFormat format, constSamplePtr src, size_t count)
+{
+   const auto bytes = count * SAMPLE_SIZE(format);
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   if (bytes > mByteBudget)
+      return;
+
+   Key key{ owner, id, format };
+   auto iter = mEntries.find(key);
+   if (iter != mEntries.end())
+      // Contents of a block never change, but be sure the size is right
+      Erase(iter);
+
+   Evict(bytes);
+
+   mRecency.push_front(key);
+   auto &entry = mEntries[key];
+   entry.data.reinit(bytes);
+   memcpy(entry.data.get(), src, bytes);
+   entry.count = count;
+   entry.position = mRecency.begin();
+   mBytes += bytes;
+}
+
+void DecodedBlockCache::Invalidate(const void *owner, SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (auto format : { int16Sample, int24Sample, floatSample }) {
+      auto iter = mEntries.find({ owner, id, format });
+      if (iter != mEntries.end())
+         Erase(iter);
+   }
+}
+
+void DecodedBlockCache::Purge(const void *owner)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (auto iter = mEntries.begin(); iter != mEntries.end();) {
+      auto next = std::next(iter);
+      if (iter->first.owner == owner)
+         Erase(iter);
+      iter = next;
+   }
+}
+
+size_t DecodedBlockCache::GetByteBudget()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mByteBudget;
+}
+
+void DecodedBlockCache::SetByteBudget(size_t bytes)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mByteBudget = bytes;
+   Evict(0);
+}
+
+auto DecodedBlockCache::GetStats() -> Stats
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return { mHits, mMisses, mBytes, mByteBudget };
+}
+
+void DecodedBlockCache::ResetStats()
+{
+   mHits = 0;
+   mMisses = 0;
+}
+
+void DecodedBlockCache::Evict(size_t bytesNeeded)
+{
+   while (!mRecency.empty() && mBytes + bytesNeeded > mByteBudget)
+      Erase(mEntries.find(mRecency.back()));
+}
+
+void DecodedBlockCache::Erase(
+   std::unordered_map<Key, Entry, KeyHash>::iterator iter)
+{
+   wxASSERT(iter != mEntries.end());
+   mBytes -= iter->second.count * SAMPLE_SIZE(iter->first.format);
+   mRecency.erase(iter->second.position);
+   mEntries.erase(iter);
+}
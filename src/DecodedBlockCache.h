@@ -0,0 +1,119 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file DecodedBlockCache.h
+@brief Declare DecodedBlockCache, a process-wide LRU of converted sample block contents
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_DECODED_BLOCK_CACHE__
+#define __SNEEDACITY_DECODED_BLOCK_CACHE__
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "SampleFormat.h"
+
+class IntSetting;
+
+using SampleBlockID = long long;
+
+//! Process-wide, memory-bounded cache of whole sample blocks converted to a sample format
+/*! Playback, export and drawing of the same track each keep their own
+ WaveTrackCache, but all sample reads go through this one cache, so that they
+ share the results of database queries and format conversions.
+
+ Block ids are unique only within one database, so entries are also keyed by
+ an opaque owner pointer (the connection to that database).
+ */
+class SNEEDACITY_DLL_API DecodedBlockCache
+{
+public:
+   //! Limit on the memory used, in megabytes; zero disables the cache
+   static IntSetting MemoryLimit;
+
+   struct Stats {
+      unsigned long long hits;
+      unsigned long long misses;
+      size_t bytes;
+      size_t byteBudget;
+   };
+
+   static DecodedBlockCache &Get();
+
+   DecodedBlockCache(const DecodedBlockCache&) = delete;
+   DecodedBlockCache &operator=(const DecodedBlockCache&) = delete;
+
+   //! Copy samples out of a cached block, counting a hit or a miss
+   /*! @return false, leaving dest untouched, if the block is not cached in
+    this format or is shorter than offset + len */
+   bool Read(const void *owner, SampleBlockID id, sampleFormat format,
+      samplePtr dest, size_t offset, size_t len);
+
+   //! Whether the block is cached in the format; does not affect statistics
+   bool Contains(const void *owner, SampleBlockID id, sampleFormat format);
+
+   //! Store all samples of a block, evicting the least recently used others
+   /*! Ignored if the block alone would exceed the budget */
+   void Store(const void *owner, SampleBlockID id, sampleFormat format,
+      constSamplePtr src, size_t count);
+
+   //! Forget the block in all formats; used when its storage is deleted
+   void Invalidate(const void *owner, SampleBlockID id);
+
+   //! Forget all blocks of the owner; used when its database closes
+   void Purge(const void *owner);
+
+   //! Zero means the cache is disabled
+   size_t GetByteBudget();
+   //! Change the memory limit, evicting as needed
+   void SetByteBudget(size_t bytes);
+
+   Stats GetStats();
+   void ResetStats();
+
+private:
+   DecodedBlockCache();
+
+   struct Key {
+      const void *owner;
+      SampleBlockID id;
+      sampleFormat format;
+
+      bool operator == (const Key &other) const
+      {
+         return owner == other.owner && id == other.id &&
+            format == other.format;
+      }
+   };
+
+   struct KeyHash {
+      size_t operator () (const Key &key) const;
+   };
+
+   struct Entry {
+      ArrayOf<char> data;
+      size_t count{ 0 };
+      std::list<Key>::iterator position;
+   };
+
+   //! Precondition: mMutex is held
+   void Evict(size_t bytesNeeded);
+   //! Precondition: mMutex is held
+   void Erase(std::unordered_map<Key, Entry, KeyHash>::iterator iter);
+
+   std::mutex mMutex;
+   std::unordered_map<Key, Entry, KeyHash> mEntries;
+   //! Most recently used at the front
+   std::list<Key> mRecency;
+   size_t mBytes{ 0 };
+   size_t mByteBudget;
+
+   std::atomic<unsigned long long> mHits{ 0 };
+   std::atomic<unsigned long long> mMisses{ 0 };
+};
+
+#endif
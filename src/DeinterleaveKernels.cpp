@@ -0,0 +1,144 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file DeinterleaveKernels.cpp
+@brief Implements DeinterleaveKernels
+
+**********************************************************************/
+
+#include "DeinterleaveKernels.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DEINTERLEAVE_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace DeinterleaveKernels {
+
+namespace {
+
+template<typename Sample>
+void ScalarDeinterleave(const Sample *src,
+   size_t nChannels, size_t nFrames, Sample *const dests[])
+{
+   // Visit the source in tiles that stay in the first level cache while
+   // each channel takes its share, so that many channels cost no more reads
+   constexpr size_t TileBytes = 16 * 1024;
+   const auto tileFrames =
+      std::max<size_t>(1, TileBytes / (nChannels * sizeof(Sample)));
+   for (size_t start = 0; start < nFrames; start += tileFrames) {
+      const auto end = std::min(nFrames, start + tileFrames);
+      for (size_t c = 0; c < nChannels; ++c) {
+         const auto s = src + c;
+         const auto dest = dests[c];
+         for (size_t ii = start; ii < end; ++ii)
+            dest[ii] = s[ii * nChannels];
+      }
+   }
+}
+
+#ifdef DEINTERLEAVE_KERNELS_SSE2
+
+void SSE2Stereo(const float *src, size_t nFrames, float *left, float *right)
+{
+   size_t ii = 0;
+   for (; ii + 4 <= nFrames; ii += 4) {
+      const __m128 a = _mm_loadu_ps(src + 2 * ii);
+      const __m128 b = _mm_loadu_ps(src + 2 * ii + 4);
+      _mm_storeu_ps(left + ii, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(right + ii, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+   }
+   for (; ii < nFrames; ++ii)
+      left[ii] = src[2 * ii], right[ii] = src[2 * ii + 1];
+}
+
+void SSE2Quad(const float *src, size_t nFrames, float *const dests[])
+{
+   size_t ii = 0;
+   for (; ii + 4 <= nFrames; ii += 4) {
+      __m128 v0 = _mm_loadu_ps(src + 4 * ii);
+      __m128 v1 = _mm_loadu_ps(src + 4 * ii + 4);
+      __m128 v2 = _mm_loadu_ps(src + 4 * ii + 8);
+      __m128 v3 = _mm_loadu_ps(src + 4 * ii + 12);
+      _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+      _mm_storeu_ps(dests[0] + ii, v0);
+      _mm_storeu_ps(dests[1] + ii, v1);
+      _mm_storeu_ps(dests[2] + ii, v2);
+      _mm_storeu_ps(dests[3] + ii, v3);
+   }
+   for (; ii < nFrames; ++ii)
+      for (size_t c = 0; c < 4; ++c)
+         dests[c][ii] = src[4 * ii + c];
+}
+
+// Each 32 bit lane holds one frame, the left sample in the low half
+void SSE2Stereo(const short *src, size_t nFrames, short *left, short *right)
+{
+   size_t ii = 0;
+   for (; ii + 8 <= nFrames; ii += 8) {
+      const auto a = _mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(src + 2 * ii));
+      const auto b = _mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(src + 2 * ii + 8));
+      const auto leftA = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+      const auto leftB = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+      const auto rightA = _mm_srai_epi32(a, 16);
+      const auto rightB = _mm_srai_epi32(b, 16);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(left + ii),
+         _mm_packs_epi32(leftA, leftB));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(right + ii),
+         _mm_packs_epi32(rightA, rightB));
+   }
+   for (; ii < nFrames; ++ii)
+      left[ii] = src[2 * ii], right[ii] = src[2 * ii + 1];
+}
+
+#endif
+
+}
+
+void Deinterleave(const float *src,
+   size_t nChannels, size_t nFrames, float *const dests[])
+{
+#ifdef DEINTERLEAVE_KERNELS_SSE2
+   if (nChannels == 2)
+      return SSE2Stereo(src, nFrames, dests[0], dests[1]);
+   if (nChannels == 4)
+      return SSE2Quad(src, nFrames, dests);
+#endif
+   ScalarDeinterleave(src, nChannels, nFrames, dests);
+}
+
+void Deinterleave(const short *src,
+   size_t nChannels, size_t nFrames, short *const dests[])
+{
+#ifdef DEINTERLEAVE_KERNELS_SSE2
+   if (nChannels == 2)
+      return SSE2Stereo(src, nFrames, dests[0], dests[1]);
+#endif
+   ScalarDeinterleave(src, nChannels, nFrames, dests);
+}
+
+void NarrowToInt16(const int *src, size_t count, unsigned shift, short *dest)
+{
+   size_t ii = 0;
+#ifdef DEINTERLEAVE_KERNELS_SSE2
+   const auto bits = _mm_cvtsi32_si128(shift);
+   for (; ii + 8 <= count; ii += 8) {
+      const auto a = _mm_sll_epi32(_mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(src + ii)), bits);
+      const auto b = _mm_sll_epi32(_mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(src + ii + 4)), bits);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + ii),
+         _mm_packs_epi32(a, b));
+   }
+#endif
+   for (; ii < count; ++ii)
+      dest[ii] = src[ii] << shift;
+}
+
+}
@@ -0,0 +1,36 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file DeinterleaveKernels.h
+@brief Scalar and SIMD loops splitting interleaved frames into channels, and narrowing decoded integers
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_DEINTERLEAVE_KERNELS__
+#define __SNEEDACITY_DEINTERLEAVE_KERNELS__
+
+#include <cstddef>
+
+//! Inner loops shared by the importers, to move decoded samples into tracks
+/*! These only copy or shift bits, so the SIMD variants, used when the
+ compiler targets SSE2, give exactly the results of the scalar ones. */
+namespace DeinterleaveKernels {
+
+//! Copy nFrames frames of nChannels interleaved samples into one array for
+//! each channel
+/*! 32 bit samples of any format can go through the float overload */
+SNEEDACITY_DLL_API void Deinterleave(const float *src,
+   size_t nChannels, size_t nFrames, float *const dests[]);
+
+SNEEDACITY_DLL_API void Deinterleave(const short *src,
+   size_t nChannels, size_t nFrames, short *const dests[]);
+
+//! Shift decoded integer samples left by shift, and store them as 16 bit
+//! samples, which they must fit
+SNEEDACITY_DLL_API void NarrowToInt16(const int *src,
+   size_t count, unsigned shift, short *dest);
+
+}
+
+#endif
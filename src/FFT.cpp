@@ -51,10 +51,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <mutex>
 
 #include "RealFFTf.h"
 
 static ArraysOf<int> gFFTBitTable;
+static std::mutex gFFTBitTableMutex;
 static const size_t MaxFastBits = 16;
 
 /* Declare Static functions */
@@ -114,6 +116,7 @@ void InitFFT()
 
 void DeinitFFT()
 {
+   std::lock_guard<std::mutex> guard(gFFTBitTableMutex);
    gFFTBitTable.reset();
 }
 
@@ -125,6 +128,66 @@ static inline size_t FastReverseBits(size_t i, size_t NumBits)
       return ReverseBits(i, NumBits);
 }
 
+/*
+ * Complex FFT of a size other than a power of two
+ *
+ * Uses Bluestein's algorithm, as RealFFTf() does for such sizes:  the
+ * transform is a convolution with the chirp exp(-i pi n^2 / NumSamples),
+ * done with FFTs of a power of two size at least 2 * NumSamples - 1.
+ */
+
+static void ChirpFFT(size_t NumSamples,
+                     bool InverseTransform,
+                     const float *RealIn, const float *ImagIn,
+                     float *RealOut, float *ImagOut)
+{
+   size_t size = 2;
+   while (size < 2 * NumSamples - 1)
+      size <<= 1;
+
+   const double sign = InverseTransform ? 1.0 : -1.0;
+   Floats chirpR{ NumSamples }, chirpI{ NumSamples };
+   for (size_t n = 0; n < NumSamples; n++) {
+      // Reduce n^2 exactly, so that large n lose no precision
+      double angle = sign * M_PI * ((n * n) % (2 * NumSamples)) / NumSamples;
+      chirpR[n] = cos(angle);
+      chirpI[n] = sin(angle);
+   }
+
+   // The input times the chirp, and the conjugate chirp at negative times
+   // too, each padded with zeroes
+   Floats aR{ size, true }, aI{ size, true };
+   Floats bR{ size, true }, bI{ size, true };
+   for (size_t n = 0; n < NumSamples; n++) {
+      float inR = RealIn[n], inI = (ImagIn == NULL) ? 0.0 : ImagIn[n];
+      aR[n] = inR * chirpR[n] - inI * chirpI[n];
+      aI[n] = inR * chirpI[n] + inI * chirpR[n];
+   }
+   bR[0] = 1;
+   for (size_t n = 1; n < NumSamples; n++) {
+      bR[n] = bR[size - n] = chirpR[n];
+      bI[n] = bI[size - n] = -chirpI[n];
+   }
+
+   // Convolve them
+   Floats AR{ size }, AI{ size }, BR{ size }, BI{ size };
+   FFT(size, false, aR.get(), aI.get(), AR.get(), AI.get());
+   FFT(size, false, bR.get(), bI.get(), BR.get(), BI.get());
+   for (size_t i = 0; i < size; i++) {
+      float tr = AR[i] * BR[i] - AI[i] * BI[i];
+      AI[i] = AR[i] * BI[i] + AI[i] * BR[i];
+      AR[i] = tr;
+   }
+   FFT(size, true, AR.get(), AI.get(), aR.get(), aI.get());
+
+   // Multiply by the chirp again
+   float denom = InverseTransform ? NumSamples : 1;
+   for (size_t k = 0; k < NumSamples; k++) {
+      RealOut[k] = (aR[k] * chirpR[k] - aI[k] * chirpI[k]) / denom;
+      ImagOut[k] = (aR[k] * chirpI[k] + aI[k] * chirpR[k]) / denom;
+   }
+}
+
 /*
  * Complex Fast Fourier Transform
  */
@@ -137,13 +200,23 @@ void FFT(size_t NumSamples,
    double angle_numerator = 2.0 * M_PI;
    double tr, ti;                /* temp real, temp imaginary */
 
-   if (!IsPowerOfTwo(NumSamples)) {
-      wxFprintf(stderr, "%ld is not a power of two\n", NumSamples);
+   if (NumSamples == 0) {
+      wxFprintf(stderr, "Error: FFT called with size %ld\n", NumSamples);
       exit(1);
    }
 
-   if (!gFFTBitTable)
-      InitFFT();
+   if (!IsPowerOfTwo(NumSamples)) {
+      ChirpFFT(NumSamples, InverseTransform,
+         RealIn, ImagIn, RealOut, ImagOut);
+      return;
+   }
+
+   {
+      // Spectra may be computed in several threads at once
+      std::lock_guard<std::mutex> guard(gFFTBitTableMutex);
+      if (!gFFTBitTable)
+         InitFFT();
+   }
 
    if (!InverseTransform)
       angle_numerator = -angle_numerator;
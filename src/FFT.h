@@ -60,7 +60,8 @@ class TranslatableString;
  * spectrum by doing a Real FFT and then computing the
  * sum of the squares of the real and imaginary parts.
  * Note that the output array is half the length of the
- * input array, and that NumSamples must be a power of two.
+ * input array, and that NumSamples must be even.  Powers of two are
+ * fastest.
  */
 
 void PowerSpectrum(size_t NumSamples, const float *In, float *Out);
@@ -69,7 +70,7 @@ void PowerSpectrum(size_t NumSamples, const float *In, float *Out);
  * Computes an FFT when the input data is real but you still
  * want complex data as output.  The output arrays are the
  * same length as the input, but will be conjugate-symmetric
- * NumSamples must be a power of two.
+ * NumSamples must be even.
  */
 
 SNEEDACITY_DLL_API
@@ -78,8 +79,7 @@ void RealFFT(size_t NumSamples,
 
 /*
  * Computes an Inverse FFT when the input data is conjugate symmetric
- * so the output is purely real.  NumSamples must be a power of
- * two.
+ * so the output is purely real.  NumSamples must be even.
  */
 SNEEDACITY_DLL_API
 void InverseRealFFT(size_t NumSamples,
@@ -88,7 +88,8 @@ void InverseRealFFT(size_t NumSamples,
 /*
  * Computes a FFT of complex input and returns complex output.
  * Currently this is the only function here that supports the
- * inverse transform as well.
+ * inverse transform as well.  NumSamples may be any size, but
+ * powers of two are fastest.
  */
 
 SNEEDACITY_DLL_API
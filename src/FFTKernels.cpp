@@ -0,0 +1,414 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file FFTKernels.cpp
+@brief Implements FFTKernels
+
+**********************************************************************/
+
+#include "FFTKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define FFT_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles intrinsics for any instruction set without options
+#define TARGET_AVX
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+namespace FFTKernels {
+
+namespace {
+
+/*
+ *  Butterfly:
+ *     Ain-----Aout
+ *         \ /
+ *         / \
+ *     Bin-----Bout
+ *
+ *  Each pass divides the buffer into groups of 2 * butterfliesPerGroup
+ *  complex values, and each group takes one twiddle factor (sin, cos) from
+ *  sinTable, in order.  These do the groups from A to end of one pass.
+ */
+
+void ScalarForwardGroups(fft_type *A, const fft_type *end,
+   const fft_type *sptr, size_t butterfliesPerGroup)
+{
+   fft_type *B = A + butterfliesPerGroup * 2;
+   while (A < end)
+   {
+      const fft_type sin = *sptr;
+      const fft_type cos = *(sptr + 1);
+      const fft_type *const endptr2 = B;
+      while (A < endptr2)
+      {
+         const fft_type v1 = *B * cos + *(B + 1) * sin;
+         const fft_type v2 = *B * sin - *(B + 1) * cos;
+         *B = (*A + v1);
+         *(A++) = *(B++) - 2 * v1;
+         *B = (*A - v2);
+         *(A++) = *(B++) + 2 * v2;
+      }
+      A = B;
+      B += butterfliesPerGroup * 2;
+      sptr += 2;
+   }
+}
+
+void ScalarInverseGroups(fft_type *A, const fft_type *end,
+   const fft_type *sptr, size_t butterfliesPerGroup)
+{
+   fft_type *B = A + butterfliesPerGroup * 2;
+   while (A < end)
+   {
+      const fft_type sin = *(sptr++);
+      const fft_type cos = *(sptr++);
+      const fft_type *const endptr2 = B;
+      while (A < endptr2)
+      {
+         const fft_type v1 = *B * cos - *(B + 1) * sin;
+         const fft_type v2 = *B * sin + *(B + 1) * cos;
+         *B = (*A + v1) * (fft_type)0.5;
+         *(A++) = *(B++) - v1;
+         *B = (*A + v2) * (fft_type)0.5;
+         *(A++) = *(B++) - v2;
+      }
+      A = B;
+      B += butterfliesPerGroup * 2;
+   }
+}
+
+void ScalarForward(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   const auto end = buffer + points * 2;
+   for (auto bpg = points / 2; bpg > 0; bpg >>= 1)
+      ScalarForwardGroups(buffer, end, sinTable, bpg);
+}
+
+void ScalarInverse(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   const auto end = buffer + points * 2;
+   for (auto bpg = points / 2; bpg > 0; bpg >>= 1)
+      ScalarInverseGroups(buffer, end, sinTable, bpg);
+}
+
+void ScalarMultiplyAdd(fft_type *sumReal, fft_type *sumImag,
+   const fft_type *xReal, const fft_type *xImag,
+   const fft_type *hReal, const fft_type *hImag, size_t count)
+{
+   for (size_t ii = 0; ii < count; ++ii) {
+      const fft_type real = xReal[ii] * hReal[ii] - xImag[ii] * hImag[ii];
+      const fft_type imag = xReal[ii] * hImag[ii] + xImag[ii] * hReal[ii];
+      sumReal[ii] += real;
+      sumImag[ii] += imag;
+   }
+}
+
+#ifdef FFT_KERNELS_X86
+
+// The vectors hold (real, imaginary) pairs of B.  With b the pairs
+// swapped, and v1, v2 as in the scalar code:
+//    forward: B * cos + (b * sin with imaginary parts negated) = (v1, -v2)
+//    inverse: B * cos + (b * sin with real parts negated) = (v1, v2)
+// Negation is exact, and x + -y == x - y, so this rounds like the scalar.
+
+inline __m128 Twiddle(__m128 b, __m128 sin, __m128 cos, __m128 signs)
+{
+   const __m128 swapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+   return _mm_add_ps(_mm_mul_ps(b, cos),
+      _mm_xor_ps(_mm_mul_ps(swapped, sin), signs));
+}
+
+//! Stores the outputs of butterflies in a and b
+inline void ForwardButterflies(__m128 &a, __m128 &b,
+   __m128 sin, __m128 cos, __m128 signs)
+{
+   const __m128 v = Twiddle(b, sin, cos, signs);
+   b = _mm_add_ps(a, v);
+   a = _mm_sub_ps(b, _mm_add_ps(v, v));
+}
+
+inline void InverseButterflies(__m128 &a, __m128 &b,
+   __m128 sin, __m128 cos, __m128 signs)
+{
+   const __m128 v = Twiddle(b, sin, cos, signs);
+   b = _mm_mul_ps(_mm_add_ps(a, v), _mm_set1_ps(0.5f));
+   a = _mm_sub_ps(b, v);
+}
+
+inline __m128 ImaginarySigns()
+{
+   // _mm_set_epi32 takes the highest lane first
+   return _mm_castsi128_ps(_mm_set_epi32(
+      int(0x80000000), 0, int(0x80000000), 0));
+}
+
+inline __m128 RealSigns()
+{
+   return _mm_castsi128_ps(_mm_set_epi32(
+      0, int(0x80000000), 0, int(0x80000000)));
+}
+
+//! A pass with at least two butterflies in each group
+template< bool Inverse >
+void SSE2Groups(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t butterfliesPerGroup)
+{
+   const __m128 signs = Inverse ? RealSigns() : ImaginarySigns();
+   const auto half = butterfliesPerGroup * 2;
+   for (auto A = buffer; A < end; A += 2 * half, sptr += 2) {
+      const __m128 sin = _mm_set1_ps(sptr[0]), cos = _mm_set1_ps(sptr[1]);
+      const auto B = A + half;
+      for (size_t ii = 0; ii < half; ii += 4) {
+         __m128 a = _mm_loadu_ps(A + ii), b = _mm_loadu_ps(B + ii);
+         if (Inverse)
+            InverseButterflies(a, b, sin, cos, signs);
+         else
+            ForwardButterflies(a, b, sin, cos, signs);
+         _mm_storeu_ps(A + ii, a);
+         _mm_storeu_ps(B + ii, b);
+      }
+   }
+}
+
+//! The last pass, with one butterfly in each group, two groups at a time
+template< bool Inverse >
+void SSE2LastPass(fft_type *buffer, const fft_type *end,
+   const fft_type *sinTable)
+{
+   const __m128 signs = Inverse ? RealSigns() : ImaginarySigns();
+   auto A = buffer;
+   auto sptr = sinTable;
+   for (; A + 8 <= end; A += 8, sptr += 4) {
+      const __m128 x = _mm_loadu_ps(A), y = _mm_loadu_ps(A + 4);
+      // sin and cos of the two groups
+      const __m128 t = _mm_loadu_ps(sptr);
+      const __m128 sin = _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 0, 0));
+      const __m128 cos = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 1, 1));
+      __m128 a = _mm_movelh_ps(x, y);
+      __m128 b = _mm_movehl_ps(y, x);
+      if (Inverse)
+         InverseButterflies(a, b, sin, cos, signs);
+      else
+         ForwardButterflies(a, b, sin, cos, signs);
+      _mm_storeu_ps(A, _mm_movelh_ps(a, b));
+      _mm_storeu_ps(A + 4, _mm_movehl_ps(b, a));
+   }
+   // An odd group is left only when points is 2
+   if (A < end) {
+      if (Inverse)
+         ScalarInverseGroups(A, end, sptr, 1);
+      else
+         ScalarForwardGroups(A, end, sptr, 1);
+   }
+}
+
+template< bool Inverse >
+void SSE2Passes(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   const auto end = buffer + points * 2;
+   auto bpg = points / 2;
+   for (; bpg >= 2; bpg >>= 1)
+      SSE2Groups<Inverse>(buffer, end, sinTable, bpg);
+   if (bpg == 1)
+      SSE2LastPass<Inverse>(buffer, end, sinTable);
+}
+
+void SSE2Forward(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   SSE2Passes<false>(buffer, sinTable, points);
+}
+
+void SSE2Inverse(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   SSE2Passes<true>(buffer, sinTable, points);
+}
+
+void SSE2MultiplyAdd(fft_type *sumReal, fft_type *sumImag,
+   const fft_type *xReal, const fft_type *xImag,
+   const fft_type *hReal, const fft_type *hImag, size_t count)
+{
+   size_t ii = 0;
+   for (; ii + 4 <= count; ii += 4) {
+      const __m128 xr = _mm_loadu_ps(xReal + ii);
+      const __m128 xi = _mm_loadu_ps(xImag + ii);
+      const __m128 hr = _mm_loadu_ps(hReal + ii);
+      const __m128 hi = _mm_loadu_ps(hImag + ii);
+      const __m128 real =
+         _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+      const __m128 imag =
+         _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+      _mm_storeu_ps(sumReal + ii,
+         _mm_add_ps(_mm_loadu_ps(sumReal + ii), real));
+      _mm_storeu_ps(sumImag + ii,
+         _mm_add_ps(_mm_loadu_ps(sumImag + ii), imag));
+   }
+   ScalarMultiplyAdd(sumReal + ii, sumImag + ii, xReal + ii, xImag + ii,
+      hReal + ii, hImag + ii, count - ii);
+}
+
+//! A pass with at least four butterflies in each group
+/*! The same arithmetic as SSE2Groups(), in eight lanes */
+template< bool Inverse >
+TARGET_AVX void AVXGroups(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t butterfliesPerGroup)
+{
+   const __m256i mask = Inverse
+      ? _mm256_setr_epi32(int(0x80000000), 0, int(0x80000000), 0,
+         int(0x80000000), 0, int(0x80000000), 0)
+      : _mm256_setr_epi32(0, int(0x80000000), 0, int(0x80000000),
+         0, int(0x80000000), 0, int(0x80000000));
+   const __m256 signs = _mm256_castsi256_ps(mask);
+   const __m256 oneHalf = _mm256_set1_ps(0.5f);
+   const auto half = butterfliesPerGroup * 2;
+   for (auto A = buffer; A < end; A += 2 * half, sptr += 2) {
+      const __m256 sin = _mm256_set1_ps(sptr[0]);
+      const __m256 cos = _mm256_set1_ps(sptr[1]);
+      const auto B = A + half;
+      for (size_t ii = 0; ii < half; ii += 8) {
+         const __m256 a = _mm256_loadu_ps(A + ii);
+         const __m256 b = _mm256_loadu_ps(B + ii);
+         const __m256 swapped = _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1));
+         const __m256 v = _mm256_add_ps(_mm256_mul_ps(b, cos),
+            _mm256_xor_ps(_mm256_mul_ps(swapped, sin), signs));
+         if (Inverse) {
+            const __m256 newB = _mm256_mul_ps(_mm256_add_ps(a, v), oneHalf);
+            _mm256_storeu_ps(B + ii, newB);
+            _mm256_storeu_ps(A + ii, _mm256_sub_ps(newB, v));
+         }
+         else {
+            const __m256 newB = _mm256_add_ps(a, v);
+            _mm256_storeu_ps(B + ii, newB);
+            _mm256_storeu_ps(A + ii, _mm256_sub_ps(newB, _mm256_add_ps(v, v)));
+         }
+      }
+   }
+}
+
+template< bool Inverse >
+void AVXPasses(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   const auto end = buffer + points * 2;
+   auto bpg = points / 2;
+   for (; bpg >= 4; bpg >>= 1)
+      AVXGroups<Inverse>(buffer, end, sinTable, bpg);
+   // Groups too short for eight lanes
+   if (bpg == 2) {
+      SSE2Groups<Inverse>(buffer, end, sinTable, bpg);
+      bpg = 1;
+   }
+   if (bpg == 1)
+      SSE2LastPass<Inverse>(buffer, end, sinTable);
+}
+
+void AVXForward(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   AVXPasses<false>(buffer, sinTable, points);
+}
+
+void AVXInverse(fft_type *buffer, const fft_type *sinTable, size_t points)
+{
+   AVXPasses<true>(buffer, sinTable, points);
+}
+
+TARGET_AVX void AVXMultiplyAdd(fft_type *sumReal, fft_type *sumImag,
+   const fft_type *xReal, const fft_type *xImag,
+   const fft_type *hReal, const fft_type *hImag, size_t count)
+{
+   size_t ii = 0;
+   for (; ii + 8 <= count; ii += 8) {
+      const __m256 xr = _mm256_loadu_ps(xReal + ii);
+      const __m256 xi = _mm256_loadu_ps(xImag + ii);
+      const __m256 hr = _mm256_loadu_ps(hReal + ii);
+      const __m256 hi = _mm256_loadu_ps(hImag + ii);
+      const __m256 real =
+         _mm256_sub_ps(_mm256_mul_ps(xr, hr), _mm256_mul_ps(xi, hi));
+      const __m256 imag =
+         _mm256_add_ps(_mm256_mul_ps(xr, hi), _mm256_mul_ps(xi, hr));
+      _mm256_storeu_ps(sumReal + ii,
+         _mm256_add_ps(_mm256_loadu_ps(sumReal + ii), real));
+      _mm256_storeu_ps(sumImag + ii,
+         _mm256_add_ps(_mm256_loadu_ps(sumImag + ii), imag));
+   }
+   SSE2MultiplyAdd(sumReal + ii, sumImag + ii, xReal + ii, xImag + ii,
+      hReal + ii, hImag + ii, count - ii);
+}
+
+bool HaveAVX()
+{
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 1);
+   // The OS must save the AVX registers too
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   if (!osxsave || (_xgetbv(0) & 6) != 6)
+      return false;
+   return (info[2] & (1 << 28)) != 0;
+#else
+   return __builtin_cpu_supports("avx");
+#endif
+}
+
+bool HaveSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+   // Always present in 64 bit processors
+   return true;
+#elif defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 1);
+   return (info[3] & (1 << 26)) != 0;
+#else
+   return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+const Kernels scalarKernels{
+   Kind::Scalar, "scalar", ScalarForward, ScalarInverse, ScalarMultiplyAdd };
+
+#ifdef FFT_KERNELS_X86
+const Kernels sse2Kernels{
+   Kind::SSE2, "SSE2", SSE2Forward, SSE2Inverse, SSE2MultiplyAdd };
+const Kernels avxKernels{
+   Kind::AVX, "AVX", AVXForward, AVXInverse, AVXMultiplyAdd };
+#endif
+
+}
+
+const Kernels *GetKernels(Kind kind)
+{
+   switch (kind) {
+#ifdef FFT_KERNELS_X86
+   case Kind::AVX:
+      return HaveAVX() ? &avxKernels : nullptr;
+   case Kind::SSE2:
+      return HaveSSE2() ? &sse2Kernels : nullptr;
+#endif
+   case Kind::Scalar:
+      return &scalarKernels;
+   default:
+      return nullptr;
+   }
+}
+
+const Kernels &GetBestKernels()
+{
+   static const Kernels &best = []() -> const Kernels & {
+      for (auto kind : { Kind::AVX, Kind::SSE2 })
+         if (auto pKernels = GetKernels(kind))
+            return *pKernels;
+      return scalarKernels;
+   }();
+   return best;
+}
+
+}
@@ -0,0 +1,56 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file FFTKernels.h
+@brief Scalar and SIMD butterfly passes of RealFFTf() and InverseRealFFTf()
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_FFT_KERNELS__
+#define __SNEEDACITY_FFT_KERNELS__
+
+#include <cstddef>
+
+#include "RealFFTf.h"
+
+//! The radix-2 butterfly passes of the real FFT, and the products of spectra
+//! that fast convolution sums, with runtime dispatch
+/*! The butterflies are the O(N log N) part of the transform; the reordering
+ for real data that follows or precedes them stays scalar.
+
+ The vector variants do the same multiplications and additions as the
+ scalar one, in the same order and without fused multiply-add, so every
+ variant gives bit-for-bit the same results, whichever one the CPU supports.
+ */
+namespace FFTKernels {
+
+enum class Kind { Scalar, SSE2, AVX };
+
+struct Kernels
+{
+   Kind kind;
+   const char *name;
+
+   //! All butterfly passes of RealFFTf(), in place on points complex values
+   void (*forward)(fft_type *buffer, const fft_type *sinTable, size_t points);
+
+   //! All butterfly passes of InverseRealFFTf()
+   void (*inverse)(fft_type *buffer, const fft_type *sinTable, size_t points);
+
+   //! Add the complex products x[i] * h[i] to sum[i], for i < count
+   /*! Real and imaginary parts are in separate arrays */
+   void (*multiplyAdd)(fft_type *sumReal, fft_type *sumImag,
+      const fft_type *xReal, const fft_type *xImag,
+      const fft_type *hReal, const fft_type *hImag, size_t count);
+};
+
+//! @return null if the CPU does not support the kind
+SNEEDACITY_DLL_API const Kernels *GetKernels(Kind kind);
+
+//! The fastest variant the CPU supports, chosen once
+SNEEDACITY_DLL_API const Kernels &GetBestKernels();
+
+}
+
+#endif
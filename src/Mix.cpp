@@ -34,6 +34,7 @@
 #include "WaveTrack.h"
 #include "Prefs.h"
 #include "Resample.h"
+#include "ThreadPool.h"
 #include "TimeTrack.h"
 #include "float_cast.h"
 
@@ -235,6 +236,8 @@ Mixer::WarpOptions::WarpOptions(double min, double max)
    }
 }
 
+BoolSetting Mixer::ParallelMixing{ L"/Performance/ParallelMixing", true };
+
 Mixer::Mixer(const WaveTrackConstArray &inputTracks,
              bool mayThrow,
              const WarpOptions &warpOptions,
@@ -298,8 +301,17 @@ Mixer::Mixer(const WaveTrackConstArray &inputTracks,
       mBuffer[c].Allocate(mInterleavedBufferSize, mFormat);
       mTemp[c].Allocate(mInterleavedBufferSize, floatSample);
    }
+   // Tracks may be fetched, resampled and enveloped concurrently, each in
+   // its own scratch space
+   size_t nSlots = 1;
+   if (mNumInputTracks > 1 && ParallelMixing.Read())
+      nSlots = std::min(mNumInputTracks, ThreadPool::Get().GetThreadCount() + 1);
+   mFloatBuffers.resize(nSlots);
+   mEnvValues.resize(nSlots);
+   mOutLens.resize(nSlots);
    // PRL:  Bug2536: see other comments below
-   mFloatBuffer = Floats{ mInterleavedBufferSize + 1 };
+   for (auto &buffer : mFloatBuffers)
+      buffer = Floats{ mInterleavedBufferSize + 1 };
 
    // But cut the queue into blocks of this finer size
    // for variable rate resampling.  Each block is resampled at some
@@ -341,7 +353,8 @@ Mixer::Mixer(const WaveTrackConstArray &inputTracks,
    MakeResamplers();
 
    const auto envLen = std::max(mQueueMaxLen, mInterleavedBufferSize);
-   mEnvValues.reinit(envLen);
+   for (auto &values : mEnvValues)
+      values.reinit(envLen);
 }
 
 Mixer::~Mixer()
@@ -410,10 +423,11 @@ double ComputeWarpFactor(const Envelope &env, double t0, double t1)
 
 }
 
-size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
+size_t Mixer::MixVariableRates(WaveTrackCache &cache,
                                     sampleCount *pos, float *queue,
                                     int *queueStart, int *queueLen,
-                                    Resample * pResample)
+                                    Resample * pResample,
+                                    float *floatBuffer, double *envValues)
 {
    const WaveTrack *const track = cache.GetTrack().get();
    const double trackRate = track->GetRate();
@@ -467,7 +481,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
+               track->GetEnvelopeValues(envValues,
                                         getLen,
                                         (*pos - (getLen- 1)).as_double() / trackRate);
                *pos -= getLen;
@@ -479,7 +493,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
+               track->GetEnvelopeValues(envValues,
                                         getLen,
                                         (*pos).as_double() / trackRate);
 
@@ -487,7 +501,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
             }
 
             for (decltype(getLen) i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
+               queue[(*queueLen) + i] *= envValues[i];
             }
 
             if (backwards)
@@ -525,13 +539,13 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
          thisProcessLen,
          last,
          // PRL:  Bug2536: crash in soxr happened on Mac, sometimes, when
-         // mMaxOut - out == 1 and &mFloatBuffer[out + 1] was an unmapped
+         // mMaxOut - out == 1 and &floatBuffer[out + 1] was an unmapped
          // address, because soxr, strangely, fetched an 8-byte (misaligned!)
-         // value from &mFloatBuffer[out], but did nothing with it anyway,
+         // value from &floatBuffer[out], but did nothing with it anyway,
          // in soxr_output_no_callback.
          // Now we make the bug go away by allocating a little more space in
          // the buffer than we need.
-         &mFloatBuffer[out],
+         &floatBuffer[out],
          mMaxOut - out);
 
       const auto input_used = results.first;
@@ -545,28 +559,11 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
       }
    }
 
-   for (size_t c = 0; c < mNumChannels; c++) {
-      if (mApplyTrackGains) {
-         mGains[c] = track->GetChannelGain(c);
-      }
-      else {
-         mGains[c] = 1.0;
-      }
-   }
-
-   MixBuffers(mNumChannels,
-              channelFlags,
-              mGains.get(),
-              (samplePtr)mFloatBuffer.get(),
-              mTemp.get(),
-              out,
-              mInterleaved);
-
    return out;
 }
 
-size_t Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
-                               sampleCount *pos)
+size_t Mixer::MixSameRate(WaveTrackCache &cache, sampleCount *pos,
+                          float *floatBuffer, double *envValues)
 {
    const WaveTrack *const track = cache.GetTrack().get();
    const double t = ( *pos ).as_double() / track->GetRate();
@@ -592,41 +589,45 @@ size_t Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
    if (backwards) {
       auto results = cache.GetFloats(*pos - (slen - 1), slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t - (slen - 1) / mRate);
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t - (slen - 1) / mRate);
       for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
-      ReverseSamples((samplePtr)mFloatBuffer.get(), floatSample, 0, slen);
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
+      ReverseSamples((samplePtr)floatBuffer, floatSample, 0, slen);
 
       *pos -= slen;
    }
    else {
       auto results = cache.GetFloats(*pos, slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t);
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t);
       for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
 
       *pos += slen;
    }
 
-   for(size_t c=0; c<mNumChannels; c++)
-      if (mApplyTrackGains)
-         mGains[c] = track->GetChannelGain(c);
-      else
-         mGains[c] = 1.0;
-
-   MixBuffers(mNumChannels, channelFlags, mGains.get(),
-              (samplePtr)mFloatBuffer.get(), mTemp.get(), slen, mInterleaved);
-
    return slen;
 }
 
+size_t Mixer::RenderTrack(size_t i, float *floatBuffer, double *envValues)
+{
+   const WaveTrack *const track = mInputTrack[i].GetTrack().get();
+   if (mbVariableRates || track->GetRate() != mRate)
+      return MixVariableRates(mInputTrack[i],
+         &mSamplePos[i], mSampleQueue[i].get(),
+         &mQueueStart[i], &mQueueLen[i], mResample[i].get(),
+         floatBuffer, envValues);
+   else
+      return MixSameRate(mInputTrack[i], &mSamplePos[i],
+         floatBuffer, envValues);
+}
+
 size_t Mixer::Process(size_t maxToProcess)
 {
    // MB: this is wrong! mT represented warped time, and mTime is too inaccurate to use
@@ -640,50 +641,69 @@ size_t Mixer::Process(size_t maxToProcess)
    mMaxOut = maxToProcess;
 
    Clear();
-   for(size_t i=0; i<mNumInputTracks; i++) {
-      const WaveTrack *const track = mInputTrack[i].GetTrack().get();
-      for(size_t j=0; j<mNumChannels; j++)
-         channelFlags[j] = 0;
-
-      if( mMixerSpec ) {
-         //ignore left and right when downmixing is not required
-         for(size_t j = 0; j < mNumChannels; j++ )
-            channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
-      }
-      else {
-         switch(track->GetChannel()) {
-         case Track::MonoChannel:
-         default:
-            for(size_t j=0; j<mNumChannels; j++)
-               channelFlags[j] = 1;
-            break;
-         case Track::LeftChannel:
-            channelFlags[0] = 1;
-            break;
-         case Track::RightChannel:
-            if (mNumChannels >= 2)
-               channelFlags[1] = 1;
-            else
+   // Render up to one track for each slot at once, then add them up in track
+   // order, so that the sums are the same as when rendering one at a time
+   const auto nSlots = mFloatBuffers.size();
+   for(size_t first = 0; first < mNumInputTracks; first += nSlots) {
+      const auto count = std::min(nSlots, mNumInputTracks - first);
+      const auto render = [&](size_t slot) {
+         mOutLens[slot] = RenderTrack(first + slot,
+            mFloatBuffers[slot].get(), mEnvValues[slot].get());
+      };
+      if (count > 1)
+         ThreadPool::Get().ParallelFor(count, render);
+      else
+         render(0);
+
+      for(size_t slot = 0; slot < count; slot++) {
+         const auto i = first + slot;
+         const WaveTrack *const track = mInputTrack[i].GetTrack().get();
+         for(size_t j=0; j<mNumChannels; j++)
+            channelFlags[j] = 0;
+
+         if( mMixerSpec ) {
+            //ignore left and right when downmixing is not required
+            for(size_t j = 0; j < mNumChannels; j++ )
+               channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+         }
+         else {
+            switch(track->GetChannel()) {
+            case Track::MonoChannel:
+            default:
+               for(size_t j=0; j<mNumChannels; j++)
+                  channelFlags[j] = 1;
+               break;
+            case Track::LeftChannel:
                channelFlags[0] = 1;
-            break;
+               break;
+            case Track::RightChannel:
+               if (mNumChannels >= 2)
+                  channelFlags[1] = 1;
+               else
+                  channelFlags[0] = 1;
+               break;
+            }
          }
-      }
-      if (mbVariableRates || track->GetRate() != mRate)
-         maxOut = std::max(maxOut,
-            MixVariableRates(channelFlags.get(), mInputTrack[i],
-               &mSamplePos[i], mSampleQueue[i].get(),
-               &mQueueStart[i], &mQueueLen[i], mResample[i].get()));
-      else
-         maxOut = std::max(maxOut,
-            MixSameRate(channelFlags.get(), mInputTrack[i], &mSamplePos[i]));
 
-      double t = mSamplePos[i].as_double() / (double)track->GetRate();
-      if (mT0 > mT1)
-         // backwards (as possibly in scrubbing)
-         mTime = std::max(std::min(t, mTime), mT1);
-      else
-         // forwards (the usual)
-         mTime = std::min(std::max(t, mTime), mT1);
+         for(size_t c=0; c<mNumChannels; c++)
+            if (mApplyTrackGains)
+               mGains[c] = track->GetChannelGain(c);
+            else
+               mGains[c] = 1.0;
+
+         const auto out = mOutLens[slot];
+         MixBuffers(mNumChannels, channelFlags.get(), mGains.get(),
+            (samplePtr)mFloatBuffers[slot].get(), mTemp.get(), out, mInterleaved);
+         maxOut = std::max(maxOut, out);
+
+         double t = mSamplePos[i].as_double() / (double)track->GetRate();
+         if (mT0 > mT1)
+            // backwards (as possibly in scrubbing)
+            mTime = std::max(std::min(t, mTime), mT1);
+         else
+            // forwards (the usual)
+            mTime = std::min(std::max(t, mTime), mT1);
+      }
    }
    if(mInterleaved) {
       for(size_t c=0; c<mNumChannels; c++) {
@@ -23,6 +23,7 @@
 #include "SampleFormat.h"
 #include <vector>
 
+class BoolSetting;
 class Resample;
 class BoundedEnvelope;
 class WaveTrackFactory;
@@ -78,6 +79,10 @@ public:
 class SNEEDACITY_DLL_API Mixer {
  public:
 
+   //! Whether to render the input tracks on the shared ThreadPool
+   /*! Results are the same either way; this only trades memory for speed */
+   static BoolSetting ParallelMixing;
+
     // An argument to Mixer's constructor
     class SNEEDACITY_DLL_API WarpOptions
     {
@@ -147,13 +152,19 @@ class SNEEDACITY_DLL_API Mixer {
  private:
 
    void Clear();
-   size_t MixSameRate(int *channelFlags, WaveTrackCache &cache,
-                           sampleCount *pos);
+   size_t MixSameRate(WaveTrackCache &cache, sampleCount *pos,
+                      float *floatBuffer, double *envValues);
 
-   size_t MixVariableRates(int *channelFlags, WaveTrackCache &cache,
+   size_t MixVariableRates(WaveTrackCache &cache,
                                 sampleCount *pos, float *queue,
                                 int *queueStart, int *queueLen,
-                                Resample * pResample);
+                                Resample * pResample,
+                                float *floatBuffer, double *envValues);
+
+   //! Fetch, resample and apply the envelope to one input track, without
+   //! touching any state of other tracks, so tracks can render in parallel
+   /*! @return number of samples put into floatBuffer */
+   size_t RenderTrack(size_t i, float *floatBuffer, double *envValues);
 
    void MakeResamplers();
 
@@ -166,7 +177,8 @@ class SNEEDACITY_DLL_API Mixer {
    const BoundedEnvelope *mEnvelope;
    ArrayOf<sampleCount> mSamplePos;
    const bool       mApplyTrackGains;
-   Doubles          mEnvValues;
+   //! Scratch space for each track rendered at once
+   std::vector<Doubles> mEnvValues;
    double           mT0; // Start time
    double           mT1; // Stop time (none if mT0==mT1)
    double           mTime;  // Current time (renamed from mT to mTime for consistency with AudioIO - mT represented warped time there)
@@ -188,7 +200,8 @@ class SNEEDACITY_DLL_API Mixer {
    const sampleFormat mFormat;
    bool             mInterleaved;
    ArrayOf<SampleBuffer> mBuffer, mTemp;
-   Floats           mFloatBuffer;
+   std::vector<Floats> mFloatBuffers;
+   std::vector<size_t> mOutLens;
    const double     mRate;
    double           mSpeed;
    bool             mHighQuality;
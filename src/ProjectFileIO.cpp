@@ -35,11 +35,10 @@ Paul Licameli split from SneedacityProject.cpp
 #include "widgets/NumericTextCtrl.h"
 #include "widgets/ProgressDialog.h"
 #include "wxFileNameWrapper.h"
-#include "xml/XMLFileReader.h"
 
 // Don't change this unless the file format changes
 // in an irrevocable way
-#define SNEEDACITY_FILE_FORMAT_VERSION "1.3.0"
+#define SNEEDACITY_FILE_FORMAT_VERSION "1.3.1"
 
 #undef NO_SHM
 #if !defined(__WXMSW__)
@@ -793,6 +792,10 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
    if (!pConn)
       return false;
 
+   // Copy committed blocks only, and ATTACH can't happen inside a transaction
+   if (!pConn->FlushBatch())
+      return false;
+
    // Get access to the active tracklist
    auto pProject = &mProject;
 
@@ -1748,6 +1751,14 @@ bool ProjectFileIO::WriteDoc(const char *table,
    auto db = DB();
    int rc;
 
+   // The document may refer to sample blocks still in a batch of writes;
+   // they must be durable first, so a crash can't leave the document
+   // without its blocks
+   if (!GetConnection().FlushBatch())
+   {
+      return false;
+   }
+
    // For now, we always use an ID of 1. This will replace the previously
    // written row every time.
    char sql[256];
@@ -1823,7 +1834,6 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
       return false;
    }
 
-   wxString project;
    wxMemoryBuffer buffer;
    bool usedAutosave = true;
 
@@ -1856,25 +1866,19 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
    }
    else
    {
-      project = ProjectSerializer::Decode(buffer);
-      if (project.empty())
+      // Load 'er up, straight from the binary document to the handlers
+      switch (ProjectSerializer::Decode(buffer, *this))
       {
+      case ProjectSerializer::DecodeResult::Corrupt:
          SetError(XO("Unable to decode project document"));
-
          return false;
-      }
-
-      XMLFileReader xmlFile;
 
-      // Load 'er up
-      success = xmlFile.ParseString(this, project);
-      if (!success)
-      {
-         SetError(
-            XO("Unable to parse project information."),
-            xmlFile.GetErrorStr()
-         );
+      case ProjectSerializer::DecodeResult::Rejected:
+         SetError(XO("Unable to parse project information."));
          return false;
+
+      default:
+         break;
       }
 
       // Check for orphans blocks...sets mRecovered if any were deleted
@@ -10,6 +10,10 @@ Paul Licameli split from SneedacityProject.cpp
 
 #include "ProjectFileManager.h"
 
+#include <atomic>
+#include <chrono>
+#include <future>
+
 #include <wx/crt.h> // for wxPrintf
 
 #if defined(__WXGTK__)
@@ -20,6 +24,7 @@ Paul Licameli split from SneedacityProject.cpp
 #include "CodeConversions.h"
 #include "Legacy.h"
 #include "PlatformCompatibility.h"
+#include "Prefs.h"
 #include "Project.h"
 #include "ProjectFileIO.h"
 #include "ProjectFSCK.h"
@@ -32,6 +37,7 @@ Paul Licameli split from SneedacityProject.cpp
 #include "SelectionState.h"
 #include "Tags.h"
 #include "TempDirectory.h"
+#include "ThreadPool.h"
 #include "TrackPanelAx.h"
 #include "TrackPanel.h"
 #include "UndoManager.h"
@@ -40,10 +46,12 @@ Paul Licameli split from SneedacityProject.cpp
 #include "export/Export.h"
 #include "import/Import.h"
 #include "import/ImportMIDI.h"
+#include "import/ImportPlugin.h"
 #include "toolbars/SelectionBar.h"
 #include "widgets/SneedacityMessageBox.h"
 #include "widgets/ErrorDialog.h"
 #include "widgets/FileHistory.h"
+#include "widgets/ProgressDialog.h"
 #include "widgets/Warning.h"
 #include "xml/XMLFileReader.h"
 
@@ -1320,6 +1328,151 @@ bool ProjectFileManager::Import(
    return true;
 }
 
+BoolSetting ProjectFileManager::ParallelImport{
+   L"/Performance/ParallelImport", true };
+
+namespace {
+// Import() treats these specially, so ImportFiles() leaves them to it
+bool ImportsAlone(const FilePath &fileName)
+{
+   const auto extension = fileName.AfterLast('.');
+   return extension.IsSameAs(wxT("lof"), false)
+      || extension.IsSameAs(wxT("aup"), false)
+      || extension.IsSameAs(wxT("aup3"), false)
+#ifdef USE_MIDI
+      || FileNames::IsMidi(fileName)
+#endif
+      ;
+}
+}
+
+void ProjectFileManager::ImportFiles(
+   const FilePaths &fileNames, bool addToHistory)
+{
+   auto &project = mProject;
+   const auto nThreads = std::min(
+      fileNames.size(), ThreadPool::Get().GetThreadCount());
+
+   if (fileNames.size() < 2 || nThreads == 0 || !ParallelImport.Read()) {
+      for (const auto &fileName : fileNames)
+         Import(fileName, addToHistory);
+      return;
+   }
+
+   struct Job {
+      std::unique_ptr<ImportFileHandle> handle;
+      std::shared_ptr<Tags> tags;
+      TrackHolders tracks;
+      ProgressResult result{ ProgressResult::Failed };
+      std::atomic<int> permille{ 0 };
+      std::future<void> done;
+      bool cancelled{ false };
+   };
+   std::vector<Job> jobs(fileNames.size());
+   std::atomic<ProgressResult> stop{ ProgressResult::Success };
+
+   auto cleanup = valueRestorer( project.mbBusyImporting, true );
+
+   // Open the files and ask about their streams here, because plugins may
+   // consult preferences or show dialogs when opening
+   size_t nOpened = 0;
+   for (size_t ii = 0; ii < jobs.size(); ++ii) {
+      auto &job = jobs[ii];
+      if (ImportsAlone(fileNames[ii]))
+         continue;
+      job.handle = Importer::Get()
+         .OpenForBatch(project, fileNames[ii], job.cancelled);
+      if (!job.handle)
+         continue;
+
+      // Collect only the tags this file sets, to merge later in file order;
+      // so an importer that clears tags clears only its own
+      job.tags = std::make_shared<Tags>();
+      job.tags->Clear();
+
+      // Importers that may show message boxes import later, in this thread,
+      // with progress dialogs of their own
+      if (!job.handle->CanImportInParallel())
+         continue;
+      ++nOpened;
+
+      job.handle->SetProgressReporter([&job, &stop](int permille){
+         job.permille = permille;
+         return stop.load();
+      });
+   }
+
+   if (nOpened > 0) {
+      // A pool of our own, because the importers append with the shared one
+      ThreadPool pool{ std::min(nThreads, nOpened) };
+      auto &trackFactory = WaveTrackFactory::Get( project );
+      for (auto &job : jobs)
+         if (job.handle && job.handle->CanImportInParallel())
+            job.done = pool.Submit([&]{
+               if ((job.result = stop) == ProgressResult::Success)
+                  job.result = job.handle->Import(
+                     &trackFactory, job.tracks, job.tags.get());
+            });
+
+      // Only this thread may update the dialog; wait for all the jobs, which
+      // use these local variables, before rethrowing any exception
+      ProgressDialog progress( XO("Import"), XO("Importing files") );
+      for (auto &job : jobs)
+         while (job.done.valid() &&
+                job.done.wait_for(std::chrono::milliseconds(100)) ==
+                   std::future_status::timeout) {
+            int total = 0;
+            for (auto &other : jobs)
+               if (other.done.valid())
+                  total += other.permille;
+            auto result = progress.Update(total, int(nOpened * 1000));
+            if (result != ProgressResult::Success)
+               stop = result;
+         }
+   }
+
+   // Add the tracks in file order, as if imported one after another
+   for (size_t ii = 0; ii < jobs.size(); ++ii) {
+      auto &job = jobs[ii];
+      const auto &fileName = fileNames[ii];
+      if (job.cancelled)
+         continue;
+      if (!job.handle) {
+         // Let Import() try again, and report what is wrong
+         Import(fileName, addToHistory);
+         continue;
+      }
+
+      if (job.done.valid())
+         job.done.get();
+      else if ((job.result = stop) == ProgressResult::Success)
+         job.result = job.handle->Import(
+            &WaveTrackFactory::Get( project ), job.tracks, job.tags.get());
+      job.handle.reset();
+
+      if (job.result == ProgressResult::Cancelled ||
+          job.result == ProgressResult::Failed)
+         continue;
+      if (!Importer::CleanUpTracks(job.tracks)) {
+         // Import() would try other plugins
+         if (stop == ProgressResult::Success)
+            Import(fileName, addToHistory);
+         continue;
+      }
+
+      auto newTags = Tags::Get( project ).Duplicate();
+      newTags->Merge( *job.tags );
+      Tags::Set( project, newTags );
+
+      if (addToHistory) {
+         FileHistory::Global().Append(fileName);
+      }
+
+      // PRL: Undo history is incremented inside this:
+      AddImportedTracks(fileName, std::move(job.tracks));
+   }
+}
+
 #include "Clipboard.h"
 #include "ShuttleGui.h"
 #include "widgets/HelpSystem.h"
@@ -20,6 +20,7 @@ Paul Licameli split from SneedacityProject.h
 
 class wxString;
 class wxFileName;
+class BoolSetting;
 class SneedacityProject;
 class Track;
 class TrackList;
@@ -98,6 +99,16 @@ public:
    bool Import(const FilePath &fileName,
                bool addToHistory = true);
 
+   //! Import the files as Import() would, one after another, but decode
+   //! some at once in worker threads, if ParallelImport is set
+   /*! The tracks of each file are added, and the undo history pushed, in the
+    order of fileNames.  One progress dialog shows all the decoding. */
+   void ImportFiles(const FilePaths &fileNames,
+               bool addToHistory = true);
+
+   //! Whether ImportFiles() may decode several files at once
+   static BoolSetting ParallelImport;
+
    void Compact();
 
    void AddImportedTracks(const FilePath &fileName,
@@ -328,14 +328,23 @@ public:
             ProjectWindow::Get( *mProject ).HandleResize(); // Adjust scrollers for NEW track sizes.
          } );
 
+         // Import runs of audio files together, in between MIDI files
+         FilePaths names;
+         auto importNames = [&]{
+            ProjectFileManager::Get( *mProject ).ImportFiles(names);
+            names.clear();
+         };
          for (const auto &name : sortednames) {
 #ifdef USE_MIDI
-            if (FileNames::IsMidi(name))
+            if (FileNames::IsMidi(name)) {
+               importNames();
                DoImportMIDI( *mProject, name );
+            }
             else
 #endif
-               ProjectFileManager::Get( *mProject ).Import(name);
+               names.push_back(name);
          }
+         importNames();
 
          auto &window = ProjectWindow::Get( *mProject );
          window.ZoomAfterImport(nullptr);
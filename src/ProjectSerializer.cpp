@@ -18,10 +18,14 @@
 #include "ProjectSerializer.h"
 
 #include <algorithm>
+#include <charconv>
 #include <cstdint>
 #include <mutex>
+#include <vector>
 #include <wx/ustring.h>
 
+#include "Internat.h"
+
 ///
 /// ProjectSerializer class
 ///
@@ -333,6 +337,11 @@ void ProjectSerializer::WriteSubTree(const ProjectSerializer & value)
    mBuffer.AppendByte(FT_Pop);
 }
 
+void ProjectSerializer::WriteFragment(const ProjectSerializer & value)
+{
+   mBuffer.AppendData(value.mBuffer.GetData(), value.mBuffer.GetDataLen());
+}
+
 void ProjectSerializer::WriteName(const wxString & name)
 {
    wxASSERT(name.length() * sizeof(wxStringCharType) <= SHRT_MAX);
@@ -383,13 +392,15 @@ bool ProjectSerializer::DictChanged() const
    return mDictChanged;
 }
 
-// See ProjectFileIO::LoadProject() for explanation of the blockids arg
-wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
+namespace {
+
+// Pass the fields of the document to out, in the calls of XMLWriter that
+// made them; returns false if the document is corrupt
+template< typename Sink >
+bool Walk(const wxMemoryBuffer &buffer, Sink &out)
 {
    wxMemoryInputStream in(buffer.GetData(), buffer.GetDataLen());
 
-   XMLStringWriter out;
-
    std::vector<char> bytes;
    IdMap mIds;
    std::vector<IdMap> mIdStack;
@@ -410,7 +421,7 @@ wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
 
    auto ReadString = [&mCharSize, &in, &bytes](int len) -> wxString
    {
-      bytes.reserve( len + 4 );
+      bytes.resize( len + 4 );
       auto data = bytes.data();
       in.Read( data, len );
       // Make a null terminator of the widest type
@@ -593,8 +604,144 @@ wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
    {
       // Document was corrupt, or platform differences in size or endianness
       // were not well canonicalized
-      return {};
+      return false;
+   }
+
+   return true;
+}
+
+// Makes the calls to tag handlers that XMLFileReader would make for the
+// XML text of the document, without making or parsing the text
+class HandlerDispatcher
+{
+public:
+   explicit HandlerDispatcher(XMLTagHandler &baseHandler)
+      : mBaseHandler{ &baseHandler }
+   {
+      mHandlers.reserve(128);
+   }
+
+   void StartTag(const wxString &name)
+   {
+      HandlePendingTag();
+      mPendingTag = name;
+      mPending = true;
+      mAttrs.clear();
+   }
+
+   void EndTag(const wxString &name)
+   {
+      HandlePendingTag();
+      if (mHandlers.empty())
+         return;
+      if (auto handler = mHandlers.back())
+         handler->HandleXMLEndTag(name.wx_str());
+      mHandlers.pop_back();
+   }
+
+   void WriteAttr(const wxString &name, const wxString &value)
+   {
+      mAttrs.push_back(name);
+      mAttrs.push_back(value);
+   }
+
+   // Numbers are formatted as XMLWriter formats them
+   void WriteAttr(const wxString &name, int value)
+      { WriteInteger(name, value); }
+   void WriteAttr(const wxString &name, long value)
+      { WriteInteger(name, value); }
+   void WriteAttr(const wxString &name, long long value)
+      { WriteInteger(name, value); }
+   void WriteAttr(const wxString &name, size_t value)
+      { WriteInteger(name, static_cast<long long>(value)); }
+   void WriteAttr(const wxString &name, float value, int digits)
+      { WriteAttr(name, Internat::ToString(value, digits)); }
+   void WriteAttr(const wxString &name, double value, int digits)
+      { WriteAttr(name, Internat::ToString(value, digits)); }
+
+   void WriteData(const wxString &value)
+   {
+      HandlePendingTag();
+      if (!mHandlers.empty())
+         if (auto handler = mHandlers.back())
+            handler->HandleXMLContent(value);
+   }
+
+   // Raw text is only the XML declaration and document type
+   void Write(const wxString &) {}
+
+   // Like XMLFileReader, succeed only if the first handler accepted its tag
+   bool Succeeded()
+   {
+      HandlePendingTag();
+      return mStarted && mBaseHandler;
+   }
+
+private:
+   template< typename Integer >
+   void WriteInteger(const wxString &name, Integer value)
+   {
+      char buffer[24];
+      const auto result =
+         std::to_chars(buffer, buffer + sizeof(buffer), value);
+      mAttrs.push_back(name);
+      mAttrs.push_back(wxString::FromAscii(buffer, result.ptr - buffer));
    }
 
+   void HandlePendingTag()
+   {
+      if (!mPending)
+         return;
+      mPending = false;
+
+      const auto tag = mPendingTag.wx_str();
+      if (mHandlers.empty()) {
+         mStarted = true;
+         mHandlers.push_back(mBaseHandler);
+      }
+      else if (auto parent = mHandlers.back())
+         mHandlers.push_back(parent->HandleXMLChild(tag));
+      else
+         mHandlers.push_back(nullptr);
+
+      if (auto &handler = mHandlers.back()) {
+         mAttrPtrs.clear();
+         for (auto &attr : mAttrs)
+            mAttrPtrs.push_back(attr.wx_str());
+         mAttrPtrs.push_back(nullptr);
+         if (!handler->HandleXMLTag(tag, mAttrPtrs.data())) {
+            handler = nullptr;
+            if (mHandlers.size() == 1)
+               mBaseHandler = nullptr;
+         }
+      }
+   }
+
+   XMLTagHandler *mBaseHandler;
+   std::vector<XMLTagHandler*> mHandlers;
+   bool mStarted{ false };
+
+   bool mPending{ false };
+   wxString mPendingTag;
+   std::vector<wxString> mAttrs;
+   std::vector<const wxChar*> mAttrPtrs;
+};
+
+}
+
+wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
+{
+   XMLStringWriter out;
+   if (!Walk(buffer, out))
+      return {};
    return out;
 }
+
+auto ProjectSerializer::Decode(
+   const wxMemoryBuffer &buffer, XMLTagHandler &baseHandler) -> DecodeResult
+{
+   HandlerDispatcher out{ baseHandler };
+   if (!Walk(buffer, out))
+      return DecodeResult::Corrupt;
+   return out.Succeeded() ? DecodeResult::Success : DecodeResult::Rejected;
+}
@@ -59,6 +59,9 @@ public:
 
    // Non-override functions
    void WriteSubTree(const ProjectSerializer & value);
+   // Appends the fields of another serializer as if written here.  Unlike
+   // WriteSubTree, adds no dictionary, which all serializers share in a run.
+   void WriteFragment(const ProjectSerializer & value);
 
    const wxMemoryBuffer &GetDict() const;
    const wxMemoryBuffer &GetData() const;
@@ -69,6 +72,14 @@ public:
    // Returns empty string if decoding fails
    static wxString Decode(const wxMemoryBuffer &buffer);
 
+   enum class DecodeResult { Success, Corrupt, Rejected };
+
+   // Calls the handlers as XMLFileReader would for the decoded XML, but
+   // without making and parsing that text.  Rejected means the base handler
+   // rejected the first tag.
+   static DecodeResult Decode(
+      const wxMemoryBuffer &buffer, XMLTagHandler &baseHandler);
+
 private:
    void WriteName(const wxString & name);
 
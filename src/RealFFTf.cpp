@@ -41,12 +41,14 @@
 
 
 
+#include <map>
+#include <mutex>
 #include <vector>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
-#include <wx/thread.h>
+#include "FFTKernels.h"
 
 #ifndef M_PI
 #define	M_PI		3.14159265358979323846  /* pi */
@@ -62,12 +64,11 @@ struct FFTParam {
    ArrayOf<int> BitReversed;
    ArrayOf<fft_type> SinTable;
    size_t Points;
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   int pow2Bits;
-#endif
 };
 
 */
+static void InitializeBluestein(FFTParam &h);
+
 HFFT InitializeFFT(size_t fftlen)
 {
    int temp;
@@ -79,6 +80,11 @@ HFFT InitializeFFT(size_t fftlen)
    *  (This optimization can be made since the data is real.)
    */
    h->Points = fftlen / 2;
+   if(h->Points & (h->Points - 1))
+   {
+      InitializeBluestein(*h);
+      return h;
+   }
    //.reinit is implemented by MemoryX
    //discard whatever was in the array managed by unique_ptr and create a new array of size n
    h->SinTable.reinit(2*h->Points);
@@ -110,62 +116,220 @@ HFFT InitializeFFT(size_t fftlen)
       h->SinTable[h->BitReversed[i]  ]=(fft_type)-sin(2*M_PI*i/(2*h->Points));
       h->SinTable[h->BitReversed[i]+1]=(fft_type)-cos(2*M_PI*i/(2*h->Points));
    }
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   // NEW SSE FFT routines work on live data
-   for(size_t i = 0; i < 32; i++)
-      if((1 << i) & fftlen)
-         h->pow2Bits = i;
-#endif
    return h;
 }
 
-enum : size_t { MAX_HFFT = 10 };
-
-// Maintain a pool:
-static std::vector< std::unique_ptr<FFTParam> > hFFTArray(MAX_HFFT);
-wxCriticalSection getFFTMutex;
+// Tables of every size requested so far.  They are never changed after
+// they are made, so any number of threads may share them.  Callers use few
+// sizes.
+static std::map< size_t, std::unique_ptr<FFTParam> > sFFTPlans;
+static std::mutex sFFTPlansMutex;
 
 /* Get a handle to the FFT tables of the desired length */
 /* This version keeps common tables rather than allocating a NEW table every time */
 HFFT GetFFT(size_t fftlen)
 {
-   // To do:  smarter policy about when to retain in the pool and when to
-   // allocate a unique instance.
-
-   wxCriticalSectionLocker locker{ getFFTMutex };
-   
-   size_t h = 0;
-   auto n = fftlen/2;
-   auto size = hFFTArray.size();
-   for(;
-       (h < size) && hFFTArray[h] && (n != hFFTArray[h]->Points);
-       h++)
-      ;
-   if(h < size) {
-      if(hFFTArray[h] == NULL) {
-         hFFTArray[h].reset( InitializeFFT(fftlen).release() );
-      }
-      return HFFT{ hFFTArray[h].get() };
-   } else {
-      // All buffers used, so fall back to allocating a NEW set of tables
-      return InitializeFFT(fftlen);
-   }
+   std::lock_guard<std::mutex> locker{ sFFTPlansMutex };
+
+   auto &plan = sFFTPlans[fftlen / 2];
+   if (!plan)
+      plan.reset( InitializeFFT(fftlen).release() );
+   return HFFT{ plan.get() };
 }
 
 /* Release a previously requested handle to the FFT tables */
 void FFTDeleter::operator() (FFTParam *hFFT) const
 {
-   wxCriticalSectionLocker locker{ getFFTMutex };
+   std::lock_guard<std::mutex> locker{ sFFTPlansMutex };
 
-   auto it = hFFTArray.begin(), end = hFFTArray.end();
-   while (it != end && it->get() != hFFT)
-      ++it;
-   if ( it != end )
+   // Keep the tables that GetFFT() shares
+   auto it = sFFTPlans.find(hFFT->Points);
+   if (it != sFFTPlans.end() && it->second.get() == hFFT)
       ;
    else
       delete hFFT;
 }
 
+/*
+*  Sizes other than powers of two
+*
+*  Bluestein's algorithm rewrites the transform of N points as a convolution
+*  with a "chirp":  since kn = (k^2 + n^2 - (k-n)^2) / 2,
+*
+*     X[k] = w[k] * sum over n of (x[n] * w[n]) * conj(w[k-n])
+*
+*  where w[n] = exp(-i pi n^2 / N).  The convolution is done with complex
+*  FFTs of a power of two size, at least 2N - 1 so that it does not wrap.
+*  The forward one is decimated in frequency, leaving its output bit
+*  reversed, and the inverse one in time, taking its input bit reversed;
+*  so the products need no reordering between them.
+*
+*  The real data are transformed as N = Points complex values, even samples
+*  in the real parts and odd samples in the imaginary parts, then separated
+*  as the power of two code does.  Computation is in double precision.
+
+https://en.wikipedia.org/wiki/Chirp_Z-transform#Bluestein's_algorithm
+
+*/
+using Complex = std::complex<double>;
+
+/* Complex product, without the checks for infinities and NaN that
+   operator * makes, which would make the transforms several times slower */
+static inline Complex Multiply(const Complex &a, const Complex &b)
+{
+   return { a.real() * b.real() - a.imag() * b.imag(),
+            a.real() * b.imag() + a.imag() * b.real() };
+}
+
+/* Complex FFT of ConvolutionPoints values, normal order in, bit reversed out */
+static void ComplexForward(Complex *a, const FFTParam &h)
+{
+   const auto size = h.ConvolutionPoints;
+   const auto twiddles = h.ConvolutionTwiddles.get();
+   for(size_t half = size / 2, step = 1; half > 0; half >>= 1, step <<= 1)
+      for(size_t start = 0; start < size; start += 2 * half)
+         for(size_t j = 0; j < half; j++)
+         {
+            const auto u = a[start + j], v = a[start + j + half];
+            a[start + j] = u + v;
+            a[start + j + half] = Multiply(u - v, twiddles[j * step]);
+         }
+}
+
+/* Inverse complex FFT of ConvolutionPoints values, without scaling,
+   bit reversed in, normal order out */
+static void ComplexInverse(Complex *a, const FFTParam &h)
+{
+   const auto size = h.ConvolutionPoints;
+   const auto twiddles = h.ConvolutionTwiddles.get();
+   for(size_t half = 1, step = size / 2; half < size; half <<= 1, step >>= 1)
+      for(size_t start = 0; start < size; start += 2 * half)
+         for(size_t j = 0; j < half; j++)
+         {
+            const auto u = a[start + j];
+            const auto v =
+               Multiply(a[start + j + half], std::conj(twiddles[j * step]));
+            a[start + j] = u + v;
+            a[start + j + half] = u - v;
+         }
+}
+
+static void InitializeBluestein(FFTParam &h)
+{
+   const auto points = h.Points;
+   size_t convolutionPoints = 1;
+   while(convolutionPoints < 2 * points - 1)
+      convolutionPoints <<= 1;
+   h.ConvolutionPoints = convolutionPoints;
+
+   // The output is in normal order
+   h.BitReversed.reinit(points);
+   for(size_t i = 0; i < points; i++)
+      h.BitReversed[i] = 2 * i;
+
+   h.Chirp.reinit(points);
+   for(size_t n = 0; n < points; n++)
+      // Reduce n^2 exactly, so that large n lose no precision
+      h.Chirp[n] = std::polar(1.0, -M_PI * ((n * n) % (2 * points)) / points);
+
+   h.ConvolutionTwiddles.reinit(convolutionPoints / 2);
+   for(size_t m = 0; m < convolutionPoints / 2; m++)
+      h.ConvolutionTwiddles[m] =
+         std::polar(1.0, -2 * M_PI * m / convolutionPoints);
+
+   h.RealTwiddles.reinit(points);
+   for(size_t k = 0; k < points; k++)
+      h.RealTwiddles[k] = std::polar(1.0, -M_PI * k / points);
+
+   // The filter is the conjugate chirp, at negative times too
+   h.ChirpFilter.reinit(convolutionPoints, true);
+   h.ChirpFilter[0] = 1.0;
+   for(size_t n = 1; n < points; n++)
+      h.ChirpFilter[n] = h.ChirpFilter[convolutionPoints - n] =
+         std::conj(h.Chirp[n]);
+   ComplexForward(h.ChirpFilter.get(), h);
+   for(size_t i = 0; i < convolutionPoints; i++)
+      h.ChirpFilter[i] /= convolutionPoints;
+}
+
+/* Space for the convolution; each thread has its own, so that the shared
+   tables stay constant */
+static Complex *BluesteinScratch(const FFTParam &h)
+{
+   static thread_local std::vector<Complex> scratch;
+   if(scratch.size() < h.ConvolutionPoints)
+      scratch.resize(h.ConvolutionPoints);
+   return scratch.data();
+}
+
+/* Transform of the Points values a[n] * Chirp[n] already in a; the rest of
+   a is overwritten */
+static void BluesteinTransform(Complex *a, const FFTParam &h)
+{
+   std::fill(a + h.Points, a + h.ConvolutionPoints, Complex{});
+   ComplexForward(a, h);
+   for(size_t i = 0; i < h.ConvolutionPoints; i++)
+      a[i] = Multiply(a[i], h.ChirpFilter[i]);
+   ComplexInverse(a, h);
+   for(size_t k = 0; k < h.Points; k++)
+      a[k] = Multiply(a[k], h.Chirp[k]);
+}
+
+static void BluesteinRealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   const auto points = h->Points;
+   const auto z = BluesteinScratch(*h);
+   for(size_t n = 0; n < points; n++)
+      z[n] = Multiply({ buffer[2 * n], buffer[2 * n + 1] }, h->Chirp[n]);
+   BluesteinTransform(z, *h);
+
+   /* Separate the transforms of the even and odd samples, and combine them */
+   for(size_t k = 1; k < points; k++)
+   {
+      const auto a = z[k], b = std::conj(z[points - k]);
+      const auto even = (a + b) * 0.5;
+      const auto odd = Multiply(a - b, { 0, -0.5 });
+      const auto x = even + Multiply(odd, h->RealTwiddles[k]);
+      buffer[2 * k] = x.real();
+      buffer[2 * k + 1] = x.imag();
+   }
+   /* DC in buffer[0] and Fs/2 in buffer[1], as for powers of two */
+   buffer[0] = z[0].real() + z[0].imag();
+   buffer[1] = z[0].real() - z[0].imag();
+}
+
+static void BluesteinInverseRealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   const auto points = h->Points;
+   const auto z = BluesteinScratch(*h);
+
+   /* Combine the spectra of the even and odd samples, as one complex
+      spectrum, conjugated so that the forward transform inverts it */
+   const auto bin = [&](size_t k){
+      if(k == 0)
+         return Complex{ buffer[0] };
+      if(k == points)
+         return Complex{ buffer[1] };
+      return Complex{ buffer[2 * k], buffer[2 * k + 1] };
+   };
+   for(size_t k = 0; k < points; k++)
+   {
+      const auto a = bin(k), b = std::conj(bin(points - k));
+      const auto even = (a + b) * 0.5;
+      const auto odd = Multiply((a - b) * 0.5, std::conj(h->RealTwiddles[k]));
+      z[k] = Multiply(std::conj(even + Multiply({ 0, 1 }, odd)), h->Chirp[k]);
+   }
+   BluesteinTransform(z, *h);
+
+   /* Scaled as the power of two code is, to give back the samples */
+   const auto scale = 1.0 / points;
+   for(size_t n = 0; n < points; n++)
+   {
+      buffer[2 * n] = z[n].real() * scale;
+      buffer[2 * n + 1] = -z[n].imag() * scale;
+   }
+}
+
 /*
 *  Forward FFT routine.  Must call GetFFT(fftlen) first!
 *
@@ -190,52 +354,27 @@ https://en.wikipedia.org/wiki/Twiddle_factor
 
 */
 void RealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   RealFFTf(buffer, h, FFTKernels::GetBestKernels());
+}
+
+void RealFFTf(fft_type *buffer, const FFTParam *h,
+              const FFTKernels::Kernels &kernels)
 {
    fft_type *A,*B;
-   const fft_type *sptr;
-   const fft_type *endptr1,*endptr2;
    const int *br1,*br2;
    fft_type HRplus,HRminus,HIplus,HIminus;
    fft_type v1,v2,sin,cos;
 
-   auto ButterfliesPerGroup = h->Points/2;
-
-   /*
-   *  Butterfly:
-   *     Ain-----Aout
-   *         \ /
-   *         / \
-   *     Bin-----Bout
-   */
-
-   endptr1 = buffer + h->Points * 2;
-
-   while(ButterfliesPerGroup > 0)
+   if(h->ConvolutionPoints)
    {
-      A = buffer;
-      B = buffer + ButterfliesPerGroup * 2;
-      sptr = h->SinTable.get();
-
-      while(A < endptr1)
-      {
-         sin = *sptr;
-         cos = *(sptr+1);
-         endptr2 = B;
-         while(A < endptr2)
-         {
-            v1 = *B * cos + *(B + 1) * sin;
-            v2 = *B * sin - *(B + 1) * cos;
-            *B = (*A + v1);
-            *(A++) = *(B++) - 2 * v1;
-            *B = (*A - v2);
-            *(A++) = *(B++) + 2 * v2;
-         }
-         A = B;
-         B += ButterfliesPerGroup * 2;
-         sptr += 2;
-      }
-      ButterfliesPerGroup >>= 1;
+      BluesteinRealFFTf(buffer, h);
+      return;
    }
+
+   /* The butterflies, scalar or vectorized */
+   kernels.forward(buffer, h->SinTable.get(), h->Points);
+
    /* Massage output to get the output for a real input sequence. */
    br1 = h->BitReversed.get() + 1;
    br2 = h->BitReversed.get() + h->Points - 1;
@@ -292,15 +431,23 @@ void RealFFTf(fft_type *buffer, const FFTParam *h)
 *        good when using fixed point arithmetic)
 */
 void InverseRealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   InverseRealFFTf(buffer, h, FFTKernels::GetBestKernels());
+}
+
+void InverseRealFFTf(fft_type *buffer, const FFTParam *h,
+                     const FFTKernels::Kernels &kernels)
 {
    fft_type *A,*B;
-   const fft_type *sptr;
-   const fft_type *endptr1,*endptr2;
    const int *br1;
    fft_type HRplus,HRminus,HIplus,HIminus;
    fft_type v1,v2,sin,cos;
 
-   auto ButterfliesPerGroup = h->Points / 2;
+   if(h->ConvolutionPoints)
+   {
+      BluesteinInverseRealFFTf(buffer, h);
+      return;
+   }
 
    /* Massage input to get the input for a real output sequence. */
    A = buffer + 2;
@@ -337,41 +484,8 @@ void InverseRealFFTf(fft_type *buffer, const FFTParam *h)
    buffer[0]=v1;
    buffer[1]=v2;
 
-   /*
-   *  Butterfly:
-   *     Ain-----Aout
-   *         \ /
-   *         / \
-   *     Bin-----Bout
-   */
-
-   endptr1 = buffer + h->Points * 2;
-
-   while(ButterfliesPerGroup > 0)
-   {
-      A = buffer;
-      B = buffer + ButterfliesPerGroup * 2;
-      sptr = h->SinTable.get();
-
-      while(A < endptr1)
-      {
-         sin = *(sptr++);
-         cos = *(sptr++);
-         endptr2 = B;
-         while(A < endptr2)
-         {
-            v1 = *B * cos - *(B + 1) * sin;
-            v2 = *B * sin + *(B + 1) * cos;
-            *B = (*A + v1) * (fft_type)0.5;
-            *(A++) = *(B++) - v1;
-            *B = (*A + v2) * (fft_type)0.5;
-            *(A++) = *(B++) - v2;
-         }
-         A = B;
-         B += ButterfliesPerGroup * 2;
-      }
-      ButterfliesPerGroup >>= 1;
-   }
+   /* The butterflies, scalar or vectorized */
+   kernels.inverse(buffer, h->SinTable.get(), h->Points);
 }
 
 void ReorderToFreq(const FFTParam *hFFT, const fft_type *buffer,
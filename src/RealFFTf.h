@@ -5,6 +5,7 @@
 
 
 
+#include <complex>
 #include "MemoryX.h"
 
 using fft_type = float;
@@ -12,9 +13,23 @@ struct FFTParam {
    ArrayOf<int> BitReversed;
    ArrayOf<fft_type> SinTable;
    size_t Points;
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   int pow2Bits;
-#endif
+
+   // When Points is not a power of two, the transform of the Points complex
+   // values is done by Bluestein's algorithm, as a convolution of a power of
+   // two size; then BitReversed is the identity, SinTable is unused, and
+   // these are not empty:
+   //! The convolution size, at least 2 * Points - 1
+   size_t ConvolutionPoints{ 0 };
+   //! exp(-i pi n^2 / Points), for n < Points
+   ArrayOf< std::complex<double> > Chirp;
+   //! The transformed conjugate chirp, in bit reversed order, and divided by
+   //! ConvolutionPoints
+   ArrayOf< std::complex<double> > ChirpFilter;
+   //! exp(-2 pi i m / ConvolutionPoints), for m < ConvolutionPoints / 2
+   ArrayOf< std::complex<double> > ConvolutionTwiddles;
+   //! exp(-2 pi i k / (2 * Points)), for k < Points, to separate the
+   //! transforms of the even and odd samples
+   ArrayOf< std::complex<double> > RealTwiddles;
 };
 
 struct SNEEDACITY_DLL_API FFTDeleter{
@@ -25,9 +40,20 @@ using HFFT = std::unique_ptr<
    FFTParam, FFTDeleter
 >;
 
+namespace FFTKernels { struct Kernels; }
+
+//! Thread-safe; tables of each size are made once and shared
+/*! The size may be any even number.  Powers of two are fastest; the output
+ of other sizes is in normal order, not bit reversed, as BitReversed says */
 SNEEDACITY_DLL_API HFFT GetFFT(size_t);
 SNEEDACITY_DLL_API void RealFFTf(fft_type *, const FFTParam *);
 SNEEDACITY_DLL_API void InverseRealFFTf(fft_type *, const FFTParam *);
+//! As above, but with the given butterflies, rather than the fastest ones
+//! (which sizes other than powers of two do not use)
+SNEEDACITY_DLL_API void RealFFTf(fft_type *, const FFTParam *,
+   const FFTKernels::Kernels &);
+SNEEDACITY_DLL_API void InverseRealFFTf(fft_type *, const FFTParam *,
+   const FFTKernels::Kernels &);
 SNEEDACITY_DLL_API void ReorderToTime(const FFTParam *hFFT, const fft_type *buffer, fft_type *TimeOut);
 SNEEDACITY_DLL_API void ReorderToFreq(const FFTParam *hFFT, const fft_type *buffer,
 		   fft_type *RealOut, fft_type *ImagOut);
@@ -22,15 +22,22 @@
   AvailForPut and AvailForGet may underestimate but will never
   overestimate.
 
+  Each position in the buffer holds a frame of one or more interleaved
+  channels.  Besides copying in and out, the writer may fill, and the reader
+  may consume, frames in place, using the regions of the buffer returned by
+  GetWriteRegions() and GetReadRegions(); so the audio callback can mix
+  directly out of the buffer, or deinterleave straight into it.
+
 *//*******************************************************************/
 
 
 #include "RingBuffer.h"
 
-RingBuffer::RingBuffer(sampleFormat format, size_t size)
+RingBuffer::RingBuffer(sampleFormat format, size_t size, size_t nChannels)
    : mFormat{ format }
    , mBufferSize{ std::max<size_t>(size, 64) }
-   , mBuffer{ mBufferSize, mFormat }
+   , mChannels{ std::max<size_t>(nChannels, 1) }
+   , mBuffer{ mBufferSize * mChannels, mFormat }
 {
 }
 
@@ -51,6 +58,16 @@ size_t RingBuffer::Free( size_t start, size_t end )
    return std::max<size_t>(mBufferSize - Filled( start, end ), 4) - 4;
 }
 
+auto RingBuffer::MakeRegions( size_t pos, size_t samples ) -> Regions
+{
+   const auto frameSize = SAMPLE_SIZE(mFormat) * mChannels;
+   const auto first = std::min( samples, mBufferSize - pos );
+   return {{
+      { mBuffer.ptr() + pos * frameSize, first },
+      { mBuffer.ptr(), samples - first },
+   }};
+}
+
 //
 // For the writer only:
 // Only writer writes the end, so it can read it again relaxed
@@ -84,10 +101,10 @@ size_t RingBuffer::Put(samplePtr buffer, sampleFormat format,
       auto block = std::min( samplesToCopy, mBufferSize - pos );
 
       CopySamples(src, format,
-                  mBuffer.ptr() + pos * SAMPLE_SIZE(mFormat), mFormat,
-                  block, DitherType::none);
+                  mBuffer.ptr() + pos * mChannels * SAMPLE_SIZE(mFormat), mFormat,
+                  block * mChannels, DitherType::none);
 
-      src += block * SAMPLE_SIZE(format);
+      src += block * mChannels * SAMPLE_SIZE(format);
       pos = (pos + block) % mBufferSize;
       samplesToCopy -= block;
       copied += block;
@@ -95,7 +112,7 @@ size_t RingBuffer::Put(samplePtr buffer, sampleFormat format,
 
    while ( padding ) {
       const auto block = std::min( padding, mBufferSize - pos );
-      ClearSamples( mBuffer.ptr(), mFormat, pos, block );
+      ClearSamples( mBuffer.ptr(), mFormat, pos * mChannels, block * mChannels );
       pos = (pos + block) % mBufferSize;
       padding -= block;
       copied += block;
@@ -119,7 +136,7 @@ size_t RingBuffer::Clear(sampleFormat format, size_t samplesToClear)
    while(samplesToClear) {
       auto block = std::min( samplesToClear, mBufferSize - pos );
 
-      ClearSamples(mBuffer.ptr(), format, pos, block);
+      ClearSamples(mBuffer.ptr(), mFormat, pos * mChannels, block * mChannels);
 
       pos = (pos + block) % mBufferSize;
       samplesToClear -= block;
@@ -133,6 +150,21 @@ size_t RingBuffer::Clear(sampleFormat format, size_t samplesToClear)
    return cleared;
 }
 
+auto RingBuffer::GetWriteRegions(size_t samples) -> Regions
+{
+   auto start = mStart.load( std::memory_order_acquire );
+   auto end = mEnd.load( std::memory_order_relaxed );
+   return MakeRegions( end, std::min( samples, Free( start, end ) ) );
+}
+
+void RingBuffer::CommitWrite(size_t samples)
+{
+   auto end = mEnd.load( std::memory_order_relaxed );
+   // Release, so the writes just done in place are visible to the reader
+   // before the new end is
+   mEnd.store( (end + samples) % mBufferSize, std::memory_order_release );
+}
+
 //
 // For the reader only:
 // Only reader writes the start, so it can read it again relaxed
@@ -165,11 +197,11 @@ size_t RingBuffer::Get(samplePtr buffer, sampleFormat format,
    while(samplesToCopy) {
       auto block = std::min( samplesToCopy, mBufferSize - start );
 
-      CopySamples(mBuffer.ptr() + start * SAMPLE_SIZE(mFormat), mFormat,
+      CopySamples(mBuffer.ptr() + start * mChannels * SAMPLE_SIZE(mFormat), mFormat,
                   dest, format,
-                  block, DitherType::none);
+                  block * mChannels, DitherType::none);
 
-      dest += block * SAMPLE_SIZE(format);
+      dest += block * mChannels * SAMPLE_SIZE(format);
       start = (start + block) % mBufferSize;
       samplesToCopy -= block;
       copied += block;
@@ -194,3 +226,38 @@ size_t RingBuffer::Discard(size_t samplesToDiscard)
 
    return samplesToDiscard;
 }
+
+auto RingBuffer::GetReadRegions(size_t samples) -> Regions
+{
+   // Must match the writer's release with acquire for well defined reads of
+   // the buffer
+   auto end = mEnd.load( std::memory_order_acquire );
+   auto start = mStart.load( std::memory_order_relaxed );
+   return MakeRegions( start, std::min( samples, Filled( start, end ) ) );
+}
+
+size_t RingBuffer::GetChannel(size_t channel,
+   samplePtr buffer, sampleFormat format, size_t samples)
+{
+   if (channel >= mChannels)
+      return 0;
+
+   auto dest = buffer;
+   size_t copied = 0;
+   for (const auto &region : GetReadRegions(samples)) {
+      CopySamples(region.data + channel * SAMPLE_SIZE(mFormat), mFormat,
+                  dest, format,
+                  region.frames, DitherType::none, mChannels, 1);
+      dest += region.frames * SAMPLE_SIZE(format);
+      copied += region.frames;
+   }
+   return copied;
+}
+
+void RingBuffer::ReleaseRead(size_t samples)
+{
+   auto start = mStart.load( std::memory_order_relaxed );
+   // Unlike Discard(), release, because the reads done in place must
+   // happen-before the writer reuses the space
+   mStart.store( (start + samples) % mBufferSize, std::memory_order_release );
+}
@@ -12,13 +12,27 @@
 #define __SNEEDACITY_RING_BUFFER__
 
 #include "SampleFormat.h"
+#include <array>
 #include <atomic>
 
 class RingBuffer final : public NonInterferingBase {
  public:
-   RingBuffer(sampleFormat format, size_t size);
+   //! A contiguous run of frames inside the buffer, in the buffer's format
+   struct Region {
+      samplePtr data{};
+      size_t frames{};
+   };
+   //! The second region is nonempty only when the run wraps around
+   using Regions = std::array<Region, 2>;
+
+   //! Counts of samples in other member functions are counts of frames,
+   //! each of nChannels interleaved samples
+   RingBuffer(sampleFormat format, size_t size, size_t nChannels = 1);
    ~RingBuffer();
 
+   sampleFormat GetFormat() const { return mFormat; }
+   size_t GetChannels() const { return mChannels; }
+
    //
    // For the writer only:
    //
@@ -30,6 +44,11 @@ class RingBuffer final : public NonInterferingBase {
               size_t padding = 0);
    size_t Clear(sampleFormat format, size_t samples);
 
+   //! Free space for up to samples frames, to be filled in place
+   Regions GetWriteRegions(size_t samples);
+   //! Publish frames filled in place, at most the total of the regions
+   void CommitWrite(size_t samples);
+
    //
    // For the reader only:
    //
@@ -39,14 +58,27 @@ class RingBuffer final : public NonInterferingBase {
    size_t Get(samplePtr buffer, sampleFormat format, size_t samples);
    size_t Discard(size_t samples);
 
+   //! Up to samples frames ready to be read in place
+   /*! The reader may also modify them in place, until ReleaseRead(); the
+    writer does not touch them before then */
+   Regions GetReadRegions(size_t samples);
+   //! Copy one channel out of up to samples frames without consuming them
+   //! Does not apply dithering
+   size_t GetChannel(size_t channel,
+      samplePtr buffer, sampleFormat format, size_t samples);
+   //! Give back space after reading in place, at most the total of the regions
+   void ReleaseRead(size_t samples);
+
  private:
    size_t Filled( size_t start, size_t end );
    size_t Free( size_t start, size_t end );
+   Regions MakeRegions( size_t pos, size_t samples );
 
    // Align the two atomics to avoid false sharing
    NonInterfering< std::atomic<size_t> > mStart { 0 }, mEnd{ 0 };
 
    const size_t  mBufferSize;
+   const size_t  mChannels;
 
    sampleFormat  mFormat;
    SampleBuffer  mBuffer;
@@ -68,6 +68,16 @@ SampleBlockPtr SampleBlockFactory::CreateFromXML(
    return result;
 }
 
+SampleBlockPtr SampleBlockFactory::CreateFromID(
+   sampleFormat srcformat,
+   SampleBlockID id)
+{
+   auto result = DoCreateFromID(srcformat, id);
+   if (!result)
+      THROW_INCONSISTENCY_EXCEPTION;
+   return result;
+}
+
 SampleBlock::~SampleBlock() = default;
 
 size_t SampleBlock::GetSamples(samplePtr dest,
@@ -105,3 +115,23 @@ size_t SampleBlock::GetSamples(samplePtr dest,
    }
 }
 
+double SampleBlock::GetSum(size_t start, size_t len, bool mayThrow)
+{
+   try{ return DoGetSum(start, len); }
+   catch( ... ) {
+      if( mayThrow )
+         throw;
+      return 0;
+   }
+}
+
+double SampleBlock::GetSum(bool mayThrow)
+{
+   try{ return DoGetSum(); }
+   catch( ... ) {
+      if( mayThrow )
+         throw;
+      return 0;
+   }
+}
+
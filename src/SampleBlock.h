@@ -59,10 +59,22 @@ public:
 
    virtual size_t GetSampleCount() const = 0;
 
+   //! Hint that the samples will soon be read; non-throwing, and never waits
+   /*! The implementation may begin reading in the background, so that a later
+    GetSamples() in float format completes without waiting for storage */
+   virtual void Prefetch() = 0;
+
    //! Non-throwing, should fill with zeroes on failure
    virtual bool
       GetSummary256(float *dest, size_t frameoffset, size_t numframes) = 0;
    //! Non-throwing, should fill with zeroes on failure
+   /*! Frames of divisor samples, which is a power of two between 512 and
+    32768, so that each level halves the resolution of the one before.
+    These levels are not stored, but derived from the 256 summaries and
+    kept in memory */
+   virtual bool GetDerivedSummary(size_t divisor,
+      float *dest, size_t frameoffset, size_t numframes) = 0;
+   //! Non-throwing, should fill with zeroes on failure
    virtual bool
       GetSummary64k(float *dest, size_t frameoffset, size_t numframes) = 0;
 
@@ -77,6 +89,16 @@ public:
    // That may be appropriate when only attempting to display samples, not edit.
    MinMaxRMS GetMinMaxRMS(bool mayThrow = true) const;
 
+   /// Gets the sum of the samples in the specified region, for DC offset
+   // If !mayThrow and there is an error, ignores it and returns zero.
+   double GetSum(size_t start, size_t len, bool mayThrow = true);
+
+   /// Gets the sum of all the samples in the block, for DC offset
+   // Reads the samples only the first time, and only if the sum was not
+   // computed when the block was made.
+   // If !mayThrow and there is an error, ignores it and returns zero.
+   double GetSum(bool mayThrow = true);
+
    virtual size_t GetSpaceUsage() const = 0;
 
    virtual void SaveXML(XMLWriter &xmlFile) = 0;
@@ -90,6 +112,10 @@ protected:
    virtual MinMaxRMS DoGetMinMaxRMS(size_t start, size_t len) = 0;
 
    virtual MinMaxRMS DoGetMinMaxRMS() const = 0;
+
+   virtual double DoGetSum(size_t start, size_t len) = 0;
+
+   virtual double DoGetSum() = 0;
 };
 
 // Makes a useful function object
@@ -131,6 +157,12 @@ public:
       sampleFormat srcformat,
       const wxChar **attrs);
 
+   // Returns a non-null pointer or else throws an exception
+   // The id is as SaveXML writes it, so zero or negative means silence
+   SampleBlockPtr CreateFromID(
+      sampleFormat srcformat,
+      SampleBlockID id);
+
    using SampleBlockIDs = std::unordered_set<SampleBlockID>;
    /*! @return ids of all sample blocks created by this factory and still extant */
    virtual SampleBlockIDs GetActiveBlockIDs() = 0;
@@ -160,6 +192,12 @@ protected:
    virtual SampleBlockPtr DoCreateFromXML(
       sampleFormat srcformat,
       const wxChar **attrs) = 0;
+
+   // The override should throw more informative exceptions on error than the
+   // default InconsistencyException thrown by CreateFromID
+   virtual SampleBlockPtr DoCreateFromID(
+      sampleFormat srcformat,
+      SampleBlockID id) = 0;
 };
 
 #endif
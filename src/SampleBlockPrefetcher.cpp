@@ -0,0 +1,172 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SampleBlockPrefetcher.cpp
+@brief Implements SampleBlockPrefetcher
+
+**********************************************************************/
+
+#include "SampleBlockPrefetcher.h"
+
+#include <algorithm>
+#include <sqlite3.h>
+
+#include <wx/log.h>
+
+#include "DBConnection.h"
+#include "DecodedBlockCache.h"
+#include "SampleFormat.h"
+
+SampleBlockPrefetcher::SampleBlockPrefetcher(DBConnection &connection)
+: mConnection{ connection }
+{
+}
+
+SampleBlockPrefetcher::~SampleBlockPrefetcher()
+{
+   Stop();
+}
+
+void SampleBlockPrefetcher::Start()
+{
+   // Precondition: mMutex is held
+   if (!mThread.joinable())
+      mThread = std::thread([this]{ Thread(); });
+}
+
+void SampleBlockPrefetcher::Stop()
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStop = true;
+      mCondition.notify_one();
+   }
+
+   // Wait for any query in progress to finish
+   if (mThread.joinable())
+      mThread.join();
+
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mPending.clear();
+      mQueued.clear();
+   }
+
+   DecodedBlockCache::Get().Purge(&mConnection);
+}
+
+void SampleBlockPrefetcher::Prefetch(SampleBlockID id)
+{
+   if (id <= 0)
+      return;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   if (mStop)
+      // Shutting down or already shut down
+      return;
+
+   if (mQueued.count(id) || id == mInFlight ||
+       DecodedBlockCache::Get().Contains(&mConnection, id, floatSample))
+      return;
+
+   if (mPending.size() >= MaxPending)
+      // Hints are only advisory; drop rather than let the queue grow
+      return;
+
+   mPending.push_back(id);
+   mQueued.insert(id);
+   Start();
+   mCondition.notify_one();
+}
+
+void SampleBlockPrefetcher::Invalidate(SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   if (id == mInFlight)
+      mInFlightCancelled = true;
+
+   if (mQueued.erase(id)) {
+      auto end = mPending.end();
+      mPending.erase(std::remove(mPending.begin(), end, id), end);
+   }
+
+   DecodedBlockCache::Get().Invalidate(&mConnection, id);
+}
+
+void SampleBlockPrefetcher::Thread()
+{
+   while (true)
+   {
+      SampleBlockID id;
+      {
+         // Wait for work or the stop signal
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock, [&]{ return mStop || !mPending.empty(); });
+         if (mStop)
+            break;
+
+         id = mPending.front();
+         mPending.pop_front();
+         mQueued.erase(id);
+         mInFlight = id;
+         mInFlightCancelled = false;
+      }
+
+      // Query the database without holding the lock, so hints from the
+      // audio thread never wait for I/O
+      Fetch(id);
+   }
+}
+
+void SampleBlockPrefetcher::Fetch(SampleBlockID id)
+{
+   // This runs in the worker thread.  Failure here only means a later read
+   // goes to the database as it would have without the hint, so swallow all
+   // errors.
+   Floats samples;
+   size_t count = 0;
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      // (The connection keeps a separate statement for each thread)
+      sqlite3_stmt *stmt = mConnection.Prepare(DBConnection::PrefetchSamples,
+         "SELECT sampleformat, samples FROM sampleblocks WHERE blockid = ?1;");
+
+      if (sqlite3_bind_int64(stmt, 1, id))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      if (sqlite3_step(stmt) == SQLITE_ROW)
+      {
+         const auto format = (sampleFormat) sqlite3_column_int(stmt, 0);
+         auto src = (constSamplePtr) sqlite3_column_blob(stmt, 1);
+         const auto bytes = (size_t) sqlite3_column_bytes(stmt, 1);
+         const auto size = SAMPLE_SIZE(format);
+         if (src && size > 0) {
+            count = bytes / size;
+            samples.reinit(count);
+            SamplesToFloats(src, format, samples.get(), count);
+         }
+      }
+      else
+         wxLogDebug(wxT("SampleBlockPrefetcher::Fetch - no row for block %lld"), id);
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+   catch (...) {
+      samples.reset();
+   }
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   // Store while holding the lock, so that Invalidate() of this id can't
+   // intervene between the test and the store
+   if (samples && !mInFlightCancelled && !mStop)
+      DecodedBlockCache::Get().Store(&mConnection, id, floatSample,
+         reinterpret_cast<constSamplePtr>(samples.get()), count);
+   mInFlight = 0;
+   mInFlightCancelled = false;
+}
@@ -0,0 +1,75 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SampleBlockPrefetcher.h
+@brief Declare SampleBlockPrefetcher, which decodes sample blocks ahead of need on a background thread
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_SAMPLE_BLOCK_PREFETCHER__
+#define __SNEEDACITY_SAMPLE_BLOCK_PREFETCHER__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+class DBConnection;
+
+using SampleBlockID = long long;
+
+//! Reads sample blocks of one database connection ahead of need
+/*! Clients give hints of block ids that will soon be read.  A worker thread
+ fetches those rows and stores their contents, converted to float, in the
+ DecodedBlockCache, so that a later read on a time-critical thread can be
+ satisfied without a database query.
+
+ Only non-silent block ids (which are positive) are ever queued.
+ */
+class SampleBlockPrefetcher
+{
+public:
+   //! Default limit on the number of hints waiting for the worker
+   static constexpr size_t MaxPending = 256;
+
+   explicit SampleBlockPrefetcher(DBConnection &connection);
+   ~SampleBlockPrefetcher();
+
+   SampleBlockPrefetcher(const SampleBlockPrefetcher&) = delete;
+   SampleBlockPrefetcher &operator=(const SampleBlockPrefetcher&) = delete;
+
+   //! Queue a block for background decoding, if it is not cached or queued
+   /*! Never blocks for database access; hints beyond MaxPending are dropped */
+   void Prefetch(SampleBlockID id);
+
+   //! Forget any cached or queued samples of a block whose row is deleted
+   void Invalidate(SampleBlockID id);
+
+   //! Stop the worker thread and discard everything; called before the
+   //! connection finalizes its statements
+   void Stop();
+
+private:
+   void Start();
+   void Thread();
+   void Fetch(SampleBlockID id);
+
+   DBConnection &mConnection;
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   std::thread mThread;
+   bool mStop{ false };
+
+   std::deque<SampleBlockID> mPending;
+   std::unordered_set<SampleBlockID> mQueued;
+
+   //! Block being fetched now by the worker, or 0
+   SampleBlockID mInFlight{ 0 };
+   //! Set if mInFlight was invalidated while it was being fetched
+   bool mInFlightCancelled{ false };
+};
+
+#endif
@@ -47,7 +47,9 @@
 
 DitherType gLowQualityDither = DitherType::none;
 DitherType gHighQualityDither = DitherType::shaped;
-static Dither gDitherAlgorithm;
+// Each thread that converts samples has its own, so that effects processing
+// tracks in worker threads don't share the state of the dither
+static thread_local Dither gDitherAlgorithm;
 
 void InitDitherers()
 {
@@ -33,6 +33,7 @@
 
 #include <algorithm>
 #include <float.h>
+#include <limits>
 #include <math.h>
 
 #include <wx/intl.h>
@@ -40,11 +41,13 @@
 #include <wx/ffile.h>
 #include <wx/log.h>
 
+#include "ProjectSerializer.h"
 #include "SampleBlock.h"
 #include "InconsistencyException.h"
 #include "widgets/SneedacityMessageBox.h"
 
 size_t Sequence::sMaxDiskBlockSize = 1048576;
+size_t Sequence::sSummaryPyramidFactor = SummaryPyramid::DefaultFactor;
 
 // Sequence methods
 Sequence::Sequence(
@@ -143,6 +146,7 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format,
    if (mBlock.size() == 0)
    {
       mSampleFormat = format;
+      MarkChanged();
       return true;
    }
 
@@ -368,6 +372,51 @@ float Sequence::GetRMS(sampleCount start, sampleCount len, bool mayThrow) const
    return sqrt(sumsq / length.as_double() );
 }
 
+double Sequence::GetSum(sampleCount start, sampleCount len, bool mayThrow) const
+{
+   if (len == 0 || mBlock.size() == 0)
+      return 0.0;
+
+   double sum = 0.0;
+
+   unsigned int block0 = FindBlock(start);
+   unsigned int block1 = FindBlock(start + len - 1);
+
+   // The blocks in the middle of this region remember their sums
+   for (unsigned b = block0 + 1; b < block1; b++)
+      sum += mBlock[b].sb->GetSum(mayThrow);
+
+   // The first and last blocks may only partly overlap the region; then we
+   // need to read some samples, unless they are whole after all
+   {
+      const SeqBlock &theBlock = mBlock[block0];
+      const auto &sb = theBlock.sb;
+      // start lies within theBlock
+      auto s0 = ( start - theBlock.start ).as_size_t();
+      const auto maxl0 =
+         (theBlock.start + sb->GetSampleCount() - start).as_size_t();
+      const auto l0 = limitSampleBufferSize( maxl0, len );
+      if (s0 == 0 && l0 == sb->GetSampleCount())
+         sum += sb->GetSum(mayThrow);
+      else
+         sum += sb->GetSum(s0, l0, mayThrow);
+   }
+
+   if (block1 > block0) {
+      const SeqBlock &theBlock = mBlock[block1];
+      const auto &sb = theBlock.sb;
+
+      // start + len - 1 lies within theBlock
+      const auto l0 = ( start + len - theBlock.start ).as_size_t();
+      if (l0 == sb->GetSampleCount())
+         sum += sb->GetSum(mayThrow);
+      else
+         sum += sb->GetSum(0, l0, mayThrow);
+   }
+
+   return sum;
+}
+
 // Must pass in the correct factory for the result.  If it's not the same
 // as in this, then block contents must be copied.
 std::unique_ptr<Sequence> Sequence::Copy( const SampleBlockFactoryPtr &pFactory,
@@ -580,6 +629,7 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
          mBlock[i].start += addedLen;
 
       mNumSamples += addedLen;
+      MarkChanged();
 
       // This consistency check won't throw, it asserts.
       // Proof that we kept consistency is not hard.
@@ -782,6 +832,90 @@ size_t Sequence::GetBestBlockSize(sampleCount start) const
    return result;
 }
 
+namespace {
+// The compact form of a block list in the project document: the value of
+// a "blockids" attribute of <sequence>, instead of a <waveblock> element for
+// each block.  Starts are not stored, because blocks are contiguous.  Each id
+// is written as its difference from the previous one (the first from zero),
+// separated by spaces, and a run of n equal differences d as "d*n", so that
+// the consecutive ids of one recording take a single token.
+wxString PackBlockIDs(const BlockArray &blocks)
+{
+   std::string result;
+   SampleBlockID previous = 0;
+   for (size_t ii = 0, nn = blocks.size(); ii < nn;) {
+      const auto delta = blocks[ii].sb->GetBlockID() - previous;
+      size_t count = 0;
+      while (ii < nn && blocks[ii].sb->GetBlockID() - previous == delta)
+         previous += delta, ++ii, ++count;
+
+      if (!result.empty())
+         result += ' ';
+      result += std::to_string(delta);
+      if (count > 1)
+         result += '*', result += std::to_string(count);
+   }
+   return wxString::FromAscii(result.c_str());
+}
+
+//! Reads one optionally negative decimal number, advancing p past it
+bool ReadPackedNumber(const wxChar *&p, long long &value)
+{
+   const bool negative = (*p == wxT('-'));
+   if (negative)
+      ++p;
+   if (*p < wxT('0') || *p > wxT('9'))
+      return false;
+
+   constexpr auto max = std::numeric_limits<long long>::max();
+   long long magnitude = 0;
+   for (; *p >= wxT('0') && *p <= wxT('9'); ++p) {
+      const int digit = *p - wxT('0');
+      if (magnitude > (max - digit) / 10)
+         return false;
+      magnitude = magnitude * 10 + digit;
+   }
+   value = negative ? -magnitude : magnitude;
+   return true;
+}
+
+//! Inverse of PackBlockIDs
+/*! @return false if the text is malformed, overflows, or gives more than
+ limit ids */
+bool UnpackBlockIDs(
+   const wxChar *text, long long limit, std::vector<SampleBlockID> &ids)
+{
+   constexpr auto max = std::numeric_limits<SampleBlockID>::max();
+   constexpr auto min = std::numeric_limits<SampleBlockID>::min();
+   SampleBlockID id = 0;
+   auto p = text;
+   while (*p) {
+      if (*p == wxT(' ')) {
+         ++p;
+         continue;
+      }
+
+      long long delta, count = 1;
+      if (!ReadPackedNumber(p, delta))
+         return false;
+      if (*p == wxT('*') && (!ReadPackedNumber(++p, count) || count < 1))
+         return false;
+      if (*p && *p != wxT(' '))
+         return false;
+      if (count > limit - (long long)ids.size())
+         return false;
+
+      for (; count > 0; --count) {
+         if ((delta > 0 && id > max - delta) || (delta < 0 && id < min - delta))
+            return false;
+         id += delta;
+         ids.push_back(id);
+      }
+   }
+   return true;
+}
+}
+
 bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
 {
    auto &factory = *mpFactory;
@@ -835,6 +969,8 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
    /* handle sequence tag and its attributes */
    if (!wxStrcmp(tag, wxT("sequence")))
    {
+      const wxChar *packedIDs = nullptr;
+
       while(*attrs)
       {
          const wxChar *attr = *attrs++;
@@ -891,8 +1027,33 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
             }
             mNumSamples = nValue;
          }
+         else if (!wxStrcmp(attr, wxT("blockids")))
+         {
+            // Decode after the loop, knowing the format and sample count
+            packedIDs = value;
+         }
       } // while
 
+      if (packedIDs)
+      {
+         // Every block has at least one sample
+         std::vector<SampleBlockID> ids;
+         if (!UnpackBlockIDs(packedIDs, mNumSamples.as_long_long(), ids))
+         {
+            mErrorOpening = true;
+            return false;
+         }
+
+         sampleCount start = 0;
+         mBlock.reserve(mBlock.size() + ids.size());
+         for (auto id : ids)
+         {
+            SeqBlock wb{ factory.CreateFromID(mSampleFormat, id), start };
+            start += wb.sb->GetSampleCount();
+            mBlock.push_back(wb);
+         }
+      }
+
       return true;
    }
 
@@ -951,9 +1112,31 @@ XMLTagHandler *Sequence::HandleXMLChild(const wxChar *tag)
    return nullptr;
 }
 
+void Sequence::MarkChanged()
+{
+   mXMLCache.reset();
+}
+
 // Throws exceptions rather than reporting errors.
 void Sequence::WriteXML(XMLWriter &xmlFile) const
 // may throw
+{
+   auto pSerializer = dynamic_cast<ProjectSerializer*>(&xmlFile);
+   if (!pSerializer) {
+      DoWriteXML(xmlFile, false);
+      return;
+   }
+
+   if (!mXMLCache) {
+      auto pCache = std::make_unique<ProjectSerializer>(1024);
+      DoWriteXML(*pCache, true);
+      mXMLCache = std::move(pCache);
+   }
+   pSerializer->WriteFragment(*mXMLCache);
+}
+
+void Sequence::DoWriteXML(XMLWriter &xmlFile, bool packed) const
+// may throw
 {
    unsigned int b;
 
@@ -985,6 +1168,9 @@ void Sequence::WriteXML(XMLWriter &xmlFile) const
 //         bb.sb->SetLength(mMaxSamples);
       }
 
+      if (packed)
+         continue;
+
       xmlFile.StartTag(wxT("waveblock"));
       xmlFile.WriteAttr(wxT("start"), bb.start.as_long_long() );
 
@@ -993,6 +1179,9 @@ void Sequence::WriteXML(XMLWriter &xmlFile) const
       xmlFile.EndTag(wxT("waveblock"));
    }
 
+   if (packed)
+      xmlFile.WriteAttr(wxT("blockids"), PackBlockIDs(mBlock));
+
    xmlFile.EndTag(wxT("sequence"));
 }
 
@@ -1045,6 +1234,38 @@ int Sequence::FindBlock(sampleCount pos) const
    return rval;
 }
 
+const SummaryPyramid &Sequence::GetBlockPyramid() const
+{
+   // Validation costs only a pass over the block pointers, while
+   // rebuilding needs no reading, because whole-block summaries are held
+   // in memory.
+   // Weak pointers compare by ownership, so a block freed since the last
+   // rebuild can't be mistaken for another allocated at the same address.
+   const auto nBlocks = mBlock.size();
+   bool valid = mPyramidBlocks.size() == nBlocks &&
+      mBlockPyramid.GetFactor() == sSummaryPyramidFactor;
+   for (size_t ii = 0; valid && ii < nBlocks; ++ii) {
+      const auto &pBlock = mBlock[ii].sb;
+      const auto &wBlock = mPyramidBlocks[ii];
+      valid = !wBlock.owner_before(pBlock) && !pBlock.owner_before(wBlock);
+   }
+
+   if (!valid) {
+      mPyramidBlocks.clear();
+      std::vector<SummaryPyramid::Frame> frames;
+      frames.reserve(nBlocks);
+      for (const auto &block : mBlock) {
+         mPyramidBlocks.push_back(block.sb);
+         const auto values = block.sb->GetMinMaxRMS(false);
+         frames.push_back(SummaryPyramid::Frame::FromRMS(
+            values.min, values.max, values.RMS, block.sb->GetSampleCount()));
+      }
+      mBlockPyramid = SummaryPyramid{ std::move(frames), sSummaryPyramidFactor };
+   }
+
+   return mBlockPyramid;
+}
+
 //static
 bool Sequence::Read(samplePtr buffer, sampleFormat format,
                     const SeqBlock &b, size_t blockRelativeStart, size_t len,
@@ -1107,6 +1328,22 @@ bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
    return result;
 }
 
+void Sequence::Prefetch(sampleCount start, sampleCount len) const
+{
+   if (start < 0) {
+      len += start;
+      start = 0;
+   }
+   const auto end = std::min(mNumSamples, start + len);
+   if (start >= end)
+      return;
+
+   const unsigned nBlocks = mBlock.size();
+   for (unsigned b = FindBlock(start);
+        b < nBlocks && mBlock[b].start < end; ++b)
+      mBlock[b].sb->Prefetch();
+}
+
 // Pass NULL to set silence
 /*! @excsafety{Strong} */
 void Sequence::SetSamples(constSamplePtr buffer, sampleFormat format,
@@ -1228,9 +1465,7 @@ struct MinMaxSumsq
       min = FLT_MAX, max = -FLT_MAX, sumsq = 0.0f;
       while (count--) {
          float v;
-         switch (divisor) {
-         default:
-         case 1:
+         if (divisor == 1) {
             // array holds samples
             v = *pv++;
             if (v < min)
@@ -1238,9 +1473,8 @@ struct MinMaxSumsq
             if (v > max)
                max = v;
             sumsq += v * v;
-            break;
-         case 256:
-         case 65536:
+         }
+         else {
             // array holds triples of min, max, and rms values
             v = *pv++;
             if (v < min)
@@ -1250,7 +1484,6 @@ struct MinMaxSumsq
                max = v;
             v = *pv++;
             sumsq += v * v;
-            break;
          }
       }
    }
@@ -1282,14 +1515,16 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
 
    auto srcX = s0;
    decltype(srcX) nextSrcX = 0;
-   int lastRmsDenom = 0;
-   int lastDivisor = 0;
+   // How many samples have contributed to the rms of the previous column
+   double lastCount = 0;
    auto whereNow = std::min(s1 - 1, where[0]);
    decltype(whereNow) whereNext = 0;
    // Loop over block files, opening and reading and closing each
    // not more than once
    unsigned nBlocks = mBlock.size();
    const unsigned int block0 = FindBlock(s0);
+   // Validated at most once, when first needed
+   const SummaryPyramid *pBlockPyramid = nullptr;
    for (unsigned int b = block0; b < nBlocks; ++b) {
       if (b > block0)
          srcX = nextSrcX;
@@ -1319,25 +1554,58 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
                 (whereNext = std::min(s1 - 1, where[nextPixel])) < nextSrcX)
             ++nextPixel;
       }
-      if (nextPixel == pixel)
+      if (nextPixel == pixel) {
          // The entire block's samples fall within one pixel column.
          // Either it's a rare odd block at the end, or else,
          // we must be really zoomed out!
-         // Omit the entire block's contents from min/max/rms
-         // calculation, which is not correct, but correctness might not
-         // be worth the compute time if this happens every pixel
-         // column. -- PRL
+         // Combine this and all following whole blocks in the same column,
+         // using the summaries over blocks, which need no reading
+         const auto columnEnd =
+            (pixel < len) ? std::min(s1, where[pixel]) : s1;
+         auto bEnd = b;
+         while (bEnd < nBlocks &&
+                mBlock[bEnd].start + mBlock[bEnd].sb->GetSampleCount()
+                   <= columnEnd)
+            ++bEnd;
+         if (bEnd > b && pixel > 0) {
+            if (!pBlockPyramid)
+               pBlockPyramid = &GetBlockPyramid();
+            const auto values = pBlockPyramid->Query(b, bEnd);
+            const int lastPixel = pixel - 1;
+            float &lastMin = min[lastPixel];
+            lastMin = std::min(lastMin, values.min);
+            float &lastMax = max[lastPixel];
+            lastMax = std::max(lastMax, values.max);
+            float &lastRms = rms[lastPixel];
+            lastRms = sqrt(
+               (lastRms * lastRms * lastCount + values.sumsq) /
+               (lastCount + values.count)
+            );
+            lastCount += values.count;
+
+            // Resume with the first block not yet combined
+            b = bEnd - 1;
+            const auto &lastBlock = mBlock[b];
+            nextSrcX = std::min(s1,
+               lastBlock.start + lastBlock.sb->GetSampleCount());
+         }
+         // Else it's the odd partial block at the end; omit it
          continue;
+      }
       if (nextPixel == len)
          whereNext = s1;
 
-      // Decide the summary level
+      // Decide the summary level, the coarsest with no more samples per
+      // frame than per pixel; the levels double from 256 to 65536, so each
+      // column combines fewer than two frames of them
       const double samplesPerPixel =
          (whereNext - whereNow).as_double() / (nextPixel - pixel);
-      const int divisor =
-           (samplesPerPixel >= 65536) ? 65536
-         : (samplesPerPixel >= 256) ? 256
-         : 1;
+      int divisor = 1;
+      if (samplesPerPixel >= 256) {
+         divisor = 256;
+         while (divisor < 65536 && samplesPerPixel >= 2 * divisor)
+            divisor *= 2;
+      }
 
       int blockStatus = b;
 
@@ -1365,7 +1633,6 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
 
       // Read from the block file or its summary
       switch (divisor) {
-      default:
       case 1:
          // Read samples
          // no-throw for display operations!
@@ -1383,6 +1650,12 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
          // This function fills with zeroes if read fails
          seqBlock.sb->GetSummary64k(temp.get(), startPosition, num);
          break;
+      default:
+         // Read triples of a level between
+         // Ignore the return value.
+         // This function fills with zeroes if read fails
+         seqBlock.sb->GetDerivedSummary(divisor, temp.get(), startPosition, num);
+         break;
       }
       
       auto filePosition = startPosition;
@@ -1401,10 +1674,9 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
             float &lastMax = max[lastPixel];
             lastMax = std::max(lastMax, values.max);
             float &lastRms = rms[lastPixel];
-            int lastNumSamples = lastRmsDenom * lastDivisor;
             lastRms = sqrt(
-               (lastRms * lastRms * lastNumSamples + values.sumsq * divisor) /
-               (lastNumSamples + diff * divisor)
+               (lastRms * lastRms * lastCount + values.sumsq * divisor) /
+               (lastCount + diff * divisor)
             );
 
             filePosition = midPosition;
@@ -1450,8 +1722,7 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
       wxASSERT(pixel == nextPixel);
       whereNow = whereNext;
       pixel = nextPixel;
-      lastDivisor = divisor;
-      lastRmsDenom = rmsDenom;
+      lastCount = double(rmsDenom) * divisor;
    } // for each block file
 
    wxASSERT(pixel == len);
@@ -1692,6 +1963,7 @@ void Sequence::Delete(sampleCount start, sampleCount len)
          mBlock[j].start -= len;
 
       mNumSamples -= len;
+      MarkChanged();
 
       // This consistency check won't throw, it asserts.
       // Proof that we kept consistency is not hard.
@@ -1870,6 +2142,7 @@ void Sequence::CommitChangesIfConsistent
 
    mBlock.swap(newBlock);
    mNumSamples = numSamples;
+   MarkChanged();
 }
 
 void Sequence::AppendBlocksIfConsistent
@@ -1912,6 +2185,7 @@ void Sequence::AppendBlocksIfConsistent
    // use No-fail-guarantee
 
    mNumSamples = numSamples;
+   MarkChanged();
    consistent = true;
 }
 
@@ -1954,3 +2228,14 @@ size_t Sequence::GetMaxDiskBlockSize()
 {
    return sMaxDiskBlockSize;
 }
+
+// static
+void Sequence::SetSummaryPyramidFactor(size_t factor)
+{
+   sSummaryPyramidFactor = std::max<size_t>(2, factor);
+}
+
+size_t Sequence::GetSummaryPyramidFactor()
+{
+   return sSummaryPyramidFactor;
+}
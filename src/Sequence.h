@@ -14,12 +14,15 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "SampleFormat.h"
+#include "SummaryPyramid.h"
 #include "xml/XMLTagHandler.h"
 
 #include "Identifier.h"
 
+class ProjectSerializer;
 class SampleBlock;
 class SampleBlockFactory;
 using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
@@ -68,6 +71,11 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    static void SetMaxDiskBlockSize(size_t bytes);
    static size_t GetMaxDiskBlockSize();
 
+   //! How many summaries of one level of the pyramid over blocks are
+   //! combined in one summary of the next level
+   static void SetSummaryPyramidFactor(size_t factor);
+   static size_t GetSummaryPyramidFactor();
+
    //
    // Constructor / Destructor / Duplicator
    //
@@ -90,6 +98,10 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    bool Get(samplePtr buffer, sampleFormat format,
             sampleCount start, size_t len, bool mayThrow) const;
 
+   //! Hint that samples in the range will soon be read; never throws or waits
+   /*! The range is clipped to the sequence */
+   void Prefetch(sampleCount start, sampleCount len) const;
+
    // Note that len is not size_t, because nullptr may be passed for buffer, in
    // which case, silence is inserted, possibly a large amount.
    void SetSamples(constSamplePtr buffer, sampleFormat format,
@@ -162,6 +174,8 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    std::pair<float, float> GetMinMax(
       sampleCount start, sampleCount len, bool mayThrow) const;
    float GetRMS(sampleCount start, sampleCount len, bool mayThrow) const;
+   //! Sum of the samples, reading only blocks partly in the range
+   double GetSum(sampleCount start, sampleCount len, bool mayThrow) const;
 
    //
    // Getting block size and alignment information
@@ -180,7 +194,7 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    // you're doing!
    //
 
-   BlockArray &GetBlockArray() { return mBlock; }
+   BlockArray &GetBlockArray() { MarkChanged(); return mBlock; }
    const BlockArray &GetBlockArray() const { return mBlock; }
 
  private:
@@ -190,6 +204,7 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    //
 
    static size_t    sMaxDiskBlockSize;
+   static size_t    sSummaryPyramidFactor;
 
    //
    // Private variables
@@ -208,12 +223,32 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
 
    bool          mErrorOpening{ false };
 
+   //! Summaries over whole blocks, for drawing when zoomed far out
+   /*! Rebuilt on demand when mBlock no longer holds mPyramidBlocks */
+   mutable SummaryPyramid mBlockPyramid;
+   mutable std::vector< std::weak_ptr<SampleBlock> > mPyramidBlocks;
+
+   //! The fields WriteXML() gives a ProjectSerializer, reused until a change
+   /*! Saving a large project re-encodes mostly untouched block lists; all
+    serializers of one run share a dictionary, so the bytes stay valid */
+   mutable std::unique_ptr<ProjectSerializer> mXMLCache;
+
    //
    // Private methods
    //
 
    int FindBlock(sampleCount pos) const;
 
+   //! Call whenever mBlock or the attributes that WriteXML() writes change
+   void MarkChanged();
+
+   //! Packed writes the block list as one attribute, as the project
+   //! document stores it, instead of a tag for each block
+   void DoWriteXML(XMLWriter &xmlFile, bool packed) const;
+
+   //! Summaries over whole blocks, up to date with mBlock
+   const SummaryPyramid &GetBlockPyramid() const;
+
    SeqBlock::SampleBlockPtr DoAppend(
       constSamplePtr buffer, sampleFormat format, size_t len, bool coalesce);
 
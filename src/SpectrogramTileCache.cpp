@@ -0,0 +1,258 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SpectrogramTileCache.cpp
+@brief Implements SpectrogramTileCache
+
+**********************************************************************/
+
+#include "SpectrogramTileCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include <wx/app.h>
+
+#include "Prefs.h"
+#include "Sequence.h"
+#include "ThreadPool.h"
+#include "WaveClip.h"
+#include "prefs/SpectrogramSettings.h"
+
+wxDEFINE_EVENT(EVT_SPECTROGRAM_TILES_READY, wxCommandEvent);
+
+IntSetting SpectrogramTileCache::MemoryLimit{
+   L"/Performance/SpectrogramCacheMB", 256 };
+
+BoolSetting SpectrogramTileCache::BackgroundRendering{
+   L"/Performance/BackgroundSpectrograms", true };
+
+bool SpectrogramTileCache::Key::operator == (const Key &other) const
+{
+   return clip == other.clip && dirty == other.dirty &&
+      algorithm == other.algorithm && windowType == other.windowType &&
+      windowSize == other.windowSize &&
+      zeroPaddingFactor == other.zeroPaddingFactor &&
+      frequencyGain == other.frequencyGain &&
+      rate == other.rate && samplesPerPixel == other.samplesPerPixel &&
+      tile == other.tile;
+}
+
+size_t SpectrogramTileCache::KeyHash::operator () (const Key &key) const
+{
+   auto result = std::hash<unsigned long long>{}(key.clip);
+   result = result * 31 + std::hash<int>{}(key.dirty);
+   result = result * 31 + std::hash<size_t>{}(key.windowSize);
+   result = result * 31 + std::hash<double>{}(key.samplesPerPixel);
+   result = result * 31 + std::hash<long long>{}(key.tile);
+   return result;
+}
+
+SpectrogramTileCache &SpectrogramTileCache::Get()
+{
+   static SpectrogramTileCache instance;
+   return instance;
+}
+
+SpectrogramTileCache::SpectrogramTileCache()
+   : mByteBudget{ size_t(std::max(0, MemoryLimit.Read())) * 1024 * 1024 }
+{
+}
+
+bool SpectrogramTileCache::CanRender(const SpectrogramSettings &settings)
+{
+   return (settings.algorithm == SpectrogramSettings::algSTFT ||
+           settings.algorithm == SpectrogramSettings::algPitchEAC) &&
+      BackgroundRendering.Read() &&
+      ThreadPool::Get().GetThreadCount() > 0;
+}
+
+bool SpectrogramTileCache::Read(
+   const Key &key, size_t column, size_t count, float *dest)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto iter = mEntries.find(key);
+   if (iter == mEntries.end())
+      return false;
+
+   auto &entry = iter->second;
+   const auto nBins = entry.data.size() / TileColumns;
+   wxASSERT(column + count <= TileColumns);
+   memcpy(dest, entry.data.data() + column * nBins,
+      count * nBins * sizeof(float));
+   // Move to the front of the recency list
+   mRecency.splice(mRecency.begin(), mRecency, entry.position);
+   return true;
+}
+
+void SpectrogramTileCache::Request(
+   unsigned long long clip, std::vector<TileRequest> requests)
+{
+   size_t toStart = 0;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mWaiting.erase(std::remove_if(mWaiting.begin(), mWaiting.end(),
+         [clip](const TileRequest &request){
+            return request.key.clip == clip; }),
+         mWaiting.end());
+      for (auto &request : requests)
+         if (!mEntries.count(request.key) && !IsComputing(request.key))
+            mWaiting.push_back(std::move(request));
+
+      const auto wanted =
+         std::min(mWaiting.size(), ThreadPool::Get().GetThreadCount());
+      if (mWorkers < wanted) {
+         toStart = wanted - mWorkers;
+         mWorkers = wanted;
+      }
+   }
+
+   while (toStart--)
+      ThreadPool::Get().Submit([this]{ Work(); });
+}
+
+void SpectrogramTileCache::Cancel(unsigned long long clip)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   mWaiting.erase(std::remove_if(mWaiting.begin(), mWaiting.end(),
+      [clip](const TileRequest &request){
+         return request.key.clip == clip; }),
+      mWaiting.end());
+   mCondition.wait(lock, [this, clip]{
+      return std::none_of(mComputing.begin(), mComputing.end(),
+         [clip](const Key &key){ return key.clip == clip; });
+   });
+}
+
+void SpectrogramTileCache::SetByteBudget(size_t bytes)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mByteBudget = bytes;
+   Evict(0);
+}
+
+void SpectrogramTileCache::Work()
+{
+   TileRequest request;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      // Another worker may have made the tile since it was requested
+      while (!mWaiting.empty() &&
+         (mEntries.count(mWaiting.front().key) ||
+          IsComputing(mWaiting.front().key)))
+         mWaiting.pop_front();
+      if (mWaiting.empty()) {
+         --mWorkers;
+         return;
+      }
+      request = std::move(mWaiting.front());
+      mWaiting.pop_front();
+      mComputing.push_back(request.key);
+   }
+
+   std::vector<float> data;
+   try {
+      Compute(request, data);
+   }
+   catch (...) {
+      // Leave the columns empty; they are requested again at the next paint
+      data.clear();
+   }
+
+   // Let go of the samples before Cancel() can return to the clip
+   const auto key = request.key;
+   request = {};
+
+   bool notify = false, more = false;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mComputing.erase(
+         std::find(mComputing.begin(), mComputing.end(), key));
+      const auto bytes = data.size() * sizeof(float);
+      if (!data.empty() && bytes <= mByteBudget) {
+         Evict(bytes);
+         mRecency.push_front(key);
+         auto &entry = mEntries[key];
+         entry.data = std::move(data);
+         entry.position = mRecency.begin();
+         mBytes += bytes;
+         notify = !mNotifying;
+         mNotifying = true;
+      }
+      more = !mWaiting.empty();
+      if (!more)
+         --mWorkers;
+      mCondition.notify_all();
+   }
+
+   if (notify)
+      // One repaint for however many tiles are ready by then
+      wxTheApp->CallAfter([]{
+         {
+            auto &cache = Get();
+            std::lock_guard<std::mutex> guard(cache.mMutex);
+            cache.mNotifying = false;
+         }
+         wxCommandEvent e{ EVT_SPECTROGRAM_TILES_READY };
+         wxTheApp->ProcessEvent(e);
+      });
+
+   if (more)
+      ThreadPool::Get().Submit([this]{ Work(); });
+}
+
+void SpectrogramTileCache::Compute(
+   const TileRequest &request, std::vector<float> &data)
+{
+   const auto &settings = *request.settings;
+   const auto &samples = *request.samples;
+   const auto &key = request.key;
+   const double pixelsPerSecond = key.rate / key.samplesPerPixel;
+
+   // Windows are cached already, so Grow() changes only the SpecCache
+   SpecCache cache;
+   cache.Grow(TileColumns, settings, pixelsPerSecond, 0);
+
+   // The same grid of columns as WaveClip::GetSpectrogram() uses
+   const auto first = key.tile * (long long)TileColumns;
+   for (size_t x = 0; x <= TileColumns; ++x)
+      cache.where[x] = sampleCount(
+         floor(1.0 + double(first + (long long)x) * key.samplesPerPixel));
+
+   std::vector<float> buffer(settings.WindowSize());
+   const SpecCache::SampleReader read =
+      [&](sampleCount start, size_t len) -> const float * {
+         if (len > buffer.size())
+            buffer.resize(len);
+         return samples.Get(reinterpret_cast<samplePtr>(buffer.data()),
+            floatSample, start, len, false)
+            ? buffer.data() : nullptr;
+      };
+   cache.Populate(settings, read, 0, 0, TileColumns,
+      samples.GetNumSamples(), 0, key.rate, pixelsPerSecond);
+
+   data = std::move(cache.freq);
+}
+
+bool SpectrogramTileCache::IsComputing(const Key &key) const
+{
+   return std::find(mComputing.begin(), mComputing.end(), key) !=
+      mComputing.end();
+}
+
+void SpectrogramTileCache::Evict(size_t bytesNeeded)
+{
+   while (!mRecency.empty() && mBytes + bytesNeeded > mByteBudget)
+      Erase(mEntries.find(mRecency.back()));
+}
+
+void SpectrogramTileCache::Erase(Entries::iterator iter)
+{
+   wxASSERT(iter != mEntries.end());
+   mBytes -= iter->second.data.size() * sizeof(float);
+   mRecency.erase(iter->second.position);
+   mEntries.erase(iter);
+}
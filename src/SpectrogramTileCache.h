@@ -0,0 +1,157 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SpectrogramTileCache.h
+@brief Declare SpectrogramTileCache, which computes spectrogram columns in worker threads and keeps them in a bounded LRU
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_SPECTROGRAM_TILE_CACHE__
+#define __SNEEDACITY_SPECTROGRAM_TILE_CACHE__
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/event.h>
+
+class BoolSetting;
+class IntSetting;
+class Sequence;
+class SpectrogramSettings;
+
+//! Sent to the application when more tiles are ready, so that views repaint
+wxDECLARE_EXPORTED_EVENT(SNEEDACITY_DLL_API,
+                         EVT_SPECTROGRAM_TILES_READY, wxCommandEvent);
+
+//! Process-wide, memory-bounded cache of spectrogram tiles, filled in the
+//! shared ThreadPool
+/*! A tile is TileColumns consecutive columns of all frequency bins, for one
+ zoom level of a clip.  Columns are counted from the start of the clip, so
+ tiles stay valid while the view scrolls, and scrolling back to a place seen
+ before needs no computation.
+
+ WaveClip::GetSpectrogram() assembles what it draws from tiles, requesting
+ the missing ones, and draws those columns empty until EVT_SPECTROGRAM_TILES_READY.
+
+ Workers read samples from a copy of the clip's Sequence, which shares the
+ immutable sample blocks, so that the clip may be edited meanwhile.
+ */
+class SNEEDACITY_DLL_API SpectrogramTileCache
+{
+public:
+   //! Limit on the memory used, in megabytes
+   static IntSetting MemoryLimit;
+   //! Whether to compute spectrograms in the background at all
+   static BoolSetting BackgroundRendering;
+
+   //! Columns of each tile
+   static constexpr size_t TileColumns = 128;
+
+   //! Identifies one tile
+   struct Key {
+      //! WaveClip::GetSerial() and the dirty count of the clip
+      unsigned long long clip;
+      int dirty;
+
+      //! What SpecCache::Matches() compares
+      int algorithm;
+      int windowType;
+      size_t windowSize;
+      unsigned zeroPaddingFactor;
+      int frequencyGain;
+      double rate;
+      double samplesPerPixel;
+
+      //! Index of the first column divided by TileColumns; may be negative
+      long long tile;
+
+      bool operator == (const Key &other) const;
+   };
+
+   //! What a worker needs to compute one tile
+   struct TileRequest {
+      Key key;
+      //! Copy of the clip's samples, which the clip must outlive; see Cancel()
+      std::shared_ptr<const Sequence> samples;
+      //! Copy of the track's settings, with windows already cached
+      std::shared_ptr<const SpectrogramSettings> settings;
+   };
+
+   static SpectrogramTileCache &Get();
+
+   //! Whether settings can be rendered in the background
+   /*! Reassignment spreads each column into its neighbours, so it is not
+    split into tiles */
+   static bool CanRender(const SpectrogramSettings &settings);
+
+   SpectrogramTileCache(const SpectrogramTileCache&) = delete;
+   SpectrogramTileCache &operator=(const SpectrogramTileCache&) = delete;
+
+   //! Copy count columns of a cached tile, from the given column of it
+   /*! @return false, leaving dest untouched, if the tile is not cached */
+   bool Read(const Key &key, size_t column, size_t count, float *dest);
+
+   //! Replace the waiting requests of a clip, most urgent first
+   /*! Requests for tiles that are cached or being computed are ignored */
+   void Request(unsigned long long clip, std::vector<TileRequest> requests);
+
+   //! Forget the waiting requests of a clip, and wait for its tiles being
+   //! computed
+   /*! The clip calls this in the main thread before it releases the samples
+    of its requests, so that sample blocks are never destroyed by workers */
+   void Cancel(unsigned long long clip);
+
+   //! Change the memory limit, evicting as needed
+   void SetByteBudget(size_t bytes);
+
+private:
+   SpectrogramTileCache();
+
+   struct KeyHash {
+      size_t operator () (const Key &key) const;
+   };
+
+   struct Entry {
+      std::vector<float> data;
+      std::list<Key>::iterator position;
+   };
+
+   using Entries = std::unordered_map<Key, Entry, KeyHash>;
+
+   //! Compute one waiting tile, then resubmit, so that a long queue does
+   //! not hold a thread of the pool
+   void Work();
+   static void Compute(const TileRequest &request, std::vector<float> &data);
+
+   //! Precondition: mMutex is held
+   bool IsComputing(const Key &key) const;
+   //! Precondition: mMutex is held
+   void Evict(size_t bytesNeeded);
+   //! Precondition: mMutex is held
+   void Erase(Entries::iterator iter);
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+
+   Entries mEntries;
+   //! Most recently used at the front
+   std::list<Key> mRecency;
+   size_t mBytes{ 0 };
+   size_t mByteBudget;
+
+   std::deque<TileRequest> mWaiting;
+   //! Keys of tiles the workers compute now
+   std::vector<Key> mComputing;
+   //! Number of tasks submitted to the pool and not yet finished
+   size_t mWorkers{ 0 };
+   //! Whether a notification is already on its way to the main thread
+   bool mNotifying{ false };
+};
+
+#endif
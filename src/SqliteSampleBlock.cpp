@@ -9,11 +9,15 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 **********************************************************************/
 
 #include <float.h>
+#include <mutex>
 #include <sqlite3.h>
 
 #include "DBConnection.h"
+#include "DecodedBlockCache.h"
 #include "ProjectFileIO.h"
+#include "SampleBlockPrefetcher.h"
 #include "SampleFormat.h"
+#include "SummaryKernels.h"
 #include "xml/XMLTagHandler.h"
 
 #include "SampleBlock.h" // to inherit
@@ -49,7 +53,11 @@ public:
    sampleFormat GetSampleFormat() const;
    size_t GetSampleCount() const override;
 
+   void Prefetch() override;
+
    bool GetSummary256(float *dest, size_t frameoffset, size_t numframes) override;
+   bool GetDerivedSummary(size_t divisor,
+      float *dest, size_t frameoffset, size_t numframes) override;
    bool GetSummary64k(float *dest, size_t frameoffset, size_t numframes) override;
    double GetSumMin() const;
    double GetSumMax() const;
@@ -61,6 +69,12 @@ public:
    /// Gets extreme values for the entire block
    MinMaxRMS DoGetMinMaxRMS() const override;
 
+   /// Gets the sum of the samples in the specified region
+   double DoGetSum(size_t start, size_t len) override;
+
+   /// Gets the sum of the samples of the entire block
+   double DoGetSum() override;
+
    size_t GetSpaceUsage() const override;
    void SaveXML(XMLWriter &xmlFile) override;
 
@@ -85,6 +99,11 @@ private:
    };
    Sizes SetSizes( size_t numsamples, sampleFormat srcformat );
    void CalcSummary(Sizes sizes);
+   //! Fill mDerivedSummaries from 256 summaries of all the samples
+   void CalcDerivedSummaries(const float *summary256);
+   //! Number of frames of divisor samples
+   size_t NumFrames(size_t divisor) const
+   { return (mSampleCount + divisor - 1) / divisor; }
 
 private:
    //! This must never be called for silent blocks
@@ -110,20 +129,44 @@ private:
 
    ArrayOf<char> mSummary256;
    ArrayOf<char> mSummary64k;
+   //! Not stored in the database; computed at creation or on first demand
+   /*! Levels of 512 up to 32768 samples per frame, one after another */
+   Floats mDerivedSummaries;
+   std::mutex mDerivedSummariesMutex;
    double mSumMin;
    double mSumMax;
    double mSumRms;
+   //! Sum of the samples, for DC offset; not stored in the database, but
+   //! computed at creation or on first demand
+   double mSumDC{ 0.0 };
+   bool mHasSumDC{ false };
+   std::mutex mSumDCMutex;
 
 #if defined(WORDS_BIGENDIAN)
 #error All sample block data is little endian...big endian not yet supported
 #endif
 };
 
+//! Sum of samples for DC offset, the same at creation and on demand
+static double SumSamples(const float *samples, size_t count)
+{
+   // Independent partial sums don't wait for each other's additions
+   double sums[4]{};
+   size_t ii = 0;
+   for (; ii + 4 <= count; ii += 4)
+      for (size_t jj = 0; jj < 4; ++jj)
+         sums[jj] += samples[ii + jj];
+   for (; ii < count; ++ii)
+      sums[0] += samples[ii];
+   return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
 // Silent blocks use nonpositive id values to encode a length
 // and don't occupy any rows in the database; share blocks for repeatedly
 // used length values
 static std::map< SampleBlockID, std::shared_ptr<SqliteSampleBlock> >
    sSilentBlocks;
+static std::mutex sSilentBlocksMutex;
 
 ///\brief Implementation of @ref SampleBlockFactory using Sqlite database
 class SqliteSampleBlockFactory final
@@ -149,6 +192,10 @@ public:
       sampleFormat srcformat,
       const wxChar **attrs) override;
 
+   SampleBlockPtr DoCreateFromID(
+      sampleFormat srcformat,
+      SampleBlockID id) override;
+
    BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) override;
 
@@ -164,6 +211,8 @@ private:
    using AllBlocksMap =
       std::map< SampleBlockID, std::weak_ptr< SqliteSampleBlock > >;
    AllBlocksMap mAllBlocks;
+   // Effects may create blocks for several tracks at once
+   std::mutex mAllBlocksMutex;
 
    BlockDeletionCallback mCallback;
 };
@@ -182,6 +231,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
    sb->SetSamples(src, numsamples, srcformat);
    // block id has now been assigned
+   std::lock_guard<std::mutex> guard(mAllBlocksMutex);
    mAllBlocks[ sb->GetBlockID() ] = sb;
    return sb;
 }
@@ -189,6 +239,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
 auto SqliteSampleBlockFactory::GetActiveBlockIDs() -> SampleBlockIDs
 {
    SampleBlockIDs result;
+   std::lock_guard<std::mutex> guard(mAllBlocksMutex);
    for (auto end = mAllBlocks.end(), it = mAllBlocks.begin(); it != end;) {
       if (it->second.expired())
          // Tighten up the map
@@ -205,6 +256,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateSilent(
    size_t numsamples, sampleFormat )
 {
    auto id = -static_cast< SampleBlockID >(numsamples);
+   std::lock_guard<std::mutex> guard(sSilentBlocksMutex);
    auto &result = sSilentBlocks[ id ];
    if ( !result ) {
       result = std::make_shared<SqliteSampleBlock>(nullptr);
@@ -238,34 +290,12 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
       }
 
       const wxString strValue = value;   // promote string, we need this for all
-      double dblValue;
       long long nValue;
 
       if (wxStrcmp(attr, wxT("blockid")) == 0 &&
          XMLValueChecker::IsGoodInt(strValue) && strValue.ToLongLong(&nValue))
       {
-         if (nValue <= 0) {
-            sb = DoCreateSilent( -nValue, floatSample );
-         }
-         else {
-            // First see if this block id was previously loaded
-            auto &wb = mAllBlocks[ nValue ];
-            auto pb = wb.lock();
-            if (pb)
-               // Reuse the block
-               sb = pb;
-            else {
-               // First sight of this id
-               auto ssb =
-                  std::make_shared<SqliteSampleBlock>(shared_from_this());
-               wb = ssb;
-               sb = ssb;
-               ssb->mSampleFormat = srcformat;
-               // This may throw database errors
-               // It initializes the rest of the fields
-               ssb->Load((SampleBlockID) nValue);
-            }
-         }
+         sb = DoCreateFromID( srcformat, nValue );
          found++;
       }
    }
@@ -279,6 +309,30 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
    return sb;
 }
 
+SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromID(
+   sampleFormat srcformat, SampleBlockID id )
+{
+   if (id <= 0)
+      return DoCreateSilent( -id, floatSample );
+
+   // First see if this block id was previously loaded
+   std::lock_guard<std::mutex> guard(mAllBlocksMutex);
+   auto &wb = mAllBlocks[ id ];
+   auto pb = wb.lock();
+   if (pb)
+      // Reuse the block
+      return pb;
+
+   // First sight of this id
+   auto ssb = std::make_shared<SqliteSampleBlock>(shared_from_this());
+   wb = ssb;
+   ssb->mSampleFormat = srcformat;
+   // This may throw database errors
+   // It initializes the rest of the fields
+   ssb->Load(id);
+   return ssb;
+}
+
 auto SqliteSampleBlockFactory::SetBlockDeletionCallback(
    BlockDeletionCallback callback ) -> BlockDeletionCallback
 {
@@ -370,6 +424,20 @@ size_t SqliteSampleBlock::GetSampleCount() const
    return mSampleCount;
 }
 
+void SqliteSampleBlock::Prefetch()
+{
+   if (IsSilent())
+      return;
+
+   // Only a hint, so ignore a missing connection without any message
+   try {
+      if (auto pPrefetcher = Conn()->GetPrefetcher())
+         pPrefetcher->Prefetch(mBlockID);
+   }
+   catch ( const SneedacityException & ) {
+   }
+}
+
 size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
                                      sampleFormat destformat,
                                      size_t sampleoffset,
@@ -381,10 +449,41 @@ size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
       return numsamples;
    }
 
+   // Samples already converted, perhaps ahead of time by the prefetch
+   // thread, or for another reader of the same block, avoid a query
+   auto &cache = DecodedBlockCache::Get();
+   const auto conn = Conn();
+   if (cache.Read(conn, mBlockID, destformat, dest, sampleoffset, numsamples))
+      return numsamples;
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
       "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
 
+   if (cache.GetByteBudget() > 0) {
+      if (!mValid)
+         Load(mBlockID);
+
+      // The whole blob is fetched from the database anyway, so convert and
+      // remember all of it for the next reader
+      SampleBuffer whole(mSampleCount, destformat);
+      GetBlob(whole.ptr(),
+              destformat,
+              stmt,
+              mSampleFormat,
+              0,
+              mSampleBytes);
+      cache.Store(conn, mBlockID, destformat, whole.ptr(), mSampleCount);
+
+      const auto size = SAMPLE_SIZE(destformat);
+      const auto offset = std::min(sampleoffset, mSampleCount);
+      const auto copied = std::min(numsamples, mSampleCount - offset);
+      memcpy(dest, whole.ptr() + offset * size, copied * size);
+      if (copied < numsamples)
+         memset(dest + copied * size, 0, (numsamples - copied) * size);
+      return numsamples;
+   }
+
    return GetBlob(dest,
                   destformat,
                   stmt,
@@ -414,6 +513,43 @@ bool SqliteSampleBlock::GetSummary256(float *dest,
       "SELECT summary256 FROM sampleblocks WHERE blockid = ?1;");
 }
 
+bool SqliteSampleBlock::GetDerivedSummary(size_t divisor,
+                                          float *dest,
+                                          size_t frameoffset,
+                                          size_t numframes)
+{
+   wxASSERT(divisor >= 512 && divisor <= 32768 &&
+            (divisor & (divisor - 1)) == 0);
+
+   // Non-throwing, it returns true for success
+   if (!IsSilent()) {
+      // The lock is needed only because drawing and analysis might meet here
+      std::lock_guard<std::mutex> guard(mDerivedSummariesMutex);
+      if (!mDerivedSummaries) {
+         const auto frames256 = NumFrames(256);
+         Floats summary256{ frames256 * fields };
+         if (!GetSummary256(summary256.get(), 0, frames256)) {
+            memset(dest, 0, fields * numframes * sizeof( float ));
+            return false;
+         }
+         CalcDerivedSummaries(summary256.get());
+      }
+
+      size_t level = 0;
+      for (size_t lesser = 512; lesser < divisor; lesser *= 2)
+         level += NumFrames(lesser);
+      const auto frames = NumFrames(divisor);
+      const auto offset = level + std::min(frameoffset, frames);
+      const auto copied = std::min(numframes, level + frames - offset);
+      std::copy(mDerivedSummaries.get() + offset * fields,
+                mDerivedSummaries.get() + (offset + copied) * fields, dest);
+      dest += copied * fields;
+      numframes -= copied;
+   }
+   memset(dest, 0, fields * numframes * sizeof( float ));
+   return true;
+}
+
 bool SqliteSampleBlock::GetSummary64k(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
@@ -496,22 +632,11 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
       float *samples = (float *) blockData.ptr();
 
       size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
-      for (size_t i = 0; i < copied; ++i, ++samples)
-      {
-         float sample = *samples;
-
-         if (sample > max)
-         {
-            max = sample;
-         }
-
-         if (sample < min)
-         {
-            min = sample;
-         }
-
-         sumsq += (sample * sample);
-      }
+      const auto scan =
+         SummaryKernels::GetBestKernels().scanSamples(samples, copied);
+      min = scan.min;
+      max = scan.max;
+      sumsq = scan.sumsq;
    }
 
    return { min, max, (float) sqrt(sumsq / len) };
@@ -525,6 +650,48 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS() const
    return { (float) mSumMin, (float) mSumMax, (float) mSumRms };
 }
 
+double SqliteSampleBlock::DoGetSum(size_t start, size_t len)
+{
+   if (IsSilent())
+      return 0.0;
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   if (start >= mSampleCount)
+      return 0.0;
+
+   len = std::min(len, mSampleCount - start);
+   SampleBuffer blockData(len, floatSample);
+   float *samples = (float *) blockData.ptr();
+   size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
+   return SumSamples(samples, copied);
+}
+
+double SqliteSampleBlock::DoGetSum()
+{
+   if (IsSilent())
+      return 0.0;
+
+   std::lock_guard<std::mutex> guard(mSumDCMutex);
+   if (!mHasSumDC) {
+      // A block loaded from the database; read it once
+      if (!mValid)
+      {
+         Load(mBlockID);
+      }
+      SampleBuffer blockData(mSampleCount, floatSample);
+      float *samples = (float *) blockData.ptr();
+      size_t copied =
+         DoGetSamples((samplePtr) samples, floatSample, 0, mSampleCount);
+      mSumDC = SumSamples(samples, copied);
+      mHasSumDC = true;
+   }
+   return mSumDC;
+}
+
 size_t SqliteSampleBlock::GetSpaceUsage() const
 {
    if (IsSilent())
@@ -737,11 +904,26 @@ void SqliteSampleBlock::Commit(Sizes sizes)
       wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
    }
  
-   // Execute the statement
-   rc = sqlite3_step(stmt);
+   // Execute the statement, in a transaction shared with neighboring blocks
+   // so that a long import or recording doesn't commit each one separately
+   Conn()->BeginBatchedWrite();
+   {
+      // Other threads may insert blocks too; hold the connection's own mutex
+      // so that the row id and any error message are those of this insert
+      sqlite3_mutex_enter(sqlite3_db_mutex(db));
+      auto unlock = finally([&]{ sqlite3_mutex_leave(sqlite3_db_mutex(db)); });
+      rc = sqlite3_step(stmt);
+      if (rc == SQLITE_DONE)
+         mBlockID = sqlite3_last_insert_rowid(db);
+      else
+         wxLogDebug(wxT("SqliteSampleBlock::Commit - SQLITE error %s"),
+            sqlite3_errmsg(db));
+   }
+   Conn()->EndBatchedWrite(rc == SQLITE_DONE
+      ? mSampleBytes + mSummary256Bytes + mSummary64kBytes
+      : 0);
    if (rc != SQLITE_DONE)
    {
-      wxLogDebug(wxT("SqliteSampleBlock::Commit - SQLITE error %s"), sqlite3_errmsg(db));
 
       // Clear statement bindings and rewind statement
       sqlite3_clear_bindings(stmt);
@@ -752,9 +934,6 @@ void SqliteSampleBlock::Commit(Sizes sizes)
       Conn()->ThrowException( true );
    }
 
-   // Retrieve returned data
-   mBlockID = sqlite3_last_insert_rowid(db);
-
    // Reset local arrays
    mSamples.reset();
    mSummary256.reset();
@@ -774,6 +953,10 @@ void SqliteSampleBlock::Delete()
 
    wxASSERT(!IsSilent());
 
+   // The row id might be reused; don't let stale samples be found under it
+   if (auto pPrefetcher = Conn()->GetPrefetcher())
+      pPrefetcher->Invalidate(mBlockID);
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::DeleteSampleBlock,
       "DELETE FROM sampleblocks WHERE blockid = ?1;");
@@ -826,7 +1009,7 @@ auto SqliteSampleBlock::SetSizes(
 /// Calculates summary block data describing this sample data.
 ///
 /// This method also has the side effect of setting the mSumMin,
-/// mSumMax, and mSumRms members of this class.
+/// mSumMax, mSumRms and mSumDC members of this class.
 ///
 void SqliteSampleBlock::CalcSummary(Sizes sizes)
 {
@@ -864,12 +1047,9 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    int sumLen = (mSampleCount + 255) / 256;
    int summaries = 256;
 
+   const auto &kernels = SummaryKernels::GetBestKernels();
    for (int i = 0; i < sumLen; ++i)
    {
-      min = samples[i * 256];
-      max = samples[i * 256];
-      sumsq = min * min;
-
       int jcount = 256;
       if (jcount > mSampleCount - i * 256)
       {
@@ -877,20 +1057,10 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
          fraction = 1.0 - (jcount / 256.0);
       }
 
-      for (int j = 1; j < jcount; ++j)
-      {
-         float f1 = samples[i * 256 + j];
-         sumsq += f1 * f1;
-
-         if (f1 < min)
-         {
-            min = f1;
-         }
-         else if (f1 > max)
-         {
-            max = f1;
-         }
-      }
+      const auto scan = kernels.scanSamples(samples + i * 256, jcount);
+      min = scan.min;
+      max = scan.max;
+      sumsq = scan.sumsq;
 
       totalSquares += sumsq;
 
@@ -914,33 +1084,26 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    // Calculate now while we can do it accurately
    mSumRms = sqrt(totalSquares / mSampleCount);
 
+   {
+      std::lock_guard<std::mutex> guard(mSumDCMutex);
+      mSumDC = SumSamples(samples, mSampleCount);
+      mHasSumDC = true;
+   }
+
+   // The derived levels are cheap to compute now, and save a query later
+   CalcDerivedSummaries(summary256);
+
    // Recalc 64K summaries
    sumLen = (mSampleCount + 65535) / 65536;
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = summary256[3 * i * 256];
-      max = summary256[3 * i * 256 + 1];
-      sumsq = summary256[3 * i * 256 + 2];
-      sumsq *= sumsq;
-
-      for (int j = 1; j < 256; ++j)
-      {
-         // we can overflow the useful summary256 values here, but have put
-         // non-harmful values in them
-         if (summary256[3 * (i * 256 + j)] < min)
-         {
-            min = summary256[3 * (i * 256 + j)];
-         }
-
-         if (summary256[3 * (i * 256 + j) + 1] > max)
-         {
-            max = summary256[3 * (i * 256 + j) + 1];
-         }
-
-         float r1 = summary256[3 * (i * 256 + j) + 2];
-         sumsq += r1 * r1;
-      }
+      // we can overflow the useful summary256 values here, but have put
+      // non-harmful values in them
+      const auto scan = kernels.scanTriples(summary256 + 3 * i * 256, 256);
+      min = scan.min;
+      max = scan.max;
+      sumsq = scan.sumsq;
 
       double denom = (i < sumLen - 1) ? 256.0 : summaries - fraction;
       float rms = (float) sqrt(sumsq / denom);
@@ -981,6 +1144,51 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    mSumMax = max;
 }
 
+void SqliteSampleBlock::CalcDerivedSummaries(const float *summary256)
+{
+   size_t total = 0;
+   for (size_t divisor = 512; divisor < 65536; divisor *= 2)
+      total += NumFrames(divisor);
+   mDerivedSummaries.reinit(total * fields);
+
+   // Each level combines pairs of frames of the level before
+   const float *prev = summary256;
+   float *next = mDerivedSummaries.get();
+   for (size_t divisor = 512; divisor < 65536; divisor *= 2)
+   {
+      const auto half = divisor / 2;
+      const auto prevFrames = NumFrames(half);
+      const auto frames = NumFrames(divisor);
+
+      for (size_t i = 0; i < frames; ++i)
+      {
+         float min = FLT_MAX;
+         float max = -FLT_MAX;
+         double sumsq = 0.0;
+         size_t count = 0;
+
+         for (size_t j = i * 2, end = std::min(j + 2, prevFrames);
+              j < end; ++j)
+         {
+            min = std::min(min, prev[j * fields]);
+            max = std::max(max, prev[j * fields + 1]);
+            // Weight the rms of a short last frame by its true length
+            const auto jcount = std::min(half, mSampleCount - j * half);
+            const double rms = prev[j * fields + 2];
+            sumsq += rms * rms * jcount;
+            count += jcount;
+         }
+
+         next[i * fields] = min;
+         next[i * fields + 1] = max;
+         next[i * fields + 2] = count ? (float) sqrt(sumsq / count) : 0.0f;
+      }
+
+      prev = next;
+      next += frames * fields;
+   }
+}
+
 // Inject our database implementation at startup
 static struct Injector
 {
@@ -0,0 +1,280 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SummaryKernels.cpp
+@brief Implements SummaryKernels
+
+**********************************************************************/
+
+#include "SummaryKernels.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define SUMMARY_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles intrinsics for any instruction set without options
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace SummaryKernels {
+
+namespace {
+
+constexpr size_t Lanes = 8;
+
+// The SIMD min and max instructions return their second operand when either
+// is NaN, or when the two are equal, such as 0 and -0.  So with the new value
+// first, they skip NaN and keep the earlier of equal values, as these do.
+inline float Min(float value, float min) { return value < min ? value : min; }
+inline float Max(float value, float max) { return value > max ? value : max; }
+
+//! The common ending of all variants, so they round identically
+/*! Adds the leftover values into the lanes where a vector loop would have put
+ them, then combines lanes pairwise */
+MinMaxSumsq Finish(float min[Lanes], float max[Lanes], float sumsq[Lanes],
+   const float *rest, size_t nRest, size_t stride)
+{
+   for (size_t ii = 0; ii < nRest; ++ii) {
+      const float minValue = rest[ii * stride];
+      const float maxValue = rest[ii * stride + (stride == 1 ? 0 : 1)];
+      const float value = rest[ii * stride + (stride == 1 ? 0 : 2)];
+      min[ii] = Min(minValue, min[ii]);
+      max[ii] = Max(maxValue, max[ii]);
+      const float square = value * value;
+      sumsq[ii] += square;
+   }
+
+   // Later lanes go first, so that the earlier lane wins a tie
+   float pairMin[4], pairMax[4], pairs[4];
+   for (size_t ii = 0; ii < 4; ++ii) {
+      pairMin[ii] = Min(min[ii + 4], min[ii]);
+      pairMax[ii] = Max(max[ii + 4], max[ii]);
+      pairs[ii] = sumsq[ii] + sumsq[ii + 4];
+   }
+   const float evenMin = Min(pairMin[2], pairMin[0]);
+   const float oddMin = Min(pairMin[3], pairMin[1]);
+   const float evenMax = Max(pairMax[2], pairMax[0]);
+   const float oddMax = Max(pairMax[3], pairMax[1]);
+   const float even = pairs[0] + pairs[2];
+   const float odd = pairs[1] + pairs[3];
+   return { Min(oddMin, evenMin), Max(oddMax, evenMax), even + odd };
+}
+
+MinMaxSumsq ScalarScan(const float *values, size_t count, size_t stride)
+{
+   float min[Lanes], max[Lanes], sumsq[Lanes]{};
+   std::fill(min, min + Lanes, FLT_MAX);
+   std::fill(max, max + Lanes, -FLT_MAX);
+   const auto nBulk = count - count % Lanes;
+   for (size_t ii = 0; ii < nBulk; ii += Lanes)
+      for (size_t lane = 0; lane < Lanes; ++lane) {
+         const float *p = values + (ii + lane) * stride;
+         const float minValue = p[0];
+         const float maxValue = p[stride == 1 ? 0 : 1];
+         const float value = p[stride == 1 ? 0 : 2];
+         min[lane] = Min(minValue, min[lane]);
+         max[lane] = Max(maxValue, max[lane]);
+         const float square = value * value;
+         sumsq[lane] += square;
+      }
+   return Finish(min, max, sumsq,
+      values + nBulk * stride, count - nBulk, stride);
+}
+
+MinMaxSumsq ScalarSamples(const float *samples, size_t count)
+{
+   return ScalarScan(samples, count, 1);
+}
+
+MinMaxSumsq ScalarTriples(const float *triples, size_t count)
+{
+   return ScalarScan(triples, count, 3);
+}
+
+#ifdef SUMMARY_KERNELS_X86
+
+// Two four-lane accumulators stand for the eight lanes of the scalar code
+MinMaxSumsq SSE2Samples(const float *samples, size_t count)
+{
+   __m128 min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+   __m128 max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+   __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+   const auto nBulk = count - count % Lanes;
+   for (size_t ii = 0; ii < nBulk; ii += Lanes) {
+      const __m128 v0 = _mm_loadu_ps(samples + ii);
+      const __m128 v1 = _mm_loadu_ps(samples + ii + 4);
+      min0 = _mm_min_ps(v0, min0);
+      min1 = _mm_min_ps(v1, min1);
+      max0 = _mm_max_ps(v0, max0);
+      max1 = _mm_max_ps(v1, max1);
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(v0, v0));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(v1, v1));
+   }
+   float min[Lanes], max[Lanes], sumsq[Lanes];
+   _mm_storeu_ps(min, min0);
+   _mm_storeu_ps(min + 4, min1);
+   _mm_storeu_ps(max, max0);
+   _mm_storeu_ps(max + 4, max1);
+   _mm_storeu_ps(sumsq, sum0);
+   _mm_storeu_ps(sumsq + 4, sum1);
+   return Finish(min, max, sumsq, samples + nBulk, count - nBulk, 1);
+}
+
+MinMaxSumsq SSE2Triples(const float *triples, size_t count)
+{
+   __m128 min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+   __m128 max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+   __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+   const auto nBulk = count - count % Lanes;
+   for (size_t ii = 0; ii < nBulk; ii += Lanes) {
+      const float *p = triples + ii * 3;
+      // Deinterleave; _mm_set_ps takes the highest lane first
+      const __m128 mins0 = _mm_set_ps(p[9], p[6], p[3], p[0]);
+      const __m128 mins1 = _mm_set_ps(p[21], p[18], p[15], p[12]);
+      const __m128 maxes0 = _mm_set_ps(p[10], p[7], p[4], p[1]);
+      const __m128 maxes1 = _mm_set_ps(p[22], p[19], p[16], p[13]);
+      const __m128 rms0 = _mm_set_ps(p[11], p[8], p[5], p[2]);
+      const __m128 rms1 = _mm_set_ps(p[23], p[20], p[17], p[14]);
+      min0 = _mm_min_ps(mins0, min0);
+      min1 = _mm_min_ps(mins1, min1);
+      max0 = _mm_max_ps(maxes0, max0);
+      max1 = _mm_max_ps(maxes1, max1);
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(rms0, rms0));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(rms1, rms1));
+   }
+   float min[Lanes], max[Lanes], sumsq[Lanes];
+   _mm_storeu_ps(min, min0);
+   _mm_storeu_ps(min + 4, min1);
+   _mm_storeu_ps(max, max0);
+   _mm_storeu_ps(max + 4, max1);
+   _mm_storeu_ps(sumsq, sum0);
+   _mm_storeu_ps(sumsq + 4, sum1);
+   return Finish(min, max, sumsq, triples + nBulk * 3, count - nBulk, 3);
+}
+
+// No fused multiply-add, which would round differently from the others
+TARGET_AVX2 MinMaxSumsq AVX2Samples(const float *samples, size_t count)
+{
+   __m256 min = _mm256_set1_ps(FLT_MAX), max = _mm256_set1_ps(-FLT_MAX);
+   __m256 sum = _mm256_setzero_ps();
+   const auto nBulk = count - count % Lanes;
+   for (size_t ii = 0; ii < nBulk; ii += Lanes) {
+      const __m256 v = _mm256_loadu_ps(samples + ii);
+      min = _mm256_min_ps(v, min);
+      max = _mm256_max_ps(v, max);
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(v, v));
+   }
+   float lowest[Lanes], highest[Lanes], sumsq[Lanes];
+   _mm256_storeu_ps(lowest, min);
+   _mm256_storeu_ps(highest, max);
+   _mm256_storeu_ps(sumsq, sum);
+   return Finish(lowest, highest, sumsq, samples + nBulk, count - nBulk, 1);
+}
+
+TARGET_AVX2 MinMaxSumsq AVX2Triples(const float *triples, size_t count)
+{
+   __m256 min = _mm256_set1_ps(FLT_MAX), max = _mm256_set1_ps(-FLT_MAX);
+   __m256 sum = _mm256_setzero_ps();
+   const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+   const auto nBulk = count - count % Lanes;
+   for (size_t ii = 0; ii < nBulk; ii += Lanes) {
+      const float *p = triples + ii * 3;
+      const __m256 mins = _mm256_i32gather_ps(p, stride, 4);
+      const __m256 maxes = _mm256_i32gather_ps(p + 1, stride, 4);
+      const __m256 rms = _mm256_i32gather_ps(p + 2, stride, 4);
+      min = _mm256_min_ps(mins, min);
+      max = _mm256_max_ps(maxes, max);
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(rms, rms));
+   }
+   float lowest[Lanes], highest[Lanes], sumsq[Lanes];
+   _mm256_storeu_ps(lowest, min);
+   _mm256_storeu_ps(highest, max);
+   _mm256_storeu_ps(sumsq, sum);
+   return Finish(lowest, highest, sumsq,
+      triples + nBulk * 3, count - nBulk, 3);
+}
+
+bool HaveAVX2()
+{
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return false;
+   __cpuid(info, 1);
+   // The OS must save the AVX registers too
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   if (!osxsave || (_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool HaveSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+   // Always present in 64 bit processors
+   return true;
+#elif defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 1);
+   return (info[3] & (1 << 26)) != 0;
+#else
+   return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+const Kernels scalarKernels{
+   Kind::Scalar, "scalar", ScalarSamples, ScalarTriples };
+
+#ifdef SUMMARY_KERNELS_X86
+const Kernels sse2Kernels{
+   Kind::SSE2, "SSE2", SSE2Samples, SSE2Triples };
+const Kernels avx2Kernels{
+   Kind::AVX2, "AVX2", AVX2Samples, AVX2Triples };
+#endif
+
+}
+
+const Kernels *GetKernels(Kind kind)
+{
+   switch (kind) {
+#ifdef SUMMARY_KERNELS_X86
+   case Kind::AVX2:
+      return HaveAVX2() ? &avx2Kernels : nullptr;
+   case Kind::SSE2:
+      return HaveSSE2() ? &sse2Kernels : nullptr;
+#endif
+   case Kind::Scalar:
+      return &scalarKernels;
+   default:
+      return nullptr;
+   }
+}
+
+const Kernels &GetBestKernels()
+{
+   static const Kernels &best = []() -> const Kernels & {
+      for (auto kind : { Kind::AVX2, Kind::SSE2 })
+         if (auto pKernels = GetKernels(kind))
+            return *pKernels;
+      return scalarKernels;
+   }();
+   return best;
+}
+
+}
@@ -0,0 +1,54 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SummaryKernels.h
+@brief Scalar and SIMD loops computing min, max and sum of squares for block summaries
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_SUMMARY_KERNELS__
+#define __SNEEDACITY_SUMMARY_KERNELS__
+
+#include <cstddef>
+
+//! Inner loops of sample block summary computation, with runtime dispatch
+/*! Every variant adds squares in the same order: eight interleaved partial
+ sums, as if in eight vector lanes, combined pairwise at the end.  Minimum
+ and maximum are found the same way, skipping NaN and keeping the earlier
+ of 0 and -0.  So all variants give bit-for-bit the same results, whichever
+ one the CPU supports.
+ */
+namespace SummaryKernels {
+
+struct MinMaxSumsq
+{
+   float min;
+   float max;
+   float sumsq;
+};
+
+enum class Kind { Scalar, SSE2, AVX2 };
+
+struct Kernels
+{
+   Kind kind;
+   const char *name;
+
+   //! Min, max and sum of squares of count samples; count may be zero
+   MinMaxSumsq (*scanSamples)(const float *samples, size_t count);
+
+   //! Min of the mins, max of the maxes, and sum of squared rms values,
+   //! of count triples of (min, max, rms)
+   MinMaxSumsq (*scanTriples)(const float *triples, size_t count);
+};
+
+//! @return null if the CPU does not support the kind
+SNEEDACITY_DLL_API const Kernels *GetKernels(Kind kind);
+
+//! The fastest variant the CPU supports, chosen once
+SNEEDACITY_DLL_API const Kernels &GetBestKernels();
+
+}
+
+#endif
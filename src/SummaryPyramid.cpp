@@ -0,0 +1,71 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SummaryPyramid.cpp
+@brief Implements SummaryPyramid
+
+**********************************************************************/
+
+#include "SummaryPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+float SummaryPyramid::Frame::RMS() const
+{
+   return count > 0 ? (float) sqrt(sumsq / count) : 0.0f;
+}
+
+SummaryPyramid::SummaryPyramid(std::vector<Frame> base, size_t factor)
+   : mFactor{ std::max<size_t>(2, factor) }
+{
+   if (base.empty())
+      return;
+
+   mLevels.push_back(std::move(base));
+   while (mLevels.back().size() > 1) {
+      const auto &finer = mLevels.back();
+      std::vector<Frame> coarser;
+      coarser.reserve((finer.size() + mFactor - 1) / mFactor);
+      for (size_t ii = 0; ii < finer.size(); ii += mFactor) {
+         Frame frame;
+         const auto end = std::min(finer.size(), ii + mFactor);
+         for (auto jj = ii; jj < end; ++jj)
+            frame.Merge(finer[jj]);
+         coarser.push_back(frame);
+      }
+      mLevels.push_back(std::move(coarser));
+   }
+}
+
+auto SummaryPyramid::Query(size_t first, size_t last) const -> Frame
+{
+   Frame result;
+   if (mLevels.empty())
+      return result;
+
+   last = std::min(last, NumFrames());
+   for (size_t level = 0; first < last; ++level) {
+      const auto &frames = mLevels[level];
+      if (level + 1 == mLevels.size()) {
+         while (first < last)
+            result.Merge(frames[first++]);
+         break;
+      }
+
+      // Consume the unaligned ends at this level, then ascend
+      while (first < last && first % mFactor)
+         result.Merge(frames[first++]);
+      while (first < last && last % mFactor && last != frames.size())
+         result.Merge(frames[--last]);
+      if (first >= last)
+         break;
+      first /= mFactor;
+      // A partial group at the end of the level is summarized by the last
+      // frame of the next level
+      last = (last + mFactor - 1) / mFactor;
+   }
+
+   return result;
+}
@@ -0,0 +1,75 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file SummaryPyramid.h
+@brief Declare SummaryPyramid, successively coarser min/max/RMS summaries of a sequence of frames
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_SUMMARY_PYRAMID__
+#define __SNEEDACITY_SUMMARY_PYRAMID__
+
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+//! Successively coarser levels of min, max and sum-of-squares summaries
+/*! Level 0 holds the given base frames, which may cover unequal numbers of
+ samples (for instance, one frame per sample block).  Each frame of level
+ k + 1 summarizes up to factor consecutive frames of level k.
+
+ Query() combines any range of base frames using at most
+ 2 * (factor - 1) frames from each level, independent of the range length.
+ */
+class SummaryPyramid
+{
+public:
+   struct Frame {
+      float min = FLT_MAX;
+      float max = -FLT_MAX;
+      double sumsq = 0;
+      double count = 0;
+
+      //! Frame summarizing count samples whose root-mean-square is rms
+      static Frame FromRMS(float min, float max, float rms, double count)
+      {
+         return { min, max, double(rms) * rms * count, count };
+      }
+
+      void Merge(const Frame &other)
+      {
+         if (other.min < min)
+            min = other.min;
+         if (other.max > max)
+            max = other.max;
+         sumsq += other.sumsq;
+         count += other.count;
+      }
+
+      float RMS() const;
+   };
+
+   //! Default number of frames of one level summarized by a frame of the next
+   static constexpr size_t DefaultFactor = 16;
+
+   SummaryPyramid() = default;
+   SummaryPyramid(std::vector<Frame> base, size_t factor = DefaultFactor);
+
+   size_t GetFactor() const { return mFactor; }
+   size_t NumLevels() const { return mLevels.size(); }
+   size_t NumFrames() const
+   { return mLevels.empty() ? 0 : mLevels[0].size(); }
+
+   const std::vector<Frame> &GetLevel(size_t level) const
+   { return mLevels[level]; }
+
+   //! Summary of base frames in [first, last); empty frame if first >= last
+   Frame Query(size_t first, size_t last) const;
+
+private:
+   size_t mFactor{ DefaultFactor };
+   std::vector< std::vector<Frame> > mLevels;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ThreadPool.cpp
+@brief Implements ThreadPool
+
+**********************************************************************/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "Prefs.h"
+
+IntSetting ThreadPool::WorkerThreads{
+   L"/Performance/WorkerThreads", 0 };
+
+ThreadPool &ThreadPool::Get()
+{
+   static ThreadPool instance{ [] {
+      auto nThreads = WorkerThreads.Read();
+      if (nThreads <= 0)
+         nThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+      return size_t(nThreads);
+   }() };
+   return instance;
+}
+
+ThreadPool::ThreadPool(size_t nThreads)
+{
+   mThreads.reserve(nThreads);
+   for (size_t ii = 0; ii < nThreads; ++ii)
+      mThreads.emplace_back([this]{ Thread(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStop = true;
+      mCondition.notify_all();
+   }
+   for (auto &thread : mThreads)
+      thread.join();
+}
+
+//! State of one ParallelFor() shared by the threads working on it
+/*! Helper threads hold it by shared_ptr, because one may dequeue its task
+ only after the caller has returned; it then finds no index left and never
+ touches the caller's function. */
+struct ThreadPool::Batch
+{
+   Batch(size_t n, const std::function<void(size_t)> &fn)
+      : n{ n }, fn{ fn }
+   {}
+
+   void Work()
+   {
+      size_t count = 0;
+      for (size_t ii; (ii = next++) < n; ++count) {
+         if (failed)
+            // Skip the rest, but still count it
+            continue;
+         try {
+            fn(ii);
+         }
+         catch (...) {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (!exception)
+               exception = std::current_exception();
+            failed = true;
+         }
+      }
+
+      if (count > 0) {
+         std::lock_guard<std::mutex> guard(mutex);
+         finished += count;
+         if (finished == n)
+            condition.notify_all();
+      }
+   }
+
+   const size_t n;
+   const std::function<void(size_t)> &fn;
+
+   std::atomic<size_t> next{ 0 };
+   std::atomic<bool> failed{ false };
+
+   std::mutex mutex;
+   std::condition_variable condition;
+   size_t finished{ 0 };
+   std::exception_ptr exception;
+};
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)> &fn)
+{
+   if (n == 0)
+      return;
+
+   if (n == 1 || mThreads.empty()) {
+      for (size_t ii = 0; ii < n; ++ii)
+         fn(ii);
+      return;
+   }
+
+   auto pBatch = std::make_shared<Batch>(n, fn);
+   Enqueue([pBatch]{ pBatch->Work(); }, std::min(n - 1, mThreads.size()));
+
+   pBatch->Work();
+
+   std::unique_lock<std::mutex> lock(pBatch->mutex);
+   pBatch->condition.wait(lock, [&]{ return pBatch->finished == n; });
+   if (pBatch->exception)
+      std::rethrow_exception(pBatch->exception);
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task)
+{
+   // std::function must be copyable, but std::packaged_task is not
+   auto pTask = std::make_shared< std::packaged_task<void()> >(std::move(task));
+   auto result = pTask->get_future();
+   if (mThreads.empty())
+      (*pTask)();
+   else
+      Enqueue([pTask]{ (*pTask)(); });
+   return result;
+}
+
+void ThreadPool::Enqueue(std::function<void()> task, size_t copies)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (size_t ii = 0; ii < copies; ++ii)
+      mTasks.push_back(task);
+   if (copies == 1)
+      mCondition.notify_one();
+   else
+      mCondition.notify_all();
+}
+
+void ThreadPool::Thread()
+{
+   while (true) {
+      std::function<void()> task;
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock, [this]{ return mStop || !mTasks.empty(); });
+         if (mStop)
+            break;
+         task = std::move(mTasks.front());
+         mTasks.pop_front();
+      }
+      // Tasks handle their own exceptions
+      task();
+   }
+}
@@ -0,0 +1,70 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ThreadPool.h
+@brief Declare ThreadPool, a fixed set of worker threads for data-parallel jobs
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_THREAD_POOL__
+#define __SNEEDACITY_THREAD_POOL__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class IntSetting;
+
+//! Fixed set of worker threads, running parallel loops and single tasks
+/*! The calling thread of ParallelFor() works too, so a pool without worker
+ threads just runs everything in the caller, and ParallelFor() may be called
+ again from inside one of its own iterations without deadlock.
+ */
+class SNEEDACITY_DLL_API ThreadPool final
+{
+public:
+   //! Number of worker threads of the shared pool; zero means one less than
+   //! the number of hardware threads
+   static IntSetting WorkerThreads;
+
+   //! The pool shared by the application, made at first use
+   static ThreadPool &Get();
+
+   explicit ThreadPool(size_t nThreads);
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool &operator=(const ThreadPool&) = delete;
+
+   size_t GetThreadCount() const { return mThreads.size(); }
+
+   //! Call fn(i) for each i in [0, n), in any order, concurrently in this
+   //! thread and the pool's
+   /*! Returns when all calls are done.  If a call throws, calls not yet
+    started are skipped, and the first exception is rethrown here. */
+   void ParallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+   //! Run a task in a worker thread, or in this thread if there are none
+   /*! @return future holding completion, or the exception the task threw */
+   std::future<void> Submit(std::function<void()> task);
+
+private:
+   struct Batch;
+
+   void Enqueue(std::function<void()> task, size_t copies = 1);
+   void Thread();
+
+   std::vector<std::thread> mThreads;
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   std::deque< std::function<void()> > mTasks;
+   bool mStop{ false };
+};
+
+#endif
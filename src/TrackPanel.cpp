@@ -73,6 +73,7 @@ is time to refresh some aspect of the screen.
 
 #include "Prefs.h"
 #include "RefreshCode.h"
+#include "SpectrogramTileCache.h"
 #include "TrackArtist.h"
 #include "TrackPanelAx.h"
 #include "TrackPanelResizerCell.h"
@@ -321,6 +322,9 @@ TrackPanel::TrackPanel(wxWindow * parent, wxWindowID id,
    wxTheApp->Bind(EVT_AUDIOIO_CAPTURE,
                      &TrackPanel::OnAudioIO,
                      this);
+   wxTheApp->Bind(EVT_SPECTROGRAM_TILES_READY,
+                     &TrackPanel::OnSpectrogramTilesReady,
+                     this);
    UpdatePrefs();
 }
 
@@ -828,6 +832,13 @@ void TrackPanel::OnAudioIO(wxCommandEvent & evt)
    CallAfter( [this]{ CellularPanel::HandleCursorForPresentMouseState(); } );
 }
 
+void TrackPanel::OnSpectrogramTilesReady(wxCommandEvent & evt)
+{
+   evt.Skip();
+   // Spectrograms drawn with missing columns can be completed
+   Refresh(false);
+}
+
 #include "TrackPanelDrawingContext.h"
 
 /// Draw the actual track areas.  We only draw the borders
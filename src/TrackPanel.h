@@ -81,6 +81,7 @@ class SNEEDACITY_DLL_API TrackPanel final
    void UpdatePrefs() override;
 
    void OnAudioIO(wxCommandEvent & evt);
+   void OnSpectrogramTilesReady(wxCommandEvent & evt);
 
    void OnPaint(wxPaintEvent & event);
    void OnMouseEvent(wxMouseEvent & event);
@@ -24,6 +24,7 @@
 
 
 #include <math.h>
+#include <atomic>
 #include <vector>
 #include <wx/log.h>
 
@@ -32,6 +33,7 @@
 #include "Prefs.h"
 #include "Envelope.h"
 #include "Resample.h"
+#include "SpectrogramTileCache.h"
 #include "WaveTrack.h"
 #include "Profiler.h"
 #include "InconsistencyException.h"
@@ -40,10 +42,6 @@
 #include "prefs/SpectrogramSettings.h"
 #include "widgets/ProgressDialog.h"
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 class WaveCache {
 public:
    WaveCache()
@@ -208,6 +206,15 @@ WaveClip::WaveClip(const WaveClip& orig,
 
 WaveClip::~WaveClip()
 {
+   // Workers may still read the copy of the samples
+   if (mSpectrogramSamples)
+      SpectrogramTileCache::Get().Cancel(mSerial);
+}
+
+unsigned long long WaveClip::NewSerial()
+{
+   static std::atomic<unsigned long long> serial{ 0 };
+   return ++serial;
 }
 
 /*! @excsafety{No-fail} */
@@ -631,7 +638,7 @@ bool SpecCache::Matches
 
 bool SpecCache::CalculateOneSpectrum
    (const SpectrogramSettings &settings,
-    WaveTrackCache &waveTrackCache,
+    const SampleReader &read,
     const int xx, const sampleCount numSamples,
     double offset, double rate, double pixelsPerSecond,
     int lowerBoundX, int upperBoundX,
@@ -707,13 +714,11 @@ bool SpecCache::CalculateOneSpectrum
          }
 
          if (myLen > 0) {
-            useBuffer = (float*)(waveTrackCache.GetFloats(
+            useBuffer = (float*)(read(
                sampleCount(
                   floor(0.5 + from.as_double() + offset * rate)
                ),
-               myLen,
-               // Don't throw in this drawing operation
-               false)
+               myLen)
             );
 
             if (copy) {
@@ -818,12 +823,6 @@ bool SpecCache::CalculateOneSpectrum
 
                   // This is non-negative, because bin and correctedX are
                   auto ind = (int)nBins * correctedX + bin;
-#ifdef _OPENMP
-                  // This assignment can race if index reaches into another thread's bins.
-                  // The probability of a race very low, so this carries little overhead,
-                  // about 5% slower vs allowing it to race.
-                  #pragma omp atomic update
-#endif
                   out[ind] += power;
                }
             }
@@ -881,6 +880,20 @@ void SpecCache::Populate
     int copyBegin, int copyEnd, size_t numPixels,
     sampleCount numSamples,
     double offset, double rate, double pixelsPerSecond)
+{
+   const SampleReader read = [&](sampleCount start, size_t len) {
+      // Don't throw in this drawing operation
+      return waveTrackCache.GetFloats(start, len, false);
+   };
+   Populate(settings, read, copyBegin, copyEnd, numPixels,
+      numSamples, offset, rate, pixelsPerSecond);
+}
+
+void SpecCache::Populate
+   (const SpectrogramSettings &settings, const SampleReader &read,
+    int copyBegin, int copyEnd, size_t numPixels,
+    sampleCount numSamples,
+    double offset, double rate, double pixelsPerSecond)
 {
    const int &frequencyGainSetting = settings.frequencyGain;
    const size_t windowSizeSetting = settings.WindowSize();
@@ -913,40 +926,13 @@ void SpecCache::Populate
       const int lowerBoundX = jj == 0 ? 0 : copyEnd;
       const int upperBoundX = jj == 0 ? copyBegin : numPixels;
 
-#ifdef _OPENMP
-      // Storage for mutable per-thread data.
-      // private clause ensures one copy per thread
-      struct ThreadLocalStorage {
-         ThreadLocalStorage()  { }
-         ~ThreadLocalStorage() { }
-
-         void init(WaveTrackCache &waveTrackCache, size_t scratchSize) {
-            if (!cache) {
-               cache = std::make_unique<WaveTrackCache>(waveTrackCache.GetTrack());
-               scratch.resize(scratchSize);
-            }
-         }
-         std::unique_ptr<WaveTrackCache> cache;
-         std::vector<float> scratch;
-      } tls;
-
-      #pragma omp parallel for private(tls)
-#endif
       for (auto xx = lowerBoundX; xx < upperBoundX; ++xx)
       {
-#ifdef _OPENMP
-         tls.init(waveTrackCache, scratchSize);
-         WaveTrackCache& cache = *tls.cache;
-         float* buffer = &tls.scratch[0];
-#else
-         WaveTrackCache& cache = waveTrackCache;
-         float* buffer = &scratch[0];
-#endif
          CalculateOneSpectrum(
-            settings, cache, xx, numSamples,
+            settings, read, xx, numSamples,
             offset, rate, pixelsPerSecond,
             lowerBoundX, upperBoundX,
-            gainFactors, buffer, &freq[0]);
+            gainFactors, &scratch[0], &freq[0]);
       }
 
       if (reassignment) {
@@ -960,7 +946,7 @@ void SpecCache::Populate
          {
             const bool result =
                CalculateOneSpectrum(
-                  settings, waveTrackCache, --xx, numSamples,
+                  settings, read, --xx, numSamples,
                   offset, rate, pixelsPerSecond,
                   lowerBoundX, upperBoundX,
                   gainFactors, &scratch[0], &freq[0]);
@@ -973,7 +959,7 @@ void SpecCache::Populate
          {
             const bool result =
                CalculateOneSpectrum(
-                  settings, waveTrackCache, xx++, numSamples,
+                  settings, read, xx++, numSamples,
                   offset, rate, pixelsPerSecond,
                   lowerBoundX, upperBoundX,
                   gainFactors, &scratch[0], &freq[0]);
@@ -983,9 +969,6 @@ void SpecCache::Populate
 
          // Now Convert to dB terms.  Do this only after accumulating
          // power values, which may cross columns with the time correction.
-#ifdef _OPENMP
-         #pragma omp parallel for
-#endif
          for (xx = lowerBoundX; xx < upperBoundX; ++xx) {
             float *const results = &freq[nBins * xx];
             for (size_t ii = 0; ii < nBins; ++ii) {
@@ -1014,6 +997,10 @@ bool WaveClip::GetSpectrogram(WaveTrackCache &waveTrackCache,
    const WaveTrack *const track = waveTrackCache.GetTrack().get();
    const SpectrogramSettings &settings = track->GetSpectrogramSettings();
 
+   if (SpectrogramTileCache::CanRender(settings))
+      return GetSpectrogramFromTiles(
+         settings, spectrogram, where, numPixels, t0, pixelsPerSecond);
+
    bool match =
       mSpecCache &&
       mSpecCache->len > 0 &&
@@ -1116,6 +1103,116 @@ bool WaveClip::GetSpectrogram(WaveTrackCache &waveTrackCache,
    return true;
 }
 
+bool WaveClip::GetSpectrogramFromTiles(const SpectrogramSettings &settings,
+                                       const float *& spectrogram,
+                                       const sampleCount *& where,
+                                       size_t numPixels,
+                                       double t0, double pixelsPerSecond) const
+{
+   using Tiles = SpectrogramTileCache;
+   auto &tiles = Tiles::Get();
+   const auto tileColumns = (long long)Tiles::TileColumns;
+   const double samplesPerPixel = mRate / pixelsPerSecond;
+   const auto nBins = settings.NBins();
+
+   // Columns of the clip are centered at fixed samples, so that tiles
+   // computed for one scroll position serve for all others
+   const auto firstColumn = (long long)floor(0.5 + t0 * pixelsPerSecond);
+
+   auto &cache = *mSpecCache;
+   const bool sameView =
+      cache.fromTiles &&
+      cache.dirty == mDirty &&
+      cache.pps == pixelsPerSecond &&
+      cache.firstColumn == firstColumn &&
+      cache.len == numPixels &&
+      cache.Matches(mDirty, pixelsPerSecond, settings, mRate);
+
+   if (sameView && cache.missing == 0) {
+      spectrogram = &cache.freq[0];
+      where = &cache.where[0];
+      return false;  //hit cache completely
+   }
+
+   if (!sameView) {
+      cache.Grow(numPixels, settings, pixelsPerSecond, t0);
+      // purposely offset the display 1/2 sample to the left, as in
+      // GetSpectrogram()
+      const double correction = firstColumn * samplesPerPixel - t0 * mRate;
+      fillWhere(cache.where, numPixels, 0.5, correction,
+         t0, mRate, samplesPerPixel);
+      // Columns not yet computed draw as silence
+      std::fill(cache.freq.begin(), cache.freq.end(), -160.0f);
+      cache.fromTiles = true;
+      cache.firstColumn = firstColumn;
+      cache.dirty = mDirty;
+      cache.ready.assign(numPixels, false);
+      cache.missing = numPixels;
+   }
+
+   Tiles::Key key{ mSerial, mDirty,
+      settings.algorithm, settings.windowType,
+      settings.WindowSize(), settings.ZeroPaddingFactor(),
+      settings.frequencyGain, double(mRate), samplesPerPixel, 0 };
+
+   std::vector<Tiles::TileRequest> requests;
+   bool updated = !sameView;
+   for (size_t xx = 0; xx < numPixels;) {
+      const auto column = firstColumn + (long long)xx;
+      // Round down, also for negative columns
+      key.tile = (column >= 0 ? column : column - (tileColumns - 1))
+         / tileColumns;
+      const auto offset = size_t(column - key.tile * tileColumns);
+      const auto count = std::min(numPixels - xx, size_t(tileColumns) - offset);
+      if (std::find(cache.ready.begin() + xx, cache.ready.begin() + xx + count,
+            false) != cache.ready.begin() + xx + count) {
+         if (tiles.Read(key, offset, count, &cache.freq[nBins * xx])) {
+            std::fill(cache.ready.begin() + xx,
+               cache.ready.begin() + xx + count, true);
+            cache.missing -= count;
+            updated = true;
+         }
+         else
+            requests.push_back({ key });
+      }
+      xx += count;
+   }
+
+   if (!requests.empty()) {
+      // Copies for the workers; the samples share blocks with this clip
+      if (!mSpectrogramSamples || mSpectrogramSamplesDirty != mDirty) {
+         if (mSpectrogramSamples)
+            // Workers must not hold the last reference to the old copy
+            tiles.Cancel(mSerial);
+         mSpectrogramSamples =
+            std::make_shared<Sequence>(*mSequence, mSequence->GetFactory());
+         mSpectrogramSamplesDirty = mDirty;
+      }
+      if (!mSpectrogramSettings ||
+          mSpectrogramSettings->algorithm != settings.algorithm ||
+          mSpectrogramSettings->windowType != settings.windowType ||
+          mSpectrogramSettings->frequencyGain != settings.frequencyGain ||
+          mSpectrogramSettings->WindowSize() != settings.WindowSize() ||
+          mSpectrogramSettings->ZeroPaddingFactor() !=
+             settings.ZeroPaddingFactor()) {
+         auto copy = std::make_shared<SpectrogramSettings>(settings);
+         copy->CacheWindows();
+         mSpectrogramSettings = std::move(copy);
+      }
+      for (auto &request : requests) {
+         request.samples = mSpectrogramSamples;
+         request.settings = mSpectrogramSettings;
+      }
+   }
+   // Also forgets requests of this clip for columns no longer in view
+   tiles.Request(mSerial, std::move(requests));
+
+   spectrogram = &cache.freq[0];
+   where = &cache.where[0];
+
+   return updated;
+}
+
 std::pair<float, float> WaveClip::GetMinMax(
    double t0, double t1, bool mayThrow) const
 {
@@ -1158,6 +1255,25 @@ float WaveClip::GetRMS(double t0, double t1, bool mayThrow) const
    return mSequence->GetRMS(s0, s1-s0, mayThrow);
 }
 
+double WaveClip::GetSum(double t0, double t1, bool mayThrow) const
+{
+   if (t0 > t1) {
+      if (mayThrow)
+         THROW_INCONSISTENCY_EXCEPTION;
+      return 0.0;
+   }
+
+   if (t0 == t1)
+      return 0.0;
+
+   sampleCount s0, s1;
+
+   TimeToSamplesClip(t0, &s0);
+   TimeToSamplesClip(t1, &s1);
+
+   return mSequence->GetSum(s0, s1-s0, mayThrow);
+}
+
 void WaveClip::ConvertToSampleFormat(sampleFormat format,
    const std::function<void(size_t)> & progressReport)
 {
@@ -55,10 +55,14 @@ public:
    bool Matches(int dirty_, double pixelsPerSecond,
       const SpectrogramSettings &settings, double rate) const;
 
+   //! Gives len samples from start, as positioned in the track, or null
+   using SampleReader =
+      std::function< const float *(sampleCount start, size_t len) >;
+
    // Calculate one column of the spectrum
    bool CalculateOneSpectrum
       (const SpectrogramSettings &settings,
-       WaveTrackCache &waveTrackCache,
+       const SampleReader &read,
        const int xx, sampleCount numSamples,
        double offset, double rate, double pixelsPerSecond,
        int lowerBoundX, int upperBoundX,
@@ -77,6 +81,12 @@ public:
        sampleCount numSamples,
        double offset, double rate, double pixelsPerSecond);
 
+   void Populate
+      (const SpectrogramSettings &settings, const SampleReader &read,
+       int copyBegin, int copyEnd, size_t numPixels,
+       sampleCount numSamples,
+       double offset, double rate, double pixelsPerSecond);
+
    size_t       len { 0 }; // counts pixels, not samples
    int          algorithm;
    double       pps;
@@ -89,6 +99,13 @@ public:
    std::vector<sampleCount> where;
 
    int          dirty;
+
+   // For columns assembled from the SpectrogramTileCache:
+   bool         fromTiles { false };
+   // Column of the clip, counting from its start, at the left edge
+   long long    firstColumn { 0 };
+   std::vector<bool> ready;
+   size_t       missing { 0 };
 };
 
 class SpecPxCache {
@@ -177,6 +194,15 @@ private:
    WaveClip(const WaveClip&) PROHIBITED;
    WaveClip& operator= (const WaveClip&) PROHIBITED;
 
+   static unsigned long long NewSerial();
+
+   // Assemble the spectrogram from tiles computed in the background
+   bool GetSpectrogramFromTiles(const SpectrogramSettings &settings,
+                                const float *& spectrogram,
+                                const sampleCount *& where,
+                                size_t numPixels,
+                                double t0, double pixelsPerSecond) const;
+
 public:
    // typical constructor
    WaveClip(const SampleBlockFactoryPtr &factory, sampleFormat format,
@@ -250,6 +276,9 @@ public:
    Sequence* GetSequence() { return mSequence.get(); }
    const Sequence* GetSequence() const { return mSequence.get(); }
 
+   //! Distinguishes this clip from every other made in the process
+   unsigned long long GetSerial() const { return mSerial; }
+
    /** WaveTrack calls this whenever data in the wave clip changes. It is
     * called automatically when WaveClip has a chance to know that something
     * has changed, like when member functions SetSamples() etc. are called. */
@@ -269,6 +298,7 @@ public:
    std::pair<float, float> GetMinMax(
       double t0, double t1, bool mayThrow = true) const;
    float GetRMS(double t0, double t1, bool mayThrow = true) const;
+   double GetSum(double t0, double t1, bool mayThrow = true) const;
 
    /** Whenever you do an operation to the sequence that will change the number
     * of samples (that is, the length of the clip), you will want to call this
@@ -361,6 +391,7 @@ protected:
    double mOffset { 0 };
    int mRate;
    int mDirty { 0 };
+   const unsigned long long mSerial { NewSerial() };
    int mColourIndex;
 
    std::unique_ptr<Sequence> mSequence;
@@ -368,6 +399,10 @@ protected:
 
    mutable std::unique_ptr<WaveCache> mWaveCache;
    mutable std::unique_ptr<SpecCache> mSpecCache;
+   // Copies given to the SpectrogramTileCache, replaced when out of date
+   mutable std::shared_ptr<const Sequence> mSpectrogramSamples;
+   mutable int mSpectrogramSamplesDirty { -1 };
+   mutable std::shared_ptr<const SpectrogramSettings> mSpectrogramSettings;
    SampleBuffer  mAppendBuffer {};
    size_t        mAppendBufferLen { 0 };
 
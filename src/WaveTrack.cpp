@@ -94,8 +94,23 @@ WaveTrack::Holder WaveTrackFactory::NewWaveTrack(sampleFormat format, double rat
    return std::make_shared<WaveTrack> ( mpFactory, format, rate );
 }
 
+WaveTrack::Holder WaveTrackFactory::NewWaveTrack(
+   const wxString &defaultName, sampleFormat format, double rate)
+{
+   if (rate == 0)
+      rate = mSettings.GetRate();
+   return std::make_shared<WaveTrack> ( mpFactory, format, rate, defaultName );
+}
+
 WaveTrack::WaveTrack( const SampleBlockFactoryPtr &pFactory,
    sampleFormat format, double rate )
+   : WaveTrack( pFactory, format, rate,
+      TracksPrefs::GetDefaultAudioTrackNamePreference() )
+{
+}
+
+WaveTrack::WaveTrack( const SampleBlockFactoryPtr &pFactory,
+   sampleFormat format, double rate, const wxString &defaultName )
    : PlayableTrack()
    , mpFactory(pFactory)
 {
@@ -109,7 +124,7 @@ WaveTrack::WaveTrack( const SampleBlockFactoryPtr &pFactory,
    mOldGain[0] = 0.0;
    mOldGain[1] = 0.0;
    mWaveColorIndex = 0;
-   SetDefaultName(TracksPrefs::GetDefaultAudioTrackNamePreference());
+   SetDefaultName(defaultName);
    SetName(GetDefaultName());
    mDisplayMin = -1.0;
    mDisplayMax = 1.0;
@@ -1912,6 +1927,41 @@ float WaveTrack::GetRMS(double t0, double t1, bool mayThrow) const
    return length > 0 ? sqrt(sumsq / length.as_double()) : 0.0;
 }
 
+double WaveTrack::GetSum(double t0, double t1,
+   sampleCount *pNumSamples, bool mayThrow) const
+{
+   if (pNumSamples)
+      *pNumSamples = 0;
+
+   if (t0 > t1) {
+      if (mayThrow)
+         THROW_INCONSISTENCY_EXCEPTION;
+      return 0.0;
+   }
+
+   double sum = 0.0;
+   sampleCount length = 0;
+
+   for (const auto &clip: mClips)
+   {
+      // As in GetRMS
+      if (t1 >= clip->GetStartTime() && t0 <= clip->GetEndTime())
+      {
+         sampleCount clipStart, clipEnd;
+
+         sum += clip->GetSum(t0, t1, mayThrow);
+
+         clip->TimeToSamplesClip(wxMax(t0, clip->GetStartTime()), &clipStart);
+         clip->TimeToSamplesClip(wxMin(t1, clip->GetEndTime()), &clipEnd);
+         length += (clipEnd - clipStart);
+      }
+   }
+
+   if (pNumSamples)
+      *pNumSamples = length;
+   return sum;
+}
+
 bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
                     sampleCount start, size_t len, fillFormat fill,
                     bool mayThrow, sampleCount * pNumWithinClips) const
@@ -2038,6 +2088,20 @@ void WaveTrack::Set(constSamplePtr buffer, sampleFormat format,
    }
 }
 
+void WaveTrack::Prefetch(sampleCount start, sampleCount len) const
+{
+   // Iterate the clips.  They are not necessarily sorted by time.
+   for (const auto &clip: mClips)
+   {
+      auto clipStart = clip->GetStartSample();
+      auto clipEnd = clip->GetEndSample();
+
+      if (clipEnd > start && clipStart < start + len)
+         // The sequence clips the range to its own extent
+         clip->GetSequence()->Prefetch(start - clipStart, len);
+   }
+}
+
 void WaveTrack::GetEnvelopeValues(double *buffer, size_t bufferLen,
                                   double t0) const
 {
@@ -2652,6 +2716,13 @@ const float *WaveTrackCache::GetFloats(
       }
       wxASSERT(mNValidBuffers < 2 || mBuffers[0].end() == mBuffers[1].start);
 
+      if (fillFirst || fillSecond)
+         // Playback and export march forward; let storage read the next
+         // blocks in the background while the caller consumes these
+         mPTrack->Prefetch(
+            mNValidBuffers > 0 ? mBuffers[mNValidBuffers - 1].end() : end,
+            sampleCount( ReadAheadBlocks * mBufferSize ));
+
       samplePtr buffer = nullptr; // will point into mOverlapBuffer
       auto remaining = len;
 
@@ -74,6 +74,9 @@ public:
 
    WaveTrack(
       const SampleBlockFactoryPtr &pFactory, sampleFormat format, double rate);
+   //! Named defaultName, rather than the name in preferences
+   WaveTrack(const SampleBlockFactoryPtr &pFactory,
+      sampleFormat format, double rate, const wxString &defaultName);
    WaveTrack(const WaveTrack &orig);
 
    // overwrite data excluding the sample sequence but including display
@@ -283,6 +286,11 @@ private:
    void Set(constSamplePtr buffer, sampleFormat format,
                    sampleCount start, size_t len);
 
+   //! Hint that samples in the range will soon be fetched; never throws or waits
+   /*! Storage may then read them in the background, so that the later
+    Get() does not wait */
+   void Prefetch(sampleCount start, sampleCount len) const;
+
    // Fetch envelope values corresponding to uniformly separated sample times
    // starting at the given time.
    void GetEnvelopeValues(double *buffer, size_t bufferLen,
@@ -293,6 +301,13 @@ private:
       double t0, double t1, bool mayThrow = true) const;
    // May assume precondition: t0 <= t1
    float GetRMS(double t0, double t1, bool mayThrow = true) const;
+   //! Sum of the samples in clips between t0 and t1, for DC offset
+   /*! Reads samples only of sample blocks partly in the range.
+    @param pNumSamples if not null, receives how many samples were summed
+    */
+   // May assume precondition: t0 <= t1
+   double GetSum(double t0, double t1,
+      sampleCount *pNumSamples = nullptr, bool mayThrow = true) const;
 
    //
    // MM: We now have more than one sequence and envelope per track, so
@@ -649,6 +664,10 @@ public:
    const float *GetFloats(sampleCount start, size_t len, bool mayThrow);
 
 private:
+   //! How many blocks of the maximum size to hint for reading ahead of the
+   //! cached ones
+   static constexpr size_t ReadAheadBlocks = 4;
+
    void Free();
 
    struct Buffer {
@@ -723,6 +742,10 @@ class SNEEDACITY_DLL_API WaveTrackFactory final
    std::shared_ptr<WaveTrack> NewWaveTrack(
       sampleFormat format = (sampleFormat)0,
       double rate = 0);
+   //! Reads no preferences, so that worker threads may call it; format
+   //! must be given
+   std::shared_ptr<WaveTrack> NewWaveTrack(
+      const wxString &defaultName, sampleFormat format, double rate);
 };
 
 #endif // __SNEEDACITY_WAVETRACK__
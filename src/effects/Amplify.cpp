@@ -184,6 +184,14 @@ bool EffectAmplify::LoadFactoryDefaults()
 
 // Effect implementation
 
+std::unique_ptr<Effect> EffectAmplify::CloneForProcessing()
+{
+   auto clone = std::make_unique<EffectAmplify>();
+   clone->mRatio = mRatio;
+   clone->mCanClip = mCanClip;
+   return FinishClone(std::move(clone));
+}
+
 bool EffectAmplify::Init()
 {
    mPeak = 0.0;
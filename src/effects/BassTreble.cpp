@@ -220,6 +220,16 @@ bool EffectBassTreble::CheckWhetherSkipEffect()
 
 // Effect implementation
 
+std::unique_ptr<Effect> EffectBassTreble::CloneForProcessing()
+{
+   auto clone = std::make_unique<EffectBassTreble>();
+   clone->mBass = mBass;
+   clone->mTreble = mTreble;
+   clone->mGain = mGain;
+   clone->mLink = mLink;
+   return FinishClone(std::move(clone));
+}
+
 void EffectBassTreble::PopulateOrExchange(ShuttleGui & S)
 {
    S.SetBorder(5);
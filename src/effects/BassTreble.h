@@ -73,6 +73,7 @@ public:
 
    // Effect Implementation
 
+   std::unique_ptr<Effect> CloneForProcessing() override;
    void PopulateOrExchange(ShuttleGui & S) override;
    bool TransferDataToWindow() override;
    bool TransferDataFromWindow() override;
@@ -357,6 +357,14 @@ bool EffectDistortion::LoadFactoryPreset(int id)
 
 // Effect implementation
 
+std::unique_ptr<Effect> EffectDistortion::CloneForProcessing()
+{
+   auto clone = std::make_unique<EffectDistortion>();
+   clone->mParams = mParams;
+   clone->mThreshold = mThreshold;
+   return FinishClone(std::move(clone));
+}
+
 void EffectDistortion::PopulateOrExchange(ShuttleGui & S)
 {
    S.AddSpace(0, 5);
@@ -93,6 +93,7 @@ public:
 
    // Effect implementation
 
+   std::unique_ptr<Effect> CloneForProcessing() override;
    void PopulateOrExchange(ShuttleGui & S) override;
    bool TransferDataToWindow() override;
    bool TransferDataFromWindow() override;
@@ -10,7 +10,219 @@ Max Maisel
 
 #include "EBUR128.h"
 
-EBUR128::EBUR128(double rate, size_t channels)
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EBUR128_SSE2
+#include <emmintrin.h>
+#endif
+
+/// Finds the largest absolute value of one channel, upsampled four times
+/// by the interpolating filter of ITU-R BS.1770-4, Annex 2.
+struct EBUR128::TruePeakMeter
+{
+   static constexpr size_t Taps = 12;
+   static constexpr size_t Phases = 4;
+   static constexpr size_t MaxDeferred = 64;
+   /// Coefficients[j][k] weighs the j-th previous sample for phase k
+   static const float Coefficients[Taps][Phases];
+
+   void Reset();
+   /// Processes any deferred samples first
+   void Process(const float *in, size_t n);
+   /// Saves the sample to process with others, so that the filter is set
+   /// up once for each block, not for each sample
+   void Defer(float x);
+   /// Processes any deferred samples first
+   float Peak();
+
+   void Flush();
+   void DoProcess(const float *in, size_t n);
+   /// Returns the newest of the last Taps samples, which precede it
+   const float *Push(float x);
+
+   /// Each sample is written twice, so that the last Taps are contiguous
+   float mHistory[2 * Taps];
+   size_t mPos;
+   float mPeak;
+   float mDeferred[MaxDeferred];
+   size_t mNDeferred;
+};
+
+const float EBUR128::TruePeakMeter::Coefficients[Taps][Phases] = {
+   {  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+   {  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+   { -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+   {  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+   { -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+   {  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+   {  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+   { -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+   {  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+   { -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+   {  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+   { -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+};
+
+void EBUR128::TruePeakMeter::Reset()
+{
+   std::fill(mHistory, mHistory + 2 * Taps, 0.0f);
+   mPos = 0;
+   mPeak = 0;
+   mNDeferred = 0;
+}
+
+void EBUR128::TruePeakMeter::Process(const float *in, size_t n)
+{
+   Flush();
+   DoProcess(in, n);
+}
+
+void EBUR128::TruePeakMeter::Defer(float x)
+{
+   mDeferred[mNDeferred++] = x;
+   if(mNDeferred == MaxDeferred)
+      Flush();
+}
+
+float EBUR128::TruePeakMeter::Peak()
+{
+   Flush();
+   return mPeak;
+}
+
+void EBUR128::TruePeakMeter::Flush()
+{
+   if(mNDeferred == 0)
+      return;
+   DoProcess(mDeferred, mNDeferred);
+   mNDeferred = 0;
+}
+
+const float *EBUR128::TruePeakMeter::Push(float x)
+{
+   mHistory[mPos] = mHistory[mPos + Taps] = x;
+   const auto newest = mHistory + mPos + Taps;
+   mPos = (mPos + 1) % Taps;
+   return newest;
+}
+
+void EBUR128::TruePeakMeter::DoProcess(const float *in, size_t n)
+{
+#ifdef EBUR128_SSE2
+   // All four phases at once, one in each lane
+   __m128 coeffs[Taps];
+   for (size_t j = 0; j < Taps; ++j)
+      coeffs[j] = _mm_loadu_ps(Coefficients[j]);
+   const auto absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+   auto peaks = _mm_set1_ps(mPeak);
+   for (size_t ii = 0; ii < n; ++ii) {
+      const auto newest = Push(in[ii]);
+      auto y = _mm_mul_ps(coeffs[0], _mm_set1_ps(newest[0]));
+      for (size_t j = 1; j < Taps; ++j)
+         y = _mm_add_ps(y, _mm_mul_ps(coeffs[j], _mm_set1_ps(newest[-int(j)])));
+      peaks = _mm_max_ps(peaks, _mm_and_ps(y, absMask));
+   }
+   float lanes[Phases];
+   _mm_storeu_ps(lanes, peaks);
+   mPeak = *std::max_element(lanes, lanes + Phases);
+#else
+   for (size_t ii = 0; ii < n; ++ii) {
+      const auto newest = Push(in[ii]);
+      for (size_t k = 0; k < Phases; ++k) {
+         float y = 0;
+         for (size_t j = 0; j < Taps; ++j)
+            y += Coefficients[j][k] * newest[-int(j)];
+         mPeak = std::max(mPeak, std::abs(y));
+      }
+   }
+#endif
+}
+
+namespace {
+
+/// Run the weighting filters of one channel over n samples, and store (or
+/// add, if add) the squares of the outputs to power.
+void WeighChannel(ArrayOf<Biquad> &filters,
+   const float *in, double *power, size_t n, bool add)
+{
+   for(size_t i = 0; i < n; ++i)
+   {
+      double value;
+      value = filters[0].ProcessOne(in[i]);
+      value = filters[1].ProcessOne(value);
+      power[i] = add ? power[i] + value * value : value * value;
+   }
+}
+
+#ifdef EBUR128_SSE2
+/// Same as WeighChannel() for two channels, one in each lane.
+/// Each lane does the same double arithmetic as Biquad::ProcessOne(),
+/// rounding outputs to float, so results are the same.
+void WeighChannelPair(ArrayOf<Biquad> &filters0, ArrayOf<Biquad> &filters1,
+   const float *in0, const float *in1, double *power, size_t n, bool add)
+{
+   __m128d b0[2], b1[2], b2[2], a1[2], a2[2];
+   __m128d prevIn[2], prevPrevIn[2], prevOut[2], prevPrevOut[2];
+   for(size_t f = 0; f < 2; ++f)
+   {
+      const Biquad &l = filters0[f], &r = filters1[f];
+      b0[f] = _mm_set_pd(r.fNumerCoeffs[Biquad::B0], l.fNumerCoeffs[Biquad::B0]);
+      b1[f] = _mm_set_pd(r.fNumerCoeffs[Biquad::B1], l.fNumerCoeffs[Biquad::B1]);
+      b2[f] = _mm_set_pd(r.fNumerCoeffs[Biquad::B2], l.fNumerCoeffs[Biquad::B2]);
+      a1[f] = _mm_set_pd(r.fDenomCoeffs[Biquad::A1], l.fDenomCoeffs[Biquad::A1]);
+      a2[f] = _mm_set_pd(r.fDenomCoeffs[Biquad::A2], l.fDenomCoeffs[Biquad::A2]);
+      prevIn[f] = _mm_set_pd(r.fPrevIn, l.fPrevIn);
+      prevPrevIn[f] = _mm_set_pd(r.fPrevPrevIn, l.fPrevPrevIn);
+      prevOut[f] = _mm_set_pd(r.fPrevOut, l.fPrevOut);
+      prevPrevOut[f] = _mm_set_pd(r.fPrevPrevOut, l.fPrevPrevOut);
+   }
+
+   for(size_t i = 0; i < n; ++i)
+   {
+      auto x = _mm_set_pd(in1[i], in0[i]);
+      for(size_t f = 0; f < 2; ++f)
+      {
+         const auto y = _mm_sub_pd(_mm_sub_pd(_mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(x, b0[f]),
+            _mm_mul_pd(prevIn[f], b1[f])),
+            _mm_mul_pd(prevPrevIn[f], b2[f])),
+            _mm_mul_pd(prevOut[f], a1[f])),
+            _mm_mul_pd(prevPrevOut[f], a2[f]));
+         prevPrevIn[f] = prevIn[f];
+         prevIn[f] = x;
+         prevPrevOut[f] = prevOut[f];
+         prevOut[f] = y;
+         x = _mm_cvtps_pd(_mm_cvtpd_ps(y));
+      }
+      // Sum the channels in order, as ProcessSampleFromChannel() does
+      const auto square = _mm_mul_pd(x, x);
+      auto sum = add
+         ? _mm_add_sd(_mm_load_sd(power + i), square)
+         : square;
+      sum = _mm_add_sd(sum, _mm_unpackhi_pd(square, square));
+      _mm_store_sd(power + i, sum);
+   }
+
+   for(size_t f = 0; f < 2; ++f)
+   {
+      Biquad &l = filters0[f], &r = filters1[f];
+      _mm_storel_pd(&l.fPrevIn, prevIn[f]);
+      _mm_storeh_pd(&r.fPrevIn, prevIn[f]);
+      _mm_storel_pd(&l.fPrevPrevIn, prevPrevIn[f]);
+      _mm_storeh_pd(&r.fPrevPrevIn, prevPrevIn[f]);
+      _mm_storel_pd(&l.fPrevOut, prevOut[f]);
+      _mm_storeh_pd(&r.fPrevOut, prevOut[f]);
+      _mm_storel_pd(&l.fPrevPrevOut, prevPrevOut[f]);
+      _mm_storeh_pd(&r.fPrevPrevOut, prevPrevOut[f]);
+   }
+}
+#endif
+
+}
+
+EBUR128::EBUR128(double rate, size_t channels, bool truePeak)
    : mChannelCount(channels)
    , mRate(rate)
 {
@@ -21,8 +233,12 @@ EBUR128::EBUR128(double rate, size_t channels)
    mWeightingFilter.reinit(mChannelCount, false);
    for(size_t channel = 0; channel < mChannelCount; ++channel)
       mWeightingFilter[channel] = CalcWeightingFilter(mRate);
+   if(truePeak)
+      mTruePeak.reinit(mChannelCount, false);
 }
 
+EBUR128::~EBUR128() = default;
+
 void EBUR128::Initialize()
 {
    mSampleCount = 0;
@@ -33,6 +249,8 @@ void EBUR128::Initialize()
    {
       mWeightingFilter[channel][0].Reset();
       mWeightingFilter[channel][1].Reset();
+      if(mTruePeak)
+         mTruePeak[channel].Reset();
    }
 }
 
@@ -87,6 +305,8 @@ ArrayOf<Biquad> EBUR128::CalcWeightingFilter(double fs)
 
 void EBUR128::ProcessSampleFromChannel(float x_in, size_t channel)
 {
+   if(mTruePeak)
+      mTruePeak[channel].Defer(x_in);
    double value;
    value = mWeightingFilter[channel][0].ProcessOne(x_in);
    value = mWeightingFilter[channel][1].ProcessOne(value);
@@ -117,6 +337,57 @@ void EBUR128::NextSample()
    ++mSampleCount;
 }
 
+void EBUR128::ProcessBlock(const float *const *channels, size_t nSamples)
+{
+   for(size_t done = 0; done < nSamples;)
+   {
+      // Fill the ring up to where NextSample() would next look at it.
+      const size_t count = std::min({ nSamples - done,
+         mBlockOverlap - mBlockRingPos % mBlockOverlap,
+         mBlockSize - mBlockRingPos });
+      const auto power = &mBlockRingBuffer[mBlockRingPos];
+
+      size_t channel = 0;
+#ifdef EBUR128_SSE2
+      for(; channel + 1 < mChannelCount; channel += 2)
+         WeighChannelPair(
+            mWeightingFilter[channel], mWeightingFilter[channel + 1],
+            channels[channel] + done, channels[channel + 1] + done,
+            power, count, channel > 0);
+#endif
+      for(; channel < mChannelCount; ++channel)
+         WeighChannel(mWeightingFilter[channel], channels[channel] + done,
+            power, count, channel > 0);
+
+      if(mTruePeak)
+         for(channel = 0; channel < mChannelCount; ++channel)
+            mTruePeak[channel].Process(channels[channel] + done, count);
+
+      // Same as count calls of NextSample(), only the last of which can
+      // complete a block.
+      mBlockRingPos += count;
+      mBlockRingSize += count;
+      if(mBlockRingPos % mBlockOverlap == 0)
+      {
+         if(mBlockRingSize >= mBlockSize)
+            AddBlockToHistogram(mBlockSize);
+      }
+      if(mBlockRingPos == mBlockSize)
+         mBlockRingPos = 0;
+      mSampleCount += count;
+      done += count;
+   }
+}
+
+float EBUR128::TruePeak()
+{
+   float peak = 0;
+   if(mTruePeak)
+      for(size_t channel = 0; channel < mChannelCount; ++channel)
+         peak = std::max(peak, mTruePeak[channel].Peak());
+   return peak;
+}
+
 double EBUR128::IntegrativeLoudness()
 {
    // EBU R128: z_i = mean square without root
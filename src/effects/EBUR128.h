@@ -21,20 +21,30 @@ Max Maisel
 class EBUR128
 {
 public:
-   EBUR128(double rate, size_t channels);
+   /// truePeak: also measure true peaks, which costs more than the loudness
+   EBUR128(double rate, size_t channels, bool truePeak = false);
    EBUR128(const EBUR128&) = delete;
    EBUR128(EBUR128&&) = delete;
-   ~EBUR128() = default;
+   ~EBUR128();
 
    static ArrayOf<Biquad> CalcWeightingFilter(double fs);
    void Initialize();
    void ProcessSampleFromChannel(float x_in, size_t channel);
    void NextSample();
+   /// Same as ProcessSampleFromChannel() for each channel and NextSample(),
+   /// for nSamples samples of all channels; but filters the channels side
+   /// by side, and many samples at a time.
+   void ProcessBlock(const float *const *channels, size_t nSamples);
    double IntegrativeLoudness();
    inline double IntegrativeLoudnessToLUFS(double loudness)
       { return 10 * log10(loudness); }
+   /// Largest absolute sample value of all channels, upsampled four times
+   /// as in ITU-R BS.1770; 0 unless constructed to measure true peaks.
+   float TruePeak();
 
 private:
+   struct TruePeakMeter;
+
    void HistogramSums(size_t start_idx, double& sum_v, long int& sum_c);
    void AddBlockToHistogram(size_t validLen);
 
@@ -56,6 +66,9 @@ private:
    /// CHANNEL = LEFT/RIGHT (0/1) and
    /// FILTER  = HSF/HPF    (0/1)
    ArrayOf<ArrayOf<Biquad>> mWeightingFilter;
+
+   /// One for each channel, or none
+   ArrayOf<TruePeakMeter> mTruePeak;
 };
 
 #endif
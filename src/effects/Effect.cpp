@@ -20,6 +20,8 @@
 #include "TimeWarper.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 
 #include <wx/defs.h>
 #include <wx/sizer.h>
@@ -36,6 +38,7 @@
 #include "../prefs/QualitySettings.h"
 #include "../ShuttleGui.h"
 #include "../Shuttle.h"
+#include "../ThreadPool.h"
 #include "../ViewInfo.h"
 #include "../WaveTrack.h"
 #include "../wxFileNameWrapper.h"
@@ -51,6 +54,12 @@
 // Effect application counter
 int Effect::nEffectsDone=0;
 
+BoolSetting Effect::ParallelProcessing{
+   L"/Performance/ParallelEffects", true };
+
+BoolSetting Effect::PipelinedProcessing{
+   L"/Performance/PipelinedEffects", true };
+
 static const int kPlayID = 20102;
 static const int kRewindID = 20103;
 static const int kFFwdID = 20104;
@@ -1398,18 +1407,35 @@ bool Effect::ProcessPass()
    bool bGoodResult = true;
    bool isGenerator = GetType() == EffectTypeGenerate;
 
-   FloatBuffers inBuffer, outBuffer;
-   ArrayOf<float *> inBufPos, outBufPos;
-
-   ChannelName map[3];
+   TrackBuffers buffers;
 
    mBufferSize = 0;
    mBlockSize = 0;
 
    int count = 0;
-   bool clear = false;
 
    const bool multichannel = mNumAudioIn > 1;
+
+   // Clones of effects that opt in process the groups in worker threads;
+   // otherwise each group is processed here as it is visited
+   std::vector<std::unique_ptr<Effect>> clones;
+   std::vector<TrackGroup> groups;
+   const auto nGroups = multichannel ? mNumGroups : mNumTracks;
+   const auto nThreads = ThreadPool::Get().GetThreadCount();
+   if (GetType() == EffectTypeProcess && nGroups > 1 && nThreads > 0 &&
+       ParallelProcessing.Read())
+   {
+      const auto nClones = std::min<size_t>(nGroups, nThreads);
+      for (size_t ii = 0; ii < nClones; ++ii) {
+         auto clone = CloneForProcessing();
+         if (!clone) {
+            clones.clear();
+            break;
+         }
+         clones.push_back(std::move(clone));
+      }
+   }
+
    auto range = multichannel
       ? mOutputTracks->Leaders()
       : mOutputTracks->Any();
@@ -1418,11 +1444,11 @@ bool Effect::ProcessPass()
          if (!left->GetSelected())
             return fallthrough();
 
-         sampleCount len = 0;
-         sampleCount start = 0;
-
-         mNumChannels = 0;
-         WaveTrack *right{};
+         TrackGroup group{};
+         group.count = count;
+         group.left = left;
+         auto &map = group.map;
+         auto &numChannels = group.numChannels;
 
          // Iterate either over one track which could be any channel,
          // or if multichannel, then over all channels of left,
@@ -1430,22 +1456,21 @@ bool Effect::ProcessPass()
          for (auto channel :
               TrackList::Channels(left).StartingWith(left)) {
             if (channel->GetChannel() == Track::LeftChannel)
-               map[mNumChannels] = ChannelNameFrontLeft;
+               map[numChannels] = ChannelNameFrontLeft;
             else if (channel->GetChannel() == Track::RightChannel)
-               map[mNumChannels] = ChannelNameFrontRight;
+               map[numChannels] = ChannelNameFrontRight;
             else
-               map[mNumChannels] = ChannelNameMono;
+               map[numChannels] = ChannelNameMono;
 
-            ++ mNumChannels;
-            map[mNumChannels] = ChannelNameEOL;
+            ++ numChannels;
+            map[numChannels] = ChannelNameEOL;
 
             if (! multichannel)
                break;
 
-            if (mNumChannels == 2) {
+            if (numChannels == 2) {
                // TODO: more-than-two-channels
-               right = channel;
-               clear = false;
+               group.right = channel;
                // Ignore other channels
                break;
             }
@@ -1453,79 +1478,21 @@ bool Effect::ProcessPass()
 
          if (!isGenerator)
          {
-            GetBounds(*left, right, &start, &len);
-            mSampleCnt = len;
+            GetBounds(*left, group.right, &group.start, &group.len);
+            group.sampleCnt = group.len;
          }
          else
-            mSampleCnt = left->TimeToLongSamples(mDuration);
+            group.sampleCnt = left->TimeToLongSamples(mDuration);
 
-         // Let the client know the sample rate
-         SetSampleRate(left->GetRate());
-
-         // Get the block size the client wants to use
-         auto max = left->GetMaxBlockSize() * 2;
-         mBlockSize = SetBlockSize(max);
-
-         // Calculate the buffer size to be at least the max rounded up to the clients
-         // selected block size.
-         const auto prevBufferSize = mBufferSize;
-         mBufferSize = ((max + (mBlockSize - 1)) / mBlockSize) * mBlockSize;
-
-         // If the buffer size has changed, then (re)allocate the buffers
-         if (prevBufferSize != mBufferSize)
-         {
-            // Always create the number of input buffers the client expects even if we don't have
-            // the same number of channels.
-            inBufPos.reinit( mNumAudioIn );
-            inBuffer.reinit( mNumAudioIn, mBufferSize );
-
-            // We won't be using more than the first 2 buffers, so clear the rest (if any)
-            for (size_t i = 2; i < mNumAudioIn; i++)
-            {
-               for (size_t j = 0; j < mBufferSize; j++)
-               {
-                  inBuffer[i][j] = 0.0;
-               }
-            }
-
-            // Always create the number of output buffers the client expects even if we don't have
-            // the same number of channels.
-            outBufPos.reinit( mNumAudioOut );
-            // Output buffers get an extra mBlockSize worth to give extra room if
-            // the plugin adds latency
-            outBuffer.reinit( mNumAudioOut, mBufferSize + mBlockSize );
-         }
-
-         // (Re)Set the input buffer positions
-         for (size_t i = 0; i < mNumAudioIn; i++)
-         {
-            inBufPos[i] = inBuffer[i].get();
-         }
-
-         // (Re)Set the output buffer positions
-         for (size_t i = 0; i < mNumAudioOut; i++)
-         {
-            outBufPos[i] = outBuffer[i].get();
-         }
+         count++;
 
-         // Clear unused input buffers
-         if (!right && !clear && mNumAudioIn > 1)
-         {
-            for (size_t j = 0; j < mBufferSize; j++)
-            {
-               inBuffer[1][j] = 0.0;
-            }
-            clear = true;
+         if (!clones.empty()) {
+            groups.push_back(group);
+            return;
          }
 
          // Go process the track(s)
-         bGoodResult = ProcessTrack(
-            count, map, left, right, start, len,
-            inBuffer, outBuffer, inBufPos, outBufPos);
-         if (!bGoodResult)
-            return;
-
-         count++;
+         bGoodResult = ProcessGroup(group, buffers);
       },
       [&](Track *t) {
          if (t->IsSyncLockSelected())
@@ -1533,6 +1500,9 @@ bool Effect::ProcessPass()
       }
    );
 
+   if (bGoodResult && !groups.empty())
+      bGoodResult = ProcessGroupsInParallel(groups, clones);
+
    if (bGoodResult && GetType() == EffectTypeGenerate)
    {
       mT1 = mT0 + mDuration;
@@ -1541,6 +1511,181 @@ bool Effect::ProcessPass()
    return bGoodResult;
 }
 
+bool Effect::ProcessGroup(TrackGroup group, TrackBuffers &buffers)
+{
+   auto left = group.left;
+   auto right = group.right;
+   auto &inBuffer = buffers.inBuffer;
+   auto &outBuffer = buffers.outBuffer;
+   auto &inBufPos = buffers.inBufPos;
+   auto &outBufPos = buffers.outBufPos;
+
+   mNumChannels = group.numChannels;
+   mSampleCnt = group.sampleCnt;
+   if (right)
+      buffers.clear = false;
+
+   // Let the client know the sample rate
+   SetSampleRate(left->GetRate());
+
+   // Get the block size the client wants to use
+   auto max = left->GetMaxBlockSize() * 2;
+   mBlockSize = SetBlockSize(max);
+
+   // Calculate the buffer size to be at least the max rounded up to the clients
+   // selected block size.
+   const auto prevBufferSize = mBufferSize;
+   mBufferSize = ((max + (mBlockSize - 1)) / mBlockSize) * mBlockSize;
+
+   // If the buffer size has changed, then (re)allocate the buffers
+   if (prevBufferSize != mBufferSize)
+   {
+      // Always create the number of input buffers the client expects even if we don't have
+      // the same number of channels.
+      inBufPos.reinit( mNumAudioIn );
+      inBuffer.reinit( mNumAudioIn, mBufferSize );
+
+      // We won't be using more than the first 2 buffers, so clear the rest (if any)
+      for (size_t i = 2; i < mNumAudioIn; i++)
+      {
+         for (size_t j = 0; j < mBufferSize; j++)
+         {
+            inBuffer[i][j] = 0.0;
+         }
+      }
+
+      // Always create the number of output buffers the client expects even if we don't have
+      // the same number of channels.
+      outBufPos.reinit( mNumAudioOut );
+      // Output buffers get an extra mBlockSize worth to give extra room if
+      // the plugin adds latency
+      outBuffer.reinit( mNumAudioOut, mBufferSize + mBlockSize );
+
+      buffers.clear = false;
+   }
+
+   // (Re)Set the input buffer positions
+   for (size_t i = 0; i < mNumAudioIn; i++)
+   {
+      inBufPos[i] = inBuffer[i].get();
+   }
+
+   // (Re)Set the output buffer positions
+   for (size_t i = 0; i < mNumAudioOut; i++)
+   {
+      outBufPos[i] = outBuffer[i].get();
+   }
+
+   // Clear unused input buffers
+   if (!right && !buffers.clear && mNumAudioIn > 1)
+   {
+      for (size_t j = 0; j < mBufferSize; j++)
+      {
+         inBuffer[1][j] = 0.0;
+      }
+      buffers.clear = true;
+   }
+
+   // Go process the track(s)
+   return ProcessTrack(
+      group.count, group.map, left, right, group.start, group.len,
+      inBuffer, outBuffer, inBufPos, outBufPos);
+}
+
+struct Effect::ParallelProgress
+{
+   explicit ParallelProgress(size_t nGroups)
+      : fractions( nGroups )
+   {
+      for (auto &fraction : fractions)
+         fraction.store(0.0, std::memory_order_relaxed);
+   }
+
+   //! Called by the clones; returns whether to stop
+   bool Update(int whichGroup, double frac)
+   {
+      fractions[whichGroup].store(frac, std::memory_order_relaxed);
+      return cancelled.load(std::memory_order_relaxed);
+   }
+
+   double Total() const
+   {
+      double sum = 0;
+      for (auto &fraction : fractions)
+         sum += fraction.load(std::memory_order_relaxed);
+      return sum / fractions.size();
+   }
+
+   std::vector< std::atomic<double> > fractions;
+   std::atomic<bool> cancelled{ false };
+};
+
+std::unique_ptr<Effect> Effect::CloneForProcessing()
+{
+   return nullptr;
+}
+
+std::unique_ptr<Effect> Effect::FinishClone(std::unique_ptr<Effect> clone)
+{
+   if (!clone)
+      return nullptr;
+
+   clone->mIsBatch = mIsBatch;
+   clone->mIsPreview = mIsPreview;
+   clone->mT0 = mT0;
+   clone->mT1 = mT1;
+   clone->mDuration = mDuration;
+   clone->mProjectRate = mProjectRate;
+   clone->mNumAudioIn = clone->GetAudioInCount();
+   clone->mNumAudioOut = clone->GetAudioOutCount();
+   if (clone->mNumAudioIn != mNumAudioIn ||
+       clone->mNumAudioOut != mNumAudioOut)
+      return nullptr;
+   return clone;
+}
+
+bool Effect::ProcessGroupsInParallel(const std::vector<TrackGroup> &groups,
+   std::vector<std::unique_ptr<Effect>> &clones)
+{
+   ParallelProgress progress{ groups.size() };
+   std::atomic<size_t> next{ 0 };
+   std::atomic<bool> failed{ false };
+
+   // Each clone takes the next group as it finishes one.  Each group writes
+   // only its own output tracks, which replace the originals in track order
+   // when the effect is done, as they do in serial processing.
+   std::vector< std::future<void> > futures;
+   for (auto &pClone : clones) {
+      pClone->mpParallelProgress = &progress;
+      futures.push_back(ThreadPool::Get().Submit([&, pEffect = pClone.get()]{
+         TrackBuffers buffers;
+         for (size_t ii;
+              !progress.cancelled && (ii = next++) < groups.size();) {
+            bool ok = false;
+            auto stop = finally([&]{
+               if (!ok) {
+                  failed = true;
+                  progress.cancelled = true;
+               }
+            });
+            ok = pEffect->ProcessGroup(groups[ii], buffers);
+         }
+      }));
+   }
+
+   // Only this thread may update the dialog; wait for all workers before
+   // rethrowing any exception, because they use these local variables
+   for (auto &future : futures)
+      while (future.wait_for(std::chrono::milliseconds(100)) ==
+             std::future_status::timeout)
+         if (TotalProgress(progress.Total()))
+            progress.cancelled = true;
+   for (auto &future : futures)
+      future.get();
+
+   return !failed && !progress.cancelled;
+}
+
 bool Effect::ProcessTrack(int count,
                           ChannelNames map,
                           WaveTrack *left,
@@ -1623,6 +1768,73 @@ bool Effect::ProcessTrack(int count,
          genRight = right->EmptyCopy();
    }
 
+   // Reading of the next input buffer, and writing of the last output
+   // buffer, can overlap processing, in a worker thread.  Reads and writes
+   // of the same track must not overlap each other, so there is at most one
+   // of either pending.  Not in clones that already run in worker threads.
+   const bool pipelined = !mpParallelProgress &&
+      ThreadPool::Get().GetThreadCount() > 0 && PipelinedProcessing.Read();
+   FloatBuffers nextInBuffer, writeBuffer;
+   if (pipelined)
+   {
+      if (len > 0)
+         nextInBuffer.reinit( mNumChannels, mBufferSize );
+      writeBuffer.reinit( chans, mBufferSize + mBlockSize );
+   }
+   auto nextInPos = inPos;
+   size_t nextInCnt = 0;
+   std::future<void> pendingIO;
+   auto waitIO = [&]{
+      if (pendingIO.valid())
+         // May rethrow an exception from the worker
+         pendingIO.get();
+   };
+   auto startIO = [&](std::function<void()> task){
+      waitIO();
+      pendingIO = ThreadPool::Get().Submit(std::move(task));
+   };
+   auto readAhead = [&](sampleCount pos, sampleCount remaining){
+      nextInPos = pos;
+      nextInCnt = limitSampleBufferSize( mBufferSize, remaining );
+      if (nextInCnt == 0)
+         return;
+      startIO([&, pos, cnt = nextInCnt]{
+         left->GetFloats(nextInBuffer[0].get(), pos, cnt);
+         if (right)
+            right->GetFloats(nextInBuffer[1].get(), pos, cnt);
+      });
+   };
+   auto writeOut = [&](FloatBuffers &buffer, sampleCount pos, size_t cnt){
+      if (isProcessor)
+      {
+         left->Set((samplePtr) buffer[0].get(), floatSample, pos, cnt);
+         if (right)
+         {
+            if (chans >= 2)
+            {
+               right->Set((samplePtr) buffer[1].get(), floatSample, pos, cnt);
+            }
+            else
+            {
+               right->Set((samplePtr) buffer[0].get(), floatSample, pos, cnt);
+            }
+         }
+      }
+      else if (isGenerator)
+      {
+         genLeft->Append((samplePtr) buffer[0].get(), floatSample, cnt);
+         if (genRight)
+         {
+            genRight->Append((samplePtr) buffer[1].get(), floatSample, cnt);
+         }
+      }
+   };
+   // Don't leave the worker with buffers about to be destroyed
+   auto finishIO = finally([&]{
+      if (pendingIO.valid())
+         pendingIO.wait();
+   });
+
    // Call the effect until we run out of input or delayed samples
    while (inputRemaining != 0 || delayRemaining != 0)
    {
@@ -1636,11 +1848,30 @@ bool Effect::ProcessTrack(int count,
             inputBufferCnt =
                limitSampleBufferSize( mBufferSize, inputRemaining );
 
-            // Fill the input buffers
-            left->GetFloats(inBuffer[0].get(), inPos, inputBufferCnt);
-            if (right)
+            if (pipelined && nextInCnt == inputBufferCnt && nextInPos == inPos)
+            {
+               // Take the buffers read ahead
+               waitIO();
+               for (size_t i = 0; i < mNumChannels; i++)
+               {
+                  inBuffer[i].swap(nextInBuffer[i]);
+               }
+            }
+            else
+            {
+               waitIO();
+
+               // Fill the input buffers
+               left->GetFloats(inBuffer[0].get(), inPos, inputBufferCnt);
+               if (right)
+               {
+                  right->GetFloats(inBuffer[1].get(), inPos, inputBufferCnt);
+               }
+            }
+
+            if (pipelined)
             {
-               right->GetFloats(inBuffer[1].get(), inPos, inputBufferCnt);
+               readAhead(inPos + inputBufferCnt, inputRemaining - inputBufferCnt);
             }
 
             // Reset the input buffer positions
@@ -1792,29 +2023,22 @@ bool Effect::ProcessTrack(int count,
       // Output buffers have filled
       else
       {
-         if (isProcessor)
+         // Write them out
+         if (pipelined)
          {
-            // Write them out
-            left->Set((samplePtr) outBuffer[0].get(), floatSample, outPos, outputBufferCnt);
-            if (right)
+            // Fill the other buffers while the worker writes these
+            waitIO();
+            for (size_t i = 0; i < chans; i++)
             {
-               if (chans >= 2)
-               {
-                  right->Set((samplePtr) outBuffer[1].get(), floatSample, outPos, outputBufferCnt);
-               }
-               else
-               {
-                  right->Set((samplePtr) outBuffer[0].get(), floatSample, outPos, outputBufferCnt);
-               }
+               outBuffer[i].swap(writeBuffer[i]);
             }
+            startIO([&, pos = outPos, cnt = outputBufferCnt]{
+               writeOut(writeBuffer, pos, cnt);
+            });
          }
-         else if (isGenerator)
+         else
          {
-            genLeft->Append((samplePtr) outBuffer[0].get(), floatSample, outputBufferCnt);
-            if (genRight)
-            {
-               genRight->Append((samplePtr) outBuffer[1].get(), floatSample, outputBufferCnt);
-            }
+            writeOut(outBuffer, outPos, outputBufferCnt);
          }
 
          // Reset the output buffer positions
@@ -1850,32 +2074,14 @@ bool Effect::ProcessTrack(int count,
       }
    }
 
+   // Finish the pending write, or the read ahead that was not needed
+   if (rc)
+      waitIO();
+
    // Put any remaining output
    if (rc && outputBufferCnt)
    {
-      if (isProcessor)
-      {
-         left->Set((samplePtr) outBuffer[0].get(), floatSample, outPos, outputBufferCnt);
-         if (right)
-         {
-            if (chans >= 2)
-            {
-               right->Set((samplePtr) outBuffer[1].get(), floatSample, outPos, outputBufferCnt);
-            }
-            else
-            {
-               right->Set((samplePtr) outBuffer[0].get(), floatSample, outPos, outputBufferCnt);
-            }
-         }
-      }
-      else if (isGenerator)
-      {
-         genLeft->Append((samplePtr) outBuffer[0].get(), floatSample, outputBufferCnt);
-         if (genRight)
-         {
-            genRight->Append((samplePtr) outBuffer[1].get(), floatSample, outputBufferCnt);
-         }
-      }
+      writeOut(outBuffer, outPos, outputBufferCnt);
    }
 
    if (rc && isGenerator)
@@ -2023,6 +2229,8 @@ bool Effect::TotalProgress(double frac, const TranslatableString &msg)
 
 bool Effect::TrackProgress(int whichTrack, double frac, const TranslatableString &msg)
 {
+   if (mpParallelProgress)
+      return mpParallelProgress->Update(whichTrack, frac);
    auto updateResult = (mProgress ?
       mProgress->Update(whichTrack + frac, (double) mNumTracks, msg) :
       ProgressResult::Success);
@@ -2031,6 +2239,8 @@ bool Effect::TrackProgress(int whichTrack, double frac, const TranslatableString
 
 bool Effect::TrackGroupProgress(int whichGroup, double frac, const TranslatableString &msg)
 {
+   if (mpParallelProgress)
+      return mpParallelProgress->Update(whichGroup, frac);
    auto updateResult = (mProgress ?
       mProgress->Update(whichGroup + frac, (double) mNumGroups, msg) :
       ProgressResult::Success);
@@ -35,6 +35,7 @@ class wxWindow;
 #include "../widgets/wxPanelWrapper.h" // to inherit
 
 class wxArrayString;
+class BoolSetting;
 class ShuttleGui;
 class SneedacityCommand;
 
@@ -80,6 +81,14 @@ class SNEEDACITY_DLL_API Effect /* not final */ : public wxEvtHandler,
    Effect();
    virtual ~Effect();
 
+   // Whether ProcessPass may process several tracks at once, for effects
+   // that support it
+   static BoolSetting ParallelProcessing;
+
+   // Whether ProcessTrack reads and writes tracks in another thread,
+   // overlapping the processing of blocks
+   static BoolSetting PipelinedProcessing;
+
    // Type of a registered function that, if it returns true,
    // causes ShowInterface to return early without making any dialog
    using VetoDialogHook = bool (*) ( wxDialog* );
@@ -308,6 +317,14 @@ protected:
    // Invoked inside a "finally" block so it must be no-throw.
    virtual void End();
 
+   // Effects that process with ProcessBlock() may opt in to the processing
+   // of several tracks or channel groups at once, by returning a new
+   // instance with the same settings, usually from FinishClone().
+   // ProcessPass() then calls ProcessInitialize(), ProcessBlock() and
+   // ProcessFinalize() of each clone in another thread, so they must not
+   // touch the user interface.  The default returns null: no opting in.
+   virtual std::unique_ptr<Effect> CloneForProcessing();
+
    // Most effects just use the previewLength, but time-stretching/compressing
    // effects need to use a different input length, so override this method.
    virtual double CalcPreviewInputLength(double previewLength);
@@ -343,6 +360,12 @@ protected:
    int GetNumWaveTracks() { return mNumTracks; }
    int GetNumWaveGroups() { return mNumGroups; }
 
+   // For overrides of CloneForProcessing(), which construct an instance of
+   // the same class and copy their settings to it directly (automation
+   // parameters would round them); copies the state that all effects share.
+   // Returns null on failure.
+   std::unique_ptr<Effect> FinishClone(std::unique_ptr<Effect> clone);
+
    // Calculates the start time and length in samples for one or two channels
    void GetBounds(
       const WaveTrack &track, const WaveTrack *pRight,
@@ -484,6 +507,32 @@ protected:
  private:
    void CountWaveTracks();
 
+   // One track, or group of channels processed together, in ProcessPass()
+   struct TrackGroup {
+      int count;
+      ChannelName map[3];
+      unsigned numChannels;
+      WaveTrack *left;
+      WaveTrack *right;
+      sampleCount start;
+      sampleCount len;
+      sampleCount sampleCnt;
+   };
+
+   // Buffers of ProcessTrack(), reused for consecutive groups
+   struct TrackBuffers {
+      FloatBuffers inBuffer, outBuffer;
+      ArrayOf<float *> inBufPos, outBufPos;
+      bool clear{ false };
+   };
+
+   // Progress of clones, which may not update the dialog themselves
+   struct ParallelProgress;
+
+   bool ProcessGroup(TrackGroup group, TrackBuffers &buffers);
+   bool ProcessGroupsInParallel(const std::vector<TrackGroup> &groups,
+      std::vector<std::unique_ptr<Effect>> &clones);
+
    // Driver for client effects
    bool ProcessTrack(int count,
                      ChannelNames map,
@@ -531,6 +580,9 @@ private:
    size_t mBlockSize;
    unsigned mNumChannels;
 
+   // Not null only in clones processing in other threads
+   ParallelProgress *mpParallelProgress{};
+
 public:
    const static wxString kUserPresetIdent;
    const static wxString kFactoryPresetIdent;
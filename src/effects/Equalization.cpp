@@ -55,8 +55,12 @@
 
 #include "Equalization.h"
 #include "LoadEffects.h"
+#include "PartitionedConvolution.h"
 
 #include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <vector>
 
 #include <wx/setup.h> // for wxUSE_* macros
@@ -98,6 +102,7 @@
 #include "../Prefs.h"
 #include "../Project.h"
 #include "../Theme.h"
+#include "../ThreadPool.h"
 #include "../TrackArtist.h"
 #include "../WaveClip.h"
 #include "../ViewInfo.h"
@@ -113,10 +118,6 @@
 
 #include "../widgets/FileDialog/FileDialog.h"
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-#include "Equalization48x.h"
-#endif
-
 
 enum
 {
@@ -134,14 +135,6 @@ enum
    ID_Curve,
    ID_Manage,
    ID_Delete,
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   ID_DefaultMath,
-   ID_SSE,
-   ID_SSEThreaded,
-   ID_AVX,
-   ID_AVXThreaded,
-   ID_Bench,
-#endif
    ID_Slider,   // needs to come last
 };
 
@@ -229,21 +222,12 @@ BEGIN_EVENT_TABLE(EffectEqualization, wxEvtHandler)
    EVT_RADIOBUTTON(ID_Graphic, EffectEqualization::OnGraphicMode)
    EVT_CHECKBOX(ID_Linear, EffectEqualization::OnLinFreq)
    EVT_CHECKBOX(ID_Grid, EffectEqualization::OnGridOnOff)
-
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   EVT_RADIOBUTTON(ID_DefaultMath, EffectEqualization::OnProcessingRadio)
-   EVT_RADIOBUTTON(ID_SSE, EffectEqualization::OnProcessingRadio)
-   EVT_RADIOBUTTON(ID_SSEThreaded, EffectEqualization::OnProcessingRadio)
-   EVT_RADIOBUTTON(ID_AVX, EffectEqualization::OnProcessingRadio)
-   EVT_RADIOBUTTON(ID_AVXThreaded, EffectEqualization::OnProcessingRadio)
-   EVT_BUTTON(ID_Bench, EffectEqualization::OnBench)
-#endif
 END_EVENT_TABLE()
 
 EffectEqualization::EffectEqualization(int Options)
-   : mFFTBuffer{ windowSize }
-   , mFilterFuncR{ windowSize }
+   : mFilterFuncR{ windowSize }
    , mFilterFuncI{ windowSize }
+   , mTaps{ windowSize }
 {
    mOptions = Options;
    mGraphic = NULL;
@@ -252,8 +236,6 @@ EffectEqualization::EffectEqualization(int Options)
    mPanel = NULL;
    mMSlider = NULL;
 
-   hFFT = GetFFT(windowSize);
-
    SetLinearEffectFlag(true);
 
    mM = DEF_FilterLength;
@@ -299,16 +281,6 @@ EffectEqualization::EffectEqualization(int Options)
    mWhenSliders[NUMBER_OF_BANDS] = 1.;
    mEQVals[NUMBER_OF_BANDS] = 0.;
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   bool useSSE;
-   GetPrivateConfig(GetCurrentSettingsGroup(), wxT("/SSE/GUI"), useSSE, false);
-   if(useSSE && !mEffectEqualization48x)
-      mEffectEqualization48x = std::make_unique<EffectEqualization48x>();
-   else if(!useSSE)
-      mEffectEqualization48x.reset();
-   mBench=false;
-#endif
-
    // We expect these Hi and Lo frequencies to be overridden by Init().
    // Don't use inputTracks().  See bug 2321.
 #if 0
@@ -365,7 +337,86 @@ EffectType EffectEqualization::GetType()
    return EffectTypeProcess;
 }
 
+bool EffectEqualization::SupportsRealtime()
+{
+#if defined(EXPERIMENTAL_REALTIME_SNEEDACITY_EFFECTS)
+   return true;
+#else
+   return false;
+#endif
+}
+
 // EffectClientInterface implementation
+
+unsigned EffectEqualization::GetAudioInCount()
+{
+   return 1;
+}
+
+unsigned EffectEqualization::GetAudioOutCount()
+{
+   return 1;
+}
+
+bool EffectEqualization::RealtimeInitialize()
+{
+   SetBlockSize(512);
+
+   mSlaves.clear();
+
+   return true;
+}
+
+bool EffectEqualization::RealtimeAddProcessor(unsigned WXUNUSED(numChannels), float sampleRate)
+{
+   mHiFreq = sampleRate / 2.0;
+   CalcFilter();
+
+   // Room for the longest filter, so that changing the curve during playback
+   // never allocates in the audio thread
+   const auto maxPartitions =
+      (MAX_FilterLength + realtimeBlockSize - 1) / realtimeBlockSize;
+   mSlaves.push_back(std::make_unique<PartitionedConvolver>(
+      MakeFilter(realtimeBlockSize), maxPartitions));
+
+   return true;
+}
+
+bool EffectEqualization::RealtimeFinalize()
+{
+   mSlaves.clear();
+
+   std::lock_guard<std::mutex> guard(mFilterMutex);
+   mNewFilter.reset();
+   mOldFilters.clear();
+
+   return true;
+}
+
+bool EffectEqualization::RealtimeProcessStart()
+{
+   // Don't wait for the main thread; take the new filter at a later buffer
+   std::unique_lock<std::mutex> lock(mFilterMutex, std::try_to_lock);
+   if (lock.owns_lock() && mNewFilter) {
+      // mOldFilters has room, and mNewFilter is not the last reference
+      for (auto &pSlave : mSlaves)
+         mOldFilters.push_back(pSlave->SetFilter(mNewFilter));
+      mNewFilter.reset();
+   }
+
+   return true;
+}
+
+size_t EffectEqualization::RealtimeProcess(int group,
+                                           float **inbuf,
+                                           float **outbuf,
+                                           size_t numSamples)
+{
+   mSlaves[group]->Process(inbuf[0], outbuf[0], numSamples);
+
+   return numSamples;
+}
+
 bool EffectEqualization::DefineParams( ShuttleParams & S ){
    S.SHUTTLE_PARAM( mM, FilterLength );
    //S.SHUTTLE_PARAM( mCurveName, CurveName);
@@ -706,20 +757,16 @@ bool EffectEqualization::Init()
 
 bool EffectEqualization::Process()
 {
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   if(mEffectEqualization48x) {
-      if(mBench) {
-         mBench=false;
-         return mEffectEqualization48x->Benchmark(this);
-      }
-      else
-         return mEffectEqualization48x->Process(this);
-   }
-#endif
    this->CopyInputTracks(); // Set up mOutputTracks.
    CalcFilter();
-   bool bGoodResult = true;
 
+   // Longer filters cost less per sample with longer blocks, up to a point
+   size_t blockSize = 1024;
+   while (blockSize < mM && blockSize < 4096)
+      blockSize *= 2;
+   const auto pFilter = MakeFilter(blockSize);
+
+   std::vector<Range> ranges;
    int count = 0;
    for( auto track : mOutputTracks->Selected< WaveTrack >() ) {
       double trackStart = track->GetStartTime();
@@ -730,17 +777,51 @@ bool EffectEqualization::Process()
       if (t1 > t0) {
          auto start = track->TimeToLongSamples(t0);
          auto end = track->TimeToLongSamples(t1);
-         auto len = end - start;
+         ranges.push_back({ track, count, start, end - start });
+      }
+
+      count++;
+   }
 
-         if (!ProcessOne(count, track, start, len))
+   // Convolve channels, and segments of long selections, in parallel
+   std::vector<Segment> segments;
+   const auto nThreads = ThreadPool::Get().GetThreadCount();
+   if (Effect::ParallelProcessing.Read() && nThreads > 0) {
+      const sampleCount maxSegments = 4 * (nThreads + 1);
+      const sampleCount nPartitions = pFilter->GetPartitionCount();
+      for (const auto &range : ranges) {
+         // Output includes 'tails' each end
+         const auto total = range.len + mM - 1;
+         const auto nBlocks = (total + blockSize - 1) / blockSize;
+         // Each segment should be long compared with the blocks before it
+         // that it convolves again
+         const auto nSegments = std::max<sampleCount>(1, std::min(maxSegments,
+            nBlocks / (8 * (nPartitions + 1))));
+         for (sampleCount kk = 0; kk < nSegments; ++kk)
+            segments.push_back({ &range,
+               total * kk / nSegments, total * (kk + 1) / nSegments, {} });
+      }
+   }
+
+   bool bGoodResult = true;
+   if (segments.size() > 1) {
+      // Copy for output after converting, so that worker threads append
+      // without dithering.  So the result is the same as ProcessOne()'s only
+      // for float tracks; others keep more precision.
+      for (const auto &range : ranges)
+         range.track->ConvertToSampleFormat( floatSample );
+      for (auto &segment : segments)
+         segment.output = segment.range->track->EmptyCopy();
+      bGoodResult = ProcessSegments(segments, pFilter);
+   }
+   else
+      for (const auto &range : ranges)
+         if (!ProcessOne(range.count, range.track, range.start, range.len,
+                         pFilter))
          {
             bGoodResult = false;
             break;
          }
-      }
-
-      count++;
-   }
 
    this->ReplaceProcessedTracks(bGoodResult);
    return bGoodResult;
@@ -1082,62 +1163,6 @@ void EffectEqualization::PopulateOrExchange(ShuttleGui & S)
    }
    S.EndMultiColumn();
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   if (mEffectEqualization48x)
-   {
-      // -------------------------------------------------------------------
-      // ROW 6: Processing routine selection
-      // -------------------------------------------------------------------
-
-      // Column 1 is blank
-      S.AddSpace(1, 1);
-
-      S.StartHorizontalLay();
-      {
-         S.AddUnits(XO("&Processing: "));
-
-         // update the control state
-         int mathPath = EffectEqualization48x::GetMathPath();
-         int value =
-            (mathPath & MATH_FUNCTION_SSE)
-            ? (mathPath & MATH_FUNCTION_THREADED)
-               ? 2
-               : 1
-            : false // (mathPath & MATH_FUNCTION_AVX) // not implemented
-               ? (mathPath & MATH_FUNCTION_THREADED)
-                  ? 4
-                  : 3
-               : 0;
-
-         mMathProcessingType[0] = S.Id(ID_DefaultMath)
-            .AddRadioButton(XXO("D&efault"),
-                            0, value);
-         mMathProcessingType[1] = S.Id(ID_SSE)
-            .Disable(!EffectEqualization48x::GetMathCaps()->SSE)
-            .AddRadioButtonToGroup(XXO("&SSE"),
-                                   1, value);
-         mMathProcessingType[2] = S.Id(ID_SSEThreaded)
-            .Disable(!EffectEqualization48x::GetMathCaps()->SSE)
-            .AddRadioButtonToGroup(XXO("SSE &Threaded"),
-                                   2, value);
-         mMathProcessingType[3] = S.Id(ID_AVX)
-            // not implemented
-            .Disable(true /* !EffectEqualization48x::GetMathCaps()->AVX */)
-            .AddRadioButtonToGroup(XXO("A&VX"),
-                                   3, value);
-         mMathProcessingType[4] = S.Id(ID_AVXThreaded)
-            // not implemented
-            .Disable(true /* !EffectEqualization48x::GetMathCaps()->AVX */)
-            .AddRadioButtonToGroup(XXO("AV&X Threaded"),
-                                   4, value);
-         S.Id(ID_Bench).AddButton(XXO("&Bench"));
-      }
-      S.EndHorizontalLay();
-
-      // Column 3 is blank
-      S.AddSpace(1, 1);
-   }
-#endif
 
    mUIParent->SetAutoLayout(false);
    if( mOptions != kEqOptionGraphic)
@@ -1295,168 +1320,220 @@ bool EffectEqualization::TransferDataFromWindow()
 
 // EffectEqualization implementation
 
+namespace {
+
+// Append to output the samples [first, end) of the convolution of the track
+// from start, where samples at len and after are silent.  It begins some
+// blocks before first, so that the output is the same as if the convolution
+// had begun at the start.  progress is given the count of each append.
+bool Convolve(PartitionedConvolver &convolver, const WaveTrack &track,
+   sampleCount start, sampleCount len, sampleCount first, sampleCount end,
+   WaveTrack &output, const std::function<bool(size_t)> &progress)
+{
+   // A block of output depends on the input of the block before it and of
+   // as many blocks as the filter has partitions
+   const auto &filter = *convolver.GetFilter();
+   const sampleCount blockSize = filter.GetBlockSize();
+   const sampleCount firstBlock = first / blockSize;
+   auto pos = std::max<sampleCount>(0,
+      firstBlock - filter.GetPartitionCount()) * blockSize;
+   convolver.Reset();
+
+   const auto latency = convolver.GetLatency();
+   const auto outStart = first + latency, outEnd = end + latency;
+   const auto bufferSize = track.GetMaxBlockSize();
+   Floats buffer{ bufferSize };
+   while (pos < outEnd) {
+      const auto block = limitSampleBufferSize(bufferSize, outEnd - pos);
+      const auto count = limitSampleBufferSize(block, len - pos);
+      if (count > 0)
+         track.GetFloats(buffer.get(), start + pos, count);
+      std::fill(buffer.get() + count, buffer.get() + block, 0.0f);
+      convolver.Process(buffer.get(), buffer.get(), block);
+
+      const auto skip = limitSampleBufferSize(block, outStart - pos);
+      if (skip < block) {
+         output.Append((samplePtr)(buffer.get() + skip), floatSample,
+            block - skip);
+         if (!progress(block - skip))
+            return false;
+      }
+      pos += block;
+   }
+
+   return true;
+}
+
+}
+
 bool EffectEqualization::ProcessOne(int count, WaveTrack * t,
-                                    sampleCount start, sampleCount len)
+   sampleCount start, sampleCount len,
+   const std::shared_ptr<const PartitionedFilter> &pFilter)
 {
    // create a NEW WaveTrack to hold all of the output, including 'tails' each end
    auto output = t->EmptyCopy();
    t->ConvertToSampleFormat( floatSample );
 
-   wxASSERT(mM - 1 < windowSize);
-   size_t L = windowSize - (mM - 1);   //Process L samples at a go
-   auto s = start;
-   auto idealBlockLen = t->GetMaxBlockSize() * 4;
-   if (idealBlockLen % L != 0)
-      idealBlockLen += (L - (idealBlockLen % L));
+   PartitionedConvolver convolver{ pFilter };
+   const auto total = len + mM - 1;
+   sampleCount done = 0;
+   TrackProgress(count, 0.);
+   if (!Convolve(convolver, *t, start, len, 0, total, *output,
+      [&](size_t block){
+         done += block;
+         return !TrackProgress(count, done.as_double() / total.as_double());
+      }))
+      return false;
 
-   Floats buffer{ idealBlockLen };
+   output->Flush();
+   ReplaceSamples(t, *output, start, len);
 
-   Floats window1{ windowSize };
-   Floats window2{ windowSize };
-   float *thisWindow = window1.get();
-   float *lastWindow = window2.get();
+   return true;
+}
 
-   auto originalLen = len;
+bool EffectEqualization::ProcessSegments(std::vector<Segment> &segments,
+   const std::shared_ptr<const PartitionedFilter> &pFilter)
+{
+   // Each worker thread convolves whole segments with a convolver of its own
+   const auto nWorkers =
+      std::min(segments.size(), ThreadPool::Get().GetThreadCount());
+
+   long long total = 0;
+   for (const auto &segment : segments)
+      total += (segment.end - segment.first).as_long_long();
+
+   std::atomic<size_t> next{ 0 };
+   std::atomic<long long> done{ 0 };
+   std::atomic<bool> failed{ false }, cancelled{ false };
+   std::vector< std::future<void> > futures;
+   for (size_t ww = 0; ww < nWorkers; ++ww)
+      futures.push_back(ThreadPool::Get().Submit([&]{
+         PartitionedConvolver convolver{ pFilter };
+         for (size_t ii;
+              !cancelled && (ii = next++) < segments.size();) {
+            bool ok = false;
+            auto stop = finally([&]{
+               if (!ok) {
+                  failed = true;
+                  cancelled = true;
+               }
+            });
+            const auto &segment = segments[ii];
+            const auto &range = *segment.range;
+            Convolve(convolver, *range.track, range.start, range.len,
+               segment.first, segment.end, *segment.output,
+               [&](size_t block){
+                  done += block;
+                  return !cancelled;
+               });
+            segment.output->Flush();
+            ok = true;
+         }
+      }));
+
+   // Only this thread updates the progress dialog
+   for (auto &future : futures)
+      while (future.wait_for(std::chrono::milliseconds(100)) !=
+             std::future_status::ready)
+         if (!cancelled && TotalProgress(double(done) / std::max(1LL, total)))
+            cancelled = true;
+   for (auto &future : futures)
+      future.get();
+   if (cancelled || failed)
+      return false;
 
-   for(size_t i = 0; i < windowSize; i++)
-      lastWindow[i] = 0;
+   // Join the segments of each range, sharing their sample blocks
+   for (auto first = segments.begin(); first != segments.end();) {
+      auto last = std::find_if(first, segments.end(),
+         [&](const Segment &segment){ return segment.range != first->range; });
+      auto &output = *first->output;
+      auto clip = output.GetClipByIndex(0);
+      for (auto iter = first + 1; iter != last; ++iter)
+         clip->Paste(clip->GetEndTime(), iter->output->GetClipByIndex(0));
+      const auto &range = *first->range;
+      ReplaceSamples(range.track, output, range.start, range.len);
+      first = last;
+   }
 
-   TrackProgress(count, 0.);
-   bool bLoopSuccess = true;
-   size_t wcopy = 0;
-   int offset = (mM - 1) / 2;
+   return true;
+}
 
-   while (len != 0)
-   {
-      auto block = limitSampleBufferSize( idealBlockLen, len );
+void EffectEqualization::ReplaceSamples(WaveTrack * t, WaveTrack &output,
+   sampleCount start, sampleCount len)
+{
+   int offset = (mM - 1) / 2;
 
-      t->GetFloats(buffer.get(), s, block);
+   std::vector<EnvPoint> envPoints;
 
-      for(size_t i = 0; i < block; i += L)   //go through block in lumps of length L
-      {
-         wcopy = std::min <size_t> (L, block - i);
-         for(size_t j = 0; j < wcopy; j++)
-            thisWindow[j] = buffer[i+j];   //copy the L (or remaining) samples
-         for(auto j = wcopy; j < windowSize; j++)
-            thisWindow[j] = 0;   //this includes the padding
+   // now move the appropriate bit of the output back to the track
+   // (this could be enhanced in the future to use the tails)
+   double offsetT0 = t->LongSamplesToTime(offset);
+   double lenT = t->LongSamplesToTime(len);
+   // 'start' is the sample offset in 't', the passed in track
+   // 'startT' is the equivalent time value
+   // 'output' starts at zero
+   double startT = t->LongSamplesToTime(start);
 
-         Filter(windowSize, thisWindow);
+   //output has one waveclip for the total length, even though
+   //t might have whitespace separating multiple clips
+   //we want to maintain the original clip structure, so
+   //only paste the intersections of the NEW clip.
 
-         // Overlap - Add
-         for(size_t j = 0; (j < mM - 1) && (j < wcopy); j++)
-            buffer[i+j] = thisWindow[j] + lastWindow[L + j];
-         for(size_t j = mM - 1; j < wcopy; j++)
-            buffer[i+j] = thisWindow[j];
+   //Find the bits of clips that need replacing
+   std::vector<std::pair<double, double> > clipStartEndTimes;
+   std::vector<std::pair<double, double> > clipRealStartEndTimes; //the above may be truncated due to a clip being partially selected
+   for (const auto &clip : t->GetClips())
+   {
+      double clipStartT;
+      double clipEndT;
 
-         std::swap( thisWindow, lastWindow );
-      }  //next i, lump of this block
+      clipStartT = clip->GetStartTime();
+      clipEndT = clip->GetEndTime();
+      if( clipEndT <= startT )
+         continue;   // clip is not within selection
+      if( clipStartT >= startT + lenT )
+         continue;   // clip is not within selection
 
-      output->Append((samplePtr)buffer.get(), floatSample, block);
-      len -= block;
-      s += block;
+      //save the actual clip start/end so that we can rejoin them after we paste.
+      clipRealStartEndTimes.push_back(std::pair<double,double>(clipStartT,clipEndT));
 
-      if (TrackProgress(count, ( s - start ).as_double() /
-                        originalLen.as_double()))
-      {
-         bLoopSuccess = false;
-         break;
-      }
-   }
+      if( clipStartT < startT )  // does selection cover the whole clip?
+         clipStartT = startT; // don't copy all the NEW clip
+      if( clipEndT > startT + lenT )  // does selection cover the whole clip?
+         clipEndT = startT + lenT; // don't copy all the NEW clip
 
-   if(bLoopSuccess)
-   {
-      // mM-1 samples of 'tail' left in lastWindow, get them now
-      if(wcopy < (mM - 1)) {
-         // Still have some overlap left to process
-         // (note that lastWindow and thisWindow have been exchanged at this point
-         //  so that 'thisWindow' is really the window prior to 'lastWindow')
-         size_t j = 0;
-         for(; j < mM - 1 - wcopy; j++)
-            buffer[j] = lastWindow[wcopy + j] + thisWindow[L + wcopy + j];
-         // And fill in the remainder after the overlap
-         for( ; j < mM - 1; j++)
-            buffer[j] = lastWindow[wcopy + j];
-      } else {
-         for(size_t j = 0; j < mM - 1; j++)
-            buffer[j] = lastWindow[wcopy + j];
-      }
-      output->Append((samplePtr)buffer.get(), floatSample, mM - 1);
-      output->Flush();
-
-      std::vector<EnvPoint> envPoints;
-
-      // now move the appropriate bit of the output back to the track
-      // (this could be enhanced in the future to use the tails)
-      double offsetT0 = t->LongSamplesToTime(offset);
-      double lenT = t->LongSamplesToTime(originalLen);
-      // 'start' is the sample offset in 't', the passed in track
-      // 'startT' is the equivalent time value
-      // 'output' starts at zero
-      double startT = t->LongSamplesToTime(start);
-
-      //output has one waveclip for the total length, even though
-      //t might have whitespace separating multiple clips
-      //we want to maintain the original clip structure, so
-      //only paste the intersections of the NEW clip.
-
-      //Find the bits of clips that need replacing
-      std::vector<std::pair<double, double> > clipStartEndTimes;
-      std::vector<std::pair<double, double> > clipRealStartEndTimes; //the above may be truncated due to a clip being partially selected
-      for (const auto &clip : t->GetClips())
-      {
-         double clipStartT;
-         double clipEndT;
-
-         clipStartT = clip->GetStartTime();
-         clipEndT = clip->GetEndTime();
-         if( clipEndT <= startT )
-            continue;   // clip is not within selection
-         if( clipStartT >= startT + lenT )
-            continue;   // clip is not within selection
-
-         //save the actual clip start/end so that we can rejoin them after we paste.
-         clipRealStartEndTimes.push_back(std::pair<double,double>(clipStartT,clipEndT));
-
-         if( clipStartT < startT )  // does selection cover the whole clip?
-            clipStartT = startT; // don't copy all the NEW clip
-         if( clipEndT > startT + lenT )  // does selection cover the whole clip?
-            clipEndT = startT + lenT; // don't copy all the NEW clip
-
-         //save them
-         clipStartEndTimes.push_back(std::pair<double,double>(clipStartT,clipEndT));
-
-         // Save the envelope points
-         const auto &env = *clip->GetEnvelope();
-         for (size_t i = 0, numPoints = env.GetNumberOfPoints(); i < numPoints; ++i) {
-            envPoints.push_back(env[i]);
-         }
-      }
+      //save them
+      clipStartEndTimes.push_back(std::pair<double,double>(clipStartT,clipEndT));
 
-      //now go thru and replace the old clips with NEW
-      for(unsigned int i = 0; i < clipStartEndTimes.size(); i++)
-      {
-         //remove the old audio and get the NEW
-         t->Clear(clipStartEndTimes[i].first,clipStartEndTimes[i].second);
-         auto toClipOutput = output->Copy(clipStartEndTimes[i].first-startT+offsetT0,clipStartEndTimes[i].second-startT+offsetT0);
-         //put the processed audio in
-         t->Paste(clipStartEndTimes[i].first, toClipOutput.get());
-         //if the clip was only partially selected, the Paste will have created a split line.  Join is needed to take care of this
-         //This is not true when the selection is fully contained within one clip (second half of conditional)
-         if( (clipRealStartEndTimes[i].first  != clipStartEndTimes[i].first ||
-            clipRealStartEndTimes[i].second != clipStartEndTimes[i].second) &&
-            !(clipRealStartEndTimes[i].first <= startT &&
-            clipRealStartEndTimes[i].second >= startT+lenT) )
-            t->Join(clipRealStartEndTimes[i].first,clipRealStartEndTimes[i].second);
+      // Save the envelope points
+      const auto &env = *clip->GetEnvelope();
+      for (size_t i = 0, numPoints = env.GetNumberOfPoints(); i < numPoints; ++i) {
+         envPoints.push_back(env[i]);
       }
+   }
 
-      // Restore the envelope points
-      for (auto point : envPoints) {
-         WaveClip *clip = t->GetClipAtTime(point.GetT());
-         clip->GetEnvelope()->Insert(point.GetT(), point.GetVal());
-      }
+   //now go thru and replace the old clips with NEW
+   for(unsigned int i = 0; i < clipStartEndTimes.size(); i++)
+   {
+      //remove the old audio and get the NEW
+      t->Clear(clipStartEndTimes[i].first,clipStartEndTimes[i].second);
+      auto toClipOutput = output.Copy(clipStartEndTimes[i].first-startT+offsetT0,clipStartEndTimes[i].second-startT+offsetT0);
+      //put the processed audio in
+      t->Paste(clipStartEndTimes[i].first, toClipOutput.get());
+      //if the clip was only partially selected, the Paste will have created a split line.  Join is needed to take care of this
+      //This is not true when the selection is fully contained within one clip (second half of conditional)
+      if( (clipRealStartEndTimes[i].first  != clipStartEndTimes[i].first ||
+         clipRealStartEndTimes[i].second != clipStartEndTimes[i].second) &&
+         !(clipRealStartEndTimes[i].first <= startT &&
+         clipRealStartEndTimes[i].second >= startT+lenT) )
+         t->Join(clipRealStartEndTimes[i].first,clipRealStartEndTimes[i].second);
    }
 
-   return bLoopSuccess;
+   // Restore the envelope points
+   for (auto point : envPoints) {
+      WaveClip *clip = t->GetClipAtTime(point.GetT());
+      clip->GetEnvelope()->Insert(point.GetT(), point.GetVal());
+   }
 }
 
 bool EffectEqualization::CalcFilter()
@@ -1565,36 +1642,35 @@ bool EffectEqualization::CalcFilter()
    {   //rest is padding
       outr[i]=0.;
    }
+   std::copy(outr.get(), outr.get() + mM, mTaps.get());
 
    //Back to the frequency domain so we can use it
    RealFFT(mWindowSize, outr.get(), mFilterFuncR.get(), mFilterFuncI.get());
 
+   UpdateRealtimeFilter();
+
    return TRUE;
 }
 
-void EffectEqualization::Filter(size_t len, float *buffer)
+std::shared_ptr<const PartitionedFilter>
+EffectEqualization::MakeFilter(size_t blockSize) const
 {
-   float re,im;
-   // Apply FFT
-   RealFFTf(buffer, hFFT.get());
-   //FFT(len, false, inr, NULL, outr, outi);
+   return std::make_shared<const PartitionedFilter>(
+      mTaps.get(), mM, blockSize);
+}
 
-   // Apply filter
-   // DC component is purely real
-   mFFTBuffer[0] = buffer[0] * mFilterFuncR[0];
-   for(size_t i = 1; i < (len / 2); i++)
-   {
-      re=buffer[hFFT->BitReversed[i]  ];
-      im=buffer[hFFT->BitReversed[i]+1];
-      mFFTBuffer[2*i  ] = re*mFilterFuncR[i] - im*mFilterFuncI[i];
-      mFFTBuffer[2*i+1] = re*mFilterFuncI[i] + im*mFilterFuncR[i];
-   }
-   // Fs/2 component is purely real
-   mFFTBuffer[1] = buffer[1] * mFilterFuncR[len/2];
+void EffectEqualization::UpdateRealtimeFilter()
+{
+   if (mSlaves.empty())
+      return;
 
-   // Inverse FFT and normalization
-   InverseRealFFTf(mFFTBuffer.get(), hFFT.get());
-   ReorderToTime(hFFT.get(), mFFTBuffer.get(), buffer);
+   auto pFilter = MakeFilter(realtimeBlockSize);
+   std::lock_guard<std::mutex> guard(mFilterMutex);
+   // Release the filters that the audio thread replaced, here and not there;
+   // a filter not yet taken is released too, when pFilter replaces it
+   mOldFilters.clear();
+   mOldFilters.reserve(mSlaves.size());
+   mNewFilter = std::move(pFilter);
 }
 
 //
@@ -3042,35 +3118,6 @@ void EffectEqualization::OnLinFreq(wxCommandEvent & WXUNUSED(event))
    ForceRecalc();
 }
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-
-void EffectEqualization::OnProcessingRadio(wxCommandEvent & event)
-{
-   int testEvent=event.GetId();
-   switch(testEvent)
-   {
-   case ID_DefaultMath: EffectEqualization48x::SetMathPath(MATH_FUNCTION_ORIGINAL);
-      break;
-   case ID_SSE: EffectEqualization48x::SetMathPath(MATH_FUNCTION_SSE);
-      break;
-   case ID_SSEThreaded: EffectEqualization48x::SetMathPath(MATH_FUNCTION_THREADED | MATH_FUNCTION_SSE);
-      break;
-   case ID_AVX: testEvent = 2;
-      break;
-   case ID_AVXThreaded: testEvent = 2;
-      break;
-   }
-
-};
-
-void EffectEqualization::OnBench( wxCommandEvent & event)
-{
-   mBench=true;
-   // OnOk(event);
-}
-
-#endif
-
 //----------------------------------------------------------------------------
 // EqualizationPanel
 //----------------------------------------------------------------------------
@@ -17,8 +17,12 @@
 
 #include <wx/setup.h> // for wxUSE_* macros
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "Effect.h"
-#include "../RealFFTf.h"
+#include "../SampleFormat.h"
 
 // Flags to specialise the UI
 const int kEqOptionGraphic =1;
@@ -41,6 +45,8 @@ class wxStaticText;
 class Envelope;
 class EnvelopeEditor;
 class EqualizationPanel;
+class PartitionedConvolver;
+class PartitionedFilter;
 class RulerPanel;
 
 //
@@ -85,10 +91,6 @@ public:
 
 using EQCurveArray = std::vector<EQCurve>;
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-class EffectEqualization48x;
-#endif
-
 class EffectEqualization : public Effect,
                            public XMLTagHandler
 {
@@ -108,9 +110,21 @@ public:
    // EffectDefinitionInterface implementation
 
    EffectType GetType() override;
+   bool SupportsRealtime() override;
 
    // EffectClientInterface implementation
 
+   unsigned GetAudioInCount() override;
+   unsigned GetAudioOutCount() override;
+   bool RealtimeInitialize() override;
+   bool RealtimeAddProcessor(unsigned numChannels, float sampleRate) override;
+   bool RealtimeFinalize() override;
+   bool RealtimeProcessStart() override;
+   size_t RealtimeProcess(int group,
+                          float **inbuf,
+                          float **outbuf,
+                          size_t numSamples) override;
+
    bool DefineParams( ShuttleParams & S ) override;
    bool GetAutomationParameters(CommandParameters & parms) override;
    bool SetAutomationParameters(CommandParameters & parms) override;
@@ -145,10 +159,38 @@ private:
    // low range of human hearing
    enum {loFreqI=20};
 
+   // Block size of convolution in realtime processing, and so its latency
+   static const size_t realtimeBlockSize = 256u;
+
+   // The selected part of one channel
+   struct Range
+   {
+      WaveTrack *track;
+      int count;
+      sampleCount start;
+      sampleCount len;
+   };
+
+   // Samples of the output of a Range that a worker thread convolves, into a
+   // track of its own
+   struct Segment
+   {
+      const Range *range;
+      sampleCount first;
+      sampleCount end;
+      std::shared_ptr<WaveTrack> output;
+   };
+
    bool ProcessOne(int count, WaveTrack * t,
+                   sampleCount start, sampleCount len,
+                   const std::shared_ptr<const PartitionedFilter> &pFilter);
+   bool ProcessSegments(std::vector<Segment> &segments,
+                   const std::shared_ptr<const PartitionedFilter> &pFilter);
+   void ReplaceSamples(WaveTrack * t, WaveTrack &output,
                    sampleCount start, sampleCount len);
    bool CalcFilter();
-   void Filter(size_t len, float *buffer);
+   std::shared_ptr<const PartitionedFilter> MakeFilter(size_t blockSize) const;
+   void UpdateRealtimeFilter();
    
    void Flatten();
    void ForceRecalc();
@@ -198,15 +240,12 @@ private:
    void OnInvert( wxCommandEvent & event );
    void OnGridOnOff( wxCommandEvent & event );
    void OnLinFreq( wxCommandEvent & event );
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   void OnProcessingRadio( wxCommandEvent & event );
-   void OnBench( wxCommandEvent & event );
-#endif
 
 private:
    int mOptions;
-   HFFT hFFT;
-   Floats mFFTBuffer, mFilterFuncR, mFilterFuncI;
+   Floats mFilterFuncR, mFilterFuncI;
+   // The impulse response that CalcFilter() makes, mM taps long
+   Floats mTaps;
    size_t mM;
    wxString mCurveName;
    bool mLin;
@@ -235,11 +274,13 @@ private:
    std::unique_ptr<Envelope> mLogEnvelope, mLinEnvelope;
    Envelope *mEnvelope;
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   bool mBench;
-   std::unique_ptr<EffectEqualization48x> mEffectEqualization48x;
-   friend class EffectEqualization48x;
-#endif
+   std::vector< std::unique_ptr<PartitionedConvolver> > mSlaves;
+   // The audio thread takes a new filter for mSlaves from mNewFilter in
+   // RealtimeProcessStart(), if it can lock mFilterMutex without waiting,
+   // and leaves the old one in mOldFilters, to be released in the main thread
+   std::mutex mFilterMutex;
+   std::shared_ptr<const PartitionedFilter> mNewFilter;
+   std::vector< std::shared_ptr<const PartitionedFilter> > mOldFilters;
 
    wxSizer *szrC;
    wxSizer *szrG;
@@ -270,11 +311,6 @@ private:
    wxSlider *mdBMaxSlider;
    wxSlider *mSliders[NUMBER_OF_BANDS];
 
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
-   wxRadioButton *mMathProcessingType[5]; // default, sse, sse threaded, AVX, AVX threaded (note AVX is not implemented yet
-   wxBoxSizer *szrM;
-#endif
-
    DECLARE_EVENT_TABLE()
 
    friend class EqualizationPanel;
@@ -18,6 +18,9 @@
 #include "Loudness.h"
 
 #include <math.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
 
 #include <wx/intl.h>
 #include <wx/simplebook.h>
@@ -26,8 +29,11 @@
 #include "Internat.h"
 #include "../Prefs.h"
 #include "../ProjectFileManager.h"
+#include "../SampleBlock.h"
+#include "../Sequence.h"
 #include "../Shuttle.h"
 #include "../ShuttleGui.h"
+#include "../WaveClip.h"
 #include "../WaveTrack.h"
 #include "../widgets/valnum.h"
 #include "../widgets/ProgressDialog.h"
@@ -54,6 +60,10 @@ Param( LUFSLevel,   double,  wxT("LUFSLevel"),           -23.0,      -145.0,  0.
 Param( RMSLevel,    double,  wxT("RMSLevel"),            -20.0,      -145.0,  0.0,      1  );
 Param( DualMono,    bool,    wxT("DualMono"),            true,       false,   true,     1  );
 Param( NormalizeTo, int,     wxT("NormalizeTo"),         kLoudness , 0    ,   nAlgos-1, 1  );
+Param( TruePeakLimit, bool,  wxT("TruePeakLimit"),       false,      false,   true,     1  );
+
+// EBU R128 recommends true peaks no higher than this, in dBTP
+static const double TruePeakCeiling = -1.0;
 
 BEGIN_EVENT_TABLE(EffectLoudness, wxEvtHandler)
    EVT_CHOICE(wxID_ANY, EffectLoudness::OnChoice)
@@ -66,6 +76,119 @@ const ComponentInterfaceSymbol EffectLoudness::Symbol
 
 namespace{ BuiltinEffectsModule::Registration< EffectLoudness > reg; }
 
+namespace {
+
+//! Identifies the samples that the loudness analysis of some channels reads:
+//! the sample blocks under the selection, and where they lie.  Blocks never
+//! change, so equal keys mean equal samples.
+struct AnalysisKey
+{
+   using Blocks = std::vector<
+      std::pair< sampleCount, std::weak_ptr<SampleBlock> > >;
+
+   AnalysisKey(TrackIterRange<WaveTrack> range,
+      sampleCount start, sampleCount end)
+      : rate{ (*range.begin())->GetRate() }, start{ start }, end{ end }
+   {
+      for (const WaveTrack *channel : range) {
+         channels.emplace_back();
+         auto &blocks = channels.back();
+         for (const auto clip : channel->SortedClipArray()) {
+            const auto clipStart = clip->GetStartSample();
+            for (const auto &block : clip->GetSequence()->GetBlockArray()) {
+               const auto blockStart = clipStart + block.start;
+               if (blockStart < end &&
+                   blockStart + block.sb->GetSampleCount() > start)
+                  blocks.emplace_back(blockStart, block.sb);
+            }
+         }
+      }
+   }
+
+   bool operator == (const AnalysisKey &other) const
+   {
+      // Compare blocks by owner, so that a block that was destroyed never
+      // matches another at the same address
+      const auto sameBlock = [](const auto &a, const auto &b){
+         return a.first == b.first &&
+            !a.second.owner_before(b.second) &&
+            !b.second.owner_before(a.second);
+      };
+      if (rate != other.rate || start != other.start || end != other.end ||
+          channels.size() != other.channels.size())
+         return false;
+      for (size_t ii = 0; ii < channels.size(); ++ii)
+         if (!std::equal(channels[ii].begin(), channels[ii].end(),
+               other.channels[ii].begin(), other.channels[ii].end(),
+               sameBlock))
+            return false;
+      return true;
+   }
+
+   bool Expired() const
+   {
+      for (const auto &blocks : channels)
+         for (const auto &block : blocks)
+            if (block.second.expired())
+               return true;
+      return false;
+   }
+
+   double rate;
+   sampleCount start, end;
+   std::vector<Blocks> channels;
+};
+
+//! Results of a loudness analysis
+struct AnalysisResult
+{
+   double loudness;
+   //! Negative if the analysis did not measure it
+   float truePeak;
+};
+
+//! Results of the last few analyses, so that analysing the same audio
+//! again, say after undoing to try another level, reads no samples
+class AnalysisCache
+{
+public:
+   //! Finds only results that include the true peak, if it is needed
+   bool Find(const AnalysisKey &key, bool needTruePeak, AnalysisResult &result)
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      for (auto iter = mEntries.begin(); iter != mEntries.end(); ++iter)
+         if (iter->first == key &&
+             !(needTruePeak && iter->second.truePeak < 0)) {
+            result = iter->second;
+            // Most recently used first
+            mEntries.splice(mEntries.begin(), mEntries, iter);
+            return true;
+         }
+      return false;
+   }
+
+   void Store(AnalysisKey key, const AnalysisResult &result)
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      // Any older result for the same samples lacked the true peak
+      mEntries.remove_if([&key](const Entry &entry){
+         return entry.first.Expired() || entry.first == key; });
+      mEntries.emplace_front(std::move(key), result);
+      if (mEntries.size() > MaxEntries)
+         mEntries.pop_back();
+   }
+
+private:
+   static constexpr size_t MaxEntries = 8;
+   using Entry = std::pair<AnalysisKey, AnalysisResult>;
+   std::list<Entry> mEntries;
+   std::mutex mMutex;
+};
+
+AnalysisCache sAnalysisCache;
+
+}
+
 EffectLoudness::EffectLoudness()
 {
    mStereoInd = DEF_StereoInd;
@@ -73,6 +196,7 @@ EffectLoudness::EffectLoudness()
    mRMSLevel = DEF_RMSLevel;
    mDualMono = DEF_DualMono;
    mNormalizeTo = DEF_NormalizeTo;
+   mTruePeakLimit = DEF_TruePeakLimit;
 
    SetLinearEffectFlag(false);
 }
@@ -113,6 +237,7 @@ bool EffectLoudness::DefineParams( ShuttleParams & S )
    S.SHUTTLE_PARAM( mRMSLevel, RMSLevel );
    S.SHUTTLE_PARAM( mDualMono, DualMono );
    S.SHUTTLE_PARAM( mNormalizeTo, NormalizeTo );
+   S.SHUTTLE_PARAM( mTruePeakLimit, TruePeakLimit );
    return true;
 }
 
@@ -123,6 +248,7 @@ bool EffectLoudness::GetAutomationParameters(CommandParameters & parms)
    parms.Write(KEY_RMSLevel, mRMSLevel);
    parms.Write(KEY_DualMono, mDualMono);
    parms.Write(KEY_NormalizeTo, mNormalizeTo);
+   parms.Write(KEY_TruePeakLimit, mTruePeakLimit);
 
    return true;
 }
@@ -134,12 +260,14 @@ bool EffectLoudness::SetAutomationParameters(CommandParameters & parms)
    ReadAndVerifyDouble(RMSLevel);
    ReadAndVerifyBool(DualMono);
    ReadAndVerifyInt(NormalizeTo);
+   ReadAndVerifyBool(TruePeakLimit);
 
    mStereoInd = StereoInd;
    mLUFSLevel = LUFSLevel;
    mRMSLevel = RMSLevel;
    mDualMono = DualMono;
    mNormalizeTo = NormalizeTo;
+   mTruePeakLimit = TruePeakLimit;
 
    return true;
 }
@@ -162,6 +290,7 @@ bool EffectLoudness::Startup()
       mNormalizeTo = kLoudness;
       mLUFSLevel = DEF_LUFSLevel;
       mRMSLevel = DEF_RMSLevel;
+      mTruePeakLimit = DEF_TruePeakLimit;
 
       SaveUserPreset(GetCurrentSettingsGroup());
 
@@ -216,15 +345,30 @@ bool EffectLoudness::Process()
 
       mProcStereo = range.size() > 1;
 
+      AnalysisResult analysis{ 0, -1 };
       if(mNormalizeTo == kLoudness)
       {
-         mLoudnessProcessor.reset(safenew EBUR128(mCurRate, range.size()));
-         mLoudnessProcessor->Initialize();
-         if(!ProcessOne(range, true))
+         AnalysisKey key{ range,
+            track->TimeToLongSamples(mCurT0), track->TimeToLongSamples(mCurT1) };
+         if(sAnalysisCache.Find(key, mTruePeakLimit, analysis))
+            // Skip the analysis and its share of progress
+            mProgressVal += double(1+mProcStereo)
+               / (double(GetNumWaveTracks()) * double(mSteps));
+         else
          {
-            // Processing failed -> abort
-            bGoodResult = false;
-            break;
+            mLoudnessProcessor.reset(
+               safenew EBUR128(mCurRate, range.size(), mTruePeakLimit));
+            mLoudnessProcessor->Initialize();
+            if(!ProcessOne(range, true))
+            {
+               // Processing failed -> abort
+               bGoodResult = false;
+               break;
+            }
+            analysis.loudness = mLoudnessProcessor->IntegrativeLoudness();
+            if(mTruePeakLimit)
+               analysis.truePeak = mLoudnessProcessor->TruePeak();
+            sAnalysisCache.Store(std::move(key), analysis);
          }
       }
       else // RMS
@@ -245,7 +389,7 @@ bool EffectLoudness::Process()
       // Calculate normalization values the analysis results
       float extent;
       if(mNormalizeTo == kLoudness)
-         extent = mLoudnessProcessor->IntegrativeLoudness();
+         extent = analysis.loudness;
       else // RMS
       {
          extent = mRMS[0];
@@ -271,6 +415,11 @@ bool EffectLoudness::Process()
 
          // LUFS are related to square values so the multiplier must be the root.
          mMult = sqrt(mMult);
+
+         // Lower the gain if it would raise the true peak above the ceiling
+         if(mTruePeakLimit && analysis.truePeak > 0)
+            mMult = std::min(mMult,
+               float(DB_TO_LINEAR(TruePeakCeiling) / analysis.truePeak));
       }
 
       mProgressMsg = topMsg + XO("Processing: %s").Format( trackName );
@@ -376,6 +525,12 @@ void EffectLoudness::PopulateOrExchange(ShuttleGui & S)
                .Validator<wxGenericValidator>( &mDualMono )
                .AddCheckBox(XXO("&Treat mono as dual-mono (recommended)"),
                   mDualMono );
+
+            mTruePeakLimitCheckBox = S
+               .Validator<wxGenericValidator>( &mTruePeakLimit )
+               /* i18n-hint: dBTP is decibels relative to full scale of the true peak, the largest value between samples */
+               .AddCheckBox(XXO("Keep true &peaks below -1 dBTP"),
+                  mTruePeakLimit );
          }
          S.EndVerticalLay();
       }
@@ -525,13 +680,8 @@ void EffectLoudness::LoadBufferBlock(TrackIterRange<WaveTrack> range,
 /// (for loudness).
 bool EffectLoudness::AnalyseBufferBlock()
 {
-   for(size_t i = 0; i < mTrackBufferLen; i++)
-   {
-      mLoudnessProcessor->ProcessSampleFromChannel(mTrackBuffer[0][i], 0);
-      if(mProcStereo)
-         mLoudnessProcessor->ProcessSampleFromChannel(mTrackBuffer[1][i], 1);
-      mLoudnessProcessor->NextSample();
-   }
+   const float *channels[] = { mTrackBuffer[0].get(), mTrackBuffer[1].get() };
+   mLoudnessProcessor->ProcessBlock(channels, mTrackBufferLen);
 
    if(!UpdateProgress())
       return false;
@@ -577,6 +727,7 @@ void EffectLoudness::OnChoice(wxCommandEvent & WXUNUSED(evt))
    mBook->SetSelection( mNormalizeTo );
    UpdateUI();
    mDualMonoCheckBox->Enable(mNormalizeTo == kLoudness);
+   mTruePeakLimitCheckBox->Enable(mNormalizeTo == kLoudness);
 }
 
 void EffectLoudness::OnUpdateUI(wxCommandEvent & WXUNUSED(evt))
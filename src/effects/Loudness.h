@@ -84,6 +84,7 @@ private:
    double mRMSLevel;
    bool   mDualMono;
    int    mNormalizeTo;
+   bool   mTruePeakLimit;
 
    double mCurT0;
    double mCurT1;
@@ -103,6 +104,7 @@ private:
    wxStaticText *mWarning;
    wxCheckBox *mStereoIndCheckBox;
    wxCheckBox *mDualMonoCheckBox;
+   wxCheckBox *mTruePeakLimitCheckBox;
 
    Floats mTrackBuffer[2];    // MM: must be increased once surround channels are supported
    size_t mTrackBufferLen;
@@ -47,12 +47,17 @@
 #include "../widgets/HelpSystem.h"
 #include "../Prefs.h"
 #include "../RealFFTf.h"
+#include "../ThreadPool.h"
 
+#include "../WaveClip.h"
 #include "../WaveTrack.h"
 #include "../widgets/SneedacityMessageBox.h"
 #include "../widgets/valnum.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <vector>
 #include <math.h>
 
@@ -113,6 +118,10 @@ const struct DiscriminationMethodInfo {
 // and the old discrimination
 const float minSignalTime = 0.05f;
 
+// Limit on the steps that raised gains may take to decay; beyond it,
+// selections are not split for processing in parallel
+const unsigned maxDecaySteps = 1 << 16;
+
 enum WindowTypes {
    WT_RECTANGULAR_HANN = 0, // 2.0.6 behavior, requires 1/2 step
    WT_HANN_RECTANGULAR, // requires 1/2 step
@@ -270,12 +279,41 @@ public:
                 TrackList &tracks, double mT0, double mT1);
 
 private:
+   // The selected part of one channel
+   struct Range
+   {
+      WaveTrack *track;
+      int count;
+      sampleCount start;
+      sampleCount len;
+   };
+
+   // Steps of a Range that a worker thread reduces, into a track of its own
+   struct Segment
+   {
+      const Range *range;
+      sampleCount firstStep;
+      sampleCount endStep;
+      WaveTrack::Holder output;
+   };
+
    bool ProcessOne(EffectNoiseReduction &effect,
                    Statistics &statistics,
                    WaveTrackFactory &factory,
                    int count, WaveTrack *track,
                    sampleCount start, sampleCount len);
 
+   bool ProcessSegments(EffectNoiseReduction &effect,
+                        Statistics &statistics,
+                        const std::vector<Range> &ranges,
+                        std::vector<Segment> &segments);
+   // In a worker thread
+   void ReduceSegment(Statistics &statistics, const Segment &segment,
+                      std::atomic<long long> &done,
+                      const std::atomic<bool> &cancelled);
+   static void ReplaceSamples(WaveTrack &track, WaveTrack &outputTrack,
+                              sampleCount start, sampleCount len);
+
    void StartNewTrack();
    void ProcessSamples(Statistics &statistics,
       WaveTrack *outputTrack, size_t len, float *buffer);
@@ -322,6 +360,14 @@ private:
    sampleCount       mOutStepCount;
    int                   mInWavePos;
 
+   // Steps to output, counting from the start of the selection
+   sampleCount       mFirstOutStep;
+   sampleCount       mEndOutStep;
+   // How many steps before its first a segment must begin, so that its
+   // output is the same as in serial processing; 0 if there is no such
+   // number
+   size_t            mWarmupSteps;
+
    float     mOneBlockAttack;
    float     mOneBlockRelease;
    float     mNoiseAttenFactor;
@@ -670,6 +716,7 @@ bool EffectNoiseReduction::Worker::Process
 (EffectNoiseReduction &effect, Statistics &statistics, WaveTrackFactory &factory,
  TrackList &tracks, double inT0, double inT1)
 {
+   std::vector<Range> ranges;
    int count = 0;
    for ( auto track : tracks.Selected< WaveTrack >() ) {
       if (track->GetRate() != mSampleRate) {
@@ -691,15 +738,44 @@ bool EffectNoiseReduction::Worker::Process
       if (t1 > t0) {
          auto start = track->TimeToLongSamples(t0);
          auto end = track->TimeToLongSamples(t1);
-         auto len = end - start;
-
-         if (!ProcessOne(effect, statistics, factory,
-                         count, track, start, len))
-            return false;
+         ranges.push_back({ track, count, start, end - start });
       }
       ++count;
    }
 
+   // Reduce channels, and segments of long selections, in parallel.
+   // Profiling stays serial, because it sums statistics in order.
+   std::vector<Segment> segments;
+   const auto nThreads = ThreadPool::Get().GetThreadCount();
+   if (!mDoProfile && Effect::ParallelProcessing.Read() && nThreads > 0) {
+      const sampleCount maxSegments = 4 * (nThreads + 1);
+      for (const auto &range : ranges) {
+         const auto nSteps = (range.len + mStepSize - 1) / mStepSize;
+         // Each segment should be long compared with its warm-up
+         sampleCount nSegments = 1;
+         if (mWarmupSteps > 0)
+            nSegments = std::max<sampleCount>(1, std::min(maxSegments,
+               nSteps / (8 * mWarmupSteps)));
+         for (sampleCount kk = 0; kk < nSegments; ++kk) {
+            // Float, so that worker threads append without dithering; the
+            // main thread converts once, in ReplaceSamples()
+            auto output = range.track->EmptyCopy();
+            output->ConvertToSampleFormat( floatSample );
+            segments.push_back({ &range,
+               nSteps * kk / nSegments, nSteps * (kk + 1) / nSegments,
+               std::move(output) });
+         }
+      }
+   }
+
+   if (segments.size() > 1)
+      return ProcessSegments(effect, statistics, ranges, segments);
+
+   for (const auto &range : ranges)
+      if (!ProcessOne(effect, statistics, factory,
+                      range.count, range.track, range.start, range.len))
+         return false;
+
    if (mDoProfile) {
       if (statistics.mTotalWindows == 0) {
          effect.Effect::MessageBox(
@@ -777,6 +853,8 @@ EffectNoiseReduction::Worker::Worker
 , mInSampleCount(0)
 , mOutStepCount(0)
 , mInWavePos(0)
+, mFirstOutStep(0)
+, mEndOutStep(std::numeric_limits<sampleCount::type>::max())
 {
 #ifdef EXPERIMENTAL_SPECTRAL_EDITING
    {
@@ -823,6 +901,23 @@ EffectNoiseReduction::Worker::Worker
    for (unsigned ii = 0; ii < mHistoryLen; ++ii)
       mQueue[ii] = std::make_unique<Record>(mSpectrumSize);
 
+   // A segment begins with windows whose history is missing.  Their
+   // effects on later windows are gone once the history has filled, and
+   // gains raised by release have decayed to the floor, as a gain of 1
+   // would, multiplied as in ReduceNoise(); then the overlap-add collects
+   // all the windows of its first step.  Attack goes back in time only.
+   {
+      unsigned decaySteps = 0;
+      if (mNoiseAttenFactor < 1.0f)
+         for (float gain = 1.0f;
+              gain >= mNoiseAttenFactor && decaySteps < maxDecaySteps;
+              gain *= mOneBlockRelease)
+            ++decaySteps;
+      mWarmupSteps = (decaySteps == maxDecaySteps)
+         ? 0
+         : mHistoryLen + decaySteps + mStepsPerWindow;
+   }
+
    // Create windows
 
    const double constantTerm =
@@ -1293,7 +1388,7 @@ void EffectNoiseReduction::Worker::ReduceNoise
       }
 
       float *buffer = &mOutOverlapBuffer[0];
-      if (mOutStepCount >= 0) {
+      if (mOutStepCount >= mFirstOutStep && mOutStepCount < mEndOutStep) {
          // Output the first portion of the overlap buffer, they're done
          outputTrack->Append((samplePtr)buffer, floatSample, mStepSize);
       }
@@ -1354,18 +1449,146 @@ bool EffectNoiseReduction::Worker::ProcessOne
       // Flush the output WaveTrack (since it's buffered)
       outputTrack->Flush();
 
-      // Take the output track and insert it in place of the original
-      // sample data (as operated on -- this may not match mT0/mT1)
-      double t0 = outputTrack->LongSamplesToTime(start);
-      double tLen = outputTrack->LongSamplesToTime(len);
-      // Filtering effects always end up with more data than they started with.  Delete this 'tail'.
-      outputTrack->HandleClear(tLen, outputTrack->GetEndTime(), false, false);
-      track->ClearAndPaste(t0, t0 + tLen, &*outputTrack, true, false);
+      ReplaceSamples(*track, *outputTrack, start, len);
    }
 
    return bLoopSuccess;
 }
 
+void EffectNoiseReduction::Worker::ReplaceSamples
+(WaveTrack &track, WaveTrack &outputTrack, sampleCount start, sampleCount len)
+{
+   // Take the output track and insert it in place of the original
+   // sample data (as operated on -- this may not match mT0/mT1)
+   double t0 = outputTrack.LongSamplesToTime(start);
+   double tLen = outputTrack.LongSamplesToTime(len);
+   // Filtering effects always end up with more data than they started with.  Delete this 'tail'.
+   outputTrack.HandleClear(tLen, outputTrack.GetEndTime(), false, false);
+   track.ClearAndPaste(t0, t0 + tLen, &outputTrack, true, false);
+}
+
+bool EffectNoiseReduction::Worker::ProcessSegments
+(EffectNoiseReduction &effect, Statistics &statistics,
+ const std::vector<Range> &ranges, std::vector<Segment> &segments)
+{
+   // Each worker thread reduces whole segments with a Worker of its own
+   const auto nWorkers =
+      std::min(segments.size(), ThreadPool::Get().GetThreadCount());
+   std::vector< std::unique_ptr<Worker> > workers;
+   for (size_t ii = 0; ii < nWorkers; ++ii)
+      workers.push_back(std::make_unique<Worker>(*effect.mSettings, mSampleRate
+#ifdef EXPERIMENTAL_SPECTRAL_EDITING
+         , mF0, mF1
+#endif
+      ));
+
+   long long total = 0;
+   for (const auto &range : ranges)
+      total += range.len.as_long_long();
+
+   std::atomic<size_t> next{ 0 };
+   std::atomic<long long> done{ 0 };
+   std::atomic<bool> failed{ false }, cancelled{ false };
+   std::vector< std::future<void> > futures;
+   for (auto &pWorker : workers)
+      futures.push_back(ThreadPool::Get().Submit(
+         [&, pWorker = pWorker.get()]{
+            for (size_t ii;
+                 !cancelled && (ii = next++) < segments.size();) {
+               bool ok = false;
+               auto stop = finally([&]{
+                  if (!ok) {
+                     failed = true;
+                     cancelled = true;
+                  }
+               });
+               pWorker->ReduceSegment(
+                  statistics, segments[ii], done, cancelled);
+               ok = true;
+            }
+         }));
+
+   // Only this thread updates the progress dialog
+   for (auto &future : futures)
+      while (future.wait_for(std::chrono::milliseconds(100)) !=
+             std::future_status::ready)
+         if (!cancelled &&
+             effect.TotalProgress(double(done) / std::max(1LL, total)))
+            cancelled = true;
+   for (auto &future : futures)
+      future.get();
+   if (cancelled || failed)
+      return false;
+
+   // Join the segments of each range, sharing their sample blocks
+   for (auto first = segments.begin(); first != segments.end();) {
+      auto last = std::find_if(first, segments.end(),
+         [&](const Segment &segment){ return segment.range != first->range; });
+      auto &outputTrack = *first->output;
+      auto clip = outputTrack.GetClipByIndex(0);
+      for (auto iter = first + 1; iter != last; ++iter)
+         clip->Paste(clip->GetEndTime(), iter->output->GetClipByIndex(0));
+      const auto &range = *first->range;
+      ReplaceSamples(*range.track, outputTrack, range.start, range.len);
+      first = last;
+   }
+
+   return true;
+}
+
+void EffectNoiseReduction::Worker::ReduceSegment
+(Statistics &statistics, const Segment &segment,
+ std::atomic<long long> &done, const std::atomic<bool> &cancelled)
+{
+   const auto &range = *segment.range;
+   auto outputTrack = segment.output.get();
+
+   StartNewTrack();
+   mFirstOutStep = segment.firstStep;
+   mEndOutStep = segment.endStep;
+
+   // Begin mWarmupSteps before the first step to output, with a full
+   // window, as if all samples before it had been processed
+   const auto warmupStep = segment.firstStep - mWarmupSteps;
+   if (warmupStep > 0) {
+      mInWavePos = 0;
+      mInSampleCount = warmupStep * mStepSize;
+      mOutStepCount = warmupStep - (int)(mHistoryLen - 1);
+   }
+
+   auto bufferSize = range.track->GetMaxBlockSize();
+   FloatVector buffer(std::max(bufferSize, mStepSize));
+
+   const auto end = range.start + range.len;
+   auto samplePos = range.start + mInSampleCount;
+   sampleCount reported = 0;
+   while (!cancelled && mOutStepCount < mEndOutStep) {
+      if (samplePos < end) {
+         const auto blockSize = limitSampleBufferSize(
+            range.track->GetBestBlockSize(samplePos), end - samplePos);
+         range.track->GetFloats(&buffer[0], samplePos, blockSize);
+         samplePos += blockSize;
+         mInSampleCount += blockSize;
+         ProcessSamples(statistics, outputTrack, blockSize, &buffer[0]);
+      }
+      else if (mOutStepCount * mStepSize < mInSampleCount) {
+         // As in FinishTrack()
+         std::fill(buffer.begin(), buffer.begin() + mStepSize, 0.0f);
+         ProcessSamples(statistics, outputTrack, mStepSize, &buffer[0]);
+      }
+      else
+         break;
+
+      // Count output samples for the progress
+      const auto output = std::max<sampleCount>(mFirstOutStep,
+         std::min(mOutStepCount, mEndOutStep)) - mFirstOutStep;
+      done += ((output - reported) * mStepSize).as_long_long();
+      reported = output;
+   }
+
+   outputTrack->Flush();
+}
+
 //----------------------------------------------------------------------------
 // EffectNoiseReduction::Dialog
 //----------------------------------------------------------------------------
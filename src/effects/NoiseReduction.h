@@ -23,6 +23,7 @@ public:
    virtual ~EffectNoiseReduction();
 
    using Effect::TrackProgress;
+   using Effect::TotalProgress;
 
    // ComponentInterface implementation
 
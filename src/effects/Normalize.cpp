@@ -398,59 +398,14 @@ bool EffectNormalize::AnalyseTrack(const WaveTrack * track, const TranslatableSt
    return result;
 }
 
-//AnalyseTrackData() takes a track, transforms it to bunch of buffer-blocks,
-//and executes selected AnalyseOperation on it...
+//AnalyseTrackData() finds the DC offset of a track, from the sums that the
+//sample blocks keep, reading only the samples of blocks partly selected
 bool EffectNormalize::AnalyseTrackData(const WaveTrack * track, const TranslatableString &msg,
                                 double &progress, float &offset)
 {
-   bool rc = true;
-
-   //Transform the marker timepoints to samples
-   auto start = track->TimeToLongSamples(mCurT0);
-   auto end = track->TimeToLongSamples(mCurT1);
-
-   //Get the length of the buffer (as double). len is
-   //used simply to calculate a progress meter, so it is easier
-   //to make it a double now than it is to do it later
-   auto len = (end - start).as_double();
-
-   //Initiate a processing buffer.  This buffer will (most likely)
-   //be shorter than the length of the track being processed.
-   Floats buffer{ track->GetMaxBlockSize() };
-
-   mSum   = 0.0; // dc offset inits
-
-   sampleCount blockSamples;
    sampleCount totalSamples = 0;
+   mSum = track->GetSum(mCurT0, mCurT1, &totalSamples); // may throw
 
-   //Go through the track one buffer at a time. s counts which
-   //sample the current buffer starts at.
-   auto s = start;
-   while (s < end) {
-      //Get a block of samples (smaller than the size of the buffer)
-      //Adjust the block size if it is the final block in the track
-      const auto block = limitSampleBufferSize(
-         track->GetBestBlockSize(s),
-         end - s
-      );
-
-      //Get the samples from the track and put them in the buffer
-      track->GetFloats(buffer.get(), s, block, fillZero, true, &blockSamples);
-      totalSamples += blockSamples;
-
-      //Process the buffer.
-      AnalyseDataDC(buffer.get(), block);
-
-      //Increment s one blockfull of samples
-      s += block;
-
-      //Update the Progress meter
-      if (TotalProgress(progress +
-                        ((s - start).as_double() / len)/double(2*GetNumWaveTracks()), msg)) {
-         rc = false; //lda .. break, not return, so that buffer is deleted
-         break;
-      }
-   }
    if( totalSamples > 0 )
       offset = -mSum / totalSamples.as_double();  // calculate actual offset (amount that needs to be added on)
    else
@@ -458,7 +413,7 @@ bool EffectNormalize::AnalyseTrackData(const WaveTrack * track, const Translatab
 
    progress += 1.0/double(2*GetNumWaveTracks());
    //Return true because the effect processing succeeded ... unless cancelled
-   return rc;
+   return !TotalProgress(progress, msg);
 }
 
 //ProcessOne() takes a track, transforms it to bunch of buffer-blocks,
@@ -519,13 +474,6 @@ bool EffectNormalize::ProcessOne(
    return rc;
 }
 
-/// @see AnalyseDataLoudnessDC
-void EffectNormalize::AnalyseDataDC(float *buffer, size_t len)
-{
-   for(decltype(len) i = 0; i < len; i++)
-      mSum += (double)buffer[i];
-}
-
 void EffectNormalize::ProcessData(float *buffer, size_t len, float offset)
 {
    for(decltype(len) i = 0; i < len; i++) {
@@ -0,0 +1,166 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file PartitionedConvolution.cpp
+@brief Implements PartitionedFilter and PartitionedConvolver
+
+**********************************************************************/
+
+#include "PartitionedConvolution.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <wx/debug.h>
+
+#include "../FFTKernels.h"
+
+namespace {
+
+// Copy the output of RealFFTf() into separate real and imaginary parts of
+// blockSize bins, in order, with Fs/2 as the imaginary part of DC
+void Unpack(const FFTParam &fft, const float *buffer,
+   float *real, float *imag)
+{
+   real[0] = buffer[0];
+   imag[0] = buffer[1];
+   for (size_t ii = 1; ii < fft.Points; ++ii) {
+      const auto kk = fft.BitReversed[ii];
+      real[ii] = buffer[kk];
+      imag[ii] = buffer[kk + 1];
+   }
+}
+
+}
+
+PartitionedFilter::PartitionedFilter(
+   const float *taps, size_t nTaps, size_t blockSize)
+   : mBlockSize{ blockSize }
+   , mPartitionCount{ std::max<size_t>(1, (nTaps + blockSize - 1) / blockSize) }
+   , mReal{ mPartitionCount * blockSize }
+   , mImag{ mPartitionCount * blockSize }
+{
+   wxASSERT(blockSize >= 2 && (blockSize & (blockSize - 1)) == 0);
+
+   // Each partition is padded with zeroes to twice the block size, so that
+   // the circular convolution of a frame of two blocks has one block free of
+   // wrap-around
+   const auto hFFT = GetFFT(2 * blockSize);
+   Floats buffer{ 2 * blockSize };
+   for (size_t pp = 0; pp < mPartitionCount; ++pp) {
+      const auto first = std::min(nTaps, pp * blockSize);
+      const auto count = std::min(nTaps - first, blockSize);
+      std::fill(buffer.get(), buffer.get() + 2 * blockSize, 0.0f);
+      std::copy(taps + first, taps + first + count, buffer.get());
+      RealFFTf(buffer.get(), hFFT.get());
+      Unpack(*hFFT, buffer.get(),
+         mReal.get() + pp * blockSize, mImag.get() + pp * blockSize);
+   }
+}
+
+PartitionedConvolver::PartitionedConvolver(
+   std::shared_ptr<const PartitionedFilter> pFilter, size_t maxPartitions)
+   : mpFilter{ std::move(pFilter) }
+   , mBlockSize{ mpFilter->GetBlockSize() }
+   , hFFT{ GetFFT(2 * mBlockSize) }
+   , mKernels{ FFTKernels::GetBestKernels() }
+   , mInput{ 2 * mBlockSize }
+   , mOutput{ mBlockSize }
+   , mHistoryLen{ std::max(maxPartitions, mpFilter->GetPartitionCount()) }
+   , mHistoryReal{ mHistoryLen * mBlockSize }
+   , mHistoryImag{ mHistoryLen * mBlockSize }
+   , mSumReal{ mBlockSize }
+   , mSumImag{ mBlockSize }
+   , mFFTBuffer{ 2 * mBlockSize }
+{
+   Reset();
+}
+
+std::shared_ptr<const PartitionedFilter>
+PartitionedConvolver::SetFilter(std::shared_ptr<const PartitionedFilter> pFilter)
+{
+   wxASSERT(pFilter->GetBlockSize() == mBlockSize);
+   wxASSERT(pFilter->GetPartitionCount() <= mHistoryLen);
+   std::swap(mpFilter, pFilter);
+   return pFilter;
+}
+
+void PartitionedConvolver::Reset()
+{
+   std::fill(mInput.get(), mInput.get() + 2 * mBlockSize, 0.0f);
+   std::fill(mOutput.get(), mOutput.get() + mBlockSize, 0.0f);
+   std::fill(mHistoryReal.get(),
+      mHistoryReal.get() + mHistoryLen * mBlockSize, 0.0f);
+   std::fill(mHistoryImag.get(),
+      mHistoryImag.get() + mHistoryLen * mBlockSize, 0.0f);
+   mFill = 0;
+   mNewest = 0;
+}
+
+void PartitionedConvolver::Process(
+   const float *input, float *output, size_t len)
+{
+   while (len > 0) {
+      const auto count = std::min(len, mBlockSize - mFill);
+      // Take the input before giving the output, which may overwrite it
+      memcpy(&mInput[mBlockSize + mFill], input, count * sizeof(float));
+      memcpy(output, &mOutput[mFill], count * sizeof(float));
+      input += count;
+      output += count;
+      len -= count;
+      mFill += count;
+      if (mFill == mBlockSize) {
+         ProcessBlock();
+         mFill = 0;
+      }
+   }
+}
+
+void PartitionedConvolver::ProcessBlock()
+{
+   const auto &filter = *mpFilter;
+   const auto nPartitions = filter.GetPartitionCount();
+
+   // Transform the frame of the previous and current blocks, into the
+   // history slot of the oldest spectrum
+   memcpy(mFFTBuffer.get(), mInput.get(), 2 * mBlockSize * sizeof(float));
+   RealFFTf(mFFTBuffer.get(), hFFT.get(), mKernels);
+   mNewest = (mNewest + mHistoryLen - 1) % mHistoryLen;
+   Unpack(*hFFT, mFFTBuffer.get(),
+      &mHistoryReal[mNewest * mBlockSize], &mHistoryImag[mNewest * mBlockSize]);
+
+   // Sum the products of each partition with the spectrum of as many blocks
+   // before.  DC and Fs/2 in bin 0 are real, and multiply separately.
+   std::fill(mSumReal.get(), mSumReal.get() + mBlockSize, 0.0f);
+   std::fill(mSumImag.get(), mSumImag.get() + mBlockSize, 0.0f);
+   float dc = 0, nyquist = 0;
+   for (size_t pp = 0; pp < nPartitions; ++pp) {
+      const auto slot = ((mNewest + pp) % mHistoryLen) * mBlockSize;
+      const auto xReal = &mHistoryReal[slot], xImag = &mHistoryImag[slot];
+      const auto hReal = &filter.mReal[pp * mBlockSize],
+         hImag = &filter.mImag[pp * mBlockSize];
+      dc += xReal[0] * hReal[0];
+      nyquist += xImag[0] * hImag[0];
+      mKernels.multiplyAdd(&mSumReal[1], &mSumImag[1],
+         xReal + 1, xImag + 1, hReal + 1, hImag + 1, mBlockSize - 1);
+   }
+
+   // Back to the time domain; the second half is free of wrap-around
+   mFFTBuffer[0] = dc;
+   mFFTBuffer[1] = nyquist;
+   for (size_t ii = 1; ii < mBlockSize; ++ii) {
+      mFFTBuffer[2 * ii] = mSumReal[ii];
+      mFFTBuffer[2 * ii + 1] = mSumImag[ii];
+   }
+   InverseRealFFTf(mFFTBuffer.get(), hFFT.get(), mKernels);
+   // As ReorderToTime() does, for the second half only
+   for (size_t ii = mBlockSize / 2; ii < mBlockSize; ++ii) {
+      const auto kk = hFFT->BitReversed[ii];
+      mOutput[2 * ii - mBlockSize] = mFFTBuffer[kk];
+      mOutput[2 * ii - mBlockSize + 1] = mFFTBuffer[kk + 1];
+   }
+
+   // The current block becomes the previous
+   memcpy(mInput.get(), &mInput[mBlockSize], mBlockSize * sizeof(float));
+}
@@ -0,0 +1,111 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file PartitionedConvolution.h
+@brief Declare PartitionedFilter and PartitionedConvolver, which apply long FIR filters by uniformly partitioned FFT convolution
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_PARTITIONED_CONVOLUTION__
+#define __SNEEDACITY_PARTITIONED_CONVOLUTION__
+
+#include <memory>
+
+#include "../RealFFTf.h"
+#include "../SampleFormat.h"
+
+namespace FFTKernels { struct Kernels; }
+
+//! An FIR filter cut into partitions of one block size, each transformed
+//! once
+/*! It is never changed after it is made, so any number of
+ PartitionedConvolver objects, in any threads, may share it. */
+class PartitionedFilter final
+{
+public:
+   //! @param blockSize a power of two, at least 2; the latency of convolution
+   PartitionedFilter(const float *taps, size_t nTaps, size_t blockSize);
+
+   size_t GetBlockSize() const { return mBlockSize; }
+   size_t GetPartitionCount() const { return mPartitionCount; }
+
+private:
+   friend class PartitionedConvolver;
+
+   const size_t mBlockSize;
+   const size_t mPartitionCount;
+   //! Spectra of the partitions, blockSize bins each, as in
+   //! PartitionedConvolver::mHistoryReal
+   Floats mReal, mImag;
+};
+
+//! Convolves one channel with a PartitionedFilter, a block at a time
+/*! Each block of input is transformed once, into a history of spectra; each
+ block of output is the sum of the products of the history with the
+ partitions, transformed back (overlap-save).  So the cost of a sample grows
+ with the filter length only by complex multiply-adds, and the latency is one
+ block, whatever the filter length.
+
+ The output is the same, to the bit, for the same input and filter, however
+ the input is divided among calls of Process(). */
+class PartitionedConvolver final
+{
+public:
+   //! @param maxPartitions room for filters of so many partitions, so that
+   //! SetFilter() need not allocate
+   explicit PartitionedConvolver(
+      std::shared_ptr<const PartitionedFilter> pFilter,
+      size_t maxPartitions = 0);
+
+   PartitionedConvolver(const PartitionedConvolver&) = delete;
+   PartitionedConvolver &operator=(const PartitionedConvolver&) = delete;
+
+   //! Samples of delay from input to output
+   size_t GetLatency() const { return mBlockSize; }
+
+   const std::shared_ptr<const PartitionedFilter> &GetFilter() const
+   { return mpFilter; }
+
+   //! Change the filter, keeping the history of input, without allocating
+   /*! The block size must be the same, and the partitions no more than the
+    maxPartitions given to the constructor
+    @return the previous filter, so that the caller may choose the thread
+    that releases it */
+   std::shared_ptr<const PartitionedFilter>
+   SetFilter(std::shared_ptr<const PartitionedFilter> pFilter);
+
+   //! Forget all input, as if preceded by silence
+   void Reset();
+
+   //! Convolve len samples; output may be the same as input
+   /*! Output sample n is the convolution at input sample n - GetLatency() */
+   void Process(const float *input, float *output, size_t len);
+
+private:
+   void ProcessBlock();
+
+   std::shared_ptr<const PartitionedFilter> mpFilter;
+   const size_t mBlockSize;
+   const HFFT hFFT;
+   const FFTKernels::Kernels &mKernels;
+
+   //! The previous block of input, then the current one
+   Floats mInput;
+   //! Output for the previous block of input
+   Floats mOutput;
+   //! Samples of the current block so far
+   size_t mFill{ 0 };
+
+   //! Spectra of the frames of input, newest at mNewest, older ones after
+   //! it, circularly
+   /*! The real part of bin 0 is DC, and its imaginary part is Fs/2 */
+   const size_t mHistoryLen;
+   Floats mHistoryReal, mHistoryImag;
+   size_t mNewest{ 0 };
+
+   Floats mSumReal, mSumImag;
+   Floats mFFTBuffer;
+};
+
+#endif
@@ -251,6 +251,19 @@ bool EffectPhaser::SetAutomationParameters(CommandParameters & parms)
 
 // Effect implementation
 
+std::unique_ptr<Effect> EffectPhaser::CloneForProcessing()
+{
+   auto clone = std::make_unique<EffectPhaser>();
+   clone->mStages = mStages;
+   clone->mDryWet = mDryWet;
+   clone->mFreq = mFreq;
+   clone->mPhase = mPhase;
+   clone->mDepth = mDepth;
+   clone->mFeedback = mFeedback;
+   clone->mOutGain = mOutGain;
+   return FinishClone(std::move(clone));
+}
+
 void EffectPhaser::PopulateOrExchange(ShuttleGui & S)
 {
    S.SetBorder(5);
@@ -12,7 +12,10 @@
 #include "RealtimeEffectManager.h"
 
 #include "sneedacity/EffectInterface.h"
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <thread>
 
 #include <atomic>
 #include <wx/time.h>
@@ -48,11 +51,9 @@ RealtimeEffectManager & RealtimeEffectManager::Get()
 
 RealtimeEffectManager::RealtimeEffectManager()
 {
-   mRealtimeLock.Enter();
    mRealtimeActive = false;
    mRealtimeSuspended = true;
    mRealtimeLatency = 0;
-   mRealtimeLock.Leave();
 }
 
 RealtimeEffectManager::~RealtimeEffectManager()
@@ -62,9 +63,6 @@ RealtimeEffectManager::~RealtimeEffectManager()
 #if defined(EXPERIMENTAL_EFFECTS_RACK)
 void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
-
    decltype( mStates ) newStates;
    auto begin = mStates.begin(), end = mStates.end();
    for ( auto pEffect : effects ) {
@@ -78,6 +76,9 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
          pEffect->RealtimeInitialize();
          newStates.emplace_back(
             std::make_unique< RealtimeEffectState >( *pEffect ) );
+         // The other effects were resumed already, or will be with this one
+         if (!mRealtimeSuspended)
+            newStates.back()->RealtimeResume();
       }
       else {
          // Preserve state for effect that remains in the chain
@@ -85,18 +86,17 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
       }
    }
 
+   // Install the NEW chain, and wait until the audio thread is done with
+   // the old one
+   mStates.swap( newStates );
+   Publish();
+   Synchronize();
+
    // Remaining states that were not moved need to clean up
-   for ( auto &state : mStates ) {
+   for ( auto &state : newStates ) {
       if ( state )
          state->GetEffect().RealtimeFinalize();
    }
-
-   // Get rid of the old chain
-   // And install the NEW one
-   mStates.swap( newStates );
-
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
 }
 #endif
 
@@ -112,14 +112,10 @@ bool RealtimeEffectManager::RealtimeIsSuspended()
 
 void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
+   auto state = std::make_unique< RealtimeEffectState >( *effect );
 
-   // Add to list of active effects
-   mStates.emplace_back( std::make_unique< RealtimeEffectState >( *effect ) );
-   auto &state = mStates.back();
-
-   // Initialize effect if realtime is already active
+   // Initialize effect if realtime is already active; the audio thread
+   // does not see it yet
    if (mRealtimeActive)
    {
       // Initialize realtime processing
@@ -131,35 +127,40 @@ void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
          state->RealtimeAddProcessor(i, mRealtimeChans[i], mRealtimeRates[i]);
       }
    }
-   
 
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
+   // The other effects were resumed already, or will be with this one
+   if (!mRealtimeSuspended)
+      state->RealtimeResume();
+
+   // Add to list of active effects, and let RealtimeProcess() see it
+   mStates.push_back( std::move( state ) );
+   Publish();
 }
 
 void RealtimeEffectManager::RealtimeRemoveEffect(EffectClientInterface *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
-
-   if (mRealtimeActive)
-   {
-      // Cleanup realtime processing
-      effect->RealtimeFinalize();
-   }
-      
    // Remove from list of active effects
+   std::unique_ptr< RealtimeEffectState > pState;
    auto end = mStates.end();
    auto found = std::find_if( mStates.begin(), end,
       [&](const decltype(mStates)::value_type &state){
          return &state->GetEffect() == effect;
       }
    );
-   if (found != end)
+   if (found != end) {
+      pState = std::move( *found );
       mStates.erase(found);
+   }
 
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
+   // Stop RealtimeProcess() from using it, without blocking the audio thread
+   Publish();
+   Synchronize();
+
+   if (mRealtimeActive)
+   {
+      // Cleanup realtime processing
+      effect->RealtimeFinalize();
+   }
 }
 
 void RealtimeEffectManager::RealtimeInitialize(double rate)
@@ -216,23 +217,19 @@ void RealtimeEffectManager::RealtimeFinalize()
 
 void RealtimeEffectManager::RealtimeSuspend()
 {
-   mRealtimeLock.Enter();
-
    // Already suspended...bail
    if (mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
    // Show that we aren't going to be doing anything
    mRealtimeSuspended = true;
 
+   // And let a buffer that began before finish
+   Synchronize();
+
    // And make sure the effects don't either
    for (auto &state : mStates)
       state->RealtimeSuspend();
-
-   mRealtimeLock.Leave();
 }
 
 void RealtimeEffectManager::RealtimeSuspendOne( EffectClientInterface &effect )
@@ -243,29 +240,25 @@ void RealtimeEffectManager::RealtimeSuspendOne( EffectClientInterface &effect )
          return state && &state->GetEffect() == &effect;
       }
    );
-   if ( found != end )
+   if ( found != end ) {
       (*found)->RealtimeSuspend();
+      Publish();
+   }
 }
 
 void RealtimeEffectManager::RealtimeResume()
 {
-   mRealtimeLock.Enter();
-
    // Already running...bail
    if (!mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
    // Tell the effects to get ready for more action
    for (auto &state : mStates)
       state->RealtimeResume();
+   Publish();
 
    // And we should too
    mRealtimeSuspended = false;
-
-   mRealtimeLock.Leave();
 }
 
 void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
@@ -276,8 +269,49 @@ void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
          return state && &state->GetEffect() == &effect;
       }
    );
-   if ( found != end )
+   if ( found != end ) {
       (*found)->RealtimeResume();
+      Publish();
+   }
+}
+
+void RealtimeEffectManager::Publish()
+{
+   auto pChain = std::make_unique<Chain>();
+   for (auto &state : mStates)
+      pChain->push_back({ state.get(), state->IsRealtimeActive() });
+
+   mChain.store(pChain.get());
+
+   // The audio thread may have read the old chain before the store, but not
+   // after the count changes
+   mRetired.emplace_back(std::move(mCurrentChain), mProcessCount.load());
+   mCurrentChain = std::move(pChain);
+
+   Reclaim();
+}
+
+void RealtimeEffectManager::Synchronize()
+{
+   // Only this thread waits, and only for one buffer; the audio thread
+   // never waits for this one
+   const auto count = mProcessCount.load();
+   if (count % 2)
+      while (mProcessCount.load() == count)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+   Reclaim();
+}
+
+void RealtimeEffectManager::Reclaim()
+{
+   const auto count = mProcessCount.load();
+   mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+      [count](const decltype(mRetired)::value_type &retired){
+         // Replaced between buffers, or during a buffer that has ended
+         return retired.second % 2 == 0 || retired.second != count;
+      }),
+      mRetired.end());
 }
 
 //
@@ -285,21 +319,24 @@ void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
 //
 void RealtimeEffectManager::RealtimeProcessStart()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   // Count the start of the buffer before reading the chain, so that the
+   // main thread frees no chain that is read after
+   ++mProcessCount;
+
+   // Use the same chain for all of this buffer, without locking
+   mAudioChain = mChain.load();
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
-   if (!mRealtimeSuspended)
+   mAudioSuspended = mRealtimeSuspended;
+   if (!mAudioSuspended && mAudioChain)
    {
-      for (auto &state : mStates)
+      for (auto &link : *mAudioChain)
       {
-         if (state->IsRealtimeActive())
-            state->GetEffect().RealtimeProcessStart();
+         if (link.active)
+            link.state->GetEffect().RealtimeProcessStart();
       }
    }
-
-   mRealtimeLock.Leave();
 }
 
 //
@@ -307,16 +344,10 @@ void RealtimeEffectManager::RealtimeProcessStart()
 //
 size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float **buffers, size_t numSamples)
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
-
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended, so allow the samples to pass as-is.
-   if (mRealtimeSuspended || mStates.empty())
-   {
-      mRealtimeLock.Leave();
+   if (mAudioSuspended || !mAudioChain || mAudioChain->empty())
       return numSamples;
-   }
 
    // Remember when we started so we can calculate the amount of latency we
    // are introducing
@@ -337,13 +368,15 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
    // Now call each effect in the chain while swapping buffer pointers to feed the
    // output of one effect as the input to the next effect
    size_t called = 0;
-   for (auto &state : mStates)
+   for (auto &link : *mAudioChain)
    {
-      if (state->IsRealtimeActive())
-      {
-         state->RealtimeProcess(group, chans, ibuf, obuf, numSamples);
-         called++;
-      }
+      // A suspended effect passes the samples as they are, so its buffers
+      // are not swapped
+      if (!link.active)
+         continue;
+
+      link.state->RealtimeProcess(group, chans, ibuf, obuf, numSamples);
+      called++;
 
       for (unsigned int j = 0; j < chans; j++)
       {
@@ -369,8 +402,6 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
    // Remember the latency
    mRealtimeLatency = (int) (wxGetUTCTimeMillis() - start).GetValue();
 
-   mRealtimeLock.Leave();
-
    //
    // This is wrong...needs to handle tails
    //
@@ -382,21 +413,20 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
 //
 void RealtimeEffectManager::RealtimeProcessEnd()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
-
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
-   if (!mRealtimeSuspended)
+   if (!mAudioSuspended && mAudioChain)
    {
-      for (auto &state : mStates)
+      for (auto &link : *mAudioChain)
       {
-         if (state->IsRealtimeActive())
-            state->GetEffect().RealtimeProcessEnd();
+         if (link.active)
+            link.state->GetEffect().RealtimeProcessEnd();
       }
    }
 
-   mRealtimeLock.Leave();
+   // Let the main thread free the chains it replaced
+   mAudioChain = nullptr;
+   ++mProcessCount;
 }
 
 int RealtimeEffectManager::GetRealtimeLatency()
@@ -11,9 +11,10 @@
 #ifndef __SNEEDACITY_REALTIME_EFFECT_MANAGER__
 #define __SNEEDACITY_REALTIME_EFFECT_MANAGER__
 
+#include <atomic>
 #include <memory>
+#include <utility>
 #include <vector>
-#include <wx/thread.h>
 
 class EffectClientInterface;
 class RealtimeEffectState;
@@ -48,10 +49,43 @@ private:
    RealtimeEffectManager();
    ~RealtimeEffectManager();
 
-   wxCriticalSection mRealtimeLock;
+   //! An effect that the audio thread processes, and whether it is active
+   struct Link
+   {
+      RealtimeEffectState *state;
+      bool active;
+   };
+
+   //! The effects that the audio thread processes, in order
+   /*! A chain is never changed after it is published, so the audio thread
+    reads it without locking, and all of a buffer sees the same effects
+    active; the main thread publishes a NEW one instead */
+   using Chain = std::vector<Link>;
+
+   //! Publish a chain of mStates for the audio thread
+   void Publish();
+   //! Wait until the audio thread finishes any buffer that it began before
+   void Synchronize();
+   //! Free the chains that the audio thread can no longer be reading
+   void Reclaim();
+
    std::vector< std::unique_ptr<RealtimeEffectState> > mStates;
-   int mRealtimeLatency;
-   bool mRealtimeSuspended;
+
+   std::atomic<const Chain*> mChain{ nullptr };
+   //! Owns *mChain
+   std::unique_ptr<const Chain> mCurrentChain;
+   //! Chains replaced, each with mProcessCount when it was replaced
+   std::vector< std::pair< std::unique_ptr<const Chain>, unsigned long > >
+      mRetired;
+   //! Incremented by the audio thread at the start and end of each buffer,
+   //! so it is odd while a buffer is processed
+   std::atomic<unsigned long> mProcessCount{ 0 };
+   //! What the audio thread read at the start of the buffer
+   const Chain *mAudioChain{ nullptr };
+   bool mAudioSuspended{ true };
+
+   std::atomic<int> mRealtimeLatency;
+   std::atomic<bool> mRealtimeSuspended;
    bool mRealtimeActive;
    std::vector<unsigned> mRealtimeChans;
    std::vector<double> mRealtimeRates;
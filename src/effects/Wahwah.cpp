@@ -235,6 +235,18 @@ bool EffectWahwah::SetAutomationParameters(CommandParameters & parms)
 
 // Effect implementation
 
+std::unique_ptr<Effect> EffectWahwah::CloneForProcessing()
+{
+   auto clone = std::make_unique<EffectWahwah>();
+   clone->mFreq = mFreq;
+   clone->mPhase = mPhase;
+   clone->mDepth = mDepth;
+   clone->mRes = mRes;
+   clone->mFreqOfs = mFreqOfs;
+   clone->mOutGain = mOutGain;
+   return FinishClone(std::move(clone));
+}
+
 void EffectWahwah::PopulateOrExchange(ShuttleGui & S)
 {
    S.SetBorder(5);
@@ -31,6 +31,8 @@
 
 #include "Export.h"
 
+#include <algorithm>
+
 #include <wx/bmpbuttn.h>
 #include <wx/dcclient.h>
 #include <wx/file.h>
@@ -53,6 +55,7 @@
 
 #include "../src/AllThemeResources.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../prefs/ImportExportPrefs.h"
 #include "../Project.h"
@@ -77,6 +80,9 @@
 // ExportPlugin
 //----------------------------------------------------------------------------
 
+BoolSetting ExportPlugin::PipelinedMixing{
+   L"/Performance/PipelinedExport", true };
+
 ExportPlugin::ExportPlugin()
 {
 }
@@ -186,6 +192,22 @@ bool ExportPlugin::GetCanMetaData(int index)
    return mFormatInfos[index].mCanMetaData;
 }
 
+bool ExportPlugin::CanExportInParallel(int WXUNUSED(index))
+{
+   return false;
+}
+
+void ExportPlugin::SetProgressReporter(ExportProgress::Reporter reporter)
+{
+   mReporter = std::move(reporter);
+}
+
+void ExportPlugin::SetMixerTracks(WaveTrackConstArray tracks)
+{
+   mMixerTracks = std::move(tracks);
+   mHasMixerTracks = true;
+}
+
 bool ExportPlugin::IsExtension(const FileExtension & ext, int index)
 {
    bool isext = false;
@@ -230,12 +252,19 @@ std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
 
    bool anySolo = !(( tracks.Any<const WaveTrack>() + &WaveTrack::GetSolo ).empty());
 
-   auto range = tracks.Any< const WaveTrack >()
-      + (selectionOnly ? &Track::IsSelected : &Track::Any )
-      - ( anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute);
-   for (auto pTrack: range)
-      inputTracks.push_back(
-         pTrack->SharedPointer< const WaveTrack >() );
+   if (mHasMixerTracks) {
+      for (const auto &pTrack : mMixerTracks)
+         if (!(anySolo ? pTrack->GetNotSolo() : pTrack->GetMute()))
+            inputTracks.push_back(pTrack);
+   }
+   else {
+      auto range = tracks.Any< const WaveTrack >()
+         + (selectionOnly ? &Track::IsSelected : &Track::Any )
+         - ( anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute);
+      for (auto pTrack: range)
+         inputTracks.push_back(
+            pTrack->SharedPointer< const WaveTrack >() );
+   }
    // MB: the stop time should not be warped, this was a bug.
    return std::make_unique<Mixer>(inputTracks,
                   // Throw, to stop exporting, if read fails:
@@ -247,9 +276,31 @@ std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
                   true, mixerSpec);
 }
 
-void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+std::unique_ptr<MixerPipeline> ExportPlugin::CreateMixerPipeline(
+         const TrackList &tracks,
+         bool selectionOnly,
+         double startTime, double stopTime,
+         unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
+         double outRate, sampleFormat outFormat,
+         MixerSpec *mixerSpec)
+{
+   auto mixer = CreateMixer(tracks, selectionOnly, startTime, stopTime,
+      numOutChannels, outBufferSize, outInterleaved, outRate, outFormat,
+      mixerSpec);
+   return std::make_unique<MixerPipeline>(std::move(mixer),
+      numOutChannels, outBufferSize, outInterleaved, outFormat,
+      PipelinedMixing.Read());
+}
+
+ExportProgress &ExportPlugin::InitProgress(
+   std::unique_ptr<ProgressDialog> &pDialog,
    const TranslatableString &title, const TranslatableString &message)
 {
+   mProgress.mReporter = mReporter;
+   mProgress.mDialog = nullptr;
+   if (mReporter)
+      return mProgress;
+
    if (!pDialog)
       pDialog = std::make_unique<ProgressDialog>( title, message );
    else {
@@ -257,15 +308,26 @@ void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
       pDialog->SetMessage( message );
       pDialog->Reinit();
    }
+   mProgress.mDialog = pDialog.get();
+   return mProgress;
 }
 
-void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+ExportProgress &ExportPlugin::InitProgress(
+   std::unique_ptr<ProgressDialog> &pDialog,
    const wxFileNameWrapper &title, const TranslatableString &message)
 {
    return InitProgress(
       pDialog, Verbatim( title.GetName() ), message );
 }
 
+ProgressResult ExportProgress::Update(double current, double total)
+{
+   if (mDialog)
+      return mDialog->Update(current, total);
+   const auto permille = total > 0 ? int(current * 1000 / total) : 0;
+   return mReporter(std::max(0, std::min(1000, permille)));
+}
+
 //----------------------------------------------------------------------------
 // Export
 //----------------------------------------------------------------------------
@@ -343,14 +405,17 @@ Exporter::Exporter( SneedacityProject &project )
 
       void Visit( SingleItem &item, const Path &path ) override
       {
-         mPlugins.emplace_back(
-            static_cast<ExporterItem&>( item ).mFactory() );
+         const auto &factory = static_cast<ExporterItem&>( item ).mFactory;
+         mPlugins.emplace_back( factory() );
+         mFactories.push_back( factory );
       }
 
       ExportPluginArray mPlugins;
+      std::vector<ExportPluginFactory> mFactories;
    } visitor;
 
    mPlugins.swap( visitor.mPlugins );
+   mFactories.swap( visitor.mFactories );
 
    SetFileDialogTitle( XO("Export Audio") );
 }
@@ -395,6 +460,11 @@ const ExportPluginArray &Exporter::GetPlugins()
    return mPlugins;
 }
 
+std::unique_ptr<ExportPlugin> Exporter::MakePlugin(int index) const
+{
+   return mFactories[index]();
+}
+
 bool Exporter::DoEditMetadata(SneedacityProject &project,
    const TranslatableString &title,
    const TranslatableString &shortUndoDescription, bool force)
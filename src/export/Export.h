@@ -35,6 +35,8 @@ class MixerSpec;
 class ProgressDialog;
 class ShuttleGui;
 class Mixer;
+class MixerPipeline;
+class BoolSetting;
 using WaveTrackConstArray = std::vector < std::shared_ptr < const WaveTrack > >;
 enum class ProgressResult : unsigned;
 class wxFileNameWrapper;
@@ -58,6 +60,25 @@ class SNEEDACITY_DLL_API FormatInfo
       bool mCanMetaData;
 };
 
+//! Where an exporter reports progress: a ProgressDialog, or a function when
+//! the export runs in a worker thread
+class SNEEDACITY_DLL_API ExportProgress final
+{
+public:
+   //! Receives the permille done, and returns what Update() should
+   /*! Called in the exporting thread */
+   using Reporter = std::function< ProgressResult(int permille) >;
+
+   //! Same as ProgressDialog::Update()
+   ProgressResult Update(double current, double total);
+
+private:
+   friend class ExportPlugin;
+
+   ProgressDialog *mDialog{};
+   Reporter mReporter;
+};
+
 //----------------------------------------------------------------------------
 // ExportPlugin
 //----------------------------------------------------------------------------
@@ -65,6 +86,10 @@ class SNEEDACITY_DLL_API ExportPlugin /* not final */
 {
 public:
 
+   //! Whether exporters mix in another thread, ahead of the encoding
+   /*! Results are the same either way */
+   static BoolSetting PipelinedMixing;
+
    ExportPlugin();
    virtual ~ExportPlugin();
 
@@ -92,6 +117,20 @@ public:
 
    virtual bool IsExtension(const FileExtension & ext, int index);
 
+   //! Whether Export() of the sub-format may run in a worker thread, while
+   //! other objects of the class export other files
+   /*! Such an Export() must not need answers from the user */
+   virtual bool CanExportInParallel(int index);
+
+   //! Make InitProgress() report to the function instead of using a dialog,
+   //! so that Export() may run in a worker thread
+   void SetProgressReporter(ExportProgress::Reporter reporter);
+
+   //! Make CreateMixer() mix these tracks, still minus the muted ones,
+   //! instead of finding them in the project
+   /*! So Export() need not change the selection */
+   void SetMixerTracks(WaveTrackConstArray tracks);
+
    virtual bool DisplayOptions(wxWindow *parent, int format = 0);
    
    virtual void OptionsCreate(ShuttleGui &S, int format) = 0;
@@ -141,14 +180,29 @@ protected:
          double outRate, sampleFormat outFormat,
          MixerSpec *mixerSpec);
 
-   // Create or recycle a dialog.
-   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+   //! Like CreateMixer(), but the mixing runs ahead of the caller's encoding
+   //! in another thread, if PipelinedMixing is set
+   std::unique_ptr<MixerPipeline> CreateMixerPipeline(const TrackList &tracks,
+         bool selectionOnly,
+         double startTime, double stopTime,
+         unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
+         double outRate, sampleFormat outFormat,
+         MixerSpec *mixerSpec);
+
+   // Create or recycle a dialog, unless there is a progress reporter.
+   // Return what to Update().
+   ExportProgress &InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
          const TranslatableString &title, const TranslatableString &message);
-   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+   ExportProgress &InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
          const wxFileNameWrapper &title, const TranslatableString &message);
 
 private:
    std::vector<FormatInfo> mFormatInfos;
+
+   ExportProgress mProgress;
+   ExportProgress::Reporter mReporter;
+   WaveTrackConstArray mMixerTracks;
+   bool mHasMixerTracks{ false };
 };
 
 using ExportPluginArray = std::vector < std::unique_ptr< ExportPlugin > > ;
@@ -201,6 +255,10 @@ public:
 
    const ExportPluginArray &GetPlugins();
 
+   //! A new object of the same class as GetPlugins()[index], so that
+   //! exports may run concurrently
+   std::unique_ptr<ExportPlugin> MakePlugin(int index) const;
+
    // Auto Export from Timer Recording
    bool ProcessFromTimerRecording(bool selectedOnly,
                                   double t0,
@@ -236,6 +294,7 @@ private:
    std::unique_ptr<MixerSpec> mMixerSpec;
 
    ExportPluginArray mPlugins;
+   std::vector<ExportPluginFactory> mFactories;
 
    wxFileName mFilename;
    wxFileName mActualName;
@@ -31,6 +31,7 @@
 #include "Export.h"
 
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../ShuttleGui.h"
 #include "../Tags.h"
@@ -493,7 +494,7 @@ ProgressResult ExportCL::Export(SneedacityProject *project,
 
    // Mix 'em up
    const auto &tracks = TrackList::Get( *project );
-   auto mixer = CreateMixer(
+   auto mixer = CreateMixerPipeline(
                             tracks,
                             selectionOnly,
                             t0,
@@ -516,11 +517,10 @@ ProgressResult ExportCL::Export(SneedacityProject *project,
       } );
 
       // Prepare the progress display
-      InitProgress( pDialog, XO("Export"),
+      auto &progress = InitProgress( pDialog, XO("Export"),
          selectionOnly
             ? XO("Exporting the selected audio using command-line encoder")
             : XO("Exporting the audio using command-line encoder") );
-      auto &progress = *pDialog;
 
       // Start piping the mixed data to the command
       while (updateResult == ProgressResult::Success && process.IsActive() && os->IsOk()) {
@@ -530,7 +530,7 @@ ProgressResult ExportCL::Export(SneedacityProject *project,
 
          // Need to mix another block
          if (numBytes == 0) {
-            auto numSamples = mixer->Process(maxBlockLen);
+            auto numSamples = mixer->Process();
             if (numSamples == 0) {
                break;
             }
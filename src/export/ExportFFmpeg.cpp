@@ -36,6 +36,7 @@ function.
 #include <wx/combobox.h>
 
 #include "Mix.h"
+#include "MixerPipeline.h"
 #include "ProjectSettings.h"
 #include "../Tags.h"
 #include "Track.h"
@@ -1145,23 +1146,22 @@ ProgressResult ExportFFmpeg::Export(SneedacityProject *project,
 
    size_t pcmBufferSize = mDefaultFrameSize;
 
-   auto mixer = CreateMixer(tracks, selectionOnly,
+   auto mixer = CreateMixerPipeline(tracks, selectionOnly,
       t0, t1,
       channels, pcmBufferSize, true,
       mSampleRate, int16Sample, mixerSpec);
 
    auto updateResult = ProgressResult::Success;
    {
-      InitProgress( pDialog, fName,
+      auto &progress = InitProgress( pDialog, fName,
          selectionOnly
             ? XO("Exporting selected audio as %s")
                  .Format( ExportFFmpegOptions::fmts[mSubFormat].description )
             : XO("Exporting the audio as %s")
                  .Format( ExportFFmpegOptions::fmts[mSubFormat].description ) );
-      auto &progress = *pDialog;
 
       while (updateResult == ProgressResult::Success) {
-         auto pcmNumSamples = mixer->Process(pcmBufferSize);
+         auto pcmNumSamples = mixer->Process();
 
          if (pcmNumSamples == 0)
             break;
@@ -32,10 +32,13 @@ and libvorbis examples, Monty <monty@xiph.org>
 #include "../float_cast.h"
 #include "../ProjectSettings.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
+#include "ParallelFLACEncoder.h"
 #include "../Prefs.h"
 #include "../ShuttleGui.h"
 
 #include "../Tags.h"
+#include "../ThreadPool.h"
 #include "../Track.h"
 
 #include "../widgets/SneedacityMessageBox.h"
@@ -116,6 +119,10 @@ ChoiceSetting FLACLevel{
    5 //"5"
 };
 
+//! Whether to encode runs of frames in worker threads
+static BoolSetting FLACParallelEncoding{
+   L"/Performance/ParallelFLACEncoding", true };
+
 ///
 ///
 void ExportFLACOptions::PopulateOrExchange(ShuttleGui & S)
@@ -193,6 +200,37 @@ static struct
    {  true,    false,   true,    false,   0, 0, 6, 0, 12 },
 };
 
+//! Apply the level of compression, and the stream format
+static bool ConfigureEncoder(FLAC::Encoder::Stream &encoder,
+   unsigned numChannels, unsigned sampleRate, unsigned bitsPerSample,
+   long level)
+{
+   bool success =
+   encoder.set_channels(numChannels) &&
+   encoder.set_sample_rate(sampleRate) &&
+   encoder.set_bits_per_sample(bitsPerSample) &&
+   encoder.set_do_exhaustive_model_search(flacLevels[level].do_exhaustive_model_search) &&
+   encoder.set_do_escape_coding(flacLevels[level].do_escape_coding);
+
+   if (numChannels != 2) {
+      success = success &&
+      encoder.set_do_mid_side_stereo(false) &&
+      encoder.set_loose_mid_side_stereo(false);
+   }
+   else {
+      success = success &&
+      encoder.set_do_mid_side_stereo(flacLevels[level].do_mid_side_stereo) &&
+      encoder.set_loose_mid_side_stereo(flacLevels[level].loose_mid_side_stereo);
+   }
+
+   return success &&
+   encoder.set_qlp_coeff_precision(flacLevels[level].qlp_coeff_precision) &&
+   encoder.set_min_residual_partition_order(flacLevels[level].min_residual_partition_order) &&
+   encoder.set_max_residual_partition_order(flacLevels[level].max_residual_partition_order) &&
+   encoder.set_rice_parameter_search_dist(flacLevels[level].rice_parameter_search_dist) &&
+   encoder.set_max_lpc_order(flacLevels[level].max_lpc_order);
+}
+
 //----------------------------------------------------------------------------
 
 struct FLAC__StreamMetadataDeleter {
@@ -223,6 +261,8 @@ public:
                const Tags *metadata = NULL,
                int subformat = 0) override;
 
+   bool CanExportInParallel(int) override { return true; }
+
 private:
 
    bool GetMetadata(SneedacityProject *project, const Tags *tags);
@@ -269,13 +309,28 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
 
    FLAC::Encoder::File encoder;
 
+   sampleFormat format;
+   unsigned bitsPerSample;
+   if (bitDepthPref == wxT("24")) {
+      format = int24Sample;
+      bitsPerSample = 24;
+   } else { //convert float to 16 bits
+      format = int16Sample;
+      bitsPerSample = 16;
+   }
+
+   // Duplicate the flac command line compression levels
+   if (levelPref < 0 || levelPref > 8) {
+      levelPref = 5;
+   }
+
+   const unsigned sampleRate = lrint(rate);
    bool success = true;
    success = success &&
 #ifdef LEGACY_FLAC
    encoder.set_filename(OSOUTPUT(fName)) &&
 #endif
-   encoder.set_channels(numChannels) &&
-   encoder.set_sample_rate(lrint(rate));
+   ConfigureEncoder(encoder, numChannels, sampleRate, bitsPerSample, levelPref);
 
    // See note in GetMetadata() about a bug in libflac++ 1.1.2
    if (success && !GetMetadata(project, metadata)) {
@@ -295,42 +350,6 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
       mMetadata.reset(); // need this?
    } );
 
-   sampleFormat format;
-   if (bitDepthPref == wxT("24")) {
-      format = int24Sample;
-      success = success && encoder.set_bits_per_sample(24);
-   } else { //convert float to 16 bits
-      format = int16Sample;
-      success = success && encoder.set_bits_per_sample(16);
-   }
-
-
-   // Duplicate the flac command line compression levels
-   if (levelPref < 0 || levelPref > 8) {
-      levelPref = 5;
-   }
-   success = success &&
-   encoder.set_do_exhaustive_model_search(flacLevels[levelPref].do_exhaustive_model_search) &&
-   encoder.set_do_escape_coding(flacLevels[levelPref].do_escape_coding);
-
-   if (numChannels != 2) {
-      success = success &&
-      encoder.set_do_mid_side_stereo(false) &&
-      encoder.set_loose_mid_side_stereo(false);
-   }
-   else {
-      success = success &&
-      encoder.set_do_mid_side_stereo(flacLevels[levelPref].do_mid_side_stereo) &&
-      encoder.set_loose_mid_side_stereo(flacLevels[levelPref].loose_mid_side_stereo);
-   }
-
-   success = success &&
-   encoder.set_qlp_coeff_precision(flacLevels[levelPref].qlp_coeff_precision) &&
-   encoder.set_min_residual_partition_order(flacLevels[levelPref].min_residual_partition_order) &&
-   encoder.set_max_residual_partition_order(flacLevels[levelPref].max_residual_partition_order) &&
-   encoder.set_rice_parameter_search_dist(flacLevels[levelPref].rice_parameter_search_dist) &&
-   encoder.set_max_lpc_order(flacLevels[levelPref].max_lpc_order);
-
    if (!success) {
       // TODO: more precise message
       ShowExportErrorDialog("FLAC:336");
@@ -371,21 +390,34 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
       }
    } );
 
-   auto mixer = CreateMixer(tracks, selectionOnly,
+   auto mixer = CreateMixerPipeline(tracks, selectionOnly,
                             t0, t1,
                             numChannels, SAMPLES_PER_RUN, false,
                             rate, format, mixerSpec);
 
    ArraysOf<FLAC__int32> tmpsmplbuf{ numChannels, SAMPLES_PER_RUN, true };
 
-   InitProgress( pDialog, fName,
+   // Once the encoder has written the header, frames may be encoded by
+   // others
+   std::unique_ptr<ParallelFLACEncoder> pParallel;
+#ifndef LEGACY_FLAC
+   if (FLACParallelEncoding.Read() && ThreadPool::Get().GetThreadCount() > 0)
+      pParallel = std::make_unique<ParallelFLACEncoder>(
+         f.fp(), numChannels, bitsPerSample, sampleRate,
+         encoder.get_blocksize(),
+         [=](FLAC::Encoder::Stream &runEncoder){
+            return ConfigureEncoder(runEncoder,
+               numChannels, sampleRate, bitsPerSample, levelPref);
+         });
+#endif
+
+   auto &progress = InitProgress( pDialog, fName,
       selectionOnly
          ? XO("Exporting the selected audio as FLAC")
          : XO("Exporting the audio as FLAC") );
-   auto &progress = *pDialog;
 
    while (updateResult == ProgressResult::Success) {
-      auto samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
+      auto samplesThisRun = mixer->Process();
       if (samplesThisRun == 0) { //stop encoding
          break;
       }
@@ -403,9 +435,11 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
                }
             }
          }
-         if (! encoder.process(
-               reinterpret_cast<FLAC__int32**>( tmpsmplbuf.get() ),
-               samplesThisRun) ) {
+         const auto buffers =
+            reinterpret_cast<FLAC__int32**>( tmpsmplbuf.get() );
+         if (! (pParallel
+               ? pParallel->Process(buffers, samplesThisRun)
+               : encoder.process(buffers, samplesThisRun)) ) {
             // TODO: more precise message
             ShowDiskFullExportErrorDialog(fName);
             updateResult = ProgressResult::Cancelled;
@@ -417,6 +451,15 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
       }
    }
 
+   if (pParallel &&
+       (updateResult == ProgressResult::Success ||
+        updateResult == ProgressResult::Stopped) &&
+       !pParallel->Flush()) {
+      // TODO: more precise message
+      ShowDiskFullExportErrorDialog(fName);
+      updateResult = ProgressResult::Cancelled;
+   }
+
    if (updateResult == ProgressResult::Success ||
        updateResult == ProgressResult::Stopped) {
 #ifndef LEGACY_FLAC
@@ -425,6 +468,11 @@ ProgressResult ExportFLAC::Export(SneedacityProject *project,
       if (!encoder.finish())
          // Do not reassign updateResult, see cleanup2
          return ProgressResult::Failed;
+#ifndef LEGACY_FLAC
+      // The encoder saw no samples when the frames were parallel
+      if (pParallel && !pParallel->PatchStreamInfo(path))
+         return ProgressResult::Failed;
+#endif
 #ifdef LEGACY_FLAC
       if (!f.Flush() || !f.Close())
          return ProgressResult::Failed;
@@ -49,6 +49,7 @@
 #include "Export.h"
 #include "../FileIO.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../ProjectSettings.h"
 #include "../ShuttleGui.h"
@@ -220,6 +221,8 @@ public:
                const Tags *metadata = NULL,
                int subformat = 0) override;
 
+   bool CanExportInParallel(int) override { return true; }
+
 private:
 
    int AddTags(SneedacityProject *project, ArrayOf<char> &buffer, bool *endOfFile, const Tags *tags);
@@ -305,21 +308,20 @@ ProgressResult ExportMP2::Export(SneedacityProject *project,
 
    auto updateResult = ProgressResult::Success;
    {
-      auto mixer = CreateMixer(tracks, selectionOnly,
+      auto mixer = CreateMixerPipeline(tracks, selectionOnly,
          t0, t1,
          stereo ? 2 : 1, pcmBufferSize, true,
          rate, int16Sample, mixerSpec);
 
-      InitProgress( pDialog, fName,
+      auto &progress = InitProgress( pDialog, fName,
          selectionOnly
             ? XO("Exporting selected audio at %ld kbps")
                  .Format( bitrate )
             : XO("Exporting the audio at %ld kbps")
                  .Format( bitrate ) );
-      auto &progress = *pDialog;
 
       while (updateResult == ProgressResult::Success) {
-         auto pcmNumSamples = mixer->Process(pcmBufferSize);
+         auto pcmNumSamples = mixer->Process();
 
          if (pcmNumSamples == 0)
             break;
@@ -82,6 +82,7 @@
 #include "../FileNames.h"
 #include "../float_cast.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../ProjectSettings.h"
 #include "../ProjectWindow.h"
@@ -1917,7 +1918,7 @@ ProgressResult ExportMP3::Export(SneedacityProject *project,
    wxASSERT(buffer);
 
    {
-      auto mixer = CreateMixer(tracks, selectionOnly,
+      auto mixer = CreateMixerPipeline(tracks, selectionOnly,
          t0, t1,
          channels, inSamples, true,
          rate, floatSample, mixerSpec);
@@ -1942,11 +1943,10 @@ ProgressResult ExportMP3::Export(SneedacityProject *project,
                .Format( bitrate );
       }
 
-      InitProgress( pDialog, fName, title );
-      auto &progress = *pDialog;
+      auto &progress = InitProgress( pDialog, fName, title );
 
       while (updateResult == ProgressResult::Success) {
-         auto blockLen = mixer->Process(inSamples);
+         auto blockLen = mixer->Process();
 
          if (blockLen == 0) {
             break;
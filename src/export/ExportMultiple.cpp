@@ -37,6 +37,11 @@
 #include <wx/textctrl.h>
 #include <wx/textdlg.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+
 #include "../FileNames.h"
 #include "../LabelTrack.h"
 #include "../Project.h"
@@ -46,6 +51,7 @@
 #include "../SelectionState.h"
 #include "../ShuttleGui.h"
 #include "../Tags.h"
+#include "../ThreadPool.h"
 #include "../WaveTrack.h"
 #include "../widgets/HelpSystem.h"
 #include "../widgets/SneedacityMessageBox.h"
@@ -53,27 +59,26 @@
 #include "../widgets/ProgressDialog.h"
 
 
-namespace {
 /** \brief A private class used to store the information needed to do an
     * export.
     *
     * We create a set of these during the interactive phase of the export
     * cycle, then use them when the actual exports are done. */
-   class ExportKit
+   class ExportMultipleDialog::ExportKit
    {
    public:
       Tags filetags; /**< The set of metadata to use for the export */
       wxFileNameWrapper destfile; /**< The file to export to */
       double t0;           /**< Start time for the export */
       double t1;           /**< End time for the export */
-      unsigned channels;   /**< Number of channels for ExportMultipleByTrack */
+      unsigned channels;   /**< Number of channels */
+      WaveTrackConstArray tracks; /**< Channels to mix for ExportMultipleByTrack */
    };  // end of ExportKit declaration
    /* we are going to want an set of these kits, and don't know how many until
     * runtime. I would dearly like to use a std::vector, but it seems that
     * this isn't done anywhere else in Sneedacity, presumably for a reason?, so
     * I'm stuck with wxArrays, which are much harder, as well as non-standard.
     */
-}
 
 /* define our dynamic array of export settings */
 
@@ -125,6 +130,9 @@ BEGIN_EVENT_TABLE(MouseEvtHandler, wxEvtHandler)
    EVT_LEFT_DCLICK(MouseEvtHandler::OnMouse)
 END_EVENT_TABLE()
 
+BoolSetting ExportMultipleDialog::ParallelExport{
+   L"/Performance/ParallelExportMultiple", true };
+
 ExportMultipleDialog::ExportMultipleDialog(SneedacityProject *project)
 : wxDialogWrapper( &GetProjectFrame( *project ),
    wxID_ANY, XO("Export Multiple") )
@@ -766,6 +774,7 @@ ProgressResult ExportMultipleDialog::ExportMultipleByLabel(bool byName,
    FilePaths otherNames;  // keep track of file names we will use, so we
    // don't duplicate them
    ExportKit setting;   // the current batch of settings
+   setting.channels = channels;
    setting.destfile.SetPath(mDir->GetValue());
    setting.destfile.SetExt(mPlugins[mPluginIndex]->GetExtension(mSubFormatIndex));
    wxLogDebug(wxT("Plug-in index = %d, Sub-format = %d"), mPluginIndex, mSubFormatIndex);
@@ -864,6 +873,9 @@ ProgressResult ExportMultipleDialog::ExportMultipleByLabel(bool byName,
       l++;  // next label, count up one
    }
 
+   if (CanExportInParallel(exportSettings))
+      return DoExportsInParallel(exportSettings, false);
+
    auto ok = ProgressResult::Success;   // did it work?
    int count = 0; // count the number of successful runs
    ExportKit activeSetting;  // pointer to the settings in use for this export
@@ -942,6 +954,11 @@ ProgressResult ExportMultipleDialog::ExportMultipleByTrack(bool byName,
                   tr->GetPan() == 0.0))
          setting.channels = 2;
 
+      setting.tracks.clear();
+      for (auto channel : channels)
+         setting.tracks.push_back(
+            channel->SharedPointer< const WaveTrack >() );
+
       // Get name and title
       title = tr->GetName();
       if( title.empty() )
@@ -1008,6 +1025,9 @@ ProgressResult ExportMultipleDialog::ExportMultipleByTrack(bool byName,
    }
    // end of user-interactive data gathering loop, start of export processing
    // loop
+   if (CanExportInParallel(exportSettings))
+      return DoExportsInParallel(exportSettings, true);
+
    int count = 0; // count the number of successful runs
    ExportKit activeSetting;  // pointer to the settings in use for this export
    std::unique_ptr<ProgressDialog> pDialog;
@@ -1073,6 +1093,164 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
       wxLogDebug(wxT("Whole Project"));
 
    wxFileName backup;
+   // Earlier files of the set exist already
+   FilePaths claimed;
+   name = ChooseExportFile(inName, claimed, backup);
+
+   ProgressResult success = ProgressResult::Cancelled;
+   const wxString fullPath{name.GetFullPath()};
+
+   auto cleanup = finally( [&] {
+      FinishExportFile(success, fullPath, backup);
+   } );
+
+   // Call the format export routine
+   success = mPlugins[mPluginIndex]->Export(mProject,
+                                            pDialog,
+                                                channels,
+                                                fullPath,
+                                                selectedOnly,
+                                                t0,
+                                                t1,
+                                                NULL,
+                                                &tags,
+                                                mSubFormatIndex);
+
+   Refresh();
+   Update();
+
+   return success;
+}
+
+bool ExportMultipleDialog::CanExportInParallel(
+   const std::vector<ExportKit> &kits)
+{
+   const auto nFiles = std::count_if(kits.begin(), kits.end(),
+      [](const ExportKit &kit){ return !kit.destfile.GetName().empty(); });
+   return nFiles > 1 &&
+      ThreadPool::Get().GetThreadCount() > 0 &&
+      ParallelExport.Read() &&
+      mPlugins[mPluginIndex]->CanExportInParallel(mSubFormatIndex);
+}
+
+ProgressResult ExportMultipleDialog::DoExportsInParallel(
+   const std::vector<ExportKit> &kits, bool selectedOnly)
+{
+   struct Job {
+      const ExportKit *kit{};
+      std::unique_ptr<ExportPlugin> plugin;
+      wxFileName name;
+      wxFileName backup;
+      double weight{ 0 };
+      std::atomic<int> permille{ 0 };
+      ProgressResult result{ ProgressResult::Cancelled };
+      bool started{ false };
+      std::future<void> done;
+   };
+   std::vector<Job> jobs(std::count_if(kits.begin(), kits.end(),
+      [](const ExportKit &kit){ return !kit.destfile.GetName().empty(); }));
+   std::atomic<ProgressResult> stop{ ProgressResult::Success };
+
+   // Settle all the names here, in order, as DoExport() would one file after
+   // another; and make the plug-in objects here, where they may consult
+   // preferences
+   FilePaths claimed;
+   double totalTime = 0;
+   auto pJob = jobs.begin();
+   for (const auto &kit : kits) {
+      // Bug 1440 fix.
+      if (kit.destfile.GetName().empty())
+         continue;
+      auto &job = *pJob++;
+      job.kit = &kit;
+      job.name = ChooseExportFile(kit.destfile, claimed, job.backup);
+      job.plugin = mExporter.MakePlugin(mPluginIndex);
+      if (selectedOnly)
+         job.plugin->SetMixerTracks(kit.tracks);
+      job.plugin->SetProgressReporter([&job, &stop](int permille){
+         job.permille = permille;
+         return stop.load();
+      });
+      totalTime += std::max(0.0, kit.t1 - kit.t0);
+   }
+   for (auto &job : jobs)
+      job.weight = totalTime > 0
+         ? std::max(0.0, job.kit->t1 - job.kit->t0) / totalTime
+         : 1.0 / jobs.size();
+
+   {
+      ThreadPool pool{
+         std::min(jobs.size(), ThreadPool::Get().GetThreadCount()) };
+      for (auto &job : jobs)
+         job.done = pool.Submit([&]{
+            if ((job.result = stop) != ProgressResult::Success)
+               return;
+            job.started = true;
+            const auto &kit = *job.kit;
+            // Given a reporter, the plug-in makes no dialog
+            std::unique_ptr<ProgressDialog> pDialog;
+            job.result = job.plugin->Export(mProject, pDialog,
+               kit.channels, job.name.GetFullPath(), selectedOnly,
+               kit.t0, kit.t1, nullptr, &kit.filetags, mSubFormatIndex);
+         });
+
+      // Only this thread may update the dialog; wait for all the jobs, which
+      // use these local variables, before rethrowing any exception
+      ProgressDialog progress( XO("Export Multiple"),
+         XO("Exporting %lld files").Format( (long long) jobs.size() ) );
+      for (auto &job : jobs)
+         while (job.done.wait_for(std::chrono::milliseconds(100)) ==
+                std::future_status::timeout) {
+            double done = 0;
+            for (auto &other : jobs)
+               done += other.permille * other.weight;
+            auto result = progress.Update(done, 1000.0);
+            if (result != ProgressResult::Success)
+               stop = result;
+         }
+   }
+
+   // Keep or discard the files in order, as DoExport() would
+   auto ok = ProgressResult::Success;
+   std::exception_ptr exception;
+   for (auto &job : jobs) {
+      try {
+         job.done.get();
+      }
+      catch (...) {
+         if (!exception)
+            exception = std::current_exception();
+         job.result = ProgressResult::Failed;
+      }
+      if (!job.started)
+         // Stopped or cancelled before it began; no file to keep
+         job.result = ProgressResult::Cancelled;
+      FinishExportFile(job.result, job.name.GetFullPath(), job.backup);
+
+      if (ok == ProgressResult::Success && job.started &&
+          job.result != ProgressResult::Success)
+         ok = job.result;
+   }
+   if (ok == ProgressResult::Success)
+      ok = stop;
+
+   Refresh();
+   Update();
+
+   if (exception)
+      std::rethrow_exception(exception);
+   return ok;
+}
+
+wxFileName ExportMultipleDialog::ChooseExportFile(
+   const wxFileName &inName, FilePaths &claimed, wxFileName &backup)
+{
+   const auto isTaken = [&](const wxFileName &fn){
+      return fn.FileExists() ||
+         make_iterator_range(claimed).contains(fn.GetFullPath());
+   };
+
+   wxFileName name;
    if (mOverwrite->GetValue()) {
       name = inName;
       backup.Assign(name);
@@ -1083,62 +1261,46 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
                            wxString::Format(wxT("%d"), suffix));
          ++suffix;
       }
-      while (backup.FileExists());
+      while (isTaken(backup));
       ::wxRenameFile(inName.GetFullPath(), backup.GetFullPath());
    }
    else {
       name = inName;
       int i = 2;
       wxString base(name.GetName());
-      while (name.FileExists()) {
+      while (isTaken(name)) {
          name.SetName(wxString::Format(wxT("%s-%d"), base, i++));
       }
    }
 
-   ProgressResult success = ProgressResult::Cancelled;
-   const wxString fullPath{name.GetFullPath()};
+   claimed.push_back(name.GetFullPath());
+   return name;
+}
 
-   auto cleanup = finally( [&] {
-      bool ok =
-         success == ProgressResult::Stopped ||
-         success == ProgressResult::Success;
-      if (backup.IsOk()) {
-         if ( ok )
-            // Remove backup
-            ::wxRemoveFile(backup.GetFullPath());
-         else {
-            // Restore original
-            ::wxRemoveFile(fullPath);
-            ::wxRenameFile(backup.GetFullPath(), fullPath);
-         }
-      }
+void ExportMultipleDialog::FinishExportFile(ProgressResult result,
+   const wxString &fullPath, const wxFileName &backup)
+{
+   bool ok =
+      result == ProgressResult::Stopped ||
+      result == ProgressResult::Success;
+   if (backup.IsOk()) {
+      if ( ok )
+         // Remove backup
+         ::wxRemoveFile(backup.GetFullPath());
       else {
-         if ( ! ok )
-            // Remove any new, and only partially written, file.
-            ::wxRemoveFile(fullPath);
+         // Restore original
+         ::wxRemoveFile(fullPath);
+         ::wxRenameFile(backup.GetFullPath(), fullPath);
       }
-   } );
-
-   // Call the format export routine
-   success = mPlugins[mPluginIndex]->Export(mProject,
-                                            pDialog,
-                                                channels,
-                                                fullPath,
-                                                selectedOnly,
-                                                t0,
-                                                t1,
-                                                NULL,
-                                                &tags,
-                                                mSubFormatIndex);
-
-   if (success == ProgressResult::Success || success == ProgressResult::Stopped) {
-      mExported.push_back(fullPath);
+   }
+   else {
+      if ( ! ok )
+         // Remove any new, and only partially written, file.
+         ::wxRemoveFile(fullPath);
    }
 
-   Refresh();
-   Update();
-
-   return success;
+   if (ok)
+      mExported.push_back(fullPath);
 }
 
 wxString ExportMultipleDialog::MakeFileName(const wxString &input)
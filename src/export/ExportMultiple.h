@@ -23,6 +23,7 @@ class wxSimplebook;
 class wxStaticText;
 class wxTextCtrl;
 
+class BoolSetting;
 class SneedacityProject;
 class LabelTrack;
 class SelectionState;
@@ -33,12 +34,17 @@ class SNEEDACITY_DLL_API ExportMultipleDialog final : public wxDialogWrapper
 {
 public:
 
+   //! Whether to export several files at once in worker threads, when the
+   //! format allows
+   static BoolSetting ParallelExport;
+
    ExportMultipleDialog(SneedacityProject *parent);
    virtual ~ExportMultipleDialog();
 
    int ShowModal();
 
 private:
+   class ExportKit;
 
    // Export
    void CanExport();
@@ -79,6 +85,32 @@ private:
                  double t0,
                  double t1,
                  const Tags &tags);
+
+   //! Whether DoExportsInParallel() may export this set
+   bool CanExportInParallel(const std::vector<ExportKit> &kits);
+
+   /** Export all files of an export multiple set concurrently
+    *
+    * Each file exports in a worker thread with its own plug-in object, and
+    * one progress dialog shows them all.  The files are named as by DoExport()
+    * one after another.
+    * @param selectedOnly Whether kits give the tracks to export; else, export
+    * the whole project */
+   ProgressResult DoExportsInParallel(
+      const std::vector<ExportKit> &kits, bool selectedOnly);
+
+   /** Choose the file to export to, moving aside any file it replaces
+    * @param claimed Paths that other files of the set will use, and so not to
+    * be chosen; the choice is added
+    * @param backup Set to where the replaced file went, if there was one */
+   wxFileName ChooseExportFile(
+      const wxFileName &inName, FilePaths &claimed, wxFileName &backup);
+
+   //! Keep the exported file, or remove a partial one and restore any file
+   //! it replaced
+   void FinishExportFile(ProgressResult result,
+      const wxString &fullPath, const wxFileName &backup);
+
    /** \brief Takes an arbitrary text string and converts it to a form that can
     * be used as a file name, if necessary prompting the user to edit the file
     * name produced */
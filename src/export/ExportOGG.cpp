@@ -30,6 +30,7 @@
 #include "../FileIO.h"
 #include "../ProjectSettings.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../ShuttleGui.h"
 
@@ -144,6 +145,8 @@ public:
                const Tags *metadata = NULL,
                int subformat = 0) override;
 
+   bool CanExportInParallel(int) override { return true; }
+
 private:
 
    bool FillComment(SneedacityProject *project, vorbis_comment *comment, const Tags *metadata);
@@ -276,20 +279,19 @@ ProgressResult ExportOGG::Export(SneedacityProject *project,
    }
 
    {
-      auto mixer = CreateMixer(tracks, selectionOnly,
+      auto mixer = CreateMixerPipeline(tracks, selectionOnly,
          t0, t1,
          numChannels, SAMPLES_PER_RUN, false,
          rate, floatSample, mixerSpec);
 
-      InitProgress( pDialog, fName,
+      auto &progress = InitProgress( pDialog, fName,
          selectionOnly
             ? XO("Exporting the selected audio as Ogg Vorbis")
             : XO("Exporting the audio as Ogg Vorbis") );
-      auto &progress = *pDialog;
 
       while (updateResult == ProgressResult::Success && !eos) {
          float **vorbis_buffer = vorbis_analysis_buffer(&dsp, SAMPLES_PER_RUN);
-         auto samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
+         auto samplesThisRun = mixer->Process();
 
          int err;
          if (samplesThisRun == 0) {
@@ -25,6 +25,7 @@
 
 #include "../FileFormats.h"
 #include "../Mix.h"
+#include "MixerPipeline.h"
 #include "../Prefs.h"
 #include "../ProjectSettings.h"
 #include "../ShuttleGui.h"
@@ -400,6 +401,7 @@ public:
    wxString GetFormat(int index) override;
    FileExtension GetExtension(int index) override;
    unsigned GetMaxChannels(int index) override;
+   bool CanExportInParallel(int) override { return true; }
 
 private:
    void ReportTooBigError(wxWindow * pParent);
@@ -616,21 +618,20 @@ ProgressResult ExportPCM::Export(SneedacityProject *project,
          }
 
          wxASSERT(info.channels >= 0);
-         auto mixer = CreateMixer(tracks, selectionOnly,
+         auto mixer = CreateMixerPipeline(tracks, selectionOnly,
                                   t0, t1,
                                   info.channels, maxBlockLen, true,
                                   rate, format, mixerSpec);
 
-         InitProgress( pDialog, fName,
+         auto &progress = InitProgress( pDialog, fName,
             (selectionOnly
                ? XO("Exporting the selected audio as %s")
                : XO("Exporting the audio as %s"))
                .Format( formatStr ) );
-         auto &progress = *pDialog;
 
          while (updateResult == ProgressResult::Success) {
             sf_count_t samplesWritten;
-            size_t numSamples = mixer->Process(maxBlockLen);
+            size_t numSamples = mixer->Process();
 
             if (numSamples == 0)
                break;
@@ -0,0 +1,148 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file MixerPipeline.cpp
+@brief Implements MixerPipeline
+
+**********************************************************************/
+
+#include "MixerPipeline.h"
+
+#include <cstring>
+#include <new>
+
+#include "../Mix.h"
+#include "../ThreadPool.h"
+
+namespace {
+//! Enough for the mixer to run ahead by one buffer while the encoder holds
+//! another, with one more to absorb uneven times
+constexpr size_t QueueLength = 3;
+}
+
+MixerPipeline::MixerPipeline(std::unique_ptr<Mixer> mixer,
+   unsigned numChannels, size_t bufferSize, bool interleaved,
+   sampleFormat format, bool pipelined)
+   : mMixer{ std::move(mixer) }
+   , mNumBuffers{ interleaved ? 1 : numChannels }
+   , mBufferSize{ bufferSize }
+   , mFormat{ format }
+   , mBufferSamples{ (interleaved ? numChannels : 1) * bufferSize }
+{
+   if (!pipelined)
+      return;
+
+   mSlots.resize(QueueLength);
+   for (auto &slot : mSlots) {
+      slot.buffers.reinit(mNumBuffers);
+      for (unsigned ii = 0; ii < mNumBuffers; ++ii)
+         if (!slot.buffers[ii].Allocate(mBufferSamples, mFormat).ptr())
+            throw std::bad_alloc{};
+   }
+
+   // A thread of its own, because the producer blocks while the queue is
+   // full, and Mixer::Process() may use the shared pool
+   mThread = std::make_unique<ThreadPool>(1);
+   mProducer = mThread->Submit([this]{ Produce(); });
+}
+
+MixerPipeline::~MixerPipeline()
+{
+   if (mProducer.valid()) {
+      {
+         std::lock_guard<std::mutex> guard(mMutex);
+         mStop = true;
+         mCondition.notify_all();
+      }
+      // The producer uses the mixer and the slots
+      mProducer.wait();
+   }
+}
+
+size_t MixerPipeline::Process()
+{
+   if (mSlots.empty())
+      return mMixer->Process(mBufferSize);
+
+   std::unique_lock<std::mutex> lock(mMutex);
+   if (mHolding) {
+      // Give the previous slot back to the producer
+      mHolding = false;
+      mHead = (mHead + 1) % mSlots.size();
+      --mFilled;
+      mCondition.notify_all();
+   }
+   mCondition.wait(lock, [this]{ return mFilled > 0 || mDone; });
+
+   if (mFilled == 0) {
+      lock.unlock();
+      if (mProducer.valid()) {
+         // Rethrow what the mixer threw, if anything, once
+         auto producer = std::move(mProducer);
+         producer.get();
+      }
+      return 0;
+   }
+
+   const auto &slot = mSlots[mHead];
+   mHolding = true;
+   mTime = slot.time;
+   return slot.count;
+}
+
+double MixerPipeline::MixGetCurrentTime()
+{
+   return mSlots.empty() ? mMixer->MixGetCurrentTime() : mTime;
+}
+
+samplePtr MixerPipeline::GetBuffer()
+{
+   return GetBuffer(0);
+}
+
+samplePtr MixerPipeline::GetBuffer(int channel)
+{
+   if (mSlots.empty())
+      return mMixer->GetBuffer(channel);
+   wxASSERT(mHolding);
+   return mSlots[mHead].buffers[channel].ptr();
+}
+
+void MixerPipeline::Produce()
+{
+   auto cleanup = finally([this]{
+      std::lock_guard<std::mutex> guard(mMutex);
+      mDone = true;
+      mCondition.notify_all();
+   });
+
+   while (true) {
+      // Mix before waiting for room, so that one more buffer is ready
+      const auto count = mMixer->Process(mBufferSize);
+      if (count == 0)
+         return;
+
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock,
+            [this]{ return mStop || mFilled < mSlots.size(); });
+         if (mStop)
+            return;
+      }
+
+      // This slot is not in the queue, so only the producer touches it
+      auto &slot = mSlots[mTail];
+      const auto bytes =
+         count * (mBufferSamples / mBufferSize) * SAMPLE_SIZE(mFormat);
+      for (unsigned ii = 0; ii < mNumBuffers; ++ii)
+         memcpy(slot.buffers[ii].ptr(), mMixer->GetBuffer(ii), bytes);
+      slot.count = count;
+      slot.time = mMixer->MixGetCurrentTime();
+      mTail = (mTail + 1) % mSlots.size();
+
+      std::lock_guard<std::mutex> guard(mMutex);
+      ++mFilled;
+      mCondition.notify_all();
+   }
+}
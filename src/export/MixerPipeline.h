@@ -0,0 +1,102 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file MixerPipeline.h
+@brief Run the Mixer of an export ahead of the encoder, in another thread
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_MIXER_PIPELINE__
+#define __SNEEDACITY_MIXER_PIPELINE__
+
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MemoryX.h"
+#include "../SampleFormat.h"
+
+class Mixer;
+class ThreadPool;
+
+//! Gives an exporter the output of a Mixer, one buffer at a time
+/*! When pipelined, a thread of its own mixes into a bounded queue of
+ buffers, while the exporter encodes earlier buffers in the calling thread.
+ So a long export takes about the longer of the mixing and the encoding
+ times, not their sum.  Otherwise, the Mixer runs in the calling thread.
+
+ The results are the same either way.  The interface mirrors that part of
+ Mixer which the exporters use. */
+class SNEEDACITY_DLL_API MixerPipeline final
+{
+public:
+   //! Mixer was made with the other arguments, which describe its buffers
+   MixerPipeline(std::unique_ptr<Mixer> mixer,
+      unsigned numChannels, size_t bufferSize, bool interleaved,
+      sampleFormat format, bool pipelined);
+
+   //! Stops the mixing thread, ignoring its exceptions
+   ~MixerPipeline();
+
+   MixerPipeline(const MixerPipeline&) = delete;
+   MixerPipeline &operator=(const MixerPipeline&) = delete;
+
+   //! Mix up to the buffer size of samples, to be retrieved by GetBuffer()
+   /*! Buffers from the previous call are no longer valid.
+    @return number of samples, or 0 when there are no more
+    @throws what Mixer::Process() threw, perhaps in the other thread */
+   size_t Process();
+
+   //! Time the Mixer reached, at the end of the samples of Process()
+   double MixGetCurrentTime();
+
+   //! The interleaved buffer, or the first channel
+   samplePtr GetBuffer();
+
+   //! One of the non-interleaved buffers
+   samplePtr GetBuffer(int channel);
+
+private:
+   //! One place in the queue, with a copy of each buffer of the Mixer
+   struct Slot {
+      ArrayOf<SampleBuffer> buffers;
+      size_t count{ 0 };
+      double time{ 0 };
+   };
+
+   void Produce();
+
+   const std::unique_ptr<Mixer> mMixer;
+   const unsigned mNumBuffers;
+   const size_t mBufferSize;
+   const sampleFormat mFormat;
+   //! Samples in each buffer, of all channels if interleaved
+   const size_t mBufferSamples;
+
+   //! Empty unless pipelined
+   std::vector<Slot> mSlots;
+
+   //! Slot the consumer holds, or will take next; first of the queue
+   size_t mHead{ 0 };
+   //! Slot the producer fills next; its own
+   size_t mTail{ 0 };
+   //! Time of the slot the consumer holds
+   double mTime{ 0 };
+   bool mHolding{ false };
+
+   //! Guard the following
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   //! Number of queued slots, including the one the consumer holds
+   size_t mFilled{ 0 };
+   bool mStop{ false };
+   bool mDone{ false };
+
+   std::unique_ptr<ThreadPool> mThread;
+   std::future<void> mProducer;
+};
+
+#endif
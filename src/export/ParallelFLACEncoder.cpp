@@ -0,0 +1,450 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ParallelFLACEncoder.cpp
+@brief Implements ParallelFLACEncoder
+
+**********************************************************************/
+
+#ifdef USE_LIBFLAC
+
+#include "ParallelFLACEncoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <wx/ffile.h>
+
+#include "FLAC++/encoder.h"
+
+#include "MemoryX.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+//! Aim for runs of about this many samples, long enough that starting an
+//! encoder for each costs little
+constexpr size_t RunSamples = 65536;
+
+//! Bytes of the STREAMINFO block, and where it starts, after "fLaC" and
+//! the block header
+constexpr size_t StreamInfoSize = 34;
+constexpr size_t StreamInfoOffset = 8;
+
+FLAC__byte CRC8(const FLAC__byte *data, size_t size)
+{
+   // Polynomial x^8 + x^2 + x + 1; frame headers are short
+   unsigned crc = 0;
+   while (size--) {
+      crc ^= *data++;
+      for (int bit = 0; bit < 8; ++bit)
+         crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF;
+   }
+   return crc;
+}
+
+FLAC__uint16 CRC16(const FLAC__byte *data, size_t size)
+{
+   // Polynomial x^16 + x^15 + x^2 + 1, by table, for whole frames
+   static const auto table = []{
+      std::array<FLAC__uint16, 256> result;
+      for (unsigned ii = 0; ii < 256; ++ii) {
+         unsigned crc = ii << 8;
+         for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+         result[ii] = crc & 0xFFFF;
+      }
+      return result;
+   }();
+
+   unsigned crc = 0;
+   while (size--)
+      crc = ((crc << 8) ^ table[(crc >> 8) ^ *data++]) & 0xFFFF;
+   return crc;
+}
+
+//! Length of the UTF-8 like coded number starting with lead, or 0 if lead
+//! cannot start one
+size_t CodedNumberLength(FLAC__byte lead)
+{
+   if (lead < 0x80)
+      return 1;
+   size_t length = 0;
+   while (length < 8 && (lead & (0x80 >> length)))
+      ++length;
+   return (length < 2 || length > 7) ? 0 : length;
+}
+
+void AppendCodedNumber(std::vector<FLAC__byte> &bytes, FLAC__uint64 value)
+{
+   if (value < 0x80) {
+      bytes.push_back(value);
+      return;
+   }
+   // With n continuation bytes, there are 6 + 5 n bits
+   unsigned n = 1;
+   while (n < 6 && (value >> (6 + 5 * n)))
+      ++n;
+   bytes.push_back(((0xFF << (7 - n)) & 0xFF) | (value >> (6 * n)));
+   while (n--)
+      bytes.push_back(0x80 | ((value >> (6 * n)) & 0x3F));
+}
+
+}
+
+struct ParallelFLACEncoder::Run
+{
+   ArraysOf<FLAC__int32> samples;
+   size_t count{ 0 };
+   FLAC__uint64 firstFrame{ 0 };
+
+   //! Results of Encode()
+   std::vector<FLAC__byte> bytes;
+   unsigned minFrameSize{ 0 };
+   unsigned maxFrameSize{ 0 };
+   bool ok{ false };
+
+   std::future<void> job;
+};
+
+//! Collects the frames of one run, numbered as in the whole file
+class ParallelFLACEncoder::RunEncoder final : public FLAC::Encoder::Stream
+{
+public:
+   explicit RunEncoder(Run &run) : mRun{ run } {}
+
+protected:
+   ::FLAC__StreamEncoderWriteStatus write_callback(
+      const FLAC__byte buffer[], size_t bytes,
+      unsigned samples, unsigned) override
+   {
+      // Skip the stream header; the file encoder wrote the real one
+      if (samples == 0)
+         return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+      // Each write is a whole frame
+      if (!AppendFrame(buffer, bytes, mRun.firstFrame + mFrames++))
+         return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+      return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+   }
+
+private:
+   //! Copy a frame with another number in its header, and new checksums
+   bool AppendFrame(
+      const FLAC__byte frame[], size_t size, FLAC__uint64 number)
+   {
+      // Sync code and fixed block size; the number follows four bytes
+      if (size < 7 || frame[0] != 0xFF || frame[1] != 0xF8)
+         return false;
+      const auto numberLength = CodedNumberLength(frame[4]);
+      if (numberLength == 0)
+         return false;
+
+      // Block size and sample rate may not fit their codes in byte 2, and
+      // follow the number
+      const unsigned blockSizeCode = frame[2] >> 4;
+      const unsigned rateCode = frame[2] & 0x0F;
+      size_t extra = 0;
+      if (blockSizeCode == 6)
+         extra += 1;
+      else if (blockSizeCode == 7)
+         extra += 2;
+      if (rateCode == 12)
+         extra += 1;
+      else if (rateCode == 13 || rateCode == 14)
+         extra += 2;
+
+      const auto rest = 4 + numberLength + extra;
+      // Then CRC-8 of the header, the subframes, and CRC-16 of all that
+      if (rest + 1 + 2 > size)
+         return false;
+
+      auto &bytes = mRun.bytes;
+      const auto start = bytes.size();
+      bytes.insert(bytes.end(), frame, frame + 4);
+      AppendCodedNumber(bytes, number);
+      bytes.insert(bytes.end(), frame + 4 + numberLength, frame + rest);
+      bytes.push_back(CRC8(bytes.data() + start, bytes.size() - start));
+      bytes.insert(bytes.end(), frame + rest + 1, frame + size - 2);
+      const auto crc = CRC16(bytes.data() + start, bytes.size() - start);
+      bytes.push_back(crc >> 8);
+      bytes.push_back(crc & 0xFF);
+
+      const unsigned frameSize = bytes.size() - start;
+      if (mFrames == 1)
+         mRun.minFrameSize = mRun.maxFrameSize = frameSize;
+      else {
+         mRun.minFrameSize = std::min(mRun.minFrameSize, frameSize);
+         mRun.maxFrameSize = std::max(mRun.maxFrameSize, frameSize);
+      }
+      return true;
+   }
+
+   Run &mRun;
+   FLAC__uint64 mFrames{ 0 };
+};
+
+//! The MD5 message digest of RFC 1321, for the STREAMINFO block
+class ParallelFLACEncoder::MD5
+{
+public:
+   void Update(const FLAC__byte *data, size_t size)
+   {
+      auto used = mLength % 64;
+      mLength += size;
+      if (used) {
+         const auto count = std::min<size_t>(size, 64 - used);
+         memcpy(mBlock + used, data, count);
+         data += count, size -= count, used += count;
+         if (used < 64)
+            return;
+         Transform(mBlock);
+      }
+      for (; size >= 64; data += 64, size -= 64)
+         Transform(data);
+      memcpy(mBlock, data, size);
+   }
+
+   void Final(FLAC__byte digest[16])
+   {
+      const auto bits = mLength * 8;
+      const FLAC__byte pad = 0x80, zero = 0;
+      Update(&pad, 1);
+      while (mLength % 64 != 56)
+         Update(&zero, 1);
+      FLAC__byte length[8];
+      for (int ii = 0; ii < 8; ++ii)
+         length[ii] = bits >> (8 * ii);
+      Update(length, 8);
+      for (int ii = 0; ii < 16; ++ii)
+         digest[ii] = mState[ii / 4] >> (8 * (ii % 4));
+   }
+
+private:
+   void Transform(const FLAC__byte block[64])
+   {
+      static const FLAC__uint32 K[64] = {
+         0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+         0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+         0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+         0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+         0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+         0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+         0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+         0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+         0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+         0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+         0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+         0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+         0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+         0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+         0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+         0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+      };
+      static const int S[4][4] = {
+         { 7, 12, 17, 22 }, { 5, 9, 14, 20 },
+         { 4, 11, 16, 23 }, { 6, 10, 15, 21 },
+      };
+
+      FLAC__uint32 M[16];
+      for (int ii = 0; ii < 16; ++ii)
+         M[ii] = block[4 * ii] | (block[4 * ii + 1] << 8) |
+            (block[4 * ii + 2] << 16) | (FLAC__uint32(block[4 * ii + 3]) << 24);
+
+      auto a = mState[0], b = mState[1], c = mState[2], d = mState[3];
+      for (int ii = 0; ii < 64; ++ii) {
+         const int round = ii / 16;
+         FLAC__uint32 f;
+         int g;
+         switch (round) {
+         case 0: f = (b & c) | (~b & d); g = ii; break;
+         case 1: f = (d & b) | (~d & c); g = (5 * ii + 1) % 16; break;
+         case 2: f = b ^ c ^ d; g = (3 * ii + 5) % 16; break;
+         default: f = c ^ (b | ~d); g = (7 * ii) % 16; break;
+         }
+         const auto sum = a + f + K[ii] + M[g];
+         const auto shift = S[round][ii % 4];
+         a = d, d = c, c = b;
+         b += (sum << shift) | (sum >> (32 - shift));
+      }
+      mState[0] += a, mState[1] += b, mState[2] += c, mState[3] += d;
+   }
+
+   FLAC__uint32 mState[4]{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+   FLAC__uint64 mLength{ 0 };
+   FLAC__byte mBlock[64];
+};
+
+ParallelFLACEncoder::ParallelFLACEncoder(FILE *fp, unsigned numChannels,
+   unsigned bitsPerSample, unsigned sampleRate, unsigned blockSize,
+   Configurer configure)
+   : mFile{ fp }
+   , mNumChannels{ numChannels }
+   , mBitsPerSample{ bitsPerSample }
+   , mSampleRate{ sampleRate }
+   , mBlockSize{ blockSize }
+   , mConfigure{ std::move(configure) }
+   , mRunSamples{ blockSize * std::max<size_t>(1, RunSamples / blockSize) }
+   // Enough to keep every thread busy while the oldest run waits to be
+   // written
+   , mMaxRuns{ 2 * (ThreadPool::Get().GetThreadCount() + 1) }
+   , mMD5{ std::make_unique<MD5>() }
+{
+}
+
+ParallelFLACEncoder::~ParallelFLACEncoder()
+{
+   // The workers use the runs
+   for (auto &run : mRuns)
+      if (run->job.valid())
+         run->job.wait();
+}
+
+bool ParallelFLACEncoder::Process(
+   const FLAC__int32 *const buffers[], size_t samples)
+{
+   if (mFailed)
+      return false;
+
+   // The signature is of interleaved little endian samples, of whole bytes
+   const auto sampleBytes = mBitsPerSample / 8;
+   mMD5Bytes.resize(samples * mNumChannels * sampleBytes);
+   auto pBytes = mMD5Bytes.data();
+   for (size_t ii = 0; ii < samples; ++ii)
+      for (unsigned channel = 0; channel < mNumChannels; ++channel) {
+         const auto sample = buffers[channel][ii];
+         for (unsigned byte = 0; byte < sampleBytes; ++byte)
+            *pBytes++ = sample >> (8 * byte);
+      }
+   mMD5->Update(mMD5Bytes.data(), mMD5Bytes.size());
+   mTotalSamples += samples;
+
+   size_t done = 0;
+   while (done < samples) {
+      if (!mFilling) {
+         if (mSpare.empty()) {
+            mFilling = std::make_unique<Run>();
+            mFilling->samples.reinit(mNumChannels, mRunSamples);
+         }
+         else {
+            mFilling = std::move(mSpare.back());
+            mSpare.pop_back();
+         }
+      }
+      auto &run = *mFilling;
+      const auto count = std::min(samples - done, mRunSamples - run.count);
+      for (unsigned channel = 0; channel < mNumChannels; ++channel)
+         std::copy(buffers[channel] + done, buffers[channel] + done + count,
+            run.samples[channel].get() + run.count);
+      run.count += count;
+      done += count;
+
+      if (run.count == mRunSamples) {
+         Submit();
+         while (mRuns.size() > mMaxRuns)
+            if (!WriteOldest())
+               return false;
+      }
+   }
+   return true;
+}
+
+bool ParallelFLACEncoder::Flush()
+{
+   if (mFilling && mFilling->count > 0)
+      Submit();
+   while (!mRuns.empty())
+      if (!WriteOldest())
+         return false;
+   return !mFailed;
+}
+
+void ParallelFLACEncoder::Submit()
+{
+   auto &run = *mFilling;
+   run.firstFrame = mNextFrame;
+   mNextFrame += (run.count + mBlockSize - 1) / mBlockSize;
+   run.job = ThreadPool::Get().Submit([this, &run]{ Encode(run); });
+   mRuns.push_back(std::move(mFilling));
+}
+
+bool ParallelFLACEncoder::WriteOldest()
+{
+   auto run = std::move(mRuns.front());
+   mRuns.pop_front();
+   run->job.get();
+
+   const auto &bytes = run->bytes;
+   if (mFailed || !run->ok ||
+       fwrite(bytes.data(), 1, bytes.size(), mFile) != bytes.size()) {
+      mFailed = true;
+      return false;
+   }
+
+   if (mMaxFrameSize == 0)
+      mMinFrameSize = run->minFrameSize, mMaxFrameSize = run->maxFrameSize;
+   else {
+      mMinFrameSize = std::min(mMinFrameSize, run->minFrameSize);
+      mMaxFrameSize = std::max(mMaxFrameSize, run->maxFrameSize);
+   }
+
+   run->count = 0;
+   mSpare.push_back(std::move(run));
+   return true;
+}
+
+void ParallelFLACEncoder::Encode(Run &run) const
+{
+   run.bytes.clear();
+   run.ok = false;
+
+   RunEncoder encoder{ run };
+   if (!(mConfigure(encoder) &&
+         encoder.set_blocksize(mBlockSize) &&
+         encoder.init() == FLAC__STREAM_ENCODER_INIT_STATUS_OK))
+      return;
+
+   std::vector<const FLAC__int32*> channels(mNumChannels);
+   for (unsigned channel = 0; channel < mNumChannels; ++channel)
+      channels[channel] = run.samples[channel].get();
+   const bool processed = encoder.process(channels.data(), run.count);
+   // The last frame comes out only at the finish
+   run.ok = encoder.finish() && processed;
+}
+
+bool ParallelFLACEncoder::PatchStreamInfo(const wxString &path) const
+{
+   FLAC__byte info[StreamInfoSize]{};
+   auto put = [&info](size_t offset, size_t size, FLAC__uint64 value){
+      // Big endian
+      while (size--)
+         info[offset + size] = value & 0xFF, value >>= 8;
+   };
+   put(0, 2, mBlockSize);
+   put(2, 2, mBlockSize);
+   put(4, 3, mMinFrameSize);
+   put(7, 3, mMaxFrameSize);
+   // 20 bits of rate, 3 of channels, 5 of bits per sample, 36 of samples
+   put(10, 8,
+      (FLAC__uint64(mSampleRate) << 44) |
+      (FLAC__uint64(mNumChannels - 1) << 41) |
+      (FLAC__uint64(mBitsPerSample - 1) << 36) |
+      (mTotalSamples & 0xFFFFFFFFFull));
+   // Final() changes the digest object, so use a copy
+   MD5{ *mMD5 }.Final(info + 18);
+
+   wxFFile f;
+   FLAC__byte header[StreamInfoOffset];
+   return f.Open(path, wxT("r+b")) &&
+      f.Read(header, sizeof header) == sizeof header &&
+      memcmp(header, "fLaC", 4) == 0 &&
+      // The first block is STREAMINFO, of its usual size
+      (header[4] & 0x7F) == 0 &&
+      header[5] == 0 && header[6] == 0 && header[7] == StreamInfoSize &&
+      f.Seek(StreamInfoOffset) &&
+      f.Write(info, sizeof info) == sizeof info &&
+      f.Close();
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ParallelFLACEncoder.h
+@brief Encode the frames of a FLAC file in worker threads, and write them in order
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_PARALLEL_FLAC_ENCODER__
+#define __SNEEDACITY_PARALLEL_FLAC_ENCODER__
+
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "FLAC/ordinals.h"
+
+class wxString;
+namespace FLAC { namespace Encoder { class Stream; } }
+
+//! Takes over the frames of a FLAC file, once its encoder wrote the header
+/*! Samples gather into runs of whole frames.  Each run is encoded in the
+ shared ThreadPool by an encoder of its own, configured like the one which
+ wrote the header.  Encoded runs are written to the file in order, with the
+ frame numbers in their headers made to count on from the previous runs.
+
+ Frames of FLAC with a fixed block size depend on no others, so the file
+ decodes to the same samples as a serial encoding.  The frames may differ a
+ little in size, because each run starts the encoder anew.
+
+ Because the file encoder sees no samples, the caller must PatchStreamInfo()
+ after it finishes, for the sizes, the sample count and the MD5 signature. */
+class ParallelFLACEncoder final
+{
+public:
+   //! Apply the same settings as for the file encoder, except the metadata
+   using Configurer = std::function< bool(FLAC::Encoder::Stream&) >;
+
+   //! fp is positioned after the header the file encoder wrote
+   ParallelFLACEncoder(FILE *fp, unsigned numChannels,
+      unsigned bitsPerSample, unsigned sampleRate, unsigned blockSize,
+      Configurer configure);
+
+   //! Waits for workers, ignoring their exceptions, without Flush()
+   ~ParallelFLACEncoder();
+
+   ParallelFLACEncoder(const ParallelFLACEncoder&) = delete;
+   ParallelFLACEncoder &operator=(const ParallelFLACEncoder&) = delete;
+
+   //! Take samples of each channel, like FLAC::Encoder::Stream::process()
+   /*! @return false if an earlier run could not be encoded or written
+    May throw what a worker threw */
+   bool Process(const FLAC__int32 *const buffers[], size_t samples);
+
+   //! Encode and write all remaining samples
+   /*! @return false if a run could not be encoded or written
+    May throw what a worker threw */
+   bool Flush();
+
+   //! Rewrite the STREAMINFO block of the file at path, after Flush() and
+   //! the finish of the file encoder
+   bool PatchStreamInfo(const wxString &path) const;
+
+private:
+   struct Run;
+   class RunEncoder;
+   class MD5;
+
+   void Submit();
+   bool WriteOldest();
+   //! In a worker thread
+   void Encode(Run &run) const;
+
+   FILE *const mFile;
+   const unsigned mNumChannels;
+   const unsigned mBitsPerSample;
+   const unsigned mSampleRate;
+   const unsigned mBlockSize;
+   const Configurer mConfigure;
+   //! Samples of each run but the last, a whole number of frames
+   const size_t mRunSamples;
+   //! Runs encoding or waiting to be written, at most
+   const size_t mMaxRuns;
+
+   //! Run gathering samples, not yet submitted
+   std::unique_ptr<Run> mFilling;
+   //! Submitted runs, oldest first
+   std::deque< std::unique_ptr<Run> > mRuns;
+   //! Written runs, kept for their buffers
+   std::vector< std::unique_ptr<Run> > mSpare;
+   FLAC__uint64 mNextFrame{ 0 };
+
+   std::unique_ptr<MD5> mMD5;
+   std::vector<FLAC__byte> mMD5Bytes;
+   FLAC__uint64 mTotalSamples{ 0 };
+   unsigned mMinFrameSize{ 0 };
+   unsigned mMaxFrameSize{ 0 };
+   bool mFailed{ false };
+};
+
+#endif
@@ -0,0 +1,116 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ChannelAppender.cpp
+@brief Implements ChannelAppender
+
+**********************************************************************/
+
+#include "ChannelAppender.h"
+
+#include <algorithm>
+#include <new>
+
+#include "../DeinterleaveKernels.h"
+#include "../ThreadPool.h"
+#include "../WaveTrack.h"
+
+ChannelAppender::ChannelAppender(
+   const Channels &channels, sampleFormat format, size_t maxFrames)
+   : mChannels{ channels }
+   , mFormat{ format }
+   , mMaxFrames{ std::max<size_t>(1, maxFrames) }
+{
+   for (auto &buffer : mBuffers)
+      if (!buffer.Allocate(mChannels.size() * mMaxFrames, mFormat).ptr())
+         throw std::bad_alloc{};
+}
+
+ChannelAppender::~ChannelAppender()
+{
+   // The workers use the buffers and the tracks
+   if (mPending.valid())
+      mPending.wait();
+}
+
+samplePtr ChannelAppender::GetChannelBuffer(size_t channel)
+{
+   return mBuffers[mCurrent].ptr() +
+      (channel * mMaxFrames + mFilled) * SAMPLE_SIZE(mFormat);
+}
+
+void ChannelAppender::Advance(size_t nFrames)
+{
+   wxASSERT(nFrames <= GetRoom());
+   mFilled += nFrames;
+   if (mFilled == mMaxFrames)
+      Submit();
+}
+
+void ChannelAppender::AppendInterleaved(constSamplePtr buffer, size_t nFrames)
+{
+   const auto nChannels = mChannels.size();
+   const auto frameSize = nChannels * SAMPLE_SIZE(mFormat);
+   std::vector<short*> shortDests;
+   std::vector<float*> floatDests;
+
+   while (nFrames > 0) {
+      const auto count = std::min(nFrames, GetRoom());
+      if (mFormat == int16Sample) {
+         shortDests.resize(nChannels);
+         for (size_t c = 0; c < nChannels; ++c)
+            shortDests[c] = reinterpret_cast<short*>(GetChannelBuffer(c));
+         DeinterleaveKernels::Deinterleave(
+            reinterpret_cast<const short*>(buffer),
+            nChannels, count, shortDests.data());
+      }
+      else {
+         // 24 bit samples are whole ints, and copy like floats
+         floatDests.resize(nChannels);
+         for (size_t c = 0; c < nChannels; ++c)
+            floatDests[c] = reinterpret_cast<float*>(GetChannelBuffer(c));
+         DeinterleaveKernels::Deinterleave(
+            reinterpret_cast<const float*>(buffer),
+            nChannels, count, floatDests.data());
+      }
+      buffer += count * frameSize;
+      nFrames -= count;
+      Advance(count);
+   }
+}
+
+void ChannelAppender::Finish()
+{
+   Submit();
+   Wait();
+}
+
+void ChannelAppender::Submit()
+{
+   // The other set of buffers is free when the workers are done with it
+   Wait();
+
+   const auto buffer = mBuffers[mCurrent].ptr();
+   const auto filled = mFilled;
+   mCurrent = 1 - mCurrent;
+   mFilled = 0;
+   if (filled == 0)
+      return;
+
+   auto &pool = ThreadPool::Get();
+   mPending = pool.Submit([this, &pool, buffer, filled]{
+      pool.ParallelFor(mChannels.size(), [&](size_t c){
+         mChannels[c]->Append(
+            buffer + c * mMaxFrames * SAMPLE_SIZE(mFormat), mFormat, filled);
+      });
+   });
+}
+
+void ChannelAppender::Wait()
+{
+   if (mPending.valid()) {
+      auto pending = std::move(mPending);
+      pending.get();
+   }
+}
@@ -0,0 +1,80 @@
+/*!********************************************************************
+
+Sneedacity: A Digital Audio Editor
+
+@file ChannelAppender.h
+@brief Append decoded samples to the tracks of an import in worker threads
+
+**********************************************************************/
+
+#ifndef __SNEEDACITY_CHANNEL_APPENDER__
+#define __SNEEDACITY_CHANNEL_APPENDER__
+
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "../SampleFormat.h"
+
+class WaveTrack;
+
+//! Collects decoded samples for the channels of one import, and appends
+//! them to the tracks in the shared ThreadPool
+/*! Samples gather in one of two sets of buffers.  When a set fills, the
+ workers append it, one task for each channel, while the importer decodes
+ into the other set.  So decoding overlaps with the block summaries and
+ database writes of WaveTrack::Append.
+
+ The tracks must not be touched otherwise until Finish() returns. */
+class SNEEDACITY_DLL_API ChannelAppender final
+{
+public:
+   using Channels = std::vector< std::shared_ptr<WaveTrack> >;
+
+   //! Buffers hold maxFrames frames in the given format
+   ChannelAppender(
+      const Channels &channels, sampleFormat format, size_t maxFrames);
+
+   //! Waits for workers, ignoring their exceptions, without Flush()
+   ~ChannelAppender();
+
+   ChannelAppender(const ChannelAppender&) = delete;
+   ChannelAppender &operator=(const ChannelAppender&) = delete;
+
+   //! How many frames fit in the buffers before the next Advance()
+   size_t GetRoom() const { return mMaxFrames - mFilled; }
+
+   //! Where the next samples of a channel go; room for GetRoom() samples
+   samplePtr GetChannelBuffer(size_t channel);
+
+   //! Count nFrames more samples as written to every channel buffer
+   /*! May throw what a worker threw while appending earlier samples */
+   void Advance(size_t nFrames);
+
+   //! Split interleaved frames of the format into the channels, and Advance()
+   /*! May throw what a worker threw while appending earlier samples */
+   void AppendInterleaved(constSamplePtr buffer, size_t nFrames);
+
+   //! Append all remaining samples and wait for the workers; the caller
+   //! still flushes the tracks
+   /*! May throw what a worker threw */
+   void Finish();
+
+private:
+   void Submit();
+   void Wait();
+
+   const Channels mChannels;
+   const sampleFormat mFormat;
+   const size_t mMaxFrames;
+
+   //! Two sets of buffers of all channels, one filling while the other is
+   //! being appended
+   SampleBuffer mBuffers[2];
+   size_t mCurrent{ 0 };
+   size_t mFilled{ 0 };
+
+   std::future<void> mPending;
+};
+
+#endif
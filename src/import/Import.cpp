@@ -453,19 +453,9 @@ std::unique_ptr<ExtImportItem> Importer::CreateDefaultImportItem()
    return new_item;
 }
 
-// returns number of tracks imported
-bool Importer::Import( SneedacityProject &project,
-                     const FilePath &fName,
-                     WaveTrackFactory *trackFactory,
-                     TrackHolders &tracks,
-                     Tags *tags,
-                     TranslatableString &errorMessage)
+bool Importer::CheckFileType(const FilePath &fName,
+                            TranslatableString &errorMessage)
 {
-   SneedacityProject *pProj = &project;
-   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
-
-   const FileExtension extension{ fName.AfterLast(wxT('.')) };
-
    // Always refuse to import MIDI, even though the FFmpeg plugin pretends to know how (but makes very bad renderings)
 #ifdef USE_MIDI
    // MIDI files must be imported, not opened
@@ -485,14 +475,16 @@ bool Importer::Import( SneedacityProject &project,
       return false;
    }
 
-   using ImportPluginPtrs = std::vector< ImportPlugin* >;
+   return true;
+}
+
+Importer::ImportPluginPtrs Importer::GetImportPlugins(const FilePath &fName)
+{
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
 
    // This list is used to call plugins in correct order
    ImportPluginPtrs importPlugins;
 
-   // This list is used to remember plugins that should have been compatible with the file.
-   ImportPluginPtrs compatiblePlugins;
-
    // Not implemented (yet?)
    wxString mime_type = wxT("*");
 
@@ -604,6 +596,82 @@ bool Importer::Import( SneedacityProject &project,
       }
    }
 
+   return importPlugins;
+}
+
+bool Importer::CleanUpTracks(TrackHolders &tracks)
+{
+   auto end = tracks.end();
+   auto iter = std::remove_if( tracks.begin(), end,
+      std::mem_fn( &NewChannelGroup::empty ) );
+   if ( iter != end ) {
+      // importer shouldn't give us empty groups of channels!
+      wxASSERT(false);
+      // But correct that and proceed anyway
+      tracks.erase( iter, end );
+   }
+   return tracks.size() > 0;
+}
+
+std::unique_ptr<ImportFileHandle> Importer::OpenForBatch(
+   SneedacityProject &project, const FilePath &fName, bool &cancelled)
+{
+   cancelled = false;
+
+   TranslatableString errorMessage;
+   if (!CheckFileType(fName, errorMessage))
+      return nullptr;
+
+   // Open as Import() would, but leave the import to the caller
+   for (const auto plugin : GetImportPlugins(fName))
+   {
+      wxLogMessage(wxT("Opening with %s"),plugin->GetPluginStringID());
+      auto inFile = plugin->Open(fName, &project);
+      if ( (inFile != NULL) && (inFile->GetStreamCount() > 0) )
+      {
+         wxLogMessage(wxT("Open(%s) succeeded"), fName);
+         if (inFile->GetStreamCount() > 1)
+         {
+            ImportStreamDialog ImportDlg(inFile.get(), NULL, -1, XO("Select stream(s) to import"));
+
+            if (ImportDlg.ShowModal() == wxID_CANCEL)
+            {
+               cancelled = true;
+               return nullptr;
+            }
+         }
+         else
+            inFile->SetStreamUsage(0,TRUE);
+
+         return inFile;
+      }
+   }
+
+   return nullptr;
+}
+
+// returns number of tracks imported
+bool Importer::Import( SneedacityProject &project,
+                     const FilePath &fName,
+                     WaveTrackFactory *trackFactory,
+                     TrackHolders &tracks,
+                     Tags *tags,
+                     TranslatableString &errorMessage)
+{
+   SneedacityProject *pProj = &project;
+   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
+
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
+
+   if (!CheckFileType(fName, errorMessage))
+      return false;
+
+   // This list is used to call plugins in correct order
+   const auto importPlugins = GetImportPlugins(fName);
+
+   // This list is used to remember plugins that should have been compatible with the file.
+   ImportPluginPtrs compatiblePlugins;
+
    // Try the import plugins, in the permuted sequences just determined
    for (const auto plugin : importPlugins)
    {
@@ -643,16 +711,7 @@ bool Importer::Import( SneedacityProject &project,
                return true;
             }
 
-            auto end = tracks.end();
-            auto iter = std::remove_if( tracks.begin(), end,
-               std::mem_fn( &NewChannelGroup::empty ) );
-            if ( iter != end ) {
-               // importer shouldn't give us empty groups of channels!
-               wxASSERT(false);
-               // But correct that and proceed anyway
-               tracks.erase( iter, end );
-            }
-            if (tracks.size() > 0)
+            if (CleanUpTracks(tracks))
             {
                // success!
                return true;
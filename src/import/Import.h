@@ -175,7 +175,31 @@ public:
               Tags *tags,
               TranslatableString &errorMessage);
 
+   //! Open a file in the main thread, so that ImportFileHandle::Import()
+   //! may run later in a worker thread
+   /*! Asks the user to choose streams, if there are several.  Returns null,
+    setting cancelled, if the user cancelled.  Otherwise returns null if no
+    plugin opens the file, or the file is not to be imported as audio; then
+    Import() should be used instead, and report the error.  Import() is also
+    the fallback when the import from the handle fails to make tracks. */
+   std::unique_ptr<ImportFileHandle> OpenForBatch( SneedacityProject &project,
+              const FilePath &fName,
+              bool &cancelled);
+
+   //! Remove empty groups of channels, which importers shouldn't make
+   //! @return whether any tracks remain
+   static bool CleanUpTracks(TrackHolders &tracks);
+
 private:
+   using ImportPluginPtrs = std::vector< ImportPlugin* >;
+
+   //! Refuse files that some plugin might open, but are not audio
+   static bool CheckFileType(const FilePath &fName,
+              TranslatableString &errorMessage);
+
+   //! The plugins to try for the file, in order
+   ImportPluginPtrs GetImportPlugins(const FilePath &fName);
+
    static Importer mInstance;
 
    ExtImportItems mExtImportItems;
@@ -214,6 +214,7 @@ public:
    ///\return import status (see Import.cpp)
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
       Tags *tags) override;
+   bool CanImportInParallel() const override { return true; }
 
    ///! Writes decoded data into WaveTracks.
    ///\param sc - stream context
@@ -46,6 +46,9 @@
 
 #define DESC XO("FLAC files")
 
+// Frames to decode before worker threads append them to the tracks
+static const size_t FLACAppendFrames = 65536;
+
 static const auto exts = {
    wxT("flac"),
    wxT("flc")
@@ -68,8 +71,10 @@ static Importer::RegisteredUnusableImportPlugin registered{
 #include "FLAC++/decoder.h"
 
 #include "../Prefs.h"
+#include "../DeinterleaveKernels.h"
 #include "../WaveTrack.h"
 #include "ImportPlugin.h"
+#include "ChannelAppender.h"
 
 #ifdef USE_LIBID3TAG
 extern "C" {
@@ -146,6 +151,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInParallel() const override { return true; }
 
    wxInt32 GetStreamCount() override { return 1; }
 
@@ -160,6 +166,7 @@ public:
 
 private:
    sampleFormat          mFormat;
+   sampleFormat          mAppendFormat;
    std::unique_ptr<MyFLACFile> mFile;
    wxFFile               mHandle;
    unsigned long         mSampleRate;
@@ -170,6 +177,7 @@ private:
    bool                  mStreamInfoDone;
    ProgressResult        mUpdateResult;
    NewChannelGroup       mChannels;
+   std::unique_ptr<ChannelAppender> mAppender;
 };
 
 
@@ -241,30 +249,23 @@ FLAC__StreamDecoderWriteStatus MyFLACFile::write_callback(const FLAC__Frame *fra
 {
    // Don't let C++ exceptions propagate through libflac
    return GuardedCall< FLAC__StreamDecoderWriteStatus > ( [&] {
-      auto tmp = ArrayOf< short >{ frame->header.blocksize };
-
-      auto iter = mFile->mChannels.begin();
-      for (unsigned int chn=0; chn<mFile->mNumChannels; ++iter, ++chn) {
-         if (frame->header.bits_per_sample <= 16) {
-            if (frame->header.bits_per_sample == 8) {
-               for (unsigned int s = 0; s < frame->header.blocksize; s++) {
-                  tmp[s] = buffer[chn][s] << 8;
-               }
-            } else /* if (frame->header.bits_per_sample == 16) */ {
-               for (unsigned int s = 0; s < frame->header.blocksize; s++) {
-                  tmp[s] = buffer[chn][s];
-               }
-            }
-
-            iter->get()->Append((samplePtr)tmp.get(),
-                     int16Sample,
-                     frame->header.blocksize);
-         }
-         else {
-            iter->get()->Append((samplePtr)buffer[chn],
-                     int24Sample,
-                     frame->header.blocksize);
+      auto &appender = *mFile->mAppender;
+      const auto blocksize = frame->header.blocksize;
+      // 8 bit samples fill the high byte of 16
+      const unsigned shift = (frame->header.bits_per_sample == 8) ? 8 : 0;
+      for (size_t done = 0; done < blocksize;) {
+         const auto count = std::min<size_t>(blocksize - done, appender.GetRoom());
+         for (unsigned int chn=0; chn<mFile->mNumChannels; ++chn) {
+            const auto dest = appender.GetChannelBuffer(chn);
+            if (mFile->mAppendFormat == int16Sample)
+               DeinterleaveKernels::NarrowToInt16(
+                  buffer[chn] + done, count, shift, (short *)dest);
+            else
+               memcpy(dest, buffer[chn] + done, count * sizeof(int));
          }
+         // Worker threads append full buffers while libflac decodes on
+         appender.Advance(count);
+         done += count;
       }
 
       mFile->mSamplesDone += frame->header.blocksize;
@@ -425,6 +426,12 @@ ProgressResult FLACImportFileHandle::Import(WaveTrackFactory *trackFactory,
          *iter = NewWaveTrack(*trackFactory, mFormat, mSampleRate);
    }
 
+   // Samples of more than 16 bits go to the tracks as 24 bit
+   mAppendFormat = (mBitsPerSample <= 16) ? int16Sample : int24Sample;
+   mAppender = std::make_unique<ChannelAppender>(
+      mChannels, mAppendFormat, FLACAppendFrames);
+   auto cleanup = finally( [&]{ mAppender.reset(); } );
+
    // TODO: Vigilant Sentry: Variable res unused after assignment (error code DA1)
    //    Should check the result.
    #ifdef LEGACY_FLAC
@@ -438,6 +445,8 @@ ProgressResult FLACImportFileHandle::Import(WaveTrackFactory *trackFactory,
       return mUpdateResult;
    }
 
+   mAppender->Finish();
+
    for (const auto &channel : mChannels)
       channel->Flush();
 
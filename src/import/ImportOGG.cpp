@@ -75,6 +75,7 @@ static Importer::RegisteredUnusableImportPlugin registered{
 
 #include "../WaveTrack.h"
 #include "ImportPlugin.h"
+#include "ChannelAppender.h"
 
 using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
 
@@ -125,6 +126,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInParallel() const override { return true; }
 
    wxInt32 GetStreamCount() override
    {
@@ -268,11 +270,21 @@ ProgressResult OggImportFileHandle::Import(
     * Balance between responsiveness of the GUI and throughput of import. */
 #define SAMPLES_PER_CALLBACK 100000
 
+   /* The number of frames to decode before handing them to worker threads
+    * that append them to the tracks */
+#define APPEND_FRAMES 65536u
+
    auto updateResult = ProgressResult::Success;
    long bytesRead = 0;
    {
       ArrayOf<short> mainBuffer{ CODEC_TRANSFER_SIZE };
 
+      std::vector< std::unique_ptr<ChannelAppender> > appenders;
+      for (const auto &link : mChannels)
+         appenders.push_back(link.empty() ? nullptr :
+            std::make_unique<ChannelAppender>(
+               link, int16Sample, APPEND_FRAMES));
+
       /* determine endianness (clever trick courtesy of Nicholas Devillard,
        * (http://www.eso.org/~ndevilla/endian/) */
       int testvar = 1, endian;
@@ -323,17 +335,9 @@ ProgressResult OggImportFileHandle::Import(
          samplesRead = bytesRead / mVorbisFile->vi[bitstream].channels / sizeof(short);
 
          /* give the data to the wavetracks */
-         auto iter = mChannels.begin();
-         std::advance(iter, bitstream);
          if (mStreamUsage[bitstream] != 0)
-         {
-            auto iter2 = iter->begin();
-            for (int c = 0; c < mVorbisFile->vi[bitstream].channels; ++iter2, ++c)
-               iter2->get()->Append((char *)(mainBuffer.get() + c),
-               int16Sample,
-               samplesRead,
-               mVorbisFile->vi[bitstream].channels);
-         }
+            appenders[bitstream]->AppendInterleaved(
+               (samplePtr)mainBuffer.get(), samplesRead);
 
          samplesSinceLastCallback += samplesRead;
          if (samplesSinceLastCallback > SAMPLES_PER_CALLBACK) {
@@ -342,6 +346,13 @@ ProgressResult OggImportFileHandle::Import(
             samplesSinceLastCallback -= SAMPLES_PER_CALLBACK;
          }
       } while (updateResult == ProgressResult::Success && bytesRead != 0);
+
+      if (bytesRead >= 0 &&
+          updateResult != ProgressResult::Failed &&
+          updateResult != ProgressResult::Cancelled)
+         for (auto &pAppender : appenders)
+            if (pAppender)
+               pAppender->Finish();
    }
 
    auto res = updateResult;
@@ -49,6 +49,7 @@
 #include "../ShuttleGui.h"
 #include "../WaveTrack.h"
 #include "ImportPlugin.h"
+#include "ChannelAppender.h"
 
 #include <algorithm>
 
@@ -93,6 +94,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInParallel() const override { return true; }
 
    wxInt32 GetStreamCount() override { return 1; }
 
@@ -285,6 +287,9 @@ using id3_tag_holder = std::unique_ptr<id3_tag, id3_tag_deleter>;
 
 using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
 
+// Bytes of interleaved samples to read from the file at once
+static const size_t MaxReadBytes = 4 * 1024 * 1024;
+
 ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
                                 TrackHolders &outTracks,
                                 Tags *tags)
@@ -322,19 +327,26 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
          std::numeric_limits<type>::max() /
             (mInfo.channels * SAMPLE_SIZE(mFormat))
       );
+      // The appender holds two more blocks of all channels
+      maxBlock = std::min<type>(maxBlock, std::max<type>(1024,
+         MaxReadBytes / (mInfo.channels * SAMPLE_SIZE(mFormat))));
       if (maxBlock < 1)
          return ProgressResult::Failed;
 
-      SampleBuffer srcbuffer, buffer;
+      SampleBuffer srcbuffer;
       wxASSERT(mInfo.channels >= 0);
-      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, mFormat).ptr() ||
-             NULL == buffer.Allocate(maxBlock, mFormat).ptr())
+      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, mFormat).ptr())
       {
          maxBlock /= 2;
          if (maxBlock < 1)
             return ProgressResult::Failed;
       }
 
+      // Worker threads append each block, while this thread reads the next
+      const auto appendFormat =
+         (mFormat == int16Sample) ? int16Sample : floatSample;
+      ChannelAppender appender{ channels, appendFormat, maxBlock };
+
       decltype(fileTotalFrames) framescompleted = 0;
 
       long block;
@@ -353,21 +365,7 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
          }
 
          if (block) {
-            auto iter = channels.begin();
-            for(int c=0; c<mInfo.channels; ++iter, ++c) {
-               if (mFormat==int16Sample) {
-                  for(int j=0; j<block; j++)
-                     ((short *)buffer.ptr())[j] =
-                        ((short *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-               else {
-                  for(int j=0; j<block; j++)
-                     ((float *)buffer.ptr())[j] =
-                        ((float *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-
-               iter->get()->Append(buffer.ptr(), (mFormat == int16Sample)?int16Sample:floatSample, block);
-            }
+            appender.AppendInterleaved(srcbuffer.ptr(), block);
             framescompleted += block;
          }
 
@@ -379,6 +377,10 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
             break;
 
       } while (block > 0);
+
+      if (updateResult != ProgressResult::Failed &&
+          updateResult != ProgressResult::Cancelled)
+         appender.Finish();
    }
 
    if (updateResult == ProgressResult::Failed || updateResult == ProgressResult::Cancelled) {
@@ -10,10 +10,12 @@ Paul Licameli split from Import.cpp
 
 #include "ImportPlugin.h"
 
+#include <algorithm>
 #include <wx/filename.h>
 #include "../WaveTrack.h"
 #include "../widgets/ProgressDialog.h"
 #include "../prefs/QualitySettings.h"
+#include "../prefs/TracksPrefs.h"
 
 ImportPlugin::ImportPlugin(FileExtensions supportedExtensions):
    mExtensions( std::move( supportedExtensions ) )
@@ -33,8 +35,66 @@ bool ImportPlugin::SupportsExtension(const FileExtension &extension)
    return mExtensions.Index(extension, false) != wxNOT_FOUND;
 }
 
+ImportProgress::ImportProgress(
+   const TranslatableString &title, const TranslatableString &message)
+   : mDialog{ std::make_unique< ProgressDialog >( title, message ) }
+{
+}
+
+ImportProgress::ImportProgress(Reporter reporter)
+   : mReporter{ std::move(reporter) }
+{
+}
+
+ImportProgress::~ImportProgress() = default;
+
+ProgressResult ImportProgress::Update(double current, double total)
+{
+   return mDialog
+      ? mDialog->Update(current, total)
+      : Report(current, total);
+}
+
+ProgressResult ImportProgress::Update(
+   wxULongLong_t current, wxULongLong_t total)
+{
+   return mDialog
+      ? mDialog->Update(current, total)
+      : Report(current, total);
+}
+
+ProgressResult ImportProgress::Update(wxLongLong current, wxLongLong total)
+{
+   return mDialog
+      ? mDialog->Update(current, total)
+      : Report(current.ToDouble(), total.ToDouble());
+}
+
+ProgressResult ImportProgress::Update(wxLongLong_t current, wxLongLong_t total)
+{
+   return mDialog
+      ? mDialog->Update(current, total)
+      : Report(current, total);
+}
+
+ProgressResult ImportProgress::Update(int current, int total)
+{
+   return mDialog
+      ? mDialog->Update(current, total)
+      : Report(current, total);
+}
+
+ProgressResult ImportProgress::Report(double current, double total)
+{
+   const auto permille = total > 0 ? int(current * 1000 / total) : 0;
+   return mReporter(std::max(0, std::min(1000, permille)));
+}
+
 ImportFileHandle::ImportFileHandle(const FilePath & filename)
 :  mFilename(filename)
+   // Consult user preferences now, in the main thread
+,  mDefaultFormat(QualitySettings::SampleFormatChoice())
+,  mDefaultName(TracksPrefs::GetDefaultAudioTrackNamePreference())
 {
 }
 
@@ -44,18 +104,37 @@ ImportFileHandle::~ImportFileHandle()
 
 void ImportFileHandle::CreateProgress()
 {
+   if (mReporter) {
+      mProgress = std::make_unique< ImportProgress >( mReporter );
+      return;
+   }
+
    wxFileName ff( mFilename );
 
    auto title = XO("Importing %s").Format( GetFileDescription() );
-   mProgress = std::make_unique< ProgressDialog >(
+   mProgress = std::make_unique< ImportProgress >(
       title, Verbatim( ff.GetFullName() ) );
 }
 
+void ImportFileHandle::SetProgressReporter(ImportProgress::Reporter reporter)
+{
+   mReporter = std::move(reporter);
+}
+
+bool ImportFileHandle::CanImportInParallel() const
+{
+   return false;
+}
+
 sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 {
    // Consult user preference
-   auto defaultFormat = QualitySettings::SampleFormatChoice();
+   return ChooseFormat(effectiveFormat, QualitySettings::SampleFormatChoice());
+}
 
+sampleFormat ImportFileHandle::ChooseFormat(
+   sampleFormat effectiveFormat, sampleFormat defaultFormat)
+{
    // Don't choose format narrower than effective or default
    auto format = std::max(effectiveFormat, defaultFormat);
 
@@ -69,5 +148,6 @@ sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 std::shared_ptr<WaveTrack> ImportFileHandle::NewWaveTrack(
    WaveTrackFactory &trackFactory, sampleFormat effectiveFormat, double rate)
 {
-   return trackFactory.NewWaveTrack(ChooseFormat(effectiveFormat), rate);
+   return trackFactory.NewWaveTrack(
+      mDefaultName, ChooseFormat(effectiveFormat, mDefaultFormat), rate);
 }
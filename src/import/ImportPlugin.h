@@ -47,7 +47,9 @@ but little else.
 
 
 
+#include <functional>
 #include <memory>
+#include <wx/longlong.h>
 #include "sneedacity/Types.h"
 #include "Identifier.h"
 #include "Internat.h"
@@ -99,6 +101,37 @@ protected:
 };
 
 
+//! Progress of one ImportFileHandle::Import(), shown in a dialog of its own,
+//! or reported to a batch of imports running in worker threads
+/*! Update() takes the same arguments as ProgressDialog::Update(), so the
+ importers need not know which it is. */
+class SNEEDACITY_DLL_API ImportProgress final
+{
+public:
+   //! Receives the permille done, and returns what Update() should
+   /*! Called in the importing thread */
+   using Reporter = std::function< ProgressResult(int permille) >;
+
+   //! Shows a ProgressDialog
+   ImportProgress(
+      const TranslatableString &title, const TranslatableString &message);
+   //! Shows nothing, but reports to the function
+   explicit ImportProgress(Reporter reporter);
+   ~ImportProgress();
+
+   ProgressResult Update(double current, double total);
+   ProgressResult Update(wxULongLong_t current, wxULongLong_t total);
+   ProgressResult Update(wxLongLong current, wxLongLong total);
+   ProgressResult Update(wxLongLong_t current, wxLongLong_t total);
+   ProgressResult Update(int current, int total);
+
+private:
+   ProgressResult Report(double current, double total);
+
+   std::unique_ptr<ProgressDialog> mDialog;
+   const Reporter mReporter;
+};
+
 class WaveTrack;
 using TrackHolders = std::vector< std::vector< std::shared_ptr<WaveTrack> > >;
 
@@ -113,6 +146,15 @@ public:
    // identify the filename being imported.
    void CreateProgress();
 
+   //! Make CreateProgress() report to the function instead of showing a
+   //! dialog, so that Import() may run in a worker thread
+   void SetProgressReporter(ImportProgress::Reporter reporter);
+
+   //! Whether Import() may run in a worker thread
+   /*! Default is false, for importers that may show a message box while
+    importing; those are imported one at a time in the main thread */
+   virtual bool CanImportInParallel() const;
+
    // This is similar to GetPluginFormatDescription, but if possible the
    // importer will return a more specific description of the
    // specific file that is open.
@@ -148,12 +190,22 @@ public:
    static sampleFormat ChooseFormat(sampleFormat effectiveFormat);
 
    //! Build a wave track with appropriate format, which will not be narrower than the specified one
+   /*! Uses the preferred format and track name as they were when the file
+    was opened, so it is safe in a worker thread */
    std::shared_ptr<WaveTrack> NewWaveTrack( WaveTrackFactory &trackFactory,
       sampleFormat effectiveFormat, double rate);
 
 protected:
    FilePath mFilename;
-   std::unique_ptr<ProgressDialog> mProgress;
+   std::unique_ptr<ImportProgress> mProgress;
+
+private:
+   static sampleFormat ChooseFormat(
+      sampleFormat effectiveFormat, sampleFormat defaultFormat);
+
+   const sampleFormat mDefaultFormat;
+   const wxString mDefaultName;
+   ImportProgress::Reporter mReporter;
 };
 
 
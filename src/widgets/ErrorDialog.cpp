@@ -30,6 +30,7 @@
 #include <wx/html/htmlwin.h>
 #include <wx/settings.h>
 #include <wx/statusbr.h>
+#include <wx/thread.h>
 #include <wx/artprov.h>
 
 #include "../AllThemeResources.h"
@@ -154,6 +155,14 @@ void ShowErrorDialog(wxWindow *parent,
                      const bool Close,
                      const std::wstring &log)
 {
+   // Only the main thread may show windows; see SneedacityMessageBox()
+   if (!wxIsMainThread()) {
+      wxTheApp->CallAfter([=]{
+         ShowErrorDialog(nullptr, dlogTitle, message, helpPage, Close, log);
+      });
+      return;
+   }
+
    ErrorDialog dlog(parent, dlogTitle, message, helpPage, log, Close);
    dlog.CentreOnParent();
    dlog.ShowModal();
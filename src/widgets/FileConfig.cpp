@@ -102,56 +102,72 @@ FileConfig::~FileConfig()
 
 void FileConfig::SetPath(const wxString& strPath)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    mConfig->SetPath(strPath);
 }
 
 const wxString& FileConfig::GetPath() const
 {
-   return mConfig->GetPath();
+   // wxConfigBase makes this return a reference, but mConfig's path may
+   // change in another thread as soon as the lock is released; so copy it
+   // while locked, to storage that only this thread overwrites
+   static thread_local wxString path;
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
+   path = mConfig->GetPath();
+   return path;
 }
 
 bool FileConfig::GetFirstGroup(wxString& str, long& lIndex) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetFirstGroup(str, lIndex);
 }
 
 bool FileConfig::GetNextGroup(wxString& str, long& lIndex) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetNextGroup(str, lIndex);
 }
 
 bool FileConfig::GetFirstEntry(wxString& str, long& lIndex) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetFirstEntry(str, lIndex);
 }
 
 bool FileConfig::GetNextEntry(wxString& str, long& lIndex) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetNextEntry(str, lIndex);
 }
 
 size_t FileConfig::GetNumberOfEntries(bool bRecursive) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetNumberOfEntries(bRecursive);
 }
 
 size_t FileConfig::GetNumberOfGroups(bool bRecursive) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->GetNumberOfGroups(bRecursive);
 }
 
 bool FileConfig::HasGroup(const wxString& strName) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->HasGroup(strName);
 }
 
 bool FileConfig::HasEntry(const wxString& strName) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->HasEntry(strName);
 }
 
 bool FileConfig::Flush(bool WXUNUSED(bCurrentOnly))
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    if (!mDirty)
    {
       return true;
@@ -198,6 +214,7 @@ bool FileConfig::Flush(bool WXUNUSED(bCurrentOnly))
 
 bool FileConfig::RenameEntry(const wxString& oldName, const wxString& newName)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    auto res = mConfig->RenameEntry(oldName, newName);
    if (res)
    {
@@ -208,6 +225,7 @@ bool FileConfig::RenameEntry(const wxString& oldName, const wxString& newName)
 
 bool FileConfig::RenameGroup(const wxString& oldName, const wxString& newName)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    auto res = mConfig->RenameGroup(oldName, newName);
    if (res)
    {
@@ -218,6 +236,7 @@ bool FileConfig::RenameGroup(const wxString& oldName, const wxString& newName)
 
 bool FileConfig::DeleteEntry(const wxString& key, bool bDeleteGroupIfEmpty)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    auto res = mConfig->DeleteEntry(key, bDeleteGroupIfEmpty);
    if (res)
    {
@@ -228,6 +247,7 @@ bool FileConfig::DeleteEntry(const wxString& key, bool bDeleteGroupIfEmpty)
 
 bool FileConfig::DeleteGroup(const wxString& key)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    auto res = mConfig->DeleteGroup(key);
    if (res)
    {
@@ -238,6 +258,7 @@ bool FileConfig::DeleteGroup(const wxString& key)
 
 bool FileConfig::DeleteAll()
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    auto res = mConfig->DeleteAll();
    if (res)
    {
@@ -248,23 +269,27 @@ bool FileConfig::DeleteAll()
 
 bool FileConfig::DoReadString(const wxString& key, wxString *pStr) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->Read(key, pStr);
 }
 
 bool FileConfig::DoReadLong(const wxString& key, long *pl) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->Read(key, pl);
 }
 
 #if wxUSE_BASE64
 bool FileConfig::DoReadBinary(const wxString& key, wxMemoryBuffer* buf) const
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    return mConfig->Read(key, buf);
 }
 #endif // wxUSE_BASE64
 
 bool FileConfig::DoWriteString(const wxString& key, const wxString& szValue)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    bool res = mConfig->Write(key, szValue);
    if (res)
    {
@@ -275,6 +300,7 @@ bool FileConfig::DoWriteString(const wxString& key, const wxString& szValue)
 
 bool FileConfig::DoWriteLong(const wxString& key, long lValue)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    bool res = mConfig->Write(key, lValue);
    if (res)
    {
@@ -286,6 +312,7 @@ bool FileConfig::DoWriteLong(const wxString& key, long lValue)
 #if wxUSE_BASE64
 bool FileConfig::DoWriteBinary(const wxString& key, const wxMemoryBuffer& buf)
 {
+   std::lock_guard<std::recursive_mutex> guard(mMutex);
    bool res = mConfig->Write(key, buf);
    if (res)
    {
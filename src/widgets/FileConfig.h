@@ -12,6 +12,7 @@
 #define __SNEEDACITY_WIDGETS_FILECONFIG__
 
 #include <memory>
+#include <mutex>
 
 #include <wx/defs.h>
 #include <wx/fileconf.h>
@@ -89,6 +90,9 @@ private:
    const wxMBConv & mConv;
 
    std::unique_ptr<wxFileConfig> mConfig;
+   //! Worker threads may read preferences too, as exports do, and
+   //! wxFileConfig changes its path around each access by key
+   mutable std::recursive_mutex mMutex;
 
    // values of the version major/minor/micro keys in sneedacity.cfg
    // when Sneedacity first opens
@@ -9,9 +9,51 @@
 **********************************************************************/
 
 #include "SneedacityMessageBox.h"
+
+#include <future>
+
+#include <wx/app.h>
+#include <wx/thread.h>
+
 #include "Internat.h"
 
 TranslatableString SneedacityMessageBoxCaptionStr()
 {
    return XO("Message");
 }
+
+int SneedacityMessageBox(const TranslatableString& message,
+   const TranslatableString& caption, long style, wxWindow *parent,
+   int x, int y)
+{
+   if (wxIsMainThread())
+      return ::wxMessageBox(message.Translation(), caption.Translation(),
+         style, parent, x, y);
+
+   // Only the main thread may show windows.  A plain message can be shown
+   // later, without waiting.  The parent is ignored, because it belongs to
+   // the main thread and might be gone by then.
+   const auto show = [=]{
+      return ::wxMessageBox(message.Translation(), caption.Translation(),
+         style, nullptr, x, y);
+   };
+   if ((style & (wxYES_NO | wxCANCEL | wxHELP)) == 0) {
+      wxTheApp->CallAfter(show);
+      return wxOK;
+   }
+
+   // But a question needs its answer before the caller goes on.  This waits
+   // for the main thread to dispatch events, as it does while a progress
+   // dialog updates.
+   auto pAnswer = std::make_shared< std::promise<int> >();
+   auto answer = pAnswer->get_future();
+   wxTheApp->CallAfter([=]{
+      try {
+         pAnswer->set_value(show());
+      }
+      catch (...) {
+         pAnswer->set_exception(std::current_exception());
+      }
+   });
+   return answer.get();
+}
@@ -17,14 +17,12 @@
 extern SNEEDACITY_DLL_API TranslatableString SneedacityMessageBoxCaptionStr();
 
 // Do not use wxMessageBox!!  Its default window title does not translate!
-inline int SneedacityMessageBox(const TranslatableString& message,
+// May be called from threads other than the main one, as exports in worker
+// threads do; see the definition
+SNEEDACITY_DLL_API int SneedacityMessageBox(const TranslatableString& message,
    const TranslatableString& caption = SneedacityMessageBoxCaptionStr(),
    long style = wxOK | wxCENTRE,
    wxWindow *parent = NULL,
-   int x = wxDefaultCoord, int y = wxDefaultCoord)
-{
-   return ::wxMessageBox(message.Translation(), caption.Translation(),
-      style, parent, x, y);
-}
+   int x = wxDefaultCoord, int y = wxDefaultCoord);
 
 #endif